@@ -0,0 +1,158 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Throughput of a mix of lookups, insertions and erasures done by an increasing
+ * number of threads on a tsl::ordered_map protected by a global mutex and on a
+ * tsl::concurrent_ordered_map.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tsl/concurrent_ordered_map.h"
+#include "tsl/ordered_map.h"
+#include "tsl/tombstone_deque.h"
+
+namespace {
+
+const std::uint64_t KEY_RANGE = 1000000;
+
+/**
+ * Baseline, a tsl::ordered_map wrapped in a global mutex. Like the shards of
+ * tsl::concurrent_ordered_map, it uses a tsl::tombstone_deque for an O(1)
+ * ordered erase.
+ */
+class mutex_ordered_map {
+ public:
+  bool insert(std::uint64_t key, std::uint64_t value) {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_map.insert({key, value}).second;
+  }
+
+  bool contains(std::uint64_t key) const {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_map.contains(key);
+  }
+
+  std::size_t erase(std::uint64_t key) {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_map.erase(key);
+  }
+
+ private:
+  mutable std::mutex m_mutex;
+  tsl::ordered_map<
+      std::uint64_t, std::uint64_t, std::hash<std::uint64_t>,
+      std::equal_to<std::uint64_t>,
+      std::allocator<std::pair<std::uint64_t, std::uint64_t>>,
+      tsl::tombstone_deque<std::pair<std::uint64_t, std::uint64_t>>>
+      m_map;
+};
+
+class sharded_ordered_map {
+ public:
+  bool insert(std::uint64_t key, std::uint64_t value) {
+    return m_map.insert({key, value});
+  }
+
+  bool contains(std::uint64_t key) const { return m_map.contains(key); }
+
+  std::size_t erase(std::uint64_t key) { return m_map.erase(key); }
+
+ private:
+  tsl::concurrent_ordered_map<std::uint64_t, std::uint64_t> m_map;
+};
+
+/**
+ * Each thread does nb_ops operations on random keys: 80% of lookups, 15% of
+ * insertions and 5% of erasures. Return the number of operations per second.
+ */
+template <class Map>
+double run(std::size_t nb_threads, std::size_t nb_ops) {
+  Map map;
+  for (std::uint64_t key = 0; key < KEY_RANGE / 2; key++) {
+    map.insert(key * 2, key);
+  }
+
+  std::atomic<std::size_t> nb_found(0);
+  std::vector<std::thread> threads;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t t = 0; t < nb_threads; t++) {
+    threads.emplace_back([&map, &nb_found, t, nb_ops]() {
+      std::mt19937_64 generator(t);
+      std::size_t nb_found_thread = 0;
+      for (std::size_t i = 0; i < nb_ops; i++) {
+        const std::uint64_t key = generator() % KEY_RANGE;
+        const std::uint64_t op = generator() % 100;
+        if (op < 80) {
+          nb_found_thread += map.contains(key);
+        } else if (op < 95) {
+          map.insert(key, i);
+        } else {
+          map.erase(key);
+        }
+      }
+      nb_found += nb_found_thread;
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  return double(nb_threads * nb_ops) / seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_ops =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : std::size_t(2000000);
+  const std::size_t max_nb_threads =
+      (argc > 2) ? std::size_t(std::stoull(argv[2]))
+                 : std::max(1u, std::thread::hardware_concurrency());
+
+  std::printf("%-10s %18s %18s\n", "threads", "mutex Mops/s",
+              "concurrent Mops/s");
+  for (std::size_t nb_threads = 1; nb_threads <= max_nb_threads;
+       nb_threads *= 2) {
+    std::printf("%-10zu %18.2f %18.2f\n", nb_threads,
+                run<mutex_ordered_map>(nb_threads, nb_ops) / 1e6,
+                run<sharded_ordered_map>(nb_threads, nb_ops) / 1e6);
+  }
+}
@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Dictionary encode a column of keys with few distinct values, row by row
+ * with ordered_set::insert and std::distance on the returned iterator, and in
+ * batch with tsl::dictionary_encoder. Then decode the codes back, row by row
+ * with nth() and with the batch gather of tsl::dictionary_encoder.
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tsl/dictionary_encoder.h"
+#include "tsl/ordered_set.h"
+
+namespace {
+
+template <class Function>
+double time_ns_per_row(std::size_t nb_rows, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_rows);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_distinct_keys =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 20);
+  const std::size_t nb_rows = nb_distinct_keys * 8;
+
+  std::mt19937_64 generator(0);
+  std::uniform_int_distribution<std::uint64_t> distribution(
+      0, nb_distinct_keys - 1);
+  std::vector<std::uint64_t> column(nb_rows);
+  for (std::uint64_t& key : column) {
+    key = distribution(generator) * 0x9E3779B97F4A7C15ull;
+  }
+
+  std::uint64_t checksum = 0;
+
+  using set_type = tsl::ordered_set<std::uint64_t>;
+  set_type set;
+  std::vector<std::uint32_t> row_codes(nb_rows);
+  const double row_encode_ns = time_ns_per_row(nb_rows, [&] {
+    for (std::size_t i = 0; i < nb_rows; i++) {
+      auto it = set.insert(column[i]).first;
+      row_codes[i] = std::uint32_t(std::distance(set.begin(), it));
+    }
+  });
+
+  tsl::dictionary_encoder<std::uint64_t> encoder;
+  std::vector<std::uint32_t> batch_codes(nb_rows);
+  const double batch_encode_ns = time_ns_per_row(nb_rows, [&] {
+    encoder.encode(column.begin(), nb_rows, batch_codes.begin());
+  });
+
+  std::vector<std::uint64_t> decoded(nb_rows);
+  const double row_decode_ns = time_ns_per_row(nb_rows, [&] {
+    for (std::size_t i = 0; i < nb_rows; i++) {
+      decoded[i] = *set.nth(row_codes[i]);
+    }
+  });
+  for (std::size_t i = 0; i < nb_rows; i += 64) {
+    checksum += decoded[i];
+  }
+
+  const double batch_decode_ns = time_ns_per_row(nb_rows, [&] {
+    encoder.decode(batch_codes.begin(), nb_rows, decoded.begin());
+  });
+  for (std::size_t i = 0; i < nb_rows; i += 64) {
+    checksum += decoded[i];
+  }
+
+  std::printf("%-20s %12s\n", "operation", "ns/row");
+  std::printf("%-20s %12.2f\n", "row_encode", row_encode_ns);
+  std::printf("%-20s %12.2f\n", "batch_encode", batch_encode_ns);
+  std::printf("%-20s %12.2f\n", "row_decode", row_decode_ns);
+  std::printf("%-20s %12.2f\n", "batch_decode", batch_decode_ns);
+  std::printf("(%llu, %s)\n", static_cast<unsigned long long>(checksum),
+              (row_codes == batch_codes) ? "same codes" : "different codes");
+}
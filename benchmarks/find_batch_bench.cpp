@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Compare a loop of find() with find_batch() and contains_batch() when probing
+ * a map bigger than the CPU caches with random keys, half of them missing.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+using map_type = tsl::ordered_map<std::uint64_t, std::uint64_t>;
+
+template <class Function>
+double time_ns_per_key(std::size_t nb_keys, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_keys);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_elements =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 23);
+
+  std::mt19937_64 generator(0);
+  std::vector<std::uint64_t> keys;
+  map_type map;
+  map.reserve(nb_elements);
+  for (std::size_t i = 0; i < nb_elements; i++) {
+    const std::uint64_t key = generator();
+    map.insert({key, i});
+    keys.push_back(key);
+    keys.push_back(generator());
+  }
+  std::shuffle(keys.begin(), keys.end(), generator);
+
+  std::vector<map_type::const_iterator> its(keys.size());
+  std::vector<char> contains(keys.size());
+  const map_type& map_const = map;
+  std::uint64_t checksum = 0;
+
+  const double find_ns = time_ns_per_key(keys.size(), [&] {
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      its[i] = map_const.find(keys[i]);
+    }
+  });
+  for (const auto& it : its) {
+    checksum += (it != map_const.end()) ? it->second : 0;
+  }
+
+  const double find_batch_ns = time_ns_per_key(keys.size(), [&] {
+    map_const.find_batch(keys.begin(), keys.size(), its.begin());
+  });
+  for (const auto& it : its) {
+    checksum += (it != map_const.end()) ? it->second : 0;
+  }
+
+  const double contains_ns = time_ns_per_key(keys.size(), [&] {
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      contains[i] = map_const.contains(keys[i]);
+    }
+  });
+  const double contains_batch_ns = time_ns_per_key(keys.size(), [&] {
+    map_const.contains_batch(keys.begin(), keys.size(), contains.begin());
+  });
+  for (const char c : contains) {
+    checksum += std::uint64_t(c);
+  }
+
+  std::printf("%-16s %12s\n", "method", "ns/key");
+  std::printf("%-16s %12.2f\n", "find", find_ns);
+  std::printf("%-16s %12.2f\n", "find_batch", find_batch_ns);
+  std::printf("%-16s %12.2f\n", "contains", contains_ns);
+  std::printf("%-16s %12.2f\n", "contains_batch", contains_batch_ns);
+  std::printf("(%llu)\n", static_cast<unsigned long long>(checksum));
+}
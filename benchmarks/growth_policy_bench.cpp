@@ -0,0 +1,147 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Compare the GrowthPolicy of a tsl::ordered_map on integer keys hashed with
+ * std::hash (the identity on libstdc++): sequential keys, keys with a stride of
+ * 64 and 4096 and random keys. Report the insertion, successful and
+ * unsuccessful lookup times, the average probe length of a hit and the bucket
+ * count at the end of the insertions.
+ *
+ * A power of two stride keeps the lower bits of the identity hash constant,
+ * the default mask policy then clusters the keys in a fraction of the buckets
+ * (and grows on the long probes) while the Fibonacci and fastrange policies mix
+ * the hash first.
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+using value_type = std::pair<std::uint64_t, std::uint64_t>;
+
+template <class GrowthPolicy>
+using map_type =
+    tsl::ordered_map<std::uint64_t, std::uint64_t, std::hash<std::uint64_t>,
+                     std::equal_to<std::uint64_t>, std::allocator<value_type>,
+                     std::deque<value_type>, std::uint_least32_t, false,
+                     false, GrowthPolicy>;
+
+template <class Function>
+double time_ns_per_key(std::size_t nb_keys, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_keys);
+}
+
+template <class Map>
+void bench(const char* name, const std::vector<std::uint64_t>& keys,
+           const std::vector<std::uint64_t>& missing_keys,
+           std::uint64_t& checksum) {
+  Map map;
+  const double insert_ns = time_ns_per_key(keys.size(), [&] {
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      map.insert({keys[i], i});
+    }
+  });
+
+  const double hit_ns = time_ns_per_key(keys.size(), [&] {
+    for (const std::uint64_t key : keys) {
+      checksum += map.find(key)->second;
+    }
+  });
+
+  const double miss_ns = time_ns_per_key(missing_keys.size(), [&] {
+    for (const std::uint64_t key : missing_keys) {
+      checksum += map.count(key);
+    }
+  });
+
+  const auto stats = map.stats();
+  std::printf("%-12s %10.2f %10.2f %10.2f %10.2f %12zu\n", name, insert_ns,
+              hit_ns, miss_ns, stats.average_probe_length_hit,
+              stats.bucket_count);
+}
+
+void bench_keys(const char* keys_name, const std::vector<std::uint64_t>& keys,
+                const std::vector<std::uint64_t>& missing_keys,
+                std::uint64_t& checksum) {
+  std::printf("%s\n", keys_name);
+  bench<map_type<tsl::oh::power_of_two_growth_policy>>("power_of_two", keys,
+                                                       missing_keys, checksum);
+  bench<map_type<tsl::oh::fibonacci_growth_policy>>("fibonacci", keys,
+                                                    missing_keys, checksum);
+  bench<map_type<tsl::oh::fastrange_growth_policy<>>>("fastrange", keys,
+                                                      missing_keys, checksum);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_keys =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 20);
+
+  std::uint64_t checksum = 0;
+  std::printf("%-12s %10s %10s %10s %10s %12s\n", "policy", "insert",
+              "find_hit", "find_miss", "probe_hit", "buckets");
+
+  for (const std::uint64_t stride : {1, 64, 4096}) {
+    std::vector<std::uint64_t> keys(nb_keys);
+    std::vector<std::uint64_t> missing_keys(nb_keys);
+    for (std::size_t i = 0; i < nb_keys; i++) {
+      keys[i] = i * stride;
+      missing_keys[i] = (nb_keys + i) * stride;
+    }
+
+    const std::string keys_name = "stride " + std::to_string(stride);
+    bench_keys(keys_name.c_str(), keys, missing_keys, checksum);
+  }
+
+  std::mt19937_64 generator(0);
+  std::vector<std::uint64_t> keys(nb_keys);
+  std::vector<std::uint64_t> missing_keys(nb_keys);
+  for (std::size_t i = 0; i < nb_keys; i++) {
+    keys[i] = generator();
+    missing_keys[i] = generator();
+  }
+  bench_keys("random", keys, missing_keys, checksum);
+
+  std::printf("(ns/key, %zu keys) (%llu)\n", nb_keys,
+              static_cast<unsigned long long>(checksum));
+}
@@ -0,0 +1,133 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Compare the lookups in a tsl::ordered_map with a large buckets array
+ * allocated with std::allocator and with tsl::oh::huge_page_allocator (see
+ * tsl::huge_page_ordered_map), on random integer keys. Report the insertion,
+ * successful and unsuccessful lookup times.
+ *
+ * The keys are looked up in a random order different from the insertion order
+ * so that both the buckets and the values are accessed randomly. With 4 KiB
+ * pages nearly every probe of a big map is a TLB miss, the huge pages only
+ * remove the misses on the buckets array. The transparent huge pages must be in
+ * the "madvise" or "always" mode (/sys/kernel/mm/transparent_hugepage/enabled)
+ * unless explicit huge pages are reserved.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsl/huge_page_allocator.h"
+#include "tsl/ordered_map.h"
+
+namespace {
+
+using value_type = std::pair<std::uint64_t, std::uint64_t>;
+
+template <class Function>
+double time_ns_per_key(std::size_t nb_keys, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_keys);
+}
+
+template <class Map>
+void bench(const char* name, Map& map, const std::vector<std::uint64_t>& keys,
+           const std::vector<std::uint64_t>& lookup_keys,
+           const std::vector<std::uint64_t>& missing_keys,
+           std::uint64_t& checksum) {
+  const double insert_ns = time_ns_per_key(keys.size(), [&] {
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      map.insert({keys[i], i});
+    }
+  });
+
+  const double hit_ns = time_ns_per_key(lookup_keys.size(), [&] {
+    for (const std::uint64_t key : lookup_keys) {
+      checksum += map.find(key)->second;
+    }
+  });
+
+  const double miss_ns = time_ns_per_key(missing_keys.size(), [&] {
+    for (const std::uint64_t key : missing_keys) {
+      checksum += map.count(key);
+    }
+  });
+
+  std::printf("%-12s %10.2f %10.2f %10.2f %12zu\n", name, insert_ns, hit_ns,
+              miss_ns, map.bucket_count());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_keys =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 23);
+  const int numa_node = (argc > 2) ? std::stoi(argv[2])
+                                   : tsl::oh::huge_page_allocator<
+                                         value_type>::NO_NUMA_NODE;
+
+  std::mt19937_64 generator(0);
+  std::vector<std::uint64_t> keys(nb_keys);
+  std::vector<std::uint64_t> missing_keys(nb_keys);
+  for (std::size_t i = 0; i < nb_keys; i++) {
+    keys[i] = generator();
+    missing_keys[i] = generator();
+  }
+
+  std::vector<std::uint64_t> lookup_keys(keys);
+  std::shuffle(lookup_keys.begin(), lookup_keys.end(), generator);
+
+  std::uint64_t checksum = 0;
+  std::printf("%-12s %10s %10s %10s %12s\n", "buckets", "insert", "find_hit",
+              "find_miss", "bucket_count");
+  {
+    tsl::ordered_map<std::uint64_t, std::uint64_t> map;
+    bench("std", map, keys, lookup_keys, missing_keys, checksum);
+  }
+  {
+    tsl::huge_page_ordered_map<std::uint64_t, std::uint64_t> map(
+        0, std::hash<std::uint64_t>(), std::equal_to<std::uint64_t>(),
+        std::allocator<value_type>(),
+        tsl::oh::huge_page_allocator<value_type>(numa_node));
+    bench("huge_page", map, keys, lookup_keys, missing_keys, checksum);
+  }
+
+  std::printf("(ns/key, %zu keys) (%llu)\n", nb_keys,
+              static_cast<unsigned long long>(checksum));
+}
@@ -0,0 +1,97 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Measure the latency of each insertion, with and without incremental rehash,
+ * and report the worst-case and tail latencies next to the total time. The
+ * worst case of the default mode is the insertion triggering the last growth.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+using map_type = tsl::ordered_map<std::uint64_t, std::uint64_t>;
+
+void bench(const char* mode_name, std::size_t incremental_rehash,
+           const std::vector<std::uint64_t>& keys) {
+  std::vector<std::uint64_t> latencies_ns(keys.size());
+
+  map_type map;
+  map.incremental_rehash(incremental_rehash);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    const auto insert_start = std::chrono::steady_clock::now();
+    map.insert({keys[i], i});
+    const auto insert_end = std::chrono::steady_clock::now();
+
+    latencies_ns[i] = std::uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(insert_end -
+                                                             insert_start)
+            .count());
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  const auto percentile = [&](double p) {
+    return static_cast<unsigned long long>(
+        latencies_ns[std::size_t(double(latencies_ns.size() - 1) * p)]);
+  };
+
+  std::printf(
+      "%-14s %10.1f %10llu %10llu %10llu %14llu\n", mode_name,
+      double(std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+                 .count()),
+      percentile(0.99), percentile(0.999), percentile(0.99999),
+      static_cast<unsigned long long>(latencies_ns.back()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_elements =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 24);
+
+  std::mt19937_64 generator(0);
+  std::vector<std::uint64_t> keys(nb_elements);
+  for (std::uint64_t& key : keys) {
+    key = generator();
+  }
+
+  std::printf("%-14s %10s %10s %10s %10s %14s\n", "mode", "total ms",
+              "p99 ns", "p99.9 ns", "p99.999 ns", "max ns");
+  bench("default", 0, keys);
+  bench("incremental_4", 4, keys);
+  bench("incremental_16", 16, keys);
+}
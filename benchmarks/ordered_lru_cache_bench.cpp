@@ -0,0 +1,135 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Compare tsl::ordered_lru_cache with a std::list + std::unordered_map LRU
+ * cache on a skewed stream of lookups where each miss inserts the key and
+ * evicts the least recently used entry.
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_lru_cache.h"
+
+namespace {
+
+/**
+ * Textbook LRU cache, the recency order is kept in a linked list.
+ */
+class list_lru_cache {
+ public:
+  explicit list_lru_cache(std::size_t max_size) : m_max_size(max_size) {}
+
+  std::uint64_t* get(std::uint64_t key) {
+    auto it = m_map.find(key);
+    if (it == m_map.end()) {
+      return nullptr;
+    }
+
+    m_list.splice(m_list.end(), m_list, it->second);
+    return &it->second->second;
+  }
+
+  void insert(std::uint64_t key, std::uint64_t value) {
+    m_map[key] = m_list.insert(m_list.end(), {key, value});
+    if (m_list.size() > m_max_size) {
+      m_map.erase(m_list.front().first);
+      m_list.pop_front();
+    }
+  }
+
+ private:
+  using list_type = std::list<std::pair<std::uint64_t, std::uint64_t>>;
+
+  std::size_t m_max_size;
+  list_type m_list;
+  std::unordered_map<std::uint64_t, list_type::iterator> m_map;
+};
+
+template <class Function>
+double time_ns_per_key(std::size_t nb_keys, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_keys);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t max_size =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 20);
+  const std::size_t nb_keys = max_size * 16;
+
+  // Geometric-like distribution of the keys, about 80% of hits.
+  std::mt19937_64 generator(0);
+  std::exponential_distribution<double> distribution(1.0 /
+                                                     double(max_size / 2));
+  std::vector<std::uint64_t> keys(nb_keys);
+  for (std::uint64_t& key : keys) {
+    key = std::uint64_t(distribution(generator)) * 0x9E3779B97F4A7C15ull;
+  }
+
+  std::uint64_t checksum = 0;
+
+  tsl::ordered_lru_cache<std::uint64_t, std::uint64_t> ordered_cache(max_size);
+  const double ordered_ns = time_ns_per_key(nb_keys, [&] {
+    for (std::size_t i = 0; i < nb_keys; i++) {
+      const std::uint64_t* value = ordered_cache.get(keys[i]);
+      if (value != nullptr) {
+        checksum += *value;
+      } else {
+        ordered_cache.insert_or_assign(keys[i], i);
+      }
+    }
+  });
+
+  list_lru_cache list_cache(max_size);
+  const double list_ns = time_ns_per_key(nb_keys, [&] {
+    for (std::size_t i = 0; i < nb_keys; i++) {
+      const std::uint64_t* value = list_cache.get(keys[i]);
+      if (value != nullptr) {
+        checksum += *value;
+      } else {
+        list_cache.insert(keys[i], i);
+      }
+    }
+  });
+
+  std::printf("%-20s %12s\n", "cache", "ns/key");
+  std::printf("%-20s %12.2f\n", "ordered_lru_cache", ordered_ns);
+  std::printf("%-20s %12.2f\n", "list_lru_cache", list_ns);
+  std::printf("(%llu)\n", static_cast<unsigned long long>(checksum));
+}
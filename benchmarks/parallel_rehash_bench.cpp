@@ -0,0 +1,119 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Time the rehash of a big map to twice its bucket count, without threads and
+ * with rehash(count, nb_threads) for an increasing number of threads. Then time
+ * the construction of the same map from a vector of values with
+ * insert(first, last) and build_parallel(first, last, nb_threads).
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+using map_type = tsl::ordered_map<std::uint64_t, std::uint64_t>;
+
+double time_rehash_ms(const map_type& map, std::size_t nb_threads) {
+  map_type map_copy = map;
+  const std::size_t bucket_count = map_copy.bucket_count() * 2;
+
+  const auto start = std::chrono::steady_clock::now();
+  if (nb_threads == 0) {
+    map_copy.rehash(bucket_count);
+  } else {
+    map_copy.rehash(bucket_count, nb_threads);
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                      start)
+                    .count()) /
+         1000.0;
+}
+
+double time_build_ms(const std::vector<map_type::value_type>& values,
+                     std::size_t nb_threads) {
+  map_type map;
+
+  const auto start = std::chrono::steady_clock::now();
+  if (nb_threads == 0) {
+    map.insert(values.begin(), values.end());
+  } else {
+    map.build_parallel(values.begin(), values.end(), nb_threads);
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                      start)
+                    .count()) /
+         1000.0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_elements =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 24);
+  const std::size_t max_nb_threads =
+      (argc > 2) ? std::size_t(std::stoull(argv[2]))
+                 : std::max(1u, std::thread::hardware_concurrency());
+
+  std::mt19937_64 generator(0);
+  std::vector<map_type::value_type> values;
+  values.reserve(nb_elements);
+  for (std::size_t i = 0; i < nb_elements; i++) {
+    values.emplace_back(generator(), i);
+  }
+
+  map_type map;
+  map.reserve(nb_elements);
+  map.insert(values.begin(), values.end());
+
+  std::printf("%-10s %12s\n", "threads", "rehash ms");
+  std::printf("%-10s %12.1f\n", "none", time_rehash_ms(map, 0));
+  for (std::size_t nb_threads = 1; nb_threads <= max_nb_threads;
+       nb_threads *= 2) {
+    std::printf("%-10zu %12.1f\n", nb_threads,
+                time_rehash_ms(map, nb_threads));
+  }
+
+  std::printf("\n%-10s %12s\n", "threads", "build ms");
+  std::printf("%-10s %12.1f\n", "none", time_build_ms(values, 0));
+  for (std::size_t nb_threads = 1; nb_threads <= max_nb_threads;
+       nb_threads *= 2) {
+    std::printf("%-10zu %12.1f\n", nb_threads,
+                time_build_ms(values, nb_threads));
+  }
+}
@@ -0,0 +1,133 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Compare the positional operations (insert_at_position, nth and erase at a
+ * random position) of a tsl::ordered_map over a std::deque, a
+ * tsl::tombstone_deque and a tsl::ranked_deque, and the cost of a full
+ * iteration and of the lookups.
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+#include "tsl/ranked_deque.h"
+#include "tsl/tombstone_deque.h"
+
+namespace {
+
+using value_type = std::pair<std::uint64_t, std::uint64_t>;
+
+template <class ValueTypeContainer>
+using map_type =
+    tsl::ordered_map<std::uint64_t, std::uint64_t, std::hash<std::uint64_t>,
+                     std::equal_to<std::uint64_t>, std::allocator<value_type>,
+                     ValueTypeContainer>;
+
+template <class Function>
+double time_ns_per_op(std::size_t nb_ops, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_ops);
+}
+
+template <class Map>
+void bench(const char* name, const std::vector<std::uint64_t>& positions,
+           std::uint64_t& checksum) {
+  const std::size_t nb_values = positions.size();
+  Map map;
+
+  const double insert_ns = time_ns_per_op(nb_values, [&] {
+    for (std::size_t i = 0; i < nb_values; i++) {
+      const std::size_t n = map.empty() ? 0 : positions[i] % map.size();
+      map.insert_at_position(map.nth(n), {i, i});
+    }
+  });
+
+  const double nth_ns = time_ns_per_op(nb_values, [&] {
+    for (std::size_t i = 0; i < nb_values; i++) {
+      checksum += map.nth(positions[i] % map.size())->second;
+    }
+  });
+
+  const double find_ns = time_ns_per_op(nb_values, [&] {
+    for (std::size_t i = 0; i < nb_values; i++) {
+      checksum += map.find(positions[i] % nb_values)->second;
+    }
+  });
+
+  const double iterate_ns = time_ns_per_op(nb_values, [&] {
+    for (const auto& key_value : map) {
+      checksum += key_value.second;
+    }
+  });
+
+  const std::size_t nb_erased = nb_values / 2;
+  const double erase_ns = time_ns_per_op(nb_erased, [&] {
+    for (std::size_t i = 0; i < nb_erased; i++) {
+      map.erase(map.nth(positions[i] % map.size()));
+    }
+  });
+
+  std::printf("%-16s %12.2f %12.2f %12.2f %12.2f %12.2f\n", name, insert_ns,
+              nth_ns, erase_ns, find_ns, iterate_ns);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_values =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 16);
+
+  std::mt19937_64 generator(0);
+  std::vector<std::uint64_t> positions(nb_values);
+  for (std::uint64_t& position : positions) {
+    position = generator();
+  }
+
+  std::uint64_t checksum = 0;
+
+  std::printf("%-16s %12s %12s %12s %12s %12s\n", "container", "insert_at",
+              "nth", "erase_at", "find", "iterate");
+  bench<map_type<std::deque<value_type>>>("deque", positions, checksum);
+  bench<map_type<tsl::tombstone_deque<value_type>>>("tombstone_deque",
+                                                     positions, checksum);
+  bench<map_type<tsl::ranked_deque<value_type>>>("ranked_deque", positions,
+                                                  checksum);
+  std::printf("(ns/op, %zu values) (%llu)\n", nb_values,
+              static_cast<unsigned long long>(checksum));
+}
@@ -0,0 +1,144 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Compare the lookup speed of the default robin hood probing with the
+ * SimdProbing mode at load factors 0.5, 0.75 and 0.95, for successful and
+ * unsuccessful lookups.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+template <class Key, bool SimdProbing>
+using map_type =
+    tsl::ordered_map<Key, std::uint64_t, std::hash<Key>, std::equal_to<Key>,
+                     std::allocator<std::pair<Key, std::uint64_t>>,
+                     std::deque<std::pair<Key, std::uint64_t>>,
+                     std::uint_least32_t, SimdProbing>;
+
+template <class Key>
+Key make_key(std::uint64_t value);
+
+template <>
+std::uint64_t make_key<std::uint64_t>(std::uint64_t value) {
+  return value;
+}
+
+template <>
+std::string make_key<std::string>(std::uint64_t value) {
+  return "key_" + std::to_string(value);
+}
+
+/**
+ * Run 'lookups' with each key of 'keys' and return the average time in ns.
+ */
+template <class Map, class Key>
+double time_lookups(const Map& map, const std::vector<Key>& keys,
+                    std::uint64_t& checksum) {
+  const auto start = std::chrono::steady_clock::now();
+  for (const Key& key : keys) {
+    auto it = map.find(key);
+    if (it != map.end()) {
+      checksum += it->second;
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(keys.size());
+}
+
+template <class Key, bool SimdProbing>
+void bench(const char* key_name, const char* mode_name, float load_factor,
+           const std::vector<Key>& inserted_keys,
+           const std::vector<Key>& missing_keys, std::size_t bucket_count) {
+  const std::size_t nb_elements =
+      std::size_t(float(bucket_count) * load_factor);
+
+  map_type<Key, SimdProbing> map;
+  map.max_load_factor(0.95f);
+  map.rehash(bucket_count);
+  for (std::size_t i = 0; i < nb_elements; i++) {
+    map.insert({inserted_keys[i], i});
+  }
+
+  std::vector<Key> hit_keys(inserted_keys.begin(),
+                            inserted_keys.begin() + nb_elements);
+  std::shuffle(hit_keys.begin(), hit_keys.end(), std::mt19937_64(1));
+
+  std::uint64_t checksum = 0;
+  const double hit_ns = time_lookups(map, hit_keys, checksum);
+  const double miss_ns = time_lookups(map, missing_keys, checksum);
+
+  std::printf("%-8s %-12s %5.2f %10zu %12.2f %12.2f   (%llu)\n", key_name,
+              mode_name, double(map.load_factor()), map.bucket_count(),
+              hit_ns, miss_ns, static_cast<unsigned long long>(checksum));
+}
+
+template <class Key>
+void bench_key(const char* key_name, std::size_t bucket_count) {
+  std::mt19937_64 generator(0);
+  std::vector<Key> inserted_keys;
+  std::vector<Key> missing_keys;
+  for (std::size_t i = 0; i < bucket_count; i++) {
+    // Even values are inserted, odd values are used for missing lookups.
+    inserted_keys.push_back(make_key<Key>(generator() & ~std::uint64_t(1)));
+    missing_keys.push_back(make_key<Key>(generator() | std::uint64_t(1)));
+  }
+
+  for (const float load_factor : {0.5f, 0.75f, 0.95f}) {
+    bench<Key, false>(key_name, "robin_hood", load_factor, inserted_keys,
+                      missing_keys, bucket_count);
+    bench<Key, true>(key_name, "simd_probing", load_factor, inserted_keys,
+                     missing_keys, bucket_count);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t bucket_count =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 20);
+
+  std::printf("%-8s %-12s %5s %10s %12s %12s\n", "key", "mode", "load",
+              "buckets", "hit ns/op", "miss ns/op");
+  bench_key<std::uint64_t>("uint64", bucket_count);
+  bench_key<std::string>("string", bucket_count);
+}
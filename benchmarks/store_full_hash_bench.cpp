@@ -0,0 +1,159 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Compare the default truncated hash with StoreFullHash on string keys with a
+ * long common prefix, where each key comparison of a bucket with a matching
+ * hash costs a memcmp. Report the insertion and lookup times, the number of
+ * key comparisons per unsuccessful lookup and the memory used by the buckets.
+ *
+ * With std::hash the truncated hash already filters almost all the
+ * comparisons. The weak hash only has 16 useful bits in its lower 32 bits, it
+ * is run on 2^15 keys so that the bucket index still uses useful bits while
+ * most of the truncated hashes in a probe are equal.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+std::size_t nb_key_compares = 0;
+
+struct counting_equal {
+  bool operator()(const std::string& lhs, const std::string& rhs) const {
+    nb_key_compares++;
+    return lhs == rhs;
+  }
+};
+
+/**
+ * std::hash with the bits 16 to 31 cleared, the truncated hashes of different
+ * keys are often equal while the full hashes still differ.
+ */
+struct weak_low_bits_hash {
+  std::size_t operator()(const std::string& key) const {
+    return std::hash<std::string>()(key) & ~std::size_t(0xFFFF0000u);
+  }
+};
+
+template <class Hash, bool StoreFullHash>
+using map_type =
+    tsl::ordered_map<std::string, std::uint64_t, Hash, counting_equal,
+                     std::allocator<std::pair<std::string, std::uint64_t>>,
+                     std::deque<std::pair<std::string, std::uint64_t>>,
+                     std::uint_least32_t, false, StoreFullHash>;
+
+template <class Function>
+double time_ns_per_key(std::size_t nb_keys, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count()) /
+         double(nb_keys);
+}
+
+template <class Map>
+void bench(const char* name, const std::vector<std::string>& keys,
+           const std::vector<std::string>& missing_keys,
+           std::uint64_t& checksum) {
+  Map map;
+  const double insert_ns = time_ns_per_key(keys.size(), [&] {
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      map.insert({keys[i], i});
+    }
+  });
+
+  const double hit_ns = time_ns_per_key(keys.size(), [&] {
+    for (const std::string& key : keys) {
+      checksum += map.find(key)->second;
+    }
+  });
+
+  nb_key_compares = 0;
+  const double miss_ns = time_ns_per_key(missing_keys.size(), [&] {
+    for (const std::string& key : missing_keys) {
+      checksum += map.count(key);
+    }
+  });
+  const double compares_per_miss =
+      double(nb_key_compares) / double(missing_keys.size());
+
+  const auto stats = map.stats();
+  std::printf("%-24s %10.2f %10.2f %10.2f %12.4f %12zu %10zu\n", name,
+              insert_ns, hit_ns, miss_ns, compares_per_miss, keys.size(),
+              stats.buckets_bytes / stats.bucket_count);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::size_t nb_keys =
+      (argc > 1) ? std::size_t(std::stoull(argv[1])) : (std::size_t(1) << 20);
+  const std::size_t key_size =
+      (argc > 2) ? std::size_t(std::stoull(argv[2])) : 64;
+
+  const std::string prefix(key_size > 16 ? key_size - 16 : 0, 'p');
+  std::mt19937_64 generator(0);
+  std::vector<std::string> keys(nb_keys);
+  std::vector<std::string> missing_keys(nb_keys);
+  for (std::size_t i = 0; i < nb_keys; i++) {
+    keys[i] = prefix + std::to_string(generator());
+    missing_keys[i] = prefix + "m" + std::to_string(generator());
+  }
+
+  std::uint64_t checksum = 0;
+
+  const std::size_t nb_weak_keys = std::min(nb_keys, std::size_t(1) << 15);
+  const std::vector<std::string> weak_keys(keys.begin(),
+                                           keys.begin() + nb_weak_keys);
+  const std::vector<std::string> weak_missing_keys(
+      missing_keys.begin(), missing_keys.begin() + nb_weak_keys);
+
+  std::printf("%-24s %10s %10s %10s %12s %12s %10s\n", "map", "insert",
+              "find_hit", "find_miss", "cmp/miss", "keys", "B/bucket");
+  bench<map_type<std::hash<std::string>, false>>("std::hash truncated", keys,
+                                                 missing_keys, checksum);
+  bench<map_type<std::hash<std::string>, true>>("std::hash full", keys,
+                                                missing_keys, checksum);
+  bench<map_type<weak_low_bits_hash, false>>(
+      "weak_low_bits truncated", weak_keys, weak_missing_keys, checksum);
+  bench<map_type<weak_low_bits_hash, true>>("weak_low_bits full", weak_keys,
+                                            weak_missing_keys, checksum);
+  std::printf("(ns/key, keys of %zu bytes) (%llu)\n", key_size,
+              static_cast<unsigned long long>(checksum));
+}
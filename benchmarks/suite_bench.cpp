@@ -0,0 +1,463 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Benchmark suite of the main operations of tsl::ordered_map: insert,
+ * emplace_back_unchecked, find, index_of, erase, unordered_erase, pop_front,
+ * rehash and serialize. Each operation is timed on random and sequential
+ * integer keys and on string keys, with a std::deque and a std::vector as
+ * ValueTypeContainer, 32 and 64 bits IndexType and several max load factors.
+ *
+ * Usage: tsl_ordered_map_suite_bench [nb_elements] [nb_repeats] [output.json]
+ *
+ * The keys are generated from fixed seeds. Each benchmark is run nb_repeats
+ * times and the median time per operation is written as JSON to output.json,
+ * or to the standard output if no file is given.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+
+namespace {
+
+using value_type = std::uint64_t;
+
+template <class Key, class ValueTypeContainer, class IndexType>
+using map_type =
+    tsl::ordered_map<Key, value_type, std::hash<Key>, std::equal_to<Key>,
+                     std::allocator<std::pair<Key, value_type>>,
+                     ValueTypeContainer, IndexType>;
+
+template <class Key>
+using deque_container = std::deque<std::pair<Key, value_type>>;
+
+template <class Key>
+using vector_container = std::vector<std::pair<Key, value_type>>;
+
+/**
+ * Serializer writing into a vector of bytes, see ordered_map::serialize.
+ */
+class byte_serializer {
+ public:
+  template <class T>
+  void operator()(const T& value) {
+    serialize(value);
+  }
+
+  std::size_t size() const { return m_bytes.size(); }
+
+ protected:
+  void write(const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    m_bytes.insert(m_bytes.end(), bytes, bytes + size);
+  }
+
+ private:
+  template <class T, class U>
+  void serialize(const std::pair<T, U>& value) {
+    serialize(value.first);
+    serialize(value.second);
+  }
+
+  void serialize(const std::string& value) {
+    serialize(std::uint64_t(value.size()));
+    write(value.data(), value.size());
+  }
+
+  template <class T, typename std::enable_if<
+                         std::is_arithmetic<T>::value>::type* = nullptr>
+  void serialize(const T& value) {
+    write(&value, sizeof(T));
+  }
+
+ private:
+  std::vector<char> m_bytes;
+};
+
+/**
+ * Also supports the bulk writes used by the serialization of trivially
+ * copyable values.
+ */
+class bulk_byte_serializer : public byte_serializer {
+ public:
+  using byte_serializer::operator();
+
+  void operator()(const char* data, std::size_t size) { write(data, size); }
+};
+
+struct result {
+  std::string benchmark;
+  std::string map;
+  std::string keys;
+  float max_load_factor;
+  double ns_per_op;
+};
+
+class benchmark_runner {
+ public:
+  benchmark_runner(std::size_t nb_elements, std::size_t nb_repeats)
+      : m_nb_elements(nb_elements), m_nb_repeats(nb_repeats), m_checksum(0) {}
+
+  /**
+   * Run all the benchmarks on a map of type Map filled with 'keys', the
+   * 'missing_keys' are absent from the map.
+   */
+  template <class Map>
+  void run(const std::string& map_name, const std::string& keys_name,
+           const std::vector<typename Map::key_type>& keys,
+           const std::vector<typename Map::key_type>& missing_keys,
+           float max_load_factor) {
+    using key_type = typename Map::key_type;
+
+    std::vector<key_type> shuffled_keys = keys;
+    std::mt19937_64 generator(1);
+    std::shuffle(shuffled_keys.begin(), shuffled_keys.end(), generator);
+
+    const std::size_t nb_erased = std::min(keys.size(), NB_ORDERED_ERASES);
+    std::vector<key_type> erased_keys(shuffled_keys.begin(),
+                                      shuffled_keys.begin() + nb_erased);
+
+    Map map = make_map<Map>(keys, max_load_factor);
+
+    auto add = [&](const std::string& benchmark, double ns_per_op) {
+      m_results.push_back(
+          {benchmark, map_name, keys_name, max_load_factor, ns_per_op});
+      std::cerr << benchmark << " " << map_name << " " << keys_name << " "
+                << max_load_factor << ": " << ns_per_op << " ns/op"
+                << std::endl;
+    };
+
+    add("insert", median([&]() {
+          Map m;
+          m.max_load_factor(max_load_factor);
+          return time_ns_per_op(keys.size(), [&]() {
+            for (std::size_t i = 0; i < keys.size(); i++) {
+              m.insert({keys[i], i});
+            }
+          });
+        }));
+
+    add("insert_reserved", median([&]() {
+          Map m;
+          m.max_load_factor(max_load_factor);
+          m.reserve(keys.size());
+          return time_ns_per_op(keys.size(), [&]() {
+            for (std::size_t i = 0; i < keys.size(); i++) {
+              m.insert({keys[i], i});
+            }
+          });
+        }));
+
+    add("emplace_back_unchecked", median([&]() {
+          Map m;
+          m.max_load_factor(max_load_factor);
+          m.reserve(keys.size());
+          return time_ns_per_op(keys.size(), [&]() {
+            for (std::size_t i = 0; i < keys.size(); i++) {
+              m.emplace_back_unchecked(keys[i], i);
+            }
+          });
+        }));
+
+    add("find_hit", median([&]() {
+          return time_ns_per_op(shuffled_keys.size(), [&]() {
+            for (const key_type& key : shuffled_keys) {
+              m_checksum += map.find(key)->second;
+            }
+          });
+        }));
+
+    add("index_of_hit", median([&]() {
+          return time_ns_per_op(shuffled_keys.size(), [&]() {
+            for (const key_type& key : shuffled_keys) {
+              m_checksum += map.value_at(map.index_of(key)).second;
+            }
+          });
+        }));
+
+    add("find_miss", median([&]() {
+          return time_ns_per_op(missing_keys.size(), [&]() {
+            for (const key_type& key : missing_keys) {
+              m_checksum += map.count(key);
+            }
+          });
+        }));
+
+    add("erase", median([&]() {
+          Map m = map;
+          return time_ns_per_op(erased_keys.size(), [&]() {
+            for (const key_type& key : erased_keys) {
+              m_checksum += m.erase(key);
+            }
+          });
+        }));
+
+    add("unordered_erase", median([&]() {
+          Map m = map;
+          return time_ns_per_op(shuffled_keys.size(), [&]() {
+            for (const key_type& key : shuffled_keys) {
+              m_checksum += m.unordered_erase(key);
+            }
+          });
+        }));
+
+    add("pop_front", median([&]() {
+          Map m = map;
+          return time_ns_per_op(nb_erased, [&]() {
+            for (std::size_t i = 0; i < nb_erased; i++) {
+              m.pop_front();
+            }
+            m_checksum += m.size();
+          });
+        }));
+
+    add("rehash", median([&]() {
+          Map m = map;
+          const std::size_t bucket_count = m.bucket_count() * 2;
+          return time_ns_per_op(m.size(), [&]() { m.rehash(bucket_count); });
+        }));
+
+    add("serialize", median([&]() {
+          byte_serializer serializer;
+          const double ns_per_op = time_ns_per_op(
+              map.size(), [&]() { map.serialize(serializer); });
+          m_checksum += serializer.size();
+
+          return ns_per_op;
+        }));
+
+    add("serialize_bulk", median([&]() {
+          bulk_byte_serializer serializer;
+          const double ns_per_op = time_ns_per_op(
+              map.size(), [&]() { map.serialize(serializer); });
+          m_checksum += serializer.size();
+
+          return ns_per_op;
+        }));
+  }
+
+  void write_json(std::ostream& out) const {
+    out << "{\n";
+    out << "  \"nb_elements\": " << m_nb_elements << ",\n";
+    out << "  \"nb_repeats\": " << m_nb_repeats << ",\n";
+    out << "  \"checksum\": " << m_checksum << ",\n";
+    out << "  \"results\": [";
+    for (std::size_t i = 0; i < m_results.size(); i++) {
+      const result& r = m_results[i];
+      out << (i == 0 ? "\n" : ",\n");
+      out << "    {\"benchmark\": \"" << r.benchmark << "\", \"map\": \""
+          << r.map << "\", \"keys\": \"" << r.keys
+          << "\", \"max_load_factor\": " << r.max_load_factor
+          << ", \"ns_per_op\": " << r.ns_per_op << "}";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+  }
+
+ private:
+  template <class Map>
+  static Map make_map(const std::vector<typename Map::key_type>& keys,
+                      float max_load_factor) {
+    Map map;
+    map.max_load_factor(max_load_factor);
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      map.insert({keys[i], i});
+    }
+
+    return map;
+  }
+
+  template <class Function>
+  static double time_ns_per_op(std::size_t nb_ops, Function function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const auto end = std::chrono::steady_clock::now();
+
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      end - start)
+                      .count()) /
+           double(std::max(nb_ops, std::size_t(1)));
+  }
+
+  template <class Function>
+  double median(Function function) const {
+    std::vector<double> times;
+    for (std::size_t i = 0; i < m_nb_repeats; i++) {
+      times.push_back(function());
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+  }
+
+ private:
+  /**
+   * The ordered erase is in O(bucket_count), only erase a few keys.
+   */
+  static const std::size_t NB_ORDERED_ERASES = 100;
+
+  std::size_t m_nb_elements;
+  std::size_t m_nb_repeats;
+  std::vector<result> m_results;
+  std::uint64_t m_checksum;
+};
+
+std::vector<std::uint64_t> random_int_keys(std::size_t nb_keys,
+                                           std::uint64_t seed) {
+  std::mt19937_64 generator(seed);
+  std::vector<std::uint64_t> keys(nb_keys);
+  for (std::uint64_t& key : keys) {
+    key = generator();
+  }
+
+  return keys;
+}
+
+std::vector<std::uint64_t> sequential_int_keys(std::size_t nb_keys,
+                                               std::uint64_t first) {
+  std::vector<std::uint64_t> keys(nb_keys);
+  for (std::size_t i = 0; i < nb_keys; i++) {
+    keys[i] = first + i;
+  }
+
+  return keys;
+}
+
+std::vector<std::string> string_keys(std::size_t nb_keys, std::uint64_t seed) {
+  std::vector<std::string> keys;
+  keys.reserve(nb_keys);
+  for (std::uint64_t key : random_int_keys(nb_keys, seed)) {
+    keys.push_back("key_" + std::to_string(key));
+  }
+
+  return keys;
+}
+
+/**
+ * Run the benchmarks with a std::deque and a std::vector as
+ * ValueTypeContainer and with 32 and 64 bits IndexType at the default max load
+ * factor, then with the default map at lower and higher max load factors.
+ */
+template <class Key>
+void run_all(benchmark_runner& runner, const std::string& keys_name,
+             const std::vector<Key>& keys,
+             const std::vector<Key>& missing_keys) {
+  const float default_max_load_factor = 0.75f;
+
+  runner.run<map_type<Key, deque_container<Key>, std::uint32_t>>(
+      "deque_index32", keys_name, keys, missing_keys,
+      default_max_load_factor);
+  runner.run<map_type<Key, deque_container<Key>, std::uint64_t>>(
+      "deque_index64", keys_name, keys, missing_keys,
+      default_max_load_factor);
+  runner.run<map_type<Key, vector_container<Key>, std::uint32_t>>(
+      "vector_index32", keys_name, keys, missing_keys,
+      default_max_load_factor);
+  runner.run<map_type<Key, vector_container<Key>, std::uint64_t>>(
+      "vector_index64", keys_name, keys, missing_keys,
+      default_max_load_factor);
+
+  for (float max_load_factor : {0.5f, 0.9f}) {
+    runner.run<map_type<Key, deque_container<Key>, std::uint32_t>>(
+        "deque_index32", keys_name, keys, missing_keys, max_load_factor);
+  }
+}
+
+/**
+ * Parse str as a positive decimal integer. Return false if str is not one.
+ */
+bool parse_count(const char* str, std::size_t& count) {
+  if (*str < '0' || *str > '9') {
+    return false;
+  }
+
+  char* end = nullptr;
+  const unsigned long long value = std::strtoull(str, &end, 10);
+  if (*end != '\0' || value == 0) {
+    return false;
+  }
+
+  count = std::size_t(value);
+  return true;
+}
+
+void print_usage(const char* program) {
+  std::fprintf(stderr, "Usage: %s [nb_elements] [nb_repeats] [output.json]\n",
+               program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t nb_elements = 1000000;
+  std::size_t nb_repeats = 3;
+  if (argc > 4 || (argc > 1 && !parse_count(argv[1], nb_elements)) ||
+      (argc > 2 && !parse_count(argv[2], nb_repeats))) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // Open the output before running the benchmarks to fail early on a bad path.
+  std::ofstream out;
+  if (argc > 3) {
+    out.open(argv[3]);
+    if (!out) {
+      std::fprintf(stderr, "Can't open '%s' for writing.\n", argv[3]);
+      return 1;
+    }
+  }
+
+  benchmark_runner runner(nb_elements, nb_repeats);
+
+  run_all(runner, "random_int", random_int_keys(nb_elements, 0),
+          random_int_keys(nb_elements, 1));
+  run_all(runner, "sequential_int", sequential_int_keys(nb_elements, 0),
+          sequential_int_keys(nb_elements, nb_elements));
+  run_all(runner, "string", string_keys(nb_elements, 0),
+          string_keys(nb_elements, 1));
+
+  if (argc > 3) {
+    runner.write_json(out);
+    out.close();
+    if (!out) {
+      std::fprintf(stderr, "Failed to write '%s'.\n", argv[3]);
+      return 1;
+    }
+  } else {
+    runner.write_json(std::cout);
+  }
+}
@@ -0,0 +1,512 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_CONCURRENT_ORDERED_MAP_H
+#define TSL_CONCURRENT_ORDERED_MAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ordered_map.h"
+#include "tombstone_deque.h"
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#include <shared_mutex>
+#endif
+
+namespace tsl {
+
+namespace detail_concurrent_ordered_map {
+
+/**
+ * Fallback for C++11 which has no shared mutex, readers are exclusive too.
+ */
+class exclusive_shared_mutex {
+ public:
+  void lock() { m_mutex.lock(); }
+  void unlock() { m_mutex.unlock(); }
+
+  void lock_shared() { m_mutex.lock(); }
+  void unlock_shared() { m_mutex.unlock(); }
+
+ private:
+  std::mutex m_mutex;
+};
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+using default_shared_mutex = std::shared_mutex;
+#elif __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+using default_shared_mutex = std::shared_timed_mutex;
+#else
+using default_shared_mutex = exclusive_shared_mutex;
+#endif
+
+template <class SharedMutex>
+class shared_lock_guard {
+ public:
+  explicit shared_lock_guard(SharedMutex& mutex) : m_mutex(mutex) {
+    m_mutex.lock_shared();
+  }
+
+  shared_lock_guard(const shared_lock_guard& other) = delete;
+  shared_lock_guard& operator=(const shared_lock_guard& other) = delete;
+
+  ~shared_lock_guard() { m_mutex.unlock_shared(); }
+
+ private:
+  SharedMutex& m_mutex;
+};
+
+/**
+ * Mapped value of a shard, tagged with the insertion sequence number of its
+ * key in the whole concurrent_ordered_map.
+ */
+template <class T>
+struct sequenced_value {
+  template <class... Args>
+  explicit sequenced_value(std::uint64_t seq, Args&&... args)
+      : sequence(seq), value(std::forward<Args>(args)...) {}
+
+  std::uint64_t sequence;
+  T value;
+};
+
+}  // end namespace detail_concurrent_ordered_map
+
+/**
+ * Thread-safe hash map which remembers the insertion order of its keys.
+ *
+ * The map is split in nb_shards() tsl::ordered_map shards. The hash of a key is
+ * first multiplied by 2^64 divided by the golden ratio and the high bits of the
+ * product select its shard. The multiplication spreads hashes which differ only
+ * in their low bits, like the identity std::hash of the integers in
+ * libstdc++, over all the shards. The shards use the raw low bits of the hash
+ * for their buckets. Each shard has its own reader/writer lock, the lookups on a
+ * shard can run concurrently and only the modifications of the same shard
+ * serialize.
+ *
+ * A global atomic counter gives an insertion sequence number to each inserted
+ * key. The values of a shard are thus sorted by sequence number and
+ * for_each_in_order merges the shards back into the insertion order of the
+ * whole map. Assigning a new value to an existing key keeps its position,
+ * erasing a key and inserting it again moves it to the end.
+ *
+ * The shards use a tsl::tombstone_deque as ValueTypeContainer for an O(1)
+ * amortized ordered erase.
+ *
+ * As the values may be modified or erased by other threads at any time, no
+ * reference or iterator to the values is given out. The lookups copy the value
+ * (find) or call a function object with the shard locked (visit, update).
+ *
+ * SharedMutex must provide lock, unlock, lock_shared and unlock_shared. By
+ * default std::shared_mutex is used in C++17, std::shared_timed_mutex in C++14
+ * and an exclusive std::mutex in C++11.
+ *
+ * The function objects passed to the methods must not call back into the map,
+ * the shard locks aren't recursive.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<std::pair<Key, T>>,
+          class IndexType = std::uint_least32_t,
+          class SharedMutex =
+              tsl::detail_concurrent_ordered_map::default_shared_mutex>
+class concurrent_ordered_map {
+ private:
+  using sequenced_value =
+      tsl::detail_concurrent_ordered_map::sequenced_value<T>;
+  using shard_value_type = std::pair<Key, sequenced_value>;
+  using shard_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<shard_value_type>;
+  using shard_map = tsl::ordered_map<
+      Key, sequenced_value, Hash, KeyEqual, shard_allocator,
+      tsl::tombstone_deque<shard_value_type, shard_allocator>, IndexType>;
+
+  using shared_lock =
+      tsl::detail_concurrent_ordered_map::shared_lock_guard<SharedMutex>;
+  using exclusive_lock = std::lock_guard<SharedMutex>;
+
+  /**
+   * The padding keeps the mutex of a shard out of the cache line of the end of
+   * the previous shard.
+   */
+  struct shard {
+    shard(const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+        : map(0, hash, equal, shard_allocator(alloc)) {}
+
+    mutable SharedMutex mutex;
+    shard_map map;
+    char padding[64];
+  };
+
+ public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+
+  /**
+   * nb_shards is rounded up to a power of two.
+   */
+  explicit concurrent_ordered_map(size_type nb_shards = DEFAULT_NB_SHARDS,
+                                  const Hash& hash = Hash(),
+                                  const KeyEqual& equal = KeyEqual(),
+                                  const Allocator& alloc = Allocator())
+      : m_hash(hash), m_shard_bits(0), m_sequence(0) {
+    while ((size_type(1) << m_shard_bits) < nb_shards &&
+           m_shard_bits < MAX_SHARD_BITS) {
+      m_shard_bits++;
+    }
+
+    m_shards.reserve(size_type(1) << m_shard_bits);
+    for (size_type i = 0; i < (size_type(1) << m_shard_bits); i++) {
+      m_shards.emplace_back(new shard(hash, equal, alloc));
+    }
+  }
+
+  concurrent_ordered_map(const concurrent_ordered_map& other) = delete;
+  concurrent_ordered_map& operator=(const concurrent_ordered_map& other) =
+      delete;
+
+  /*
+   * Capacity
+   */
+
+  /**
+   * The shards are locked one after the other, the result may not correspond
+   * to any single point in time if other threads modify the map.
+   */
+  size_type size() const {
+    size_type nb_values = 0;
+    for (const auto& s : m_shards) {
+      const shared_lock lock(s->mutex);
+      nb_values += s->map.size();
+    }
+
+    return nb_values;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  /*
+   * Modifiers
+   */
+  void clear() {
+    for (const auto& s : m_shards) {
+      const exclusive_lock lock(s->mutex);
+      s->map.clear();
+    }
+  }
+
+  /**
+   * Return true if the value was inserted, false if the key was already
+   * present.
+   */
+  bool insert(const value_type& value) {
+    return try_emplace(value.first, value.second);
+  }
+
+  bool insert(value_type&& value) {
+    return try_emplace(std::move(value.first), std::move(value.second));
+  }
+
+  template <class... Args>
+  bool try_emplace(const key_type& key, Args&&... args) {
+    const std::size_t hash = m_hash(key);
+    shard& s = shard_for(hash);
+    const exclusive_lock lock(s.mutex);
+    return s.map
+        .try_emplace(precalculated_hash_t(hash), key, next_sequence(),
+                     std::forward<Args>(args)...)
+        .second;
+  }
+
+  template <class... Args>
+  bool try_emplace(key_type&& key, Args&&... args) {
+    const std::size_t hash = m_hash(key);
+    shard& s = shard_for(hash);
+    const exclusive_lock lock(s.mutex);
+    return s.map
+        .try_emplace(precalculated_hash_t(hash), std::move(key),
+                     next_sequence(), std::forward<Args>(args)...)
+        .second;
+  }
+
+  /**
+   * Return true if the value was inserted, false if it was assigned to an
+   * existing key (which keeps its position in the insertion order).
+   */
+  template <class M>
+  bool insert_or_assign(const key_type& key, M&& obj) {
+    const std::size_t hash = m_hash(key);
+    shard& s = shard_for(hash);
+    const exclusive_lock lock(s.mutex);
+
+    auto it = s.map.find(key, hash);
+    if (it != s.map.end()) {
+      it.value().value = std::forward<M>(obj);
+      return false;
+    }
+
+    s.map.try_emplace(precalculated_hash_t(hash), key, next_sequence(),
+                      std::forward<M>(obj));
+    return true;
+  }
+
+  size_type erase(const key_type& key) {
+    const std::size_t hash = m_hash(key);
+    shard& s = shard_for(hash);
+    const exclusive_lock lock(s.mutex);
+    return s.map.erase(key, hash);
+  }
+
+  /**
+   * If the key is present, call f(mapped_type&) with its shard locked in
+   * exclusive mode and return true.
+   */
+  template <class F>
+  bool update(const key_type& key, F&& f) {
+    const std::size_t hash = m_hash(key);
+    shard& s = shard_for(hash);
+    const exclusive_lock lock(s.mutex);
+
+    auto it = s.map.find(key, hash);
+    if (it == s.map.end()) {
+      return false;
+    }
+
+    f(it.value().value);
+    return true;
+  }
+
+  /*
+   * Lookup
+   */
+
+  /**
+   * If the key is present, copy its value in 'value' and return true.
+   */
+  bool find(const key_type& key, mapped_type& value) const {
+    return visit(key, [&](const mapped_type& v) { value = v; });
+  }
+
+  /**
+   * If the key is present, call f(const mapped_type&) with its shard locked in
+   * shared mode and return true.
+   */
+  template <class F>
+  bool visit(const key_type& key, F&& f) const {
+    const std::size_t hash = m_hash(key);
+    const shard& s = shard_for(hash);
+    const shared_lock lock(s.mutex);
+
+    auto it = s.map.find(key, hash);
+    if (it == s.map.end()) {
+      return false;
+    }
+
+    f(it->second.value);
+    return true;
+  }
+
+  size_type count(const key_type& key) const { return contains(key) ? 1 : 0; }
+
+  bool contains(const key_type& key) const {
+    const std::size_t hash = m_hash(key);
+    const shard& s = shard_for(hash);
+    const shared_lock lock(s.mutex);
+    return s.map.contains(key, hash);
+  }
+
+  /*
+   * Iteration
+   */
+
+  /**
+   * Call f(const key_type&, const mapped_type&) on each value, shard by shard
+   * with only the current shard locked in shared mode. The order of the values
+   * is unspecified.
+   */
+  template <class F>
+  void for_each(F&& f) const {
+    for (const auto& s : m_shards) {
+      const shared_lock lock(s->mutex);
+      for (const auto& value : s->map) {
+        f(value.first, value.second.value);
+      }
+    }
+  }
+
+  /**
+   * Call f(const key_type&, const mapped_type&) on each value in insertion
+   * order. All the shards are locked in shared mode during the call, giving a
+   * consistent view of the map. The shards are merged with a heap in
+   * O(size() * log(nb_shards())).
+   */
+  template <class F>
+  void for_each_in_order(F&& f) const {
+    using shard_iterator = typename shard_map::const_iterator;
+    using heap_entry = std::pair<std::uint64_t, size_type>;
+
+    const all_shards_shared_lock lock(*this);
+
+    std::vector<shard_iterator> its;
+    its.reserve(m_shards.size());
+
+    std::priority_queue<heap_entry, std::vector<heap_entry>,
+                        std::greater<heap_entry>>
+        heap;
+    for (size_type i = 0; i < m_shards.size(); i++) {
+      its.push_back(m_shards[i]->map.cbegin());
+      if (its[i] != m_shards[i]->map.cend()) {
+        heap.emplace(its[i]->second.sequence, i);
+      }
+    }
+
+    while (!heap.empty()) {
+      const size_type ishard = heap.top().second;
+      heap.pop();
+
+      shard_iterator& it = its[ishard];
+      f(it->first, it->second.value);
+
+      ++it;
+      if (it != m_shards[ishard]->map.cend()) {
+        heap.emplace(it->second.sequence, ishard);
+      }
+    }
+  }
+
+  /*
+   * Hash policy
+   */
+
+  /**
+   * Reserve enough buckets in each shard for count values evenly distributed
+   * among the shards.
+   */
+  void reserve(size_type count) {
+    const size_type count_per_shard =
+        (count + m_shards.size() - 1) / m_shards.size();
+    for (const auto& s : m_shards) {
+      const exclusive_lock lock(s->mutex);
+      s->map.reserve(count_per_shard);
+    }
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return m_hash; }
+
+  key_equal key_eq() const { return m_shards.front()->map.key_eq(); }
+
+  /*
+   * Other
+   */
+  size_type nb_shards() const noexcept { return m_shards.size(); }
+
+ private:
+  /**
+   * Lock all the shards in shared mode, always in the same order. The writers
+   * only lock one shard at a time.
+   */
+  class all_shards_shared_lock {
+   public:
+    explicit all_shards_shared_lock(const concurrent_ordered_map& map)
+        : m_map(map) {
+      for (const auto& s : m_map.m_shards) {
+        s->mutex.lock_shared();
+      }
+    }
+
+    all_shards_shared_lock(const all_shards_shared_lock& other) = delete;
+    all_shards_shared_lock& operator=(const all_shards_shared_lock& other) =
+        delete;
+
+    ~all_shards_shared_lock() {
+      for (const auto& s : m_map.m_shards) {
+        s->mutex.unlock_shared();
+      }
+    }
+
+   private:
+    const concurrent_ordered_map& m_map;
+  };
+
+  shard& shard_for(std::size_t hash) {
+    return *m_shards[shard_index(hash)];
+  }
+
+  const shard& shard_for(std::size_t hash) const {
+    return *m_shards[shard_index(hash)];
+  }
+
+  size_type shard_index(std::size_t hash) const noexcept {
+    if (m_shard_bits == 0) {
+      return 0;
+    }
+
+    return size_type((std::uint64_t(hash) * FIBONACCI_MULTIPLIER) >>
+                     (64 - m_shard_bits));
+  }
+
+  /**
+   * Called with the shard of the key locked, the sequence numbers of the
+   * values of a shard are thus increasing.
+   */
+  std::uint64_t next_sequence() noexcept {
+    return m_sequence.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ public:
+  static const size_type DEFAULT_NB_SHARDS = 64;
+
+ private:
+  static const size_type MAX_SHARD_BITS = 16;
+
+  /**
+   * 2^64 divided by the golden ratio, rounded to an odd number.
+   */
+  static const std::uint64_t FIBONACCI_MULTIPLIER = 11400714819323198485ull;
+
+  Hash m_hash;
+  std::vector<std::unique_ptr<shard>> m_shards;
+  size_type m_shard_bits;
+  std::atomic<std::uint64_t> m_sequence;
+};
+
+}  // end namespace tsl
+
+#endif
@@ -0,0 +1,219 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_DICTIONARY_ENCODER_H
+#define TSL_DICTIONARY_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ordered_set.h"
+
+namespace tsl {
+
+/**
+ * Dictionary encoding of a column of keys on top of a tsl::ordered_set: each
+ * distinct key gets as code its insertion index in the set, the codes are
+ * dense in [0, size()). Encoding a key appends it to the set if it's not
+ * already there, decoding a code is an access to the values of the set.
+ *
+ * The set uses a std::vector as ValueTypeContainer so that the keys are
+ * contiguous in code order: decode(codes, count, out) is a plain gather loop,
+ * `out[i] = keys[codes[i]]`, which compilers can vectorize with gather
+ * instructions for arithmetic keys (e.g. with AVX2). encode(keys, count, codes)
+ * processes the keys by groups and prefetches their buckets and values before
+ * probing, see ordered_set::emplace_index_batch.
+ *
+ * IndexType, the type of the codes, must be an unsigned integer type. The
+ * dictionary can hold up to std::numeric_limits<IndexType>::max() - 1 keys.
+ * The keys are never erased, the codes stay valid until clear(). The encoder
+ * is not thread-safe.
+ */
+template <class Key, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<Key>,
+          class IndexType = std::uint_least32_t>
+class dictionary_encoder {
+  static_assert(std::is_integral<IndexType>::value &&
+                    std::is_unsigned<IndexType>::value,
+                "IndexType must be an unsigned integer type.");
+
+ public:
+  using set_type = tsl::ordered_set<Key, Hash, KeyEqual, Allocator,
+                                    std::vector<Key, Allocator>, IndexType>;
+
+  using key_type = Key;
+  using code_type = IndexType;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+
+  explicit dictionary_encoder(size_type bucket_count = 0,
+                              const Hash& hash = Hash(),
+                              const KeyEqual& equal = KeyEqual(),
+                              const Allocator& alloc = Allocator())
+      : m_set(bucket_count, hash, equal, alloc) {}
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_set.empty(); }
+
+  /**
+   * Number of distinct keys, the codes are in [0, size()).
+   */
+  size_type size() const noexcept { return m_set.size(); }
+
+  /**
+   * Reserve the buckets and the storage of the keys for 'count' distinct keys.
+   */
+  void reserve(size_type count) { m_set.reserve(count); }
+
+  /*
+   * Encoding
+   */
+
+  /**
+   * Return the code of 'key', appending it to the dictionary if it's not
+   * already there.
+   */
+  code_type encode(const key_type& key) {
+    return code_type(m_set.emplace_index(key).first);
+  }
+
+  code_type encode(key_type&& key) {
+    return code_type(m_set.emplace_index(std::move(key)).first);
+  }
+
+  /**
+   * Encode the 'count' keys starting at 'keys', a forward iterator, and write
+   * their codes to 'codes'. Return the output iterator past the last written
+   * code.
+   */
+  template <class KeyIt, class CodeIt>
+  CodeIt encode(KeyIt keys, size_type count, CodeIt codes) {
+    size_type indexes[ENCODE_BLOCK_SIZE];
+
+    while (count > 0) {
+      const size_type block_size =
+          (count < ENCODE_BLOCK_SIZE) ? count : ENCODE_BLOCK_SIZE;
+      m_set.emplace_index_batch(keys, block_size, indexes);
+      std::advance(keys, block_size);
+
+      for (size_type i = 0; i < block_size; i++, ++codes) {
+        *codes = code_type(indexes[i]);
+      }
+
+      count -= block_size;
+    }
+
+    return codes;
+  }
+
+  /**
+   * Return true and set 'code' to the code of 'key' if the key is in the
+   * dictionary, without appending it otherwise.
+   */
+  bool find_code(const key_type& key, code_type& code) const {
+    const size_type index = m_set.index_of(key);
+    if (index == std::numeric_limits<size_type>::max()) {
+      return false;
+    }
+
+    code = code_type(index);
+    return true;
+  }
+
+  bool contains(const key_type& key) const { return m_set.contains(key); }
+
+  /*
+   * Decoding
+   */
+
+  /**
+   * Key of the code 'code', which must be in [0, size()).
+   */
+  const key_type& decode(code_type code) const {
+    tsl_oh_assert(code < size());
+    return *m_set.nth(code);
+  }
+
+  /**
+   * Write the keys of the 'count' codes starting at 'codes' to 'out' and
+   * return the output iterator past the last written key. The codes must be
+   * in [0, size()).
+   */
+  template <class CodeIt, class OutputIt>
+  OutputIt decode(CodeIt codes, size_type count, OutputIt out) const {
+    const key_type* keys = m_set.data();
+    for (size_type i = 0; i < count; i++, ++codes, ++out) {
+      tsl_oh_assert(size_type(*codes) < size());
+      *out = keys[*codes];
+    }
+
+    return out;
+  }
+
+  /*
+   * Modifiers
+   */
+
+  /**
+   * Remove all the keys, invalidating all the codes.
+   */
+  void clear() noexcept { m_set.clear(); }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return m_set.hash_function(); }
+
+  key_equal key_eq() const { return m_set.key_eq(); }
+
+  /**
+   * The underlying set, its keys are in code order: the key of code c is
+   * values_container()[c].
+   */
+  const set_type& dictionary() const noexcept { return m_set; }
+
+ private:
+  /**
+   * Number of codes computed by ordered_set::emplace_index_batch before they
+   * are converted to code_type.
+   */
+  static const size_type ENCODE_BLOCK_SIZE = 256;
+
+  set_type m_set;
+};
+
+}  // end namespace tsl
+
+#endif
@@ -0,0 +1,301 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_HUGE_PAGE_ALLOCATOR_H
+#define TSL_HUGE_PAGE_ALLOCATOR_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "ordered_map.h"
+#include "ordered_set.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TSL_OH_HUGE_PAGES
+#endif
+
+namespace tsl {
+namespace oh {
+
+namespace detail_huge_page {
+
+/**
+ * Size of a huge page on x86-64 and of the default huge pages on most aarch64
+ * kernels.
+ */
+static const std::size_t HUGE_PAGE_SIZE = std::size_t(2) * 1024 * 1024;
+
+[[noreturn]] inline void throw_bad_alloc() {
+#ifdef TSL_OH_NO_EXCEPTIONS
+  std::terminate();
+#else
+  throw std::bad_alloc();
+#endif
+}
+
+inline std::size_t round_up_to_huge_page(std::size_t size) {
+  return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+#ifdef TSL_OH_HUGE_PAGES
+/**
+ * Prefer 'numa_node' for the pages of [ptr, ptr + size) which are not faulted
+ * yet. Best effort, a kernel without NUMA support or an invalid node keeps the
+ * default policy (the node of the thread touching the page first).
+ */
+inline void prefer_numa_node(void* ptr, std::size_t size, int numa_node) {
+  static const int MPOL_PREFERRED_MODE = 1;
+  static const std::size_t BITS_PER_MASK_WORD =
+      sizeof(unsigned long) * CHAR_BIT;
+
+  std::vector<unsigned long> node_mask(
+      std::size_t(numa_node) / BITS_PER_MASK_WORD + 1, 0);
+  node_mask[std::size_t(numa_node) / BITS_PER_MASK_WORD] |=
+      1ul << (std::size_t(numa_node) % BITS_PER_MASK_WORD);
+
+  // The kernel reads maxnode - 1 bits of the mask.
+  static_cast<void>(syscall(SYS_mbind, ptr, size, MPOL_PREFERRED_MODE,
+                            node_mask.data(),
+                            node_mask.size() * BITS_PER_MASK_WORD + 1, 0));
+}
+
+/**
+ * Map 'size' bytes, a multiple of HUGE_PAGE_SIZE, aligned on HUGE_PAGE_SIZE.
+ * Use the explicit huge pages (MAP_HUGETLB) if enough of them are reserved in
+ * /proc/sys/vm/nr_hugepages, otherwise ask for transparent huge pages with
+ * madvise(MADV_HUGEPAGE). Return nullptr on failure.
+ */
+inline void* map_huge_pages(std::size_t size, int numa_node) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr == MAP_FAILED) {
+    // Map one more huge page and unmap the unaligned head and tail, the
+    // transparent huge pages are only used on aligned ranges.
+    const std::size_t mapped_size = size + HUGE_PAGE_SIZE;
+    void* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+      return nullptr;
+    }
+
+    const std::uintptr_t mapped_address =
+        reinterpret_cast<std::uintptr_t>(mapped);
+    const std::uintptr_t address =
+        (mapped_address + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    const std::size_t head_size = std::size_t(address - mapped_address);
+    if (head_size > 0) {
+      munmap(mapped, head_size);
+    }
+    if (mapped_size - head_size > size) {
+      munmap(reinterpret_cast<void*>(address + size),
+             mapped_size - head_size - size);
+    }
+
+    ptr = reinterpret_cast<void*>(address);
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  if (numa_node >= 0) {
+    prefer_numa_node(ptr, size, numa_node);
+  }
+
+  return ptr;
+}
+
+inline void unmap_huge_pages(void* ptr, std::size_t size) noexcept {
+  munmap(ptr, size);
+}
+#endif
+
+}  // end namespace detail_huge_page
+
+/**
+ * Allocator for the buckets array of a very large map (see the BucketAllocator
+ * parameter of tsl::ordered_map), whose random probes cause a TLB miss on
+ * nearly every lookup with 4 KiB pages.
+ *
+ * On Linux, the allocations of at least 2 MiB are rounded up to a multiple of
+ * 2 MiB and mapped with mmap: in explicit huge pages if enough are reserved,
+ * otherwise in memory advised for the transparent huge pages (which must be
+ * in the "madvise" or "always" mode, see
+ * /sys/kernel/mm/transparent_hugepage/enabled). If 'numa_node' is set, the
+ * pages are placed preferably on this NUMA node with mbind. Smaller
+ * allocations, and all the allocations on other systems, use ::operator new.
+ *
+ * The allocators are stateless apart from the NUMA node, which is only a
+ * placement hint: any instance can deallocate the memory of another.
+ */
+template <class T>
+class huge_page_allocator {
+ public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using propagate_on_container_move_assignment = std::true_type;
+
+  static const int NO_NUMA_NODE = -1;
+
+  template <class U>
+  struct rebind {
+    using other = huge_page_allocator<U>;
+  };
+
+  huge_page_allocator() noexcept : m_numa_node(NO_NUMA_NODE) {}
+
+  explicit huge_page_allocator(int numa_node) noexcept
+      : m_numa_node(numa_node) {}
+
+  template <class U>
+  huge_page_allocator(const huge_page_allocator<U>& other) noexcept
+      : m_numa_node(other.numa_node()) {}
+
+  T* allocate(size_type n) {
+    if (n > max_size()) {
+      detail_huge_page::throw_bad_alloc();
+    }
+
+    const std::size_t size = n * sizeof(T);
+    if (!use_huge_pages(size)) {
+      return static_cast<T*>(::operator new(size));
+    }
+
+#ifdef TSL_OH_HUGE_PAGES
+    void* ptr = detail_huge_page::map_huge_pages(
+        detail_huge_page::round_up_to_huge_page(size), m_numa_node);
+    if (ptr == nullptr) {
+      detail_huge_page::throw_bad_alloc();
+    }
+
+    return static_cast<T*>(ptr);
+#else
+    return nullptr;
+#endif
+  }
+
+  void deallocate(T* p, size_type n) noexcept {
+    const std::size_t size = n * sizeof(T);
+    if (!use_huge_pages(size)) {
+      ::operator delete(p);
+      return;
+    }
+
+#ifdef TSL_OH_HUGE_PAGES
+    detail_huge_page::unmap_huge_pages(
+        p, detail_huge_page::round_up_to_huge_page(size));
+#endif
+  }
+
+  size_type max_size() const noexcept {
+    return (std::numeric_limits<size_type>::max() -
+            detail_huge_page::HUGE_PAGE_SIZE) /
+           sizeof(T);
+  }
+
+  /**
+   * NUMA node on which the pages are preferably placed, NO_NUMA_NODE if none.
+   */
+  int numa_node() const noexcept { return m_numa_node; }
+
+  /**
+   * True if an allocation of 'size' bytes is mapped in huge pages.
+   */
+  static bool use_huge_pages(std::size_t size) noexcept {
+#ifdef TSL_OH_HUGE_PAGES
+    return size >= detail_huge_page::HUGE_PAGE_SIZE;
+#else
+    static_cast<void>(size);
+    return false;
+#endif
+  }
+
+ private:
+  int m_numa_node;
+};
+
+template <class T>
+const int huge_page_allocator<T>::NO_NUMA_NODE;
+
+template <class T, class U>
+bool operator==(const huge_page_allocator<T>& /*lhs*/,
+                const huge_page_allocator<U>& /*rhs*/) noexcept {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const huge_page_allocator<T>& lhs,
+                const huge_page_allocator<U>& rhs) noexcept {
+  return !(lhs == rhs);
+}
+
+}  // end namespace oh
+
+/**
+ * tsl::ordered_map whose buckets array is allocated with
+ * tsl::oh::huge_page_allocator, the values keep Allocator. To place the
+ * buckets on a NUMA node, pass a tsl::oh::huge_page_allocator(numa_node) to
+ * the constructor taking a BucketAllocator.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<std::pair<Key, T>>,
+          class ValueTypeContainer = std::deque<std::pair<Key, T>, Allocator>,
+          class IndexType = std::uint_least32_t, bool SimdProbing = false,
+          bool StoreFullHash = false,
+          class GrowthPolicy = tsl::oh::power_of_two_growth_policy>
+using huge_page_ordered_map =
+    ordered_map<Key, T, Hash, KeyEqual, Allocator, ValueTypeContainer,
+                IndexType, SimdProbing, StoreFullHash, GrowthPolicy,
+                oh::huge_page_allocator<std::pair<Key, T>>>;
+
+/**
+ * Same as tsl::huge_page_ordered_map for a tsl::ordered_set.
+ */
+template <class Key, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<Key>,
+          class ValueTypeContainer = std::deque<Key, Allocator>,
+          class IndexType = std::uint_least32_t, bool SimdProbing = false,
+          bool StoreFullHash = false,
+          class GrowthPolicy = tsl::oh::power_of_two_growth_policy>
+using huge_page_ordered_set =
+    ordered_set<Key, Hash, KeyEqual, Allocator, ValueTypeContainer, IndexType,
+                SimdProbing, StoreFullHash, GrowthPolicy,
+                oh::huge_page_allocator<Key>>;
+
+}  // end namespace tsl
+
+#endif
@@ -0,0 +1,627 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_MAPPED_ORDERED_MAP_H
+#define TSL_MAPPED_ORDERED_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "ordered_hash.h"
+#include "ordered_map.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#define TSL_MOM_UNDEF_NOMINMAX
+#endif
+#include <windows.h>
+#ifdef TSL_MOM_UNDEF_NOMINMAX
+#undef NOMINMAX
+#undef TSL_MOM_UNDEF_NOMINMAX
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tsl {
+
+namespace detail_mapped_ordered_map {
+
+/**
+ * Header at the beginning of a file written by mapped_ordered_map::write. The
+ * values array and the buckets array follow at values_offset and
+ * buckets_offset, both multiples of FILE_ALIGNMENT.
+ */
+struct file_header {
+  char magic[8];
+  std::uint64_t version;
+  std::uint64_t value_size;
+  std::uint64_t bucket_size;
+  std::uint64_t nb_values;
+  std::uint64_t bucket_count;
+  std::uint64_t values_offset;
+  std::uint64_t buckets_offset;
+};
+
+static const char FILE_MAGIC[8] = {'T', 'S', 'L', 'O', 'M', 'A', 'P', '\0'};
+static const std::uint64_t FILE_FORMAT_VERSION = 1;
+static const std::uint64_t FILE_ALIGNMENT = 64;
+
+inline std::uint64_t align_file_offset(std::uint64_t offset) noexcept {
+  return (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+}
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class file_mapping {
+ public:
+  file_mapping() noexcept : m_data(nullptr), m_size(0) {}
+
+  explicit file_mapping(const std::string& path) : file_mapping() {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Couldn't open the file.");
+    }
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+      mapping =
+          CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+
+    if (mapping == nullptr) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Couldn't map the file.");
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == nullptr) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Couldn't map the file.");
+    }
+
+    m_data = static_cast<const unsigned char*>(data);
+    m_size = std::size_t(file_size.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Couldn't open the file.");
+    }
+
+    struct stat file_stat;
+    void* data = MAP_FAILED;
+    if (::fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+      data = ::mmap(nullptr, std::size_t(file_stat.st_size), PROT_READ,
+                    MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Couldn't map the file.");
+    }
+
+    m_data = static_cast<const unsigned char*>(data);
+    m_size = std::size_t(file_stat.st_size);
+#endif
+  }
+
+  file_mapping(const file_mapping& other) = delete;
+
+  file_mapping(file_mapping&& other) noexcept
+      : m_data(other.m_data), m_size(other.m_size) {
+    other.m_data = nullptr;
+    other.m_size = 0;
+  }
+
+  file_mapping& operator=(const file_mapping& other) = delete;
+
+  file_mapping& operator=(file_mapping&& other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~file_mapping() {
+    if (m_data == nullptr) {
+      return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    ::munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+  }
+
+  const unsigned char* data() const noexcept { return m_data; }
+
+  std::size_t size() const noexcept { return m_size; }
+
+  void swap(file_mapping& other) noexcept {
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+  }
+
+ private:
+  const unsigned char* m_data;
+  std::size_t m_size;
+};
+
+/**
+ * Serializer passed to ordered_map::serialize which writes the file read by
+ * mapped_ordered_map, see mapped_ordered_map::write.
+ *
+ * The calls come in the order of the serialization protocol of the
+ * ordered_hash: the protocol version, the number of values, the bucket count,
+ * the max load factor, the values and finally the index and the truncated
+ * hash of each bucket.
+ */
+template <class ValueType, class BucketEntry>
+class file_writer {
+ public:
+  explicit file_writer(const std::string& path)
+      : m_file(path, std::ios::binary | std::ios::trunc),
+        m_nb_sizes(0),
+        m_offset(0),
+        m_has_bucket_index(false),
+        m_bucket_index(0) {
+    if (!m_file) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                "Couldn't open the file for writing.");
+    }
+  }
+
+  void operator()(const ValueType& value) {
+    write(&value, sizeof(ValueType));
+  }
+
+  void operator()(std::uint64_t value) {
+    if (m_nb_sizes < 3) {
+      m_sizes[m_nb_sizes++] = value;
+      if (m_nb_sizes == 1 && value != 1) {
+        TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                  "Unsupported serialization protocol.");
+      }
+      return;
+    }
+
+    if (m_offset < m_header.buckets_offset) {
+      pad_to(m_header.buckets_offset);
+    }
+
+    if (!m_has_bucket_index) {
+      m_bucket_index = value;
+      m_has_bucket_index = true;
+      return;
+    }
+
+    BucketEntry bucket;
+    if (m_bucket_index <= BucketEntry::max_size()) {
+      bucket.set_index(
+          static_cast<typename BucketEntry::index_type>(m_bucket_index));
+      bucket.set_hash(std::size_t(value));
+    }
+    write(&bucket, sizeof(BucketEntry));
+    m_has_bucket_index = false;
+  }
+
+  /**
+   * The max load factor comes right before the values, write the header.
+   */
+  void operator()(float /*max_load_factor*/) {
+    tsl_oh_assert(m_nb_sizes == 3);
+
+    std::memcpy(m_header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    m_header.version = FILE_FORMAT_VERSION;
+    m_header.value_size = sizeof(ValueType);
+    m_header.bucket_size = sizeof(BucketEntry);
+    m_header.nb_values = m_sizes[1];
+    m_header.bucket_count = m_sizes[2];
+    m_header.values_offset = align_file_offset(sizeof(file_header));
+    m_header.buckets_offset = align_file_offset(
+        m_header.values_offset + m_header.nb_values * sizeof(ValueType));
+
+    write(&m_header, sizeof(file_header));
+    pad_to(m_header.values_offset);
+  }
+
+  void close() {
+    if (m_offset < m_header.buckets_offset) {
+      pad_to(m_header.buckets_offset);
+    }
+
+    m_file.close();
+    if (!m_file) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                "Couldn't write the file.");
+    }
+  }
+
+ private:
+  void write(const void* data, std::size_t size) {
+    m_file.write(static_cast<const char*>(data), std::streamsize(size));
+    m_offset += size;
+  }
+
+  void pad_to(std::uint64_t offset) {
+    static const char padding[FILE_ALIGNMENT] = {};
+    write(padding, std::size_t(offset - m_offset));
+  }
+
+ private:
+  std::ofstream m_file;
+  file_header m_header;
+
+  std::uint64_t m_sizes[3];
+  std::size_t m_nb_sizes;
+
+  std::uint64_t m_offset;
+
+  bool m_has_bucket_index;
+  std::uint64_t m_bucket_index;
+};
+
+/**
+ * Template parameters of a tsl::ordered_map which decide where its buckets
+ * are placed and how they are stored, to check that a map written by
+ * mapped_ordered_map::write can be read back.
+ */
+template <class Map>
+struct map_layout {
+  static const bool is_ordered_map = false;
+  static const bool store_full_hash = false;
+  using index_type = void;
+  using growth_policy = void;
+};
+
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class ValueTypeContainer, class IndexType, bool SimdProbing,
+          bool StoreFullHash, class GrowthPolicy, class BucketAllocator>
+struct map_layout<tsl::ordered_map<Key, T, Hash, KeyEqual, Allocator,
+                                   ValueTypeContainer, IndexType, SimdProbing,
+                                   StoreFullHash, GrowthPolicy,
+                                   BucketAllocator>> {
+  static const bool is_ordered_map = true;
+  static const bool store_full_hash = StoreFullHash;
+  using index_type = IndexType;
+  using growth_policy = GrowthPolicy;
+};
+
+}  // end namespace detail_mapped_ordered_map
+
+/**
+ * Read-only view of a tsl::ordered_map saved to a file with
+ * mapped_ordered_map::write. The file is memory-mapped and the lookups and the
+ * iteration are served directly from the mapping, opening a map is thus in
+ * O(1) whatever its size, the pages being loaded on demand by the OS.
+ *
+ * The file is laid out as a header, the values array in insertion order and
+ * the buckets array of the map. Key and T must be trivially copyable, the
+ * values are written as raw bytes, and the file can only be read back on a
+ * platform with the same endianness and the same layout of std::pair<Key, T>.
+ * As with the hash compatible deserialization, Hash and KeyEqual must behave
+ * the same way than the ones of the written map, and IndexType, GrowthPolicy
+ * and StoreFullHash must be the same (checked by write). The content of the file isn't validated
+ * beyond its header, only trusted files should be opened.
+ *
+ * The iterators are pointers to const std::pair<Key, T> and stay valid as long
+ * as the mapped_ordered_map they come from is alive.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class IndexType = std::uint_least32_t,
+          class GrowthPolicy = tsl::oh::power_of_two_growth_policy,
+          bool StoreFullHash = false>
+class mapped_ordered_map {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+                    std::is_trivially_copyable<T>::value,
+                "Key and T must be trivially copyable.");
+
+ private:
+  using bucket_entry =
+      tsl::detail_ordered_hash::bucket_entry<IndexType, StoreFullHash>;
+
+  static_assert(!bucket_entry::STORES_DISTANCE,
+                "A tsl::oh::packed_index isn't supported.");
+
+ public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using const_reference = const value_type&;
+  using const_pointer = const value_type*;
+  using const_iterator = const value_type*;
+  using iterator = const_iterator;
+
+  /**
+   * Write 'map' to the file at 'path' in the format read by the constructor.
+   * 'map' must be a tsl::ordered_map<Key, T, ...> (any ValueTypeContainer)
+   * with the same IndexType, GrowthPolicy and StoreFullHash, the buckets of
+   * the file are probed as they were placed in 'map'.
+   */
+  template <class Map>
+  static void write(const Map& map, const std::string& path) {
+    using map_layout = detail_mapped_ordered_map::map_layout<Map>;
+    static_assert(map_layout::is_ordered_map,
+                  "The map must be a tsl::ordered_map.");
+    static_assert(std::is_same<typename Map::value_type, value_type>::value,
+                  "The map must store std::pair<Key, T> values.");
+    static_assert(
+        std::is_same<typename map_layout::index_type, IndexType>::value,
+        "The map must have the same IndexType.");
+    static_assert(
+        std::is_same<typename map_layout::growth_policy, GrowthPolicy>::value,
+        "The map must have the same GrowthPolicy.");
+    static_assert(map_layout::store_full_hash == StoreFullHash,
+                  "The map must have the same StoreFullHash.");
+
+    detail_mapped_ordered_map::file_writer<value_type, bucket_entry> writer(
+        path);
+    map.serialize(writer);
+    writer.close();
+  }
+
+  /**
+   * Map the file at 'path', written by mapped_ordered_map::write.
+   */
+  explicit mapped_ordered_map(const std::string& path,
+                              const Hash& hash = Hash(),
+                              const KeyEqual& equal = KeyEqual())
+      : m_mapping(path),
+        m_values(nullptr),
+        m_buckets(nullptr),
+        m_nb_values(0),
+        m_bucket_count(0),
+        m_growth_policy(m_bucket_count),
+        m_hash(hash),
+        m_key_equal(equal) {
+    using namespace detail_mapped_ordered_map;
+
+    file_header header;
+    if (m_mapping.size() < sizeof(file_header)) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Invalid file header.");
+    }
+    std::memcpy(&header, m_mapping.data(), sizeof(file_header));
+
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+        header.version != FILE_FORMAT_VERSION) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Invalid file header.");
+    }
+
+    if (header.value_size != sizeof(value_type) ||
+        header.bucket_size != sizeof(bucket_entry)) {
+      TSL_OH_THROW_OR_TERMINATE(
+          std::runtime_error,
+          "The file was written with different Key, T or IndexType types.");
+    }
+
+    const std::uint64_t file_size = m_mapping.size();
+    if (header.nb_values > header.bucket_count ||
+        header.values_offset % FILE_ALIGNMENT != 0 ||
+        header.buckets_offset % FILE_ALIGNMENT != 0 ||
+        header.values_offset > file_size ||
+        header.nb_values > (file_size - header.values_offset) /
+                               sizeof(value_type) ||
+        header.buckets_offset > file_size ||
+        header.bucket_count > (file_size - header.buckets_offset) /
+                                  sizeof(bucket_entry)) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Invalid file header.");
+    }
+
+    m_values = reinterpret_cast<const value_type*>(m_mapping.data() +
+                                                   header.values_offset);
+    m_buckets = reinterpret_cast<const bucket_entry*>(m_mapping.data() +
+                                                      header.buckets_offset);
+    size_type bucket_count = size_type(header.bucket_count);
+    if (bucket_count > m_growth_policy.max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error, "Invalid file header.");
+    }
+
+    GrowthPolicy growth_policy(bucket_count);
+    if (bucket_count != header.bucket_count) {
+      TSL_OH_THROW_OR_TERMINATE(
+          std::runtime_error,
+          "The file was written with a different GrowthPolicy.");
+    }
+
+    m_nb_values = size_type(header.nb_values);
+    m_bucket_count = bucket_count;
+    m_growth_policy = growth_policy;
+  }
+
+  mapped_ordered_map(const mapped_ordered_map& other) = delete;
+  mapped_ordered_map(mapped_ordered_map&& other) = default;
+  mapped_ordered_map& operator=(const mapped_ordered_map& other) = delete;
+  mapped_ordered_map& operator=(mapped_ordered_map&& other) = default;
+
+  /*
+   * Iterators
+   */
+  const_iterator begin() const noexcept { return m_values; }
+  const_iterator cbegin() const noexcept { return m_values; }
+
+  const_iterator end() const noexcept { return m_values + m_nb_values; }
+  const_iterator cend() const noexcept { return end(); }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_nb_values == 0; }
+  size_type size() const noexcept { return m_nb_values; }
+
+  /*
+   * Lookup
+   */
+  const T& at(const Key& key) const { return at(key, hash_function()(key)); }
+
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup if you already have the hash.
+   */
+  const T& at(const Key& key, std::size_t precalculated_hash) const {
+    const_iterator it = find(key, precalculated_hash);
+    if (it == end()) {
+      TSL_OH_THROW_OR_TERMINATE(std::out_of_range, "Couldn't find the key.");
+    }
+
+    return it->second;
+  }
+
+  size_type count(const Key& key) const { return (find(key) != end()) ? 1 : 0; }
+
+  size_type count(const Key& key, std::size_t precalculated_hash) const {
+    return (find(key, precalculated_hash) != end()) ? 1 : 0;
+  }
+
+  const_iterator find(const Key& key) const {
+    return find(key, hash_function()(key));
+  }
+
+  /**
+   * Same robin hood probing as the ordered_map the file was written from.
+   */
+  const_iterator find(const Key& key, std::size_t precalculated_hash) const {
+    if (m_bucket_count == 0) {
+      return end();
+    }
+
+    for (std::size_t ibucket = m_growth_policy.bucket_for_hash(
+                         bucket_entry::truncate_hash(precalculated_hash)),
+                     dist_from_ideal_bucket = 0;
+         ; ibucket = (ibucket + 1 < m_bucket_count) ? ibucket + 1 : 0,
+                     dist_from_ideal_bucket++) {
+      const bucket_entry& bucket = m_buckets[ibucket];
+      if (bucket.empty() ||
+          dist_from_ideal_bucket > distance_from_ideal_bucket(ibucket)) {
+        return end();
+      }
+
+      if (bucket.truncated_hash() ==
+              bucket_entry::truncate_hash(precalculated_hash) &&
+          m_key_equal(key, m_values[bucket.index()].first)) {
+        return m_values + bucket.index();
+      }
+    }
+  }
+
+  bool contains(const Key& key) const { return find(key) != end(); }
+
+  bool contains(const Key& key, std::size_t precalculated_hash) const {
+    return find(key, precalculated_hash) != end();
+  }
+
+  /*
+   * Bucket interface
+   */
+  size_type bucket_count() const noexcept { return m_bucket_count; }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return m_hash; }
+  key_equal key_eq() const { return m_key_equal; }
+
+  /*
+   * Other
+   */
+
+  /**
+   * Requires index <= size().
+   *
+   * Return an iterator to the element at index. Return end() if index ==
+   * size().
+   */
+  const_iterator nth(size_type index) const {
+    tsl_oh_assert(index <= size());
+    return m_values + index;
+  }
+
+  /**
+   * Return const_reference to the first element. Requires the container to
+   * not be empty.
+   */
+  const_reference front() const {
+    tsl_oh_assert(!empty());
+    return m_values[0];
+  }
+
+  /**
+   * Return const_reference to the last element. Requires the container to not
+   * be empty.
+   */
+  const_reference back() const {
+    tsl_oh_assert(!empty());
+    return m_values[m_nb_values - 1];
+  }
+
+  /**
+   * Pointer to the values array in the mapping, in insertion order.
+   */
+  const value_type* data() const noexcept { return m_values; }
+
+ private:
+  std::size_t distance_from_ideal_bucket(std::size_t ibucket) const noexcept {
+    const std::size_t ideal_bucket =
+        m_growth_policy.bucket_for_hash(m_buckets[ibucket].truncated_hash());
+    return (ibucket >= ideal_bucket)
+               ? ibucket - ideal_bucket
+               : (m_bucket_count + ibucket) - ideal_bucket;
+  }
+
+ private:
+  detail_mapped_ordered_map::file_mapping m_mapping;
+
+  const value_type* m_values;
+  const bucket_entry* m_buckets;
+  size_type m_nb_values;
+  size_type m_bucket_count;
+  GrowthPolicy m_growth_policy;
+
+  Hash m_hash;
+  KeyEqual m_key_equal;
+};
+
+}  // end namespace tsl
+
+#endif
@@ -0,0 +1,304 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_ORDERED_GROWTH_POLICY_H
+#define TSL_ORDERED_GROWTH_POLICY_H
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <ratio>
+#include <stdexcept>
+
+/**
+ * Only activate tsl_oh_assert if TSL_DEBUG is defined.
+ * This way we avoid the performance hit when NDEBUG is not defined with assert
+ * as tsl_oh_assert is used a lot (people usually compile with "-O3" and not
+ * "-O3 -DNDEBUG").
+ */
+#ifdef TSL_DEBUG
+#define tsl_oh_assert(expr) assert(expr)
+#else
+#define tsl_oh_assert(expr) (static_cast<void>(0))
+#endif
+
+/**
+ * If exceptions are enabled, throw the exception passed in parameter, otherwise
+ * call std::terminate.
+ */
+#if (defined(__cpp_exceptions) || defined(__EXCEPTIONS) || \
+     (defined(_MSC_VER) && defined(_CPPUNWIND))) &&        \
+    !defined(TSL_NO_EXCEPTIONS)
+#define TSL_OH_THROW_OR_TERMINATE(ex, msg) throw ex(msg)
+#else
+#define TSL_OH_NO_EXCEPTIONS
+#ifdef TSL_DEBUG
+#include <iostream>
+#define TSL_OH_THROW_OR_TERMINATE(ex, msg) \
+  do {                                     \
+    std::cerr << msg << std::endl;         \
+    std::terminate();                      \
+  } while (0)
+#else
+#define TSL_OH_THROW_OR_TERMINATE(ex, msg) std::terminate()
+#endif
+#endif
+
+namespace tsl {
+namespace oh {
+
+/**
+ * A GrowthPolicy maps the hash of a key to its ideal bucket and chooses the
+ * number of buckets of the ordered_hash. It must provide:
+ *
+ * - explicit GrowthPolicy(std::size_t& min_bucket_count_in_out): round
+ *   min_bucket_count_in_out up to a bucket count supported by the policy and
+ *   prepare the mapping for this bucket count. A bucket count of 0 must stay 0
+ *   and map every hash to the bucket 0. Throw std::length_error if
+ *   min_bucket_count_in_out > max_bucket_count().
+ *
+ * - std::size_t bucket_for_hash(std::size_t hash) const noexcept: the ideal
+ *   bucket of 'hash', in [0, bucket_count) (or 0 if bucket_count is 0). The
+ *   ordered_hash only passes the part of the hash stored in its buckets (the
+ *   lower 32 bits unless the buckets store the full hash), so that the ideal
+ *   bucket of a value can be found again on rehash.
+ *
+ * - std::size_t next_bucket_count() const: the bucket count to grow to.
+ *   Throw std::length_error if the current bucket count is
+ *   max_bucket_count().
+ *
+ * - std::size_t max_bucket_count() const: the maximum bucket count.
+ *
+ * - void clear() noexcept: reset the policy to a bucket count of 0.
+ *
+ * The probing wraps around at the end of the buckets array with a comparison,
+ * the bucket count doesn't have to be a power of two.
+ */
+
+/**
+ * Power of two bucket counts, the ideal bucket is `hash & (bucket_count - 1)`.
+ * The fastest mapping but only the lower bits of the hash are used: a hash
+ * function like the identity std::hash of libstdc++ on integers with a
+ * power of two stride clusters the keys in a fraction of the buckets.
+ */
+class power_of_two_growth_policy {
+ public:
+  explicit power_of_two_growth_policy(std::size_t& min_bucket_count_in_out) {
+    if (min_bucket_count_in_out > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The hash table exceeds its maximum size.");
+    }
+
+    if (min_bucket_count_in_out > 0) {
+      min_bucket_count_in_out =
+          round_up_to_power_of_two(min_bucket_count_in_out);
+      m_mask = min_bucket_count_in_out - 1;
+    } else {
+      m_mask = 0;
+    }
+  }
+
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    return hash & m_mask;
+  }
+
+  std::size_t next_bucket_count() const {
+    if (m_mask + 1 > max_bucket_count() / 2) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The hash table exceeds its maximum size.");
+    }
+
+    return (m_mask + 1) * 2;
+  }
+
+  std::size_t max_bucket_count() const {
+    return (std::numeric_limits<std::size_t>::max() / 2) + 1;
+  }
+
+  void clear() noexcept { m_mask = 0; }
+
+  static std::size_t round_up_to_power_of_two(std::size_t value) {
+    if (is_power_of_two(value)) {
+      return value;
+    }
+
+    if (value == 0) {
+      return 1;
+    }
+
+    --value;
+    for (std::size_t i = 1; i < sizeof(std::size_t) * CHAR_BIT; i *= 2) {
+      value |= value >> i;
+    }
+
+    return value + 1;
+  }
+
+  static constexpr bool is_power_of_two(std::size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+  }
+
+ private:
+  std::size_t m_mask;
+};
+
+/**
+ * Power of two bucket counts with Fibonacci hashing, the ideal bucket is made
+ * of the top log2(bucket_count) bits of `hash * 2^64 / phi`. The
+ * multiplication spreads every bit of the hash to the top bits, sequential or
+ * strided integer keys with an identity hash are distributed evenly, at the
+ * cost of a multiplication per lookup.
+ */
+class fibonacci_growth_policy {
+ public:
+  explicit fibonacci_growth_policy(std::size_t& min_bucket_count_in_out) {
+    if (min_bucket_count_in_out > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The hash table exceeds its maximum size.");
+    }
+
+    m_mask = 0;
+    m_shift = 63;
+    if (min_bucket_count_in_out > 0) {
+      min_bucket_count_in_out =
+          power_of_two_growth_policy::round_up_to_power_of_two(
+              min_bucket_count_in_out);
+      m_mask = min_bucket_count_in_out - 1;
+
+      // A shift of 64 would be undefined, a single bucket keeps 63 and relies
+      // on the mask.
+      for (std::size_t count = min_bucket_count_in_out; count > 2;
+           count /= 2) {
+        m_shift--;
+      }
+    }
+  }
+
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    return std::size_t((std::uint64_t(hash) * FIBONACCI_MULTIPLIER) >>
+                       m_shift) &
+           m_mask;
+  }
+
+  std::size_t next_bucket_count() const {
+    if (m_mask + 1 > max_bucket_count() / 2) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The hash table exceeds its maximum size.");
+    }
+
+    return (m_mask + 1) * 2;
+  }
+
+  std::size_t max_bucket_count() const {
+    return std::size_t(std::min<std::uint64_t>(
+        (std::numeric_limits<std::size_t>::max() / 2) + 1,
+        std::uint64_t(1) << 63));
+  }
+
+  void clear() noexcept {
+    m_mask = 0;
+    m_shift = 63;
+  }
+
+ private:
+  /**
+   * 2^64 divided by the golden ratio, rounded to an odd number.
+   */
+  static const std::uint64_t FIBONACCI_MULTIPLIER = 11400714819323198485ull;
+
+  std::size_t m_mask;
+  unsigned int m_shift;
+};
+
+/**
+ * Any bucket count with Lemire's fastrange, the ideal bucket is
+ * `(h * bucket_count) >> 32` with h a 32 bits hash. The map can thus be
+ * reserved to the exact number of buckets needed and grows by GrowthFactor,
+ * 1.5 by default, instead of doubling.
+ *
+ * fastrange keeps the order of the hashes and thus uses their top bits, which
+ * are all zero for small integers with an identity hash. The lower 32 bits of
+ * the hash are first mixed with a Fibonacci multiplication to get h.
+ *
+ * max_bucket_count() is 2^32 as h only has 32 bits.
+ */
+template <class GrowthFactor = std::ratio<3, 2>>
+class fastrange_growth_policy {
+  static_assert(GrowthFactor::num > GrowthFactor::den,
+                "GrowthFactor must be > 1.");
+
+ public:
+  explicit fastrange_growth_policy(std::size_t& min_bucket_count_in_out) {
+    if (min_bucket_count_in_out > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The hash table exceeds its maximum size.");
+    }
+
+    m_bucket_count = min_bucket_count_in_out;
+  }
+
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    const std::uint64_t mixed_hash =
+        (std::uint64_t(std::uint32_t(hash)) * FIBONACCI_MULTIPLIER) >> 32;
+    return std::size_t((mixed_hash * m_bucket_count) >> 32);
+  }
+
+  /**
+   * Grow by at least one bucket and at most up to max_bucket_count().
+   */
+  std::size_t next_bucket_count() const {
+    if (m_bucket_count >= max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The hash table exceeds its maximum size.");
+    }
+
+    const std::uint64_t next_bucket_count =
+        std::max(m_bucket_count + 1,
+                 (m_bucket_count * GrowthFactor::num + GrowthFactor::den - 1) /
+                     GrowthFactor::den);
+
+    return std::size_t(std::min<std::uint64_t>(next_bucket_count,
+                                               max_bucket_count()));
+  }
+
+  std::size_t max_bucket_count() const {
+    return std::size_t(std::min<std::uint64_t>(
+        std::numeric_limits<std::size_t>::max(), std::uint64_t(1) << 32));
+  }
+
+  void clear() noexcept { m_bucket_count = 0; }
+
+ private:
+  static const std::uint64_t FIBONACCI_MULTIPLIER = 11400714819323198485ull;
+
+  std::uint64_t m_bucket_count;
+};
+
+}  // end namespace oh
+}  // end namespace tsl
+
+#endif
@@ -32,59 +32,186 @@
 #include <cstdint>
 #include <exception>
 #include <functional>
+#include <initializer_list>
 #include <iterator>
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "ordered_growth_policy.h"
+
 /**
  * Macros for compatibility with GCC 4.8
  */
 #if (defined(__GNUC__) && (__GNUC__ == 4) && (__GNUC_MINOR__ < 9))
 #define TSL_OH_NO_CONTAINER_ERASE_CONST_ITERATOR
-#define TSL_OH_NO_CONTAINER_EMPLACE_CONST_ITERATOR
 #endif
 
 /**
- * Only activate tsl_oh_assert if TSL_DEBUG is defined.
- * This way we avoid the performance hit when NDEBUG is not defined with assert
- * as tsl_oh_assert is used a lot (people usually compile with "-O3" and not
- * "-O3 -DNDEBUG").
+ * SIMD instruction sets used to scan the probe metadata of the ordered_hash
+ * when the SimdProbing template parameter is true. A portable scalar fallback
+ * is used if none is available or if TSL_OH_NO_SIMD is defined.
  */
-#ifdef TSL_DEBUG
-#define tsl_oh_assert(expr) assert(expr)
-#else
-#define tsl_oh_assert(expr) (static_cast<void>(0))
+#if !defined(TSL_OH_NO_SIMD)
+#if defined(__AVX2__)
+#define TSL_OH_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TSL_OH_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
 #endif
 
 /**
- * If exceptions are enabled, throw the exception passed in parameter, otherwise
- * call std::terminate.
+ * Instrumentation hook called on the hot paths of the ordered_hash with a
+ * tsl::ordered_hash_event and a std::size_t value, see ordered_hash_event.
+ *
+ * Define it before including the header to collect the events, e.g.
+ * `#define TSL_OH_INSTRUMENT(event, value) my_counters.add(event, value)`.
+ * The hook is called from noexcept methods and must not throw. By default it
+ * expands to nothing and the instrumentation has no cost.
+ *
+ * All the translation units of a program instantiating the same ordered_map
+ * or ordered_set types must see the same definition.
  */
-#if (defined(__cpp_exceptions) || defined(__EXCEPTIONS) || \
-     (defined(_MSC_VER) && defined(_CPPUNWIND))) &&        \
-    !defined(TSL_NO_EXCEPTIONS)
-#define TSL_OH_THROW_OR_TERMINATE(ex, msg) throw ex(msg)
-#else
-#define TSL_OH_NO_EXCEPTIONS
-#ifdef TSL_DEBUG
-#include <iostream>
-#define TSL_OH_THROW_OR_TERMINATE(ex, msg) \
-  do {                                     \
-    std::cerr << msg << std::endl;         \
-    std::terminate();                      \
-  } while (0)
-#else
-#define TSL_OH_THROW_OR_TERMINATE(ex, msg) std::terminate()
-#endif
+#ifndef TSL_OH_INSTRUMENT
+#define TSL_OH_INSTRUMENT(event, value) (static_cast<void>(0))
 #endif
 
 namespace tsl {
 
+/**
+ * Events passed to TSL_OH_INSTRUMENT.
+ */
+enum class ordered_hash_event {
+  /**
+   * A bucket is visited by a lookup or an insertion probe. The value is the
+   * distance of the bucket from the ideal bucket of the probe. With
+   * SimdProbing, a lookup fires the event once per scanned probe group.
+   */
+  probe_step,
+  /**
+   * Start of a rehash of the buckets, the value is the new bucket count.
+   */
+  rehash_start,
+  /**
+   * End of the rehash, the value is the new bucket count. With an incremental
+   * rehash, the migration of the old buckets happens after this event.
+   */
+  rehash_end,
+  /**
+   * A contiguous values container (e.g. std::vector) reallocated its storage
+   * on insertion, the value is its new capacity.
+   */
+  values_grow,
+  /**
+   * Start of a shift of the indexes stored in the buckets after an insertion
+   * or an erase in the middle of the values container. The value is the
+   * number of buckets to update.
+   */
+  shift_indexes_start,
+  /**
+   * End of the shift of the indexes, same value as shift_indexes_start.
+   */
+  shift_indexes_end
+};
+
+/**
+ * Statistics on the buckets and the memory of an ordered_map/set, see
+ * ordered_map::stats().
+ */
+struct ordered_hash_stats {
+  std::size_t size = 0;
+  std::size_t bucket_count = 0;
+  float load_factor = 0.0f;
+  float max_load_factor = 0.0f;
+
+  /**
+   * distance_histogram[d] is the number of values at a distance d of their
+   * ideal bucket.
+   */
+  std::vector<std::size_t> distance_histogram;
+
+  /**
+   * Number of buckets inspected by a successful lookup, average over the
+   * values and maximum.
+   */
+  double average_probe_length_hit = 0.0;
+  std::size_t max_probe_length_hit = 0;
+
+  /**
+   * Number of buckets inspected by an unsuccessful lookup, average over the
+   * possible ideal buckets and maximum.
+   */
+  double average_probe_length_miss = 0.0;
+  std::size_t max_probe_length_miss = 0;
+
+  /**
+   * Number of rehashes since the construction, and the number of growths
+   * caused by an insertion needing more than REHASH_ON_HIGH_NB_PROBES__NPROBES
+   * probes (a sign of a bad hash function).
+   */
+  std::size_t nb_rehashes = 0;
+  std::size_t nb_grows_on_high_nb_probes = 0;
+
+  /**
+   * Bytes allocated for the buckets (with the probe metadata and the arrays
+   * of an incremental rehash) and for the values.
+   */
+  std::size_t buckets_bytes = 0;
+  std::size_t values_bytes = 0;
+};
+
+/**
+ * Hash of a key computed beforehand, passed as first argument (after the
+ * position for emplace_at_position and try_emplace_at_position) to the
+ * variadic emplace and try_emplace methods of ordered_map and ordered_set to
+ * avoid hashing the key again. The other methods take the precalculated hash
+ * as a last std::size_t parameter, which would be ambiguous with the
+ * arguments of the value for the variadic methods.
+ *
+ * The hash must be the same as hash_function()(key).
+ */
+struct precalculated_hash_t {
+  explicit precalculated_hash_t(std::size_t hash_value) noexcept
+      : hash(hash_value) {}
+
+  std::size_t hash;
+};
+
+namespace oh {
+
+/**
+ * IndexType packing a bucket in a single std::uint64_t: an index of IndexBits
+ * bits, the distance of the bucket from its ideal bucket on 8 bits and the
+ * upper 56 - IndexBits bits of the hash (e.g. 16 bits with a 40 bits index, 8
+ * bits with a 48 bits index). The map is limited to 2^IndexBits - 2 values
+ * with 8 bytes buckets, where a std::uint64_t IndexType needs 16 bytes.
+ *
+ * The stored part of the hash only filters the key comparisons. The distance
+ * stored in the bucket replaces the computation of the ideal bucket from the
+ * stored hash on lookups and insertions, the hash of the keys is computed
+ * again from the values on rehash (and for the rare distances which don't fit
+ * in 8 bits). Hash must thus not throw.
+ */
+template <unsigned IndexBits>
+struct packed_index {
+  static_assert(IndexBits >= 24 && IndexBits <= 48,
+                "IndexBits must be in [24, 48].");
+};
+
+}  // end namespace oh
+
 namespace detail_ordered_hash {
 
 template <typename T>
@@ -110,6 +237,73 @@ struct is_vector<T,
                                     typename T::allocator_type>>::value>::type>
     : std::true_type {};
 
+/**
+ * True if T is a ValueTypeContainer where erased values only become
+ * tombstones (e.g. tsl::tombstone_deque), see ordered_hash.
+ */
+template <typename T, typename = void>
+struct has_tombstones : std::false_type {};
+
+template <typename T>
+struct has_tombstones<T, typename make_void<typename T::tombstone_tag>::type>
+    : std::true_type {};
+
+/**
+ * True if T is a ValueTypeContainer where inserting a value in the middle
+ * doesn't change the index of the other values (e.g. tsl::ranked_deque), see
+ * ordered_hash.
+ */
+template <typename T, typename = void>
+struct has_stable_indexes : std::false_type {};
+
+template <typename T>
+struct has_stable_indexes<
+    T, typename make_void<typename T::stable_index_tag>::type>
+    : std::true_type {};
+
+/**
+ * True if the values of type T can be serialized as raw bytes and deserialized
+ * into a default constructed T. std::pair isn't trivially copyable with all
+ * standard libraries due to its operator=, check its members instead.
+ */
+template <typename T>
+struct is_bulk_serializable
+    : std::integral_constant<bool,
+                             std::is_trivially_copyable<T>::value &&
+                                 std::is_default_constructible<T>::value> {};
+
+template <typename T1, typename T2>
+struct is_bulk_serializable<std::pair<T1, T2>>
+    : std::integral_constant<bool, is_bulk_serializable<T1>::value &&
+                                       is_bulk_serializable<T2>::value> {};
+
+/**
+ * True if Serializer supports `operator()(const char* data, std::size_t size)`
+ * to write a block of bytes.
+ */
+template <typename Serializer, typename = void>
+struct has_bulk_serializer : std::false_type {};
+
+template <typename Serializer>
+struct has_bulk_serializer<
+    Serializer, typename make_void<decltype(std::declval<Serializer&>()(
+                    std::declval<const char*>(),
+                    std::declval<std::size_t>()))>::type> : std::true_type {};
+
+/**
+ * True if Deserializer supports `operator()(char* data, std::size_t size)` to
+ * read a block of bytes.
+ */
+template <typename Deserializer, typename = void>
+struct has_bulk_deserializer : std::false_type {};
+
+template <typename Deserializer>
+struct has_bulk_deserializer<
+    Deserializer, typename make_void<decltype(std::declval<Deserializer&>()(
+                      std::declval<char*>(),
+                      std::declval<std::size_t>()))>::type> : std::true_type {
+};
+
 // Only available in C++17, we need to be compatible with C++11
 template <class T>
 const T& clamp(const T& v, const T& lo, const T& hi) {
@@ -163,8 +357,13 @@ static T deserialize_value(Deserializer& deserializer) {
  * The size of IndexType limits the size of the hash table to
  * std::numeric_limits<IndexType>::max() - 1 elements (-1 due to a reserved
  * value used to mark a bucket as empty).
+ *
+ * If StoreFullHash is true, the whole std::size_t hash is stored whatever the
+ * size of IndexType. A truncated hash can only address max_bucket_count()
+ * buckets on rehash and lets more keys with a different hash reach the key
+ * comparison.
  */
-template <class IndexType>
+template <class IndexType, bool StoreFullHash = false>
 class bucket_entry {
   static_assert(std::is_unsigned<IndexType>::value,
                 "IndexType must be an unsigned value.");
@@ -176,8 +375,8 @@ class bucket_entry {
  public:
   using index_type = IndexType;
   using truncated_hash_type = typename std::conditional<
-      std::numeric_limits<IndexType>::max() <=
-          std::numeric_limits<std::uint_least32_t>::max(),
+      !StoreFullHash && std::numeric_limits<IndexType>::max() <=
+                            std::numeric_limits<std::uint_least32_t>::max(),
       std::uint_least32_t, std::size_t>::type;
 
   bucket_entry() noexcept : m_index(EMPTY_MARKER_INDEX), m_hash(0) {}
@@ -191,11 +390,6 @@ class bucket_entry {
     return m_index;
   }
 
-  index_type& index_ref() noexcept {
-    tsl_oh_assert(!empty());
-    return m_index;
-  }
-
   void set_index(index_type index) noexcept {
     tsl_oh_assert(index <= max_size());
 
@@ -207,13 +401,16 @@ class bucket_entry {
     return m_hash;
   }
 
-  truncated_hash_type& truncated_hash_ref() noexcept {
-    tsl_oh_assert(!empty());
-    return m_hash;
-  }
-
   void set_hash(std::size_t hash) noexcept { m_hash = truncate_hash(hash); }
 
+  void set_truncated_hash(truncated_hash_type hash) noexcept { m_hash = hash; }
+
+  /**
+   * The distance from the ideal bucket is computed from the stored hash, see
+   * STORES_DISTANCE.
+   */
+  void set_distance(std::size_t /*distance*/) noexcept {}
+
   template <class Serializer>
   void serialize(Serializer& serializer) const {
     const slz_size_type index = m_index;
@@ -241,11 +438,41 @@ class bucket_entry {
     return truncated_hash_type(hash);
   }
 
+  /**
+   * Part of 'hash' mapped to the ideal bucket by the GrowthPolicy, the stored
+   * hash so that the buckets can be moved on rehash without the keys.
+   */
+  static std::size_t ideal_hash(std::size_t hash) noexcept {
+    return truncate_hash(hash);
+  }
+
   static std::size_t max_size() noexcept {
     return static_cast<std::size_t>(std::numeric_limits<index_type>::max()) -
            NB_RESERVED_INDEXES;
   }
 
+  /**
+   * Maximum number of buckets whose index can be computed from the stored
+   * hash, the buckets are moved on rehash with their stored hash only.
+   */
+  static std::size_t max_bucket_count() noexcept {
+    if (std::numeric_limits<truncated_hash_type>::max() >=
+        std::numeric_limits<std::size_t>::max()) {
+      return std::numeric_limits<std::size_t>::max();
+    }
+
+    return static_cast<std::size_t>(
+               std::numeric_limits<truncated_hash_type>::max()) +
+           1;
+  }
+
+ public:
+  /**
+   * False if the distance of a bucket from its ideal bucket is computed from
+   * its hash, true if it is stored in the bucket (see distance()).
+   */
+  static const bool STORES_DISTANCE = false;
+
  private:
   static const index_type EMPTY_MARKER_INDEX =
       std::numeric_limits<index_type>::max();
@@ -256,1139 +483,3440 @@ class bucket_entry {
 };
 
 /**
- * Internal common class used by ordered_map and ordered_set.
- *
- * ValueType is what will be stored by ordered_hash (usually std::pair<Key, T>
- * for map and Key for set).
- *
- * KeySelect should be a FunctionObject which takes a ValueType in parameter and
- * return a reference to the key.
- *
- * ValueSelect should be a FunctionObject which takes a ValueType in parameter
- * and return a reference to the value. ValueSelect should be void if there is
- * no value (in set for example).
- *
- * ValueTypeContainer is the container which will be used to store ValueType
- * values. Usually a std::deque<ValueType, Allocator> or std::vector<ValueType,
- * Allocator>.
- *
+ * bucket_entry of a tsl::oh::packed_index, a single std::uint64_t with from
+ * the lowest bits: the index, the distance from the ideal bucket and the upper
+ * bits of the hash.
  *
- *
- * The ordered_hash structure is a hash table which preserves the order of
- * insertion of the elements. To do so, it stores the values in the
- * ValueTypeContainer (m_values) using emplace_back at each insertion of a new
- * element. Another structure (m_buckets of type std::vector<bucket_entry>) will
- * serve as buckets array for the hash table part. Each bucket stores an index
- * which corresponds to the index in m_values where the bucket's value is and
- * the (truncated) hash of this value. An index is used instead of a pointer to
- * the value to reduce the size of each bucket entry.
- *
- * To resolve collisions in the buckets array, the structures use robin hood
- * linear probing with backward shift deletion.
+ * The hash isn't enough to find the ideal bucket of a value, only the
+ * ordered_hash can through the key of the value (see ideal_hash). The distance
+ * is thus stored and must be updated each time a bucket is moved,
+ * DISTANCE_OVERFLOW marks a distance too long to be stored.
  */
-template <class ValueType, class KeySelect, class ValueSelect, class Hash,
-          class KeyEqual, class Allocator, class ValueTypeContainer,
-          class IndexType>
-class ordered_hash : private Hash, private KeyEqual {
- private:
-  template <typename U>
-  using has_mapped_type =
-      typename std::integral_constant<bool, !std::is_same<U, void>::value>;
-
-  static_assert(
-      std::is_same<typename ValueTypeContainer::value_type, ValueType>::value,
-      "ValueTypeContainer::value_type != ValueType. "
-      "Check that the ValueTypeContainer has 'Key' as type for a set or "
-      "'std::pair<Key, T>' as type for a map.");
+template <unsigned IndexBits, bool StoreFullHash>
+class bucket_entry<tsl::oh::packed_index<IndexBits>, StoreFullHash> {
+  static_assert(!StoreFullHash,
+                "StoreFullHash isn't supported with a packed_index.");
+
+  static const unsigned DISTANCE_BITS = 8;
+  static const unsigned HASH_BITS = 64 - IndexBits - DISTANCE_BITS;
+  static const unsigned HASH_SHIFT = IndexBits + DISTANCE_BITS;
+  static const std::uint64_t INDEX_MASK =
+      (std::uint64_t(1) << IndexBits) - 1;
+  static const std::uint64_t DISTANCE_MASK =
+      ((std::uint64_t(1) << DISTANCE_BITS) - 1) << IndexBits;
 
-  static_assert(std::is_same<typename ValueTypeContainer::allocator_type,
-                             Allocator>::value,
-                "ValueTypeContainer::allocator_type != Allocator. "
-                "Check that the allocator for ValueTypeContainer is the same "
-                "as Allocator.");
+ public:
+  using index_type = std::uint64_t;
+  using truncated_hash_type = std::uint_least32_t;
 
-  static_assert(std::is_same<typename Allocator::value_type, ValueType>::value,
-                "Allocator::value_type != ValueType. "
-                "Check that the allocator has 'Key' as type for a set or "
-                "'std::pair<Key, T>' as type for a map.");
+  static const bool STORES_DISTANCE = true;
+  static const std::size_t DISTANCE_OVERFLOW =
+      (std::size_t(1) << DISTANCE_BITS) - 1;
 
- public:
-  template <bool IsConst>
-  class ordered_iterator;
+  bucket_entry() noexcept : m_data(EMPTY_MARKER_INDEX) {}
 
-  using key_type = typename KeySelect::key_type;
-  using value_type = ValueType;
-  using size_type = std::size_t;
-  using difference_type = std::ptrdiff_t;
-  using hasher = Hash;
-  using key_equal = KeyEqual;
-  using allocator_type = Allocator;
-  using reference = value_type&;
-  using const_reference = const value_type&;
-  using pointer = value_type*;
-  using const_pointer = const value_type*;
-  using iterator = ordered_iterator<false>;
-  using const_iterator = ordered_iterator<true>;
-  using reverse_iterator = std::reverse_iterator<iterator>;
-  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  bool empty() const noexcept {
+    return (m_data & INDEX_MASK) == EMPTY_MARKER_INDEX;
+  }
 
-  using values_container_type = ValueTypeContainer;
+  void clear() noexcept { m_data = EMPTY_MARKER_INDEX; }
 
- public:
-  template <bool IsConst>
-  class ordered_iterator {
-    friend class ordered_hash;
+  index_type index() const noexcept {
+    tsl_oh_assert(!empty());
+    return m_data & INDEX_MASK;
+  }
 
-   private:
-    using iterator = typename std::conditional<
-        IsConst, typename values_container_type::const_iterator,
-        typename values_container_type::iterator>::type;
+  void set_index(index_type index) noexcept {
+    tsl_oh_assert(index <= max_size());
 
-    ordered_iterator(iterator it) noexcept : m_iterator(it) {}
+    m_data = (m_data & ~INDEX_MASK) | index;
+  }
 
-   public:
-    using iterator_category = std::random_access_iterator_tag;
-    using value_type = const typename ordered_hash::value_type;
-    using difference_type = typename iterator::difference_type;
-    using reference = value_type&;
-    using pointer = value_type*;
+  truncated_hash_type truncated_hash() const noexcept {
+    tsl_oh_assert(!empty());
+    return truncated_hash_type(m_data >> HASH_SHIFT);
+  }
 
-    ordered_iterator() noexcept {}
+  void set_hash(std::size_t hash) noexcept {
+    set_truncated_hash(truncate_hash(hash));
+  }
 
-    // Copy constructor from iterator to const_iterator.
-    template <bool TIsConst = IsConst,
-              typename std::enable_if<TIsConst>::type* = nullptr>
-    ordered_iterator(const ordered_iterator<!TIsConst>& other) noexcept
-        : m_iterator(other.m_iterator) {}
+  void set_truncated_hash(truncated_hash_type hash) noexcept {
+    m_data = (m_data & (INDEX_MASK | DISTANCE_MASK)) |
+             (std::uint64_t(hash) << HASH_SHIFT);
+  }
 
-    ordered_iterator(const ordered_iterator& other) = default;
-    ordered_iterator(ordered_iterator&& other) = default;
-    ordered_iterator& operator=(const ordered_iterator& other) = default;
-    ordered_iterator& operator=(ordered_iterator&& other) = default;
+  /**
+   * Distance from the ideal bucket, DISTANCE_OVERFLOW if it is
+   * >= DISTANCE_OVERFLOW.
+   */
+  std::size_t distance() const noexcept {
+    tsl_oh_assert(!empty());
+    return std::size_t((m_data & DISTANCE_MASK) >> IndexBits);
+  }
 
-    const typename ordered_hash::key_type& key() const {
-      return KeySelect()(*m_iterator);
+  void set_distance(std::size_t distance) noexcept {
+    if (distance > DISTANCE_OVERFLOW) {
+      distance = DISTANCE_OVERFLOW;
     }
 
-    template <class U = ValueSelect,
-              typename std::enable_if<has_mapped_type<U>::value &&
-                                      IsConst>::type* = nullptr>
-    const typename U::value_type& value() const {
-      return U()(*m_iterator);
-    }
+    m_data = (m_data & ~DISTANCE_MASK) | (std::uint64_t(distance) << IndexBits);
+  }
 
-    template <class U = ValueSelect,
-              typename std::enable_if<has_mapped_type<U>::value &&
-                                      !IsConst>::type* = nullptr>
-    typename U::value_type& value() {
-      return U()(*m_iterator);
-    }
+  /**
+   * Serialize the index and, as the hash, the distance with the hash bits.
+   */
+  template <class Serializer>
+  void serialize(Serializer& serializer) const {
+    const slz_size_type index = m_data & INDEX_MASK;
+    serializer(index);
 
-    reference operator*() const { return *m_iterator; }
-    pointer operator->() const { return m_iterator.operator->(); }
+    const slz_size_type hash = m_data >> IndexBits;
+    serializer(hash);
+  }
 
-    ordered_iterator& operator++() {
-      ++m_iterator;
-      return *this;
-    }
-    ordered_iterator& operator--() {
-      --m_iterator;
-      return *this;
+  template <class Deserializer>
+  static bucket_entry deserialize(Deserializer& deserializer) {
+    const slz_size_type index = deserialize_value<slz_size_type>(deserializer);
+    const slz_size_type hash = deserialize_value<slz_size_type>(deserializer);
+    if (index > INDEX_MASK || hash >> (64 - IndexBits) != 0) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                "Deserialized bucket is invalid.");
     }
 
-    ordered_iterator operator++(int) {
-      ordered_iterator tmp(*this);
-      ++(*this);
-      return tmp;
-    }
-    ordered_iterator operator--(int) {
-      ordered_iterator tmp(*this);
-      --(*this);
-      return tmp;
-    }
+    bucket_entry bentry;
+    bentry.m_data = index | (hash << IndexBits);
 
-    reference operator[](difference_type n) const { return m_iterator[n]; }
+    return bentry;
+  }
 
-    ordered_iterator& operator+=(difference_type n) {
-      m_iterator += n;
-      return *this;
-    }
-    ordered_iterator& operator-=(difference_type n) {
-      m_iterator -= n;
-      return *this;
-    }
+  /**
+   * The upper HASH_BITS bits of the hash, the lower ones usually select the
+   * ideal bucket and wouldn't filter the keys of a probe.
+   */
+  static truncated_hash_type truncate_hash(std::size_t hash) noexcept {
+    return (sizeof(std::size_t) * CHAR_BIT > HASH_BITS)
+               ? truncated_hash_type(hash >> (sizeof(std::size_t) * CHAR_BIT -
+                                              HASH_BITS))
+               : truncated_hash_type(hash);
+  }
 
-    ordered_iterator operator+(difference_type n) {
-      ordered_iterator tmp(*this);
-      tmp += n;
-      return tmp;
-    }
-    ordered_iterator operator-(difference_type n) {
-      ordered_iterator tmp(*this);
-      tmp -= n;
-      return tmp;
-    }
+  /**
+   * The whole hash, the ordered_hash computes it again from the key of the
+   * value on rehash.
+   */
+  static std::size_t ideal_hash(std::size_t hash) noexcept { return hash; }
 
-    friend bool operator==(const ordered_iterator& lhs,
-                           const ordered_iterator& rhs) {
-      return lhs.m_iterator == rhs.m_iterator;
-    }
+  static std::size_t max_size() noexcept {
+    return std::size_t(
+        std::min<std::uint64_t>(INDEX_MASK - NB_RESERVED_INDEXES,
+                                std::numeric_limits<std::size_t>::max()));
+  }
 
-    friend bool operator!=(const ordered_iterator& lhs,
-                           const ordered_iterator& rhs) {
-      return lhs.m_iterator != rhs.m_iterator;
-    }
+  static std::size_t max_bucket_count() noexcept {
+    return std::numeric_limits<std::size_t>::max();
+  }
 
-    friend bool operator<(const ordered_iterator& lhs,
-                          const ordered_iterator& rhs) {
-      return lhs.m_iterator < rhs.m_iterator;
-    }
+ private:
+  static const std::uint64_t EMPTY_MARKER_INDEX = INDEX_MASK;
+  static const std::uint64_t NB_RESERVED_INDEXES = 1;
 
-    friend bool operator>(const ordered_iterator& lhs,
-                          const ordered_iterator& rhs) {
-      return lhs.m_iterator > rhs.m_iterator;
-    }
+  std::uint64_t m_data;
+};
 
-    friend bool operator<=(const ordered_iterator& lhs,
-                           const ordered_iterator& rhs) {
-      return lhs.m_iterator <= rhs.m_iterator;
-    }
+/**
+ * Return the index of the lowest set bit of a non-zero mask.
+ */
+inline std::size_t count_trailing_zeros(std::uint32_t mask) noexcept {
+  tsl_oh_assert(mask != 0);
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return std::size_t(index);
+#elif defined(__GNUC__) || defined(__clang__)
+  return std::size_t(__builtin_ctz(mask));
+#else
+  std::size_t index = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    index++;
+  }
+  return index;
+#endif
+}
 
-    friend bool operator>=(const ordered_iterator& lhs,
-                           const ordered_iterator& rhs) {
-      return lhs.m_iterator >= rhs.m_iterator;
+/**
+ * Scan WIDTH consecutive entries of the probe metadata kept by an ordered_hash
+ * with SimdProbing. Each bucket has a distance byte, 0 if the bucket is empty
+ * and min(distance_from_ideal_bucket, MAX_DISTANCE) + 1 otherwise, and a
+ * fingerprint byte computed from the hash of its value.
+ *
+ * scan(...) sets bit j of 'stop' if the bucket j of the group ends the robin
+ * hood probe of a value which is at 'dist_from_ideal_bucket' when reaching the
+ * first bucket of the group (the bucket is empty or has a distance lower than
+ * dist_from_ideal_bucket + j), and bit j of 'match' if the fingerprint of the
+ * bucket j is equal to 'fingerprint'.
+ *
+ * The caller must ensure that dist_from_ideal_bucket + WIDTH <= MAX_DISTANCE
+ * so that the expected distances of the group fit in a byte.
+ */
+struct probe_group {
+  using mask_type = std::uint32_t;
+
+  static const std::size_t MAX_DISTANCE = 254;
+#if defined(TSL_OH_AVX2)
+  static const std::size_t WIDTH = 32;
+#elif defined(TSL_OH_SSE2)
+  static const std::size_t WIDTH = 16;
+#else
+  static const std::size_t WIDTH = 8;
+#endif
+  /**
+   * Number of metadata bytes mirrored after the last bucket so that a group
+   * starting at any bucket can be loaded without wrapping. Independent of the
+   * instruction set to keep the same layout whatever the compilation flags.
+   */
+  static const std::size_t MIRRORED_BYTES = 32;
+
+  static void scan(const std::uint8_t* distances,
+                   const std::uint8_t* fingerprints,
+                   std::size_t dist_from_ideal_bucket, std::uint8_t fingerprint,
+                   mask_type& stop, mask_type& match) noexcept {
+    tsl_oh_assert(dist_from_ideal_bucket + WIDTH <= MAX_DISTANCE);
+#if defined(TSL_OH_AVX2)
+    const __m256i expected = _mm256_add_epi8(
+        _mm256_set1_epi8(static_cast<char>(dist_from_ideal_bucket + 1)),
+        _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                         16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+                         29, 30, 31));
+    const __m256i dists = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(distances));
+    const __m256i fps = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(fingerprints));
+
+    // dists >= expected <=> max(dists, expected) == dists
+    const __m256i no_stop =
+        _mm256_cmpeq_epi8(_mm256_max_epu8(dists, expected), dists);
+    stop = ~mask_type(_mm256_movemask_epi8(no_stop));
+    match = mask_type(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        fps, _mm256_set1_epi8(static_cast<char>(fingerprint)))));
+#elif defined(TSL_OH_SSE2)
+    const __m128i expected = _mm_add_epi8(
+        _mm_set1_epi8(static_cast<char>(dist_from_ideal_bucket + 1)),
+        _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __m128i dists =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(distances));
+    const __m128i fps =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(fingerprints));
+
+    // dists >= expected <=> max(dists, expected) == dists
+    const __m128i no_stop =
+        _mm_cmpeq_epi8(_mm_max_epu8(dists, expected), dists);
+    stop = ~mask_type(_mm_movemask_epi8(no_stop)) & 0xFFFFu;
+    match = mask_type(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(fps, _mm_set1_epi8(static_cast<char>(fingerprint)))));
+#else
+    stop = 0;
+    match = 0;
+    for (std::size_t j = 0; j < WIDTH; j++) {
+      if (distances[j] < dist_from_ideal_bucket + 1 + j) {
+        stop |= mask_type(1) << j;
+      }
+      if (fingerprints[j] == fingerprint) {
+        match |= mask_type(1) << j;
+      }
     }
+#endif
+  }
+};
 
-    friend ordered_iterator operator+(difference_type n,
-                                      const ordered_iterator& it) {
-      return n + it.m_iterator;
-    }
+/**
+ * Hint the CPU to start loading the cache line containing 'ptr'. No-op if the
+ * compiler doesn't provide a prefetch intrinsic.
+ */
+inline void prefetch(const void* ptr) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+  static_cast<void>(ptr);
+#endif
+}
 
-    friend difference_type operator-(const ordered_iterator& lhs,
-                                     const ordered_iterator& rhs) {
-      return lhs.m_iterator - rhs.m_iterator;
+/**
+ * Call task(i) for each i in [0, nb_tasks), task(0) on the current thread and
+ * the others on new threads. Return once all the tasks are done, also if
+ * starting a thread throws.
+ */
+template <class Function>
+void parallel_for(std::size_t nb_tasks, const Function& task) {
+  tsl_oh_assert(nb_tasks > 0);
+
+  struct thread_joiner {
+    ~thread_joiner() {
+      for (std::thread& thread : threads) {
+        thread.join();
+      }
     }
 
-   private:
-    iterator m_iterator;
-  };
+    std::vector<std::thread> threads;
+  } joiner;
 
- private:
-  using bucket_entry = tsl::detail_ordered_hash::bucket_entry<IndexType>;
+  joiner.threads.reserve(nb_tasks - 1);
+  for (std::size_t i = 1; i < nb_tasks; i++) {
+    joiner.threads.emplace_back([&task, i]() { task(i); });
+  }
 
-  using buckets_container_allocator = typename std::allocator_traits<
-      allocator_type>::template rebind_alloc<bucket_entry>;
+  task(0);
+}
 
-  using buckets_container_type =
-      std::vector<bucket_entry, buckets_container_allocator>;
+/**
+ * Fixed size array of buckets, only a pointer and a size. The buckets are
+ * allocated with BucketAllocator (rebound to BucketEntry) and, BucketEntry
+ * being trivially destructible, only deallocated on destruction.
+ *
+ * An empty array points to a static empty bucket instead of nullptr. It spares
+ * the lookups in an empty ordered_hash a check of the size before reading the
+ * bucket at the ideal position.
+ *
+ * The buckets of an array allocated with the std::false_type 'initialize' tag
+ * must be constructed with construct_buckets before being read.
+ */
+template <class BucketEntry, class BucketAllocator>
+class bucket_array : private BucketAllocator {
+  static_assert(std::is_trivially_destructible<BucketEntry>::value,
+                "The buckets must be trivially destructible.");
+  static_assert(
+      std::is_same<typename std::allocator_traits<BucketAllocator>::pointer,
+                   BucketEntry*>::value,
+      "The bucket allocator must allocate raw pointers.");
 
-  using truncated_hash_type = typename bucket_entry::truncated_hash_type;
-  using index_type = typename bucket_entry::index_type;
+  using allocator_traits = std::allocator_traits<BucketAllocator>;
 
  public:
-  ordered_hash(size_type bucket_count, const Hash& hash, const KeyEqual& equal,
-               const Allocator& alloc, float max_load_factor)
-      : Hash(hash),
-        KeyEqual(equal),
-        m_buckets_data(alloc),
+  using value_type = BucketEntry;
+  using allocator_type = BucketAllocator;
+  using size_type = std::size_t;
+  using iterator = BucketEntry*;
+  using const_iterator = const BucketEntry*;
+
+  explicit bucket_array(const allocator_type& alloc) noexcept
+      : BucketAllocator(alloc),
         m_buckets(static_empty_bucket_ptr()),
-        m_hash_mask(0),
-        m_values(alloc),
-        m_grow_on_next_insert(false) {
-    if (bucket_count > max_bucket_count()) {
-      TSL_OH_THROW_OR_TERMINATE(std::length_error,
-                                "The map exceeds its maximum size.");
-    }
+        m_size(0) {}
 
-    if (bucket_count > 0) {
-      bucket_count = round_up_to_power_of_two(bucket_count);
+  bucket_array(size_type size, const allocator_type& alloc)
+      : bucket_array(size, alloc, std::false_type()) {
+    construct_buckets(0, size);
+  }
 
-      m_buckets_data.resize(bucket_count);
-      m_buckets = m_buckets_data.data(), m_hash_mask = bucket_count - 1;
+  bucket_array(size_type size, const allocator_type& alloc,
+               std::false_type /*initialize*/)
+      : bucket_array(alloc) {
+    if (size > 0) {
+      m_buckets = allocator_traits::allocate(allocator(), size);
+      m_size = size;
     }
-
-    this->max_load_factor(max_load_factor);
   }
 
-  ordered_hash(const ordered_hash& other)
-      : Hash(other),
-        KeyEqual(other),
-        m_buckets_data(other.m_buckets_data),
-        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data()),
-        m_hash_mask(other.m_hash_mask),
-        m_values(other.m_values),
-        m_load_threshold(other.m_load_threshold),
-        m_max_load_factor(other.m_max_load_factor),
-        m_grow_on_next_insert(other.m_grow_on_next_insert) {}
+  bucket_array(const bucket_array& other)
+      : bucket_array(other.m_size,
+                     allocator_traits::select_on_container_copy_construction(
+                         other.allocator()),
+                     std::false_type()) {
+    copy_buckets(other);
+  }
 
-  ordered_hash(ordered_hash&& other) noexcept(
-      std::is_nothrow_move_constructible<
-          Hash>::value&& std::is_nothrow_move_constructible<KeyEqual>::value&&
-          std::is_nothrow_move_constructible<buckets_container_type>::value&&
-              std::is_nothrow_move_constructible<values_container_type>::value)
-      : Hash(std::move(static_cast<Hash&>(other))),
-        KeyEqual(std::move(static_cast<KeyEqual&>(other))),
-        m_buckets_data(std::move(other.m_buckets_data)),
-        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data()),
-        m_hash_mask(other.m_hash_mask),
-        m_values(std::move(other.m_values)),
-        m_load_threshold(other.m_load_threshold),
-        m_max_load_factor(other.m_max_load_factor),
-        m_grow_on_next_insert(other.m_grow_on_next_insert) {
-    other.m_buckets_data.clear();
+  bucket_array(bucket_array&& other) noexcept
+      : BucketAllocator(std::move(other.allocator())),
+        m_buckets(other.m_buckets),
+        m_size(other.m_size) {
     other.m_buckets = static_empty_bucket_ptr();
-    other.m_hash_mask = 0;
-    other.m_values.clear();
-    other.m_load_threshold = 0;
-    other.m_grow_on_next_insert = false;
+    other.m_size = 0;
   }
 
-  ordered_hash& operator=(const ordered_hash& other) {
+  bucket_array& operator=(const bucket_array& other) {
     if (&other != this) {
-      Hash::operator=(other);
-      KeyEqual::operator=(other);
-
-      m_buckets_data = other.m_buckets_data;
-      m_buckets = m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data();
-
-      m_hash_mask = other.m_hash_mask;
-      m_values = other.m_values;
-      m_load_threshold = other.m_load_threshold;
-      m_max_load_factor = other.m_max_load_factor;
-      m_grow_on_next_insert = other.m_grow_on_next_insert;
+      bucket_array buckets(other.m_size, allocator(), std::false_type());
+      buckets.copy_buckets(other);
+      swap(buckets);
     }
 
     return *this;
   }
 
-  ordered_hash& operator=(ordered_hash&& other) {
-    other.swap(*this);
-    other.clear();
-
+  bucket_array& operator=(bucket_array&& other) noexcept {
+    swap(other);
     return *this;
   }
 
-  allocator_type get_allocator() const { return m_values.get_allocator(); }
-
-  /*
-   * Iterators
-   */
-  iterator begin() noexcept { return iterator(m_values.begin()); }
-
-  const_iterator begin() const noexcept { return cbegin(); }
-
-  const_iterator cbegin() const noexcept {
-    return const_iterator(m_values.cbegin());
-  }
+  ~bucket_array() { deallocate(); }
 
-  iterator end() noexcept { return iterator(m_values.end()); }
+  allocator_type get_allocator() const { return allocator(); }
 
-  const_iterator end() const noexcept { return cend(); }
+  iterator begin() noexcept { return m_buckets; }
+  const_iterator begin() const noexcept { return m_buckets; }
+  const_iterator cbegin() const noexcept { return m_buckets; }
 
-  const_iterator cend() const noexcept {
-    return const_iterator(m_values.cend());
-  }
+  iterator end() noexcept { return m_buckets + m_size; }
+  const_iterator end() const noexcept { return m_buckets + m_size; }
+  const_iterator cend() const noexcept { return m_buckets + m_size; }
 
-  reverse_iterator rbegin() noexcept {
-    return reverse_iterator(m_values.end());
-  }
+  BucketEntry* data() noexcept { return m_buckets; }
+  const BucketEntry* data() const noexcept { return m_buckets; }
 
-  const_reverse_iterator rbegin() const noexcept { return rcbegin(); }
+  bool empty() const noexcept { return m_size == 0; }
+  size_type size() const noexcept { return m_size; }
 
-  const_reverse_iterator rcbegin() const noexcept {
-    return const_reverse_iterator(m_values.cend());
+  size_type max_size() const noexcept {
+    return allocator_traits::max_size(allocator());
   }
 
-  reverse_iterator rend() noexcept {
-    return reverse_iterator(m_values.begin());
+  /**
+   * The bucket 0 of an empty array is the static empty bucket.
+   */
+  BucketEntry& operator[](size_type i) noexcept {
+    tsl_oh_assert(i < m_size || i == 0);
+    return m_buckets[i];
   }
 
-  const_reverse_iterator rend() const noexcept { return rcend(); }
-
-  const_reverse_iterator rcend() const noexcept {
-    return const_reverse_iterator(m_values.cbegin());
+  const BucketEntry& operator[](size_type i) const noexcept {
+    tsl_oh_assert(i < m_size || i == 0);
+    return m_buckets[i];
   }
 
-  /*
-   * Capacity
+  /**
+   * Construct the empty buckets [first, last).
    */
-  bool empty() const noexcept { return m_values.empty(); }
-
-  size_type size() const noexcept { return m_values.size(); }
-
-  size_type max_size() const noexcept {
-    return std::min(bucket_entry::max_size(), m_values.max_size());
+  void construct_buckets(size_type first, size_type last) {
+    tsl_oh_assert(first <= last && last <= m_size);
+    for (size_type i = first; i < last; i++) {
+      allocator_traits::construct(allocator(), m_buckets + i);
+    }
   }
 
-  /*
-   * Modifiers
+  /**
+   * Free the buckets, the array is then empty.
    */
   void clear() noexcept {
-    for (auto& bucket : m_buckets_data) {
-      bucket.clear();
-    }
-
-    m_values.clear();
-    m_grow_on_next_insert = false;
+    deallocate();
+    m_buckets = static_empty_bucket_ptr();
+    m_size = 0;
   }
 
-  template <typename P>
-  std::pair<iterator, bool> insert(P&& value) {
-    return insert_impl(KeySelect()(value), std::forward<P>(value));
+  void swap(bucket_array& other) noexcept {
+    using std::swap;
+    swap(allocator(), other.allocator());
+    swap(m_buckets, other.m_buckets);
+    swap(m_size, other.m_size);
   }
 
-  template <typename P>
-  iterator insert_hint(const_iterator hint, P&& value) {
-    if (hint != cend() &&
-        compare_keys(KeySelect()(*hint), KeySelect()(value))) {
-      return mutable_iterator(hint);
+ private:
+  allocator_type& allocator() noexcept { return *this; }
+  const allocator_type& allocator() const noexcept { return *this; }
+
+  void copy_buckets(const bucket_array& other) {
+    tsl_oh_assert(m_size == other.m_size);
+    for (size_type i = 0; i < m_size; i++) {
+      allocator_traits::construct(allocator(), m_buckets + i,
+                                  other.m_buckets[i]);
     }
-
-    return insert(std::forward<P>(value)).first;
   }
 
-  template <class InputIt>
-  void insert(InputIt first, InputIt last) {
-    if (std::is_base_of<
-            std::forward_iterator_tag,
-            typename std::iterator_traits<InputIt>::iterator_category>::value) {
-      const auto nb_elements_insert = std::distance(first, last);
-      const size_type nb_free_buckets = m_load_threshold - size();
-      tsl_oh_assert(m_load_threshold >= size());
-
-      if (nb_elements_insert > 0 &&
-          nb_free_buckets < size_type(nb_elements_insert)) {
-        reserve(size() + size_type(nb_elements_insert));
-      }
+  void deallocate() noexcept {
+    if (m_size > 0) {
+      allocator_traits::deallocate(allocator(), m_buckets, m_size);
     }
+  }
 
-    for (; first != last; ++first) {
-      insert(*first);
-    }
+  /**
+   * Return an always valid pointer to a static empty bucket.
+   */
+  static BucketEntry* static_empty_bucket_ptr() noexcept {
+    static BucketEntry empty_bucket;
+    return &empty_bucket;
   }
 
-  template <class K, class M>
-  std::pair<iterator, bool> insert_or_assign(K&& key, M&& value) {
-    auto it = try_emplace(std::forward<K>(key), std::forward<M>(value));
-    if (!it.second) {
-      it.first.value() = std::forward<M>(value);
-    }
+ private:
+  BucketEntry* m_buckets;
+  size_type m_size;
+};
 
-    return it;
-  }
+/**
+ * Placeholder for the probe metadata of an ordered_hash without SimdProbing.
+ */
+struct no_probe_metadata {
+  no_probe_metadata() = default;
 
-  template <class K, class M>
+  template <class Allocator>
+  explicit no_probe_metadata(const Allocator& /*alloc*/) noexcept {}
+
+  void clear() noexcept {}
+
+  std::size_t capacity() const noexcept { return 0; }
+};
+
+/**
+ * Internal common class used by ordered_map and ordered_set.
+ *
+ * ValueType is what will be stored by ordered_hash (usually std::pair<Key, T>
+ * for map and Key for set).
+ *
+ * KeySelect should be a FunctionObject which takes a ValueType in parameter and
+ * return a reference to the key.
+ *
+ * ValueSelect should be a FunctionObject which takes a ValueType in parameter
+ * and return a reference to the value. ValueSelect should be void if there is
+ * no value (in set for example).
+ *
+ * ValueTypeContainer is the container which will be used to store ValueType
+ * values. Usually a std::deque<ValueType, Allocator> or std::vector<ValueType,
+ * Allocator>.
+ *
+ *
+ *
+ * The ordered_hash structure is a hash table which preserves the order of
+ * insertion of the elements. To do so, it stores the values in the
+ * ValueTypeContainer (m_values) using emplace_back at each insertion of a new
+ * element. Another structure (m_buckets, a bucket_array of bucket_entry) will
+ * serve as buckets array for the hash table part. Each bucket stores an index
+ * which corresponds to the index in m_values where the bucket's value is and
+ * the (truncated unless StoreFullHash is true) hash of this value. An index is
+ * used instead of a pointer to the value to reduce the size of each bucket
+ * entry.
+ *
+ * To resolve collisions in the buckets array, the structures use robin hood
+ * linear probing with backward shift deletion.
+ *
+ * With a tsl::oh::packed_index IndexType, a bucket only keeps a part of the
+ * hash and stores its distance from its ideal bucket instead, which must be
+ * updated each time the bucket moves. The ideal bucket of a value is computed
+ * from the hash of its key when needed (see ideal_hash).
+ *
+ * If SimdProbing is true, a probe metadata array (m_probe_metadata) is kept
+ * besides the buckets array. It stores for each bucket a byte with its distance
+ * from its ideal bucket and a byte fingerprint of its hash. Lookups scan this
+ * array probe_group::WIDTH buckets at a time with SSE2/AVX2 (or a scalar
+ * fallback) and only touch the bucket_entry and the value of the buckets with
+ * a matching fingerprint. It costs two extra bytes per bucket.
+ *
+ * If ValueTypeContainer has tombstones (see has_tombstones), erasing a value
+ * only marks its slot as a tombstone in m_values instead of shifting the values
+ * on its right, the indexes in the buckets thus stay valid and the erase is in
+ * O(1). The indexes stored in the buckets are raw indexes, tombstones
+ * included. Once the tombstones reach COMPACT_TOMBSTONES__RATIO of the number
+ * of slots plus the number of buckets, m_values is compacted and the indexes
+ * remapped in O(m_values.raw_size() + bucket_count()), which keeps the erase in
+ * O(1) amortized.
+ *
+ * If ValueTypeContainer also has stable indexes (see has_stable_indexes), a
+ * value inserted with insert_at_position gets a new slot at the end of m_values
+ * and is only linked at its position in the order of m_values. No index needs
+ * to be shifted in the buckets and the raw indexes are no longer in iteration
+ * order until the next compaction.
+ *
+ * If incremental_rehash(n) is set with n > 0, growing the map doesn't
+ * reinsert all the buckets at once. The previous buckets array is kept in
+ * m_old_buckets, a valid robin hood array of its own, and up to n of its
+ * buckets are migrated to m_buckets on each insertion and non-const
+ * lookup. A value is either in m_buckets or in m_old_buckets, the lookups
+ * check m_old_buckets on a miss in m_buckets.
+ *
+ * GrowthPolicy maps a hash to its ideal bucket and chooses the bucket counts,
+ * see tsl::oh::power_of_two_growth_policy. The policy of m_old_buckets is kept
+ * in m_old_growth_policy during an incremental rehash.
+ *
+ * The buckets arrays (and the probe metadata) are allocated with
+ * BucketAllocator, rebound to bucket_entry, instead of Allocator. It allows to
+ * put the buckets, which are randomly accessed on each lookup, in another
+ * memory pool than the values (e.g. huge pages). By default BucketAllocator is
+ * Allocator.
+ */
+template <class ValueType, class KeySelect, class ValueSelect, class Hash,
+          class KeyEqual, class Allocator, class ValueTypeContainer,
+          class IndexType, bool SimdProbing = false,
+          bool StoreFullHash = false,
+          class GrowthPolicy = tsl::oh::power_of_two_growth_policy,
+          class BucketAllocator = Allocator>
+class ordered_hash : private Hash, private KeyEqual, private GrowthPolicy {
+ private:
+  template <typename U>
+  using has_mapped_type =
+      typename std::integral_constant<bool, !std::is_same<U, void>::value>;
+
+  static_assert(
+      std::is_same<typename ValueTypeContainer::value_type, ValueType>::value,
+      "ValueTypeContainer::value_type != ValueType. "
+      "Check that the ValueTypeContainer has 'Key' as type for a set or "
+      "'std::pair<Key, T>' as type for a map.");
+
+  static_assert(std::is_same<typename ValueTypeContainer::allocator_type,
+                             Allocator>::value,
+                "ValueTypeContainer::allocator_type != Allocator. "
+                "Check that the allocator for ValueTypeContainer is the same "
+                "as Allocator.");
+
+  static_assert(std::is_same<typename Allocator::value_type, ValueType>::value,
+                "Allocator::value_type != ValueType. "
+                "Check that the allocator has 'Key' as type for a set or "
+                "'std::pair<Key, T>' as type for a map.");
+
+ public:
+  template <bool IsConst>
+  class ordered_iterator;
+
+  using key_type = typename KeySelect::key_type;
+  using value_type = ValueType;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+  using iterator = ordered_iterator<false>;
+  using const_iterator = ordered_iterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  using values_container_type = ValueTypeContainer;
+
+ public:
+  template <bool IsConst>
+  class ordered_iterator {
+    friend class ordered_hash;
+
+   private:
+    using iterator = typename std::conditional<
+        IsConst, typename values_container_type::const_iterator,
+        typename values_container_type::iterator>::type;
+
+    ordered_iterator(iterator it) noexcept : m_iterator(it) {}
+
+   public:
+    using iterator_category =
+        typename std::iterator_traits<iterator>::iterator_category;
+    using value_type = const typename ordered_hash::value_type;
+    using difference_type = typename iterator::difference_type;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    ordered_iterator() noexcept {}
+
+    // Copy constructor from iterator to const_iterator.
+    template <bool TIsConst = IsConst,
+              typename std::enable_if<TIsConst>::type* = nullptr>
+    ordered_iterator(const ordered_iterator<!TIsConst>& other) noexcept
+        : m_iterator(other.m_iterator) {}
+
+    ordered_iterator(const ordered_iterator& other) = default;
+    ordered_iterator(ordered_iterator&& other) = default;
+    ordered_iterator& operator=(const ordered_iterator& other) = default;
+    ordered_iterator& operator=(ordered_iterator&& other) = default;
+
+    const typename ordered_hash::key_type& key() const {
+      return KeySelect()(*m_iterator);
+    }
+
+    template <class U = ValueSelect,
+              typename std::enable_if<has_mapped_type<U>::value &&
+                                      IsConst>::type* = nullptr>
+    const typename U::value_type& value() const {
+      return U()(*m_iterator);
+    }
+
+    template <class U = ValueSelect,
+              typename std::enable_if<has_mapped_type<U>::value &&
+                                      !IsConst>::type* = nullptr>
+    typename U::value_type& value() {
+      return U()(*m_iterator);
+    }
+
+    reference operator*() const { return *m_iterator; }
+    pointer operator->() const { return m_iterator.operator->(); }
+
+    ordered_iterator& operator++() {
+      ++m_iterator;
+      return *this;
+    }
+    ordered_iterator& operator--() {
+      --m_iterator;
+      return *this;
+    }
+
+    ordered_iterator operator++(int) {
+      ordered_iterator tmp(*this);
+      ++(*this);
+      return tmp;
+    }
+    ordered_iterator operator--(int) {
+      ordered_iterator tmp(*this);
+      --(*this);
+      return tmp;
+    }
+
+    reference operator[](difference_type n) const { return m_iterator[n]; }
+
+    ordered_iterator& operator+=(difference_type n) {
+      m_iterator += n;
+      return *this;
+    }
+    ordered_iterator& operator-=(difference_type n) {
+      m_iterator -= n;
+      return *this;
+    }
+
+    ordered_iterator operator+(difference_type n) {
+      ordered_iterator tmp(*this);
+      tmp += n;
+      return tmp;
+    }
+    ordered_iterator operator-(difference_type n) {
+      ordered_iterator tmp(*this);
+      tmp -= n;
+      return tmp;
+    }
+
+    friend bool operator==(const ordered_iterator& lhs,
+                           const ordered_iterator& rhs) {
+      return lhs.m_iterator == rhs.m_iterator;
+    }
+
+    friend bool operator!=(const ordered_iterator& lhs,
+                           const ordered_iterator& rhs) {
+      return lhs.m_iterator != rhs.m_iterator;
+    }
+
+    friend bool operator<(const ordered_iterator& lhs,
+                          const ordered_iterator& rhs) {
+      return lhs.m_iterator < rhs.m_iterator;
+    }
+
+    friend bool operator>(const ordered_iterator& lhs,
+                          const ordered_iterator& rhs) {
+      return lhs.m_iterator > rhs.m_iterator;
+    }
+
+    friend bool operator<=(const ordered_iterator& lhs,
+                           const ordered_iterator& rhs) {
+      return lhs.m_iterator <= rhs.m_iterator;
+    }
+
+    friend bool operator>=(const ordered_iterator& lhs,
+                           const ordered_iterator& rhs) {
+      return lhs.m_iterator >= rhs.m_iterator;
+    }
+
+    friend ordered_iterator operator+(difference_type n,
+                                      const ordered_iterator& it) {
+      return n + it.m_iterator;
+    }
+
+    friend difference_type operator-(const ordered_iterator& lhs,
+                                     const ordered_iterator& rhs) {
+      return lhs.m_iterator - rhs.m_iterator;
+    }
+
+   private:
+    iterator m_iterator;
+  };
+
+ private:
+  using bucket_entry =
+      tsl::detail_ordered_hash::bucket_entry<IndexType, StoreFullHash>;
+
+  using buckets_container_allocator = typename std::allocator_traits<
+      BucketAllocator>::template rebind_alloc<bucket_entry>;
+
+  using buckets_container_type =
+      bucket_array<bucket_entry, buckets_container_allocator>;
+
+  using truncated_hash_type = typename bucket_entry::truncated_hash_type;
+  using index_type = typename bucket_entry::index_type;
+
+  using has_probe_metadata = std::integral_constant<bool, SimdProbing>;
+
+  using has_stored_distance =
+      std::integral_constant<bool, bucket_entry::STORES_DISTANCE>;
+
+  using has_tombstone_values = has_tombstones<values_container_type>;
+
+  using has_stable_index_values = has_stable_indexes<values_container_type>;
+
+  using has_contiguous_values = is_vector<values_container_type>;
+
+  template <class Serializer>
+  using bulk_serialization =
+      std::integral_constant<bool, is_bulk_serializable<value_type>::value &&
+                                       has_bulk_serializer<Serializer>::value>;
+
+  template <class Deserializer>
+  using bulk_deserialization = std::integral_constant<
+      bool, is_bulk_serializable<value_type>::value &&
+                has_bulk_deserializer<Deserializer>::value>;
+
+  using probe_metadata_allocator = typename std::allocator_traits<
+      BucketAllocator>::template rebind_alloc<std::uint8_t>;
+
+  using probe_metadata_container_type = typename std::conditional<
+      SimdProbing, std::vector<std::uint8_t, probe_metadata_allocator>,
+      no_probe_metadata>::type;
+
+ public:
+  ordered_hash(size_type bucket_count, const Hash& hash, const KeyEqual& equal,
+               const Allocator& alloc, float max_load_factor)
+      : ordered_hash(bucket_count, hash, equal, alloc,
+                     default_bucket_allocator(alloc), max_load_factor) {}
+
+  ordered_hash(size_type bucket_count, const Hash& hash, const KeyEqual& equal,
+               const Allocator& alloc, const BucketAllocator& bucket_alloc,
+               float max_load_factor)
+      : Hash(hash),
+        KeyEqual(equal),
+        GrowthPolicy(bucket_count),
+        m_buckets(buckets_container_allocator(bucket_alloc)),
+        m_values(alloc),
+        m_index_offset(0),
+        m_grow_on_next_insert(false),
+        m_probe_metadata(probe_metadata_allocator(bucket_alloc)),
+        m_old_buckets(buckets_container_allocator(bucket_alloc)),
+        m_old_growth_policy(empty_growth_policy()),
+        m_old_ibucket(0),
+        m_next_buckets(buckets_container_allocator(bucket_alloc)),
+        m_nb_next_buckets(0),
+        m_incremental_rehash(0),
+        m_nb_rehashes(0),
+        m_nb_grows_on_high_nb_probes(0) {
+    if (bucket_count > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The map exceeds its maximum size.");
+    }
+
+    if (bucket_count > 0) {
+      buckets_container_type(bucket_count, m_buckets.get_allocator())
+          .swap(m_buckets);
+      m_probe_metadata = make_probe_metadata(bucket_count);
+    }
+
+    this->max_load_factor(max_load_factor);
+  }
+
+  ordered_hash(const ordered_hash& other)
+      : Hash(other),
+        KeyEqual(other),
+        GrowthPolicy(other),
+        m_buckets(other.m_buckets),
+        m_values(other.m_values),
+        m_index_offset(other.m_index_offset),
+        m_load_threshold(other.m_load_threshold),
+        m_max_load_factor(other.m_max_load_factor),
+        m_grow_on_next_insert(other.m_grow_on_next_insert),
+        m_probe_metadata(other.m_probe_metadata),
+        m_old_buckets(other.m_old_buckets),
+        m_old_growth_policy(other.m_old_growth_policy),
+        m_old_ibucket(other.m_old_ibucket),
+        m_next_buckets(other.m_next_buckets.get_allocator()),
+        m_nb_next_buckets(0),
+        m_incremental_rehash(other.m_incremental_rehash),
+        m_nb_rehashes(other.m_nb_rehashes),
+        m_nb_grows_on_high_nb_probes(other.m_nb_grows_on_high_nb_probes) {}
+
+  ordered_hash(ordered_hash&& other) noexcept(
+      std::is_nothrow_move_constructible<
+          Hash>::value&& std::is_nothrow_move_constructible<KeyEqual>::value&&
+          std::is_nothrow_move_constructible<buckets_container_type>::value&&
+              std::is_nothrow_move_constructible<values_container_type>::value&&
+                  std::is_nothrow_move_constructible<
+                      probe_metadata_container_type>::value)
+      : Hash(std::move(static_cast<Hash&>(other))),
+        KeyEqual(std::move(static_cast<KeyEqual&>(other))),
+        GrowthPolicy(std::move(static_cast<GrowthPolicy&>(other))),
+        m_buckets(std::move(other.m_buckets)),
+        m_values(std::move(other.m_values)),
+        m_index_offset(other.m_index_offset),
+        m_load_threshold(other.m_load_threshold),
+        m_max_load_factor(other.m_max_load_factor),
+        m_grow_on_next_insert(other.m_grow_on_next_insert),
+        m_probe_metadata(std::move(other.m_probe_metadata)),
+        m_old_buckets(std::move(other.m_old_buckets)),
+        m_old_growth_policy(std::move(other.m_old_growth_policy)),
+        m_old_ibucket(other.m_old_ibucket),
+        m_next_buckets(std::move(other.m_next_buckets)),
+        m_nb_next_buckets(other.m_nb_next_buckets),
+        m_incremental_rehash(other.m_incremental_rehash),
+        m_nb_rehashes(other.m_nb_rehashes),
+        m_nb_grows_on_high_nb_probes(other.m_nb_grows_on_high_nb_probes) {
+    other.GrowthPolicy::clear();
+    other.m_values.clear();
+    other.m_index_offset = 0;
+    other.m_load_threshold = 0;
+    other.m_grow_on_next_insert = false;
+    other.m_probe_metadata.clear();
+    other.m_old_buckets.clear();
+    other.m_old_growth_policy.clear();
+    other.m_old_ibucket = 0;
+    other.m_nb_next_buckets = 0;
+  }
+
+  ordered_hash& operator=(const ordered_hash& other) {
+    if (&other != this) {
+      Hash::operator=(other);
+      KeyEqual::operator=(other);
+      GrowthPolicy::operator=(other);
+
+      m_buckets = other.m_buckets;
+      m_values = other.m_values;
+      m_index_offset = other.m_index_offset;
+      m_load_threshold = other.m_load_threshold;
+      m_max_load_factor = other.m_max_load_factor;
+      m_grow_on_next_insert = other.m_grow_on_next_insert;
+      m_probe_metadata = other.m_probe_metadata;
+      m_old_buckets = other.m_old_buckets;
+      m_old_growth_policy = other.m_old_growth_policy;
+      m_old_ibucket = other.m_old_ibucket;
+      m_incremental_rehash = other.m_incremental_rehash;
+      m_nb_rehashes = other.m_nb_rehashes;
+      m_nb_grows_on_high_nb_probes = other.m_nb_grows_on_high_nb_probes;
+    }
+
+    return *this;
+  }
+
+  ordered_hash& operator=(ordered_hash&& other) {
+    other.swap(*this);
+    other.clear();
+
+    return *this;
+  }
+
+  allocator_type get_allocator() const { return m_values.get_allocator(); }
+
+  BucketAllocator get_bucket_allocator() const {
+    return BucketAllocator(m_buckets.get_allocator());
+  }
+
+  /*
+   * Iterators
+   */
+  iterator begin() noexcept { return iterator(m_values.begin()); }
+
+  const_iterator begin() const noexcept { return cbegin(); }
+
+  const_iterator cbegin() const noexcept {
+    return const_iterator(m_values.cbegin());
+  }
+
+  iterator end() noexcept { return iterator(m_values.end()); }
+
+  const_iterator end() const noexcept { return cend(); }
+
+  const_iterator cend() const noexcept {
+    return const_iterator(m_values.cend());
+  }
+
+  reverse_iterator rbegin() noexcept {
+    return reverse_iterator(m_values.end());
+  }
+
+  const_reverse_iterator rbegin() const noexcept { return rcbegin(); }
+
+  const_reverse_iterator rcbegin() const noexcept {
+    return const_reverse_iterator(m_values.cend());
+  }
+
+  reverse_iterator rend() noexcept {
+    return reverse_iterator(m_values.begin());
+  }
+
+  const_reverse_iterator rend() const noexcept { return rcend(); }
+
+  const_reverse_iterator rcend() const noexcept {
+    return const_reverse_iterator(m_values.cbegin());
+  }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_values.empty(); }
+
+  size_type size() const noexcept { return m_values.size(); }
+
+  size_type max_size() const noexcept {
+    return std::min(bucket_entry::max_size(), m_values.max_size());
+  }
+
+  /*
+   * Modifiers
+   */
+  void clear() noexcept {
+    for (auto& bucket : m_buckets) {
+      bucket.clear();
+    }
+    clear_all_probe_metadata();
+    m_old_buckets.clear();
+    m_old_ibucket = 0;
+
+    m_values.clear();
+    m_index_offset = 0;
+    m_grow_on_next_insert = false;
+  }
+
+  template <typename P>
+  std::pair<iterator, bool> insert(P&& value) {
+    return insert_with_hash(hash_key(KeySelect()(value)),
+                            std::forward<P>(value));
+  }
+
+  template <typename P>
+  std::pair<iterator, bool> insert_with_hash(std::size_t hash, P&& value) {
+    return insert_impl(KeySelect()(value), hash, std::forward<P>(value));
+  }
+
+  template <typename P>
+  iterator insert_hint(const_iterator hint, P&& value) {
+    if (hint != cend() &&
+        compare_keys(KeySelect()(*hint), KeySelect()(value))) {
+      return mutable_iterator(hint);
+    }
+
+    return insert(std::forward<P>(value)).first;
+  }
+
+  template <class InputIt>
+  void insert(InputIt first, InputIt last) {
+    if (std::is_base_of<
+            std::forward_iterator_tag,
+            typename std::iterator_traits<InputIt>::iterator_category>::value) {
+      const auto nb_elements_insert = std::distance(first, last);
+      const size_type nb_free_buckets = m_load_threshold - size();
+      tsl_oh_assert(m_load_threshold >= size());
+
+      if (nb_elements_insert > 0 &&
+          nb_free_buckets < size_type(nb_elements_insert)) {
+        reserve(size() + size_type(nb_elements_insert));
+      }
+    }
+
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  template <class InputIt>
+  void insert_unique_unchecked(InputIt first, InputIt last) {
+    if (std::is_base_of<
+            std::forward_iterator_tag,
+            typename std::iterator_traits<InputIt>::iterator_category>::value) {
+      const auto nb_elements_insert = std::distance(first, last);
+      const size_type nb_free_buckets = m_load_threshold - size();
+      tsl_oh_assert(m_load_threshold >= size());
+
+      if (nb_elements_insert > 0 &&
+          nb_free_buckets < size_type(nb_elements_insert)) {
+        reserve(size() + size_type(nb_elements_insert));
+      }
+    }
+
+    for (; first != last; ++first) {
+      insert_unique_unchecked_impl(KeySelect()(*first), *first);
+    }
+  }
+
+  template <class... Args>
+  iterator emplace_back_unchecked(Args&&... args) {
+    value_type value(std::forward<Args>(args)...);
+    return insert_unique_unchecked_impl(KeySelect()(value), std::move(value));
+  }
+
+  template <class InputIt>
+  void build_parallel(InputIt first, InputIt last, size_type nb_threads) {
+    using iterator_traits = std::iterator_traits<InputIt>;
+    using parallel_build = std::integral_constant<
+        bool, std::is_base_of<
+                  std::random_access_iterator_tag,
+                  typename iterator_traits::iterator_category>::value &&
+                  std::is_same<typename std::remove_cv<
+                                   typename iterator_traits::value_type>::type,
+                               value_type>::value>;
+
+    build_parallel(first, last, nb_threads, parallel_build());
+  }
+
+  template <class K, class M>
+  std::pair<iterator, bool> insert_or_assign(K&& key, M&& value) {
+    return insert_or_assign_with_hash(hash_key(key), std::forward<K>(key),
+                                      std::forward<M>(value));
+  }
+
+  template <class K, class M>
+  std::pair<iterator, bool> insert_or_assign_with_hash(std::size_t hash,
+                                                       K&& key, M&& value) {
+    auto it = try_emplace_with_hash(hash, std::forward<K>(key),
+                                    std::forward<M>(value));
+    if (!it.second) {
+      it.first.value() = std::forward<M>(value);
+    }
+
+    return it;
+  }
+
+  template <class K, class M>
   iterator insert_or_assign(const_iterator hint, K&& key, M&& obj) {
     if (hint != cend() && compare_keys(KeySelect()(*hint), key)) {
       auto it = mutable_iterator(hint);
       it.value() = std::forward<M>(obj);
 
-      return it;
+      return it;
+    }
+
+    return insert_or_assign(std::forward<K>(key), std::forward<M>(obj)).first;
+  }
+
+  template <class... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  template <class... Args>
+  std::pair<iterator, bool> emplace_with_hash(std::size_t hash,
+                                              Args&&... args) {
+    return insert_with_hash(hash, value_type(std::forward<Args>(args)...));
+  }
+
+  template <class... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert_hint(hint, value_type(std::forward<Args>(args)...));
+  }
+
+  template <class K, class... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... value_args) {
+    return try_emplace_with_hash(hash_key(key), std::forward<K>(key),
+                                 std::forward<Args>(value_args)...);
+  }
+
+  template <class K, class... Args>
+  std::pair<iterator, bool> try_emplace_with_hash(std::size_t hash, K&& key,
+                                                  Args&&... value_args) {
+    return insert_impl(
+        key, hash, std::piecewise_construct,
+        std::forward_as_tuple(std::forward<K>(key)),
+        std::forward_as_tuple(std::forward<Args>(value_args)...));
+  }
+
+  template <class K, class... Args>
+  std::pair<size_type, bool> try_emplace_index(K&& key, Args&&... value_args) {
+    return try_emplace_index_with_hash(hash_key(key), std::forward<K>(key),
+                                       std::forward<Args>(value_args)...);
+  }
+
+  template <class K, class... Args>
+  std::pair<size_type, bool> try_emplace_index_with_hash(
+      std::size_t hash, K&& key, Args&&... value_args) {
+    return insert_value_impl(
+        key, hash, std::piecewise_construct,
+        std::forward_as_tuple(std::forward<K>(key)),
+        std::forward_as_tuple(std::forward<Args>(value_args)...));
+  }
+
+  template <class... Args>
+  std::pair<size_type, bool> emplace_index(Args&&... args) {
+    value_type value(std::forward<Args>(args)...);
+    const std::size_t hash = hash_key(KeySelect()(value));
+    return insert_value_impl(KeySelect()(value), hash, std::move(value));
+  }
+
+  template <class... Args>
+  std::pair<size_type, bool> emplace_index_with_hash(std::size_t hash,
+                                                     Args&&... args) {
+    value_type value(std::forward<Args>(args)...);
+    return insert_value_impl(KeySelect()(value), hash, std::move(value));
+  }
+
+  /**
+   * Write emplace_index(key).first for each of the 'count' keys starting at
+   * 'keys' to 'out' and return the output iterator past the last written
+   * element. See insert_keys_batch.
+   */
+  template <class KeyIt, class OutputIt>
+  OutputIt emplace_index_batch(KeyIt keys, size_type count, OutputIt out) {
+    insert_keys_batch(keys, count, [&](std::size_t index) {
+      *out = index;
+      ++out;
+    });
+
+    return out;
+  }
+
+  template <class K, class... Args>
+  iterator try_emplace_hint(const_iterator hint, K&& key, Args&&... args) {
+    if (hint != cend() && compare_keys(KeySelect()(*hint), key)) {
+      return mutable_iterator(hint);
+    }
+
+    return try_emplace(std::forward<K>(key), std::forward<Args>(args)...).first;
+  }
+
+  /**
+   * Here to avoid `template<class K> size_type erase(const K& key)` being used
+   * when we use an `iterator` instead of a `const_iterator`.
+   */
+  iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+  iterator erase(const_iterator pos) {
+    tsl_oh_assert(pos != cend());
+    return erase_at(pos, has_tombstone_values());
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    if (first == last) {
+      return mutable_iterator(first);
+    }
+
+    return erase_range(first, last, has_tombstone_values());
+  }
+
+  template <class K>
+  size_type erase(const K& key) {
+    return erase(key, hash_key(key));
+  }
+
+  template <class K>
+  size_type erase(const K& key, std::size_t hash) {
+    return erase_impl(key, hash);
+  }
+
+  void swap(ordered_hash& other) {
+    using std::swap;
+
+    swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
+    swap(static_cast<KeyEqual&>(*this), static_cast<KeyEqual&>(other));
+    swap(static_cast<GrowthPolicy&>(*this),
+         static_cast<GrowthPolicy&>(other));
+    m_buckets.swap(other.m_buckets);
+    swap(m_values, other.m_values);
+    swap(m_index_offset, other.m_index_offset);
+    swap(m_load_threshold, other.m_load_threshold);
+    swap(m_max_load_factor, other.m_max_load_factor);
+    swap(m_grow_on_next_insert, other.m_grow_on_next_insert);
+    swap(m_probe_metadata, other.m_probe_metadata);
+    m_old_buckets.swap(other.m_old_buckets);
+    swap(m_old_growth_policy, other.m_old_growth_policy);
+    swap(m_old_ibucket, other.m_old_ibucket);
+    m_next_buckets.swap(other.m_next_buckets);
+    swap(m_nb_next_buckets, other.m_nb_next_buckets);
+    swap(m_incremental_rehash, other.m_incremental_rehash);
+    swap(m_nb_rehashes, other.m_nb_rehashes);
+    swap(m_nb_grows_on_high_nb_probes, other.m_nb_grows_on_high_nb_probes);
+  }
+
+  /*
+   * Lookup
+   */
+  template <class K, class U = ValueSelect,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  typename U::value_type& at(const K& key) {
+    return at(key, hash_key(key));
+  }
+
+  template <class K, class U = ValueSelect,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  typename U::value_type& at(const K& key, std::size_t hash) {
+    return const_cast<typename U::value_type&>(
+        static_cast<const ordered_hash*>(this)->at(key, hash));
+  }
+
+  template <class K, class U = ValueSelect,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  const typename U::value_type& at(const K& key) const {
+    return at(key, hash_key(key));
+  }
+
+  template <class K, class U = ValueSelect,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  const typename U::value_type& at(const K& key, std::size_t hash) const {
+    auto it = find(key, hash);
+    if (it != end()) {
+      return it.value();
+    } else {
+      TSL_OH_THROW_OR_TERMINATE(std::out_of_range, "Couldn't find the key.");
+    }
+  }
+
+  template <class K, class U = ValueSelect,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  typename U::value_type& operator[](K&& key) {
+    return try_emplace(std::forward<K>(key)).first.value();
+  }
+
+  template <class K>
+  size_type count(const K& key) const {
+    return count(key, hash_key(key));
+  }
+
+  template <class K>
+  size_type count(const K& key, std::size_t hash) const {
+    if (find(key, hash) == cend()) {
+      return 0;
+    } else {
+      return 1;
+    }
+  }
+
+  template <class K>
+  iterator find(const K& key) {
+    return find(key, hash_key(key));
+  }
+
+  template <class K>
+  iterator find(const K& key, std::size_t hash) {
+    incremental_rehash_step();
+
+    const bucket_entry* bucket = find_bucket(key, hash);
+    return (bucket != nullptr)
+               ? iterator(values_iterator_at(value_index(*bucket)))
+               : end();
+  }
+
+  template <class K>
+  const_iterator find(const K& key) const {
+    return find(key, hash_key(key));
+  }
+
+  /**
+   * Index in m_values of the value with the key 'key', see index_of in
+   * ordered_map.
+   */
+  template <class K>
+  size_type index_of(const K& key) const {
+    return index_of(key, hash_key(key));
+  }
+
+  template <class K>
+  size_type index_of(const K& key, std::size_t hash) const {
+    const bucket_entry* bucket = find_bucket(key, hash);
+    return (bucket != nullptr) ? value_index(*bucket)
+                               : std::numeric_limits<size_type>::max();
+  }
+
+  const_reference value_at(size_type index) const {
+    tsl_oh_assert(index < values_raw_size());
+    return m_values[index];
+  }
+
+  template <class K>
+  const_iterator find(const K& key, std::size_t hash) const {
+    const bucket_entry* bucket = find_bucket(key, hash);
+    return (bucket != nullptr)
+               ? const_iterator(values_iterator_at(value_index(*bucket)))
+               : end();
+  }
+
+  /**
+   * Write find(key) for each of the 'count' keys starting at 'keys' to 'out'
+   * and return the output iterator past the last written element. See
+   * find_keys_batch.
+   */
+  template <class KeyIt, class OutputIt>
+  OutputIt find_batch(KeyIt keys, size_type count, OutputIt out) {
+    find_keys_batch(
+        keys, count,
+        [&](const bucket_entry* bucket) {
+          *out = (bucket != nullptr)
+                     ? iterator(values_iterator_at(value_index(*bucket)))
+                     : end();
+          ++out;
+        });
+
+    return out;
+  }
+
+  template <class KeyIt, class OutputIt>
+  OutputIt find_batch(KeyIt keys, size_type count, OutputIt out) const {
+    find_keys_batch(
+        keys, count,
+        [&](const bucket_entry* bucket) {
+          *out = (bucket != nullptr)
+                     ? const_iterator(values_iterator_at(value_index(*bucket)))
+                     : cend();
+          ++out;
+        });
+
+    return out;
+  }
+
+  template <class KeyIt, class OutputIt>
+  OutputIt contains_batch(KeyIt keys, size_type count, OutputIt out) const {
+    find_keys_batch(
+        keys, count,
+        [&](const bucket_entry* bucket) {
+          *out = (bucket != nullptr);
+          ++out;
+        });
+
+    return out;
+  }
+
+  template <class K>
+  bool contains(const K& key) const {
+    return contains(key, hash_key(key));
+  }
+
+  template <class K>
+  bool contains(const K& key, std::size_t hash) const {
+    return find(key, hash) != cend();
+  }
+
+  template <class K>
+  std::pair<iterator, iterator> equal_range(const K& key) {
+    return equal_range(key, hash_key(key));
+  }
+
+  template <class K>
+  std::pair<iterator, iterator> equal_range(const K& key, std::size_t hash) {
+    iterator it = find(key, hash);
+    return std::make_pair(it, (it == end()) ? it : std::next(it));
+  }
+
+  template <class K>
+  std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+    return equal_range(key, hash_key(key));
+  }
+
+  template <class K>
+  std::pair<const_iterator, const_iterator> equal_range(
+      const K& key, std::size_t hash) const {
+    const_iterator it = find(key, hash);
+    return std::make_pair(it, (it == cend()) ? it : std::next(it));
+  }
+
+  /*
+   * Bucket interface
+   */
+  size_type bucket_count() const { return m_buckets.size(); }
+
+  size_type max_bucket_count() const {
+    return std::min({m_buckets.max_size(),
+                     bucket_entry::max_bucket_count(),
+                     GrowthPolicy::max_bucket_count()});
+  }
+
+  /*
+   *  Hash policy
+   */
+  float load_factor() const {
+    if (bucket_count() == 0) {
+      return 0;
+    }
+
+    return float(size()) / float(bucket_count());
+  }
+
+  float max_load_factor() const { return m_max_load_factor; }
+
+  void max_load_factor(float ml) {
+    m_max_load_factor = clamp(ml, float(MAX_LOAD_FACTOR__MINIMUM),
+                              float(MAX_LOAD_FACTOR__MAXIMUM));
+
+    m_max_load_factor = ml;
+    m_load_threshold = size_type(float(bucket_count()) * m_max_load_factor);
+  }
+
+  size_type incremental_rehash() const noexcept { return m_incremental_rehash; }
+
+  void incremental_rehash(size_type nb_buckets_per_op) {
+    m_incremental_rehash = nb_buckets_per_op;
+    if (nb_buckets_per_op == 0) {
+      complete_incremental_rehash();
+      m_next_buckets.clear();
+      m_nb_next_buckets = 0;
+    }
+  }
+
+  void rehash(size_type count) {
+    count = std::max(count,
+                     size_type(std::ceil(float(size()) / max_load_factor())));
+    rehash_impl(count);
+  }
+
+  void reserve(size_type count) {
+    reserve_space_for_values(count);
+
+    count = size_type(std::ceil(float(count) / max_load_factor()));
+    rehash(count);
+  }
+
+  void rehash(size_type count, size_type nb_threads) {
+    count = std::max(count,
+                     size_type(std::ceil(float(size()) / max_load_factor())));
+    rehash_impl_parallel(count, nb_threads);
+  }
+
+  void reserve(size_type count, size_type nb_threads) {
+    reserve_space_for_values(count);
+
+    count = size_type(std::ceil(float(count) / max_load_factor()));
+    rehash(count, nb_threads);
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return static_cast<const Hash&>(*this); }
+
+  key_equal key_eq() const { return static_cast<const KeyEqual&>(*this); }
+
+  /*
+   * Other
+   */
+
+  /**
+   * Walk the buckets in O(bucket_count() * average_probe_length_miss).
+   *
+   * During an incremental rehash, the values not migrated yet are counted with
+   * their distance in the old buckets array and the unsuccessful lookups are
+   * only measured on the new one.
+   */
+  ordered_hash_stats stats() const {
+    ordered_hash_stats stats;
+    stats.size = size();
+    stats.bucket_count = bucket_count();
+    stats.load_factor = load_factor();
+    stats.max_load_factor = max_load_factor();
+    stats.nb_rehashes = m_nb_rehashes;
+    stats.nb_grows_on_high_nb_probes = m_nb_grows_on_high_nb_probes;
+
+    stats.buckets_bytes = (m_buckets.size() + m_old_buckets.size() +
+                           m_next_buckets.size()) *
+                              sizeof(bucket_entry) +
+                          m_probe_metadata.capacity();
+    stats.values_bytes =
+        values_capacity(has_contiguous_values()) * sizeof(value_type);
+
+    std::size_t nb_hits = 0;
+    std::size_t total_probe_length_hit = 0;
+    for (int old = 0; old < 2; old++) {
+      const buckets_container_type& buckets =
+          (old == 0) ? m_buckets : m_old_buckets;
+      const GrowthPolicy& growth_policy =
+          (old == 0) ? static_cast<const GrowthPolicy&>(*this)
+                     : m_old_growth_policy;
+      for (std::size_t ibucket = 0; ibucket < buckets.size(); ibucket++) {
+        if (buckets[ibucket].empty()) {
+          continue;
+        }
+
+        const std::size_t dist =
+            bucket_distance(buckets, growth_policy, ibucket);
+        if (dist >= stats.distance_histogram.size()) {
+          stats.distance_histogram.resize(dist + 1, 0);
+        }
+        stats.distance_histogram[dist]++;
+
+        nb_hits++;
+        total_probe_length_hit += dist + 1;
+        stats.max_probe_length_hit =
+            std::max(stats.max_probe_length_hit, dist + 1);
+      }
+    }
+
+    std::size_t total_probe_length_miss = 0;
+    for (std::size_t ibucket_start = 0; ibucket_start < m_buckets.size();
+         ibucket_start++) {
+      std::size_t ibucket = ibucket_start;
+      std::size_t probe_length = 1;
+      while (!m_buckets[ibucket].empty() &&
+             distance_from_ideal_bucket(ibucket) >= probe_length - 1) {
+        ibucket = next_bucket(ibucket);
+        probe_length++;
+      }
+
+      total_probe_length_miss += probe_length;
+      stats.max_probe_length_miss =
+          std::max(stats.max_probe_length_miss, probe_length);
+    }
+
+    if (nb_hits > 0) {
+      stats.average_probe_length_hit =
+          double(total_probe_length_hit) / double(nb_hits);
+    }
+    if (!m_buckets.empty()) {
+      stats.average_probe_length_miss =
+          double(total_probe_length_miss) / double(m_buckets.size());
+    }
+
+    return stats;
+  }
+
+  iterator mutable_iterator(const_iterator pos) {
+    return iterator(values_iterator_at(iterator_to_index(pos)));
+  }
+
+  iterator nth(size_type index) {
+    tsl_oh_assert(index <= size());
+    return iterator(values_nth(index, has_tombstone_values()));
+  }
+
+  const_iterator nth(size_type index) const {
+    tsl_oh_assert(index <= size());
+    return const_iterator(values_nth(index, has_tombstone_values()));
+  }
+
+  const_reference front() const {
+    tsl_oh_assert(!empty());
+    return m_values.front();
+  }
+
+  const_reference back() const {
+    tsl_oh_assert(!empty());
+    return m_values.back();
+  }
+
+  const values_container_type& values_container() const noexcept {
+    return m_values;
+  }
+
+  values_container_type release() {
+    values_container_type ret;
+    for (auto& bucket : m_buckets) {
+      bucket.clear();
+    }
+    clear_all_probe_metadata();
+    m_old_buckets.clear();
+    m_old_ibucket = 0;
+    m_grow_on_next_insert = false;
+    std::swap(ret, m_values);
+    return ret;
+  }
+
+  template <class U = values_container_type,
+            typename std::enable_if<is_vector<U>::value>::type* = nullptr>
+  const typename values_container_type::value_type* data() const noexcept {
+    return m_values.data();
+  }
+
+  template <class U = values_container_type,
+            typename std::enable_if<is_vector<U>::value>::type* = nullptr>
+  size_type capacity() const noexcept {
+    return m_values.capacity();
+  }
+
+  void shrink_to_fit() {
+    compact_all_tombstones(has_tombstone_values());
+    m_values.shrink_to_fit();
+  }
+
+  template <typename P>
+  std::pair<iterator, bool> insert_at_position(const_iterator pos, P&& value) {
+    return insert_at_position_with_hash(pos, hash_key(KeySelect()(value)),
+                                        std::forward<P>(value));
+  }
+
+  template <typename P>
+  std::pair<iterator, bool> insert_at_position_with_hash(const_iterator pos,
+                                                         std::size_t hash,
+                                                         P&& value) {
+    return insert_at_position_impl(pos.m_iterator, KeySelect()(value), hash,
+                                   std::forward<P>(value));
+  }
+
+  template <class... Args>
+  std::pair<iterator, bool> emplace_at_position(const_iterator pos,
+                                                Args&&... args) {
+    return insert_at_position(pos, value_type(std::forward<Args>(args)...));
+  }
+
+  template <class... Args>
+  std::pair<iterator, bool> emplace_at_position_with_hash(const_iterator pos,
+                                                          std::size_t hash,
+                                                          Args&&... args) {
+    return insert_at_position_with_hash(
+        pos, hash, value_type(std::forward<Args>(args)...));
+  }
+
+  template <class K, class... Args>
+  std::pair<iterator, bool> try_emplace_at_position(const_iterator pos, K&& key,
+                                                    Args&&... value_args) {
+    return try_emplace_at_position_with_hash(pos, hash_key(key),
+                                             std::forward<K>(key),
+                                             std::forward<Args>(value_args)...);
+  }
+
+  template <class K, class... Args>
+  std::pair<iterator, bool> try_emplace_at_position_with_hash(
+      const_iterator pos, std::size_t hash, K&& key, Args&&... value_args) {
+    return insert_at_position_impl(
+        pos.m_iterator, key, hash, std::piecewise_construct,
+        std::forward_as_tuple(std::forward<K>(key)),
+        std::forward_as_tuple(std::forward<Args>(value_args)...));
+  }
+
+  void pop_back() {
+    tsl_oh_assert(!empty());
+    erase(std::prev(end()));
+  }
+
+  void pop_front() {
+    tsl_oh_assert(!empty());
+    erase(begin());
+  }
+
+  /**
+   * Move the value at 'pos' to the end of m_values, keeping its bucket. The
+   * value is move-constructed in a new slot at the end and its old slot is
+   * erased, only the index of its bucket needs to be updated with tombstones.
+   */
+  iterator move_to_back(const_iterator pos) {
+    tsl_oh_assert(pos != cend());
+    if (std::next(pos) == cend()) {
+      return mutable_iterator(pos);
+    }
+
+    return move_to_back(pos, hash_key(pos.key()));
+  }
+
+  /**
+   * Same as move_to_back(pos) but 'hash' is the hash of the key at 'pos', used
+   * to find its bucket.
+   */
+  iterator move_to_back(const_iterator pos, std::size_t hash) {
+    tsl_oh_assert(pos != cend());
+    if (std::next(pos) == cend()) {
+      return mutable_iterator(pos);
+    }
+
+    const std::size_t index =
+        compact_tombstones_if_needed(iterator_to_index(pos));
+    reset_index_offset_if_needed();
+
+    const key_type& key = KeySelect()(m_values[index]);
+    auto it_bucket = find_key(key, hash);
+    tsl_oh_assert(it_bucket != m_buckets.end());
+
+    m_values.emplace_back(std::move(m_values[index]));
+    it_bucket->set_index(stored_index(values_raw_size() - 1));
+    erase_value_at(index_type(index), has_tombstone_values());
+
+    return std::prev(end());
+  }
+
+  /**
+   * Here to avoid `template<class K> size_type unordered_erase(const K& key)`
+   * being used when we use a iterator instead of a const_iterator.
+   */
+  iterator unordered_erase(iterator pos) {
+    return unordered_erase(const_iterator(pos));
+  }
+
+  iterator unordered_erase(const_iterator pos) {
+    return unordered_erase_at(pos, has_tombstone_values());
+  }
+
+  template <class K>
+  size_type unordered_erase(const K& key) {
+    return unordered_erase(key, hash_key(key));
+  }
+
+  template <class K>
+  size_type unordered_erase(const K& key, std::size_t hash) {
+    return unordered_erase_impl(key, hash, has_tombstone_values());
+  }
+
+  /**
+   * Remove all entries for which the given predicate matches.
+   */
+  template <class Predicate>
+  size_type erase_if(Predicate& pred) {
+    return erase_if_impl(pred, has_tombstone_values());
+  }
+
+  template <class Serializer>
+  void serialize(Serializer& serializer) const {
+    serialize_impl(serializer);
+  }
+
+  template <class Deserializer>
+  void deserialize(Deserializer& deserializer, bool hash_compatible) {
+    deserialize_impl(deserializer, hash_compatible);
+  }
+
+  friend bool operator==(const ordered_hash& lhs, const ordered_hash& rhs) {
+    return lhs.m_values == rhs.m_values;
+  }
+
+  friend bool operator!=(const ordered_hash& lhs, const ordered_hash& rhs) {
+    return lhs.m_values != rhs.m_values;
+  }
+
+  friend bool operator<(const ordered_hash& lhs, const ordered_hash& rhs) {
+    return lhs.m_values < rhs.m_values;
+  }
+
+  friend bool operator<=(const ordered_hash& lhs, const ordered_hash& rhs) {
+    return lhs.m_values <= rhs.m_values;
+  }
+
+  friend bool operator>(const ordered_hash& lhs, const ordered_hash& rhs) {
+    return lhs.m_values > rhs.m_values;
+  }
+
+  friend bool operator>=(const ordered_hash& lhs, const ordered_hash& rhs) {
+    return lhs.m_values >= rhs.m_values;
+  }
+
+ private:
+  template <class K>
+  std::size_t hash_key(const K& key) const {
+    return Hash::operator()(key);
+  }
+
+  template <class K1, class K2>
+  bool compare_keys(const K1& key1, const K2& key2) const {
+    return KeyEqual::operator()(key1, key2);
+  }
+
+  /**
+   * Used by the erase operations which need the bucket of the key to be in
+   * m_buckets, the bucket is migrated first if it's still in
+   * m_old_buckets. The migration may move the other buckets of
+   * m_buckets.
+   */
+  template <class K>
+  typename buckets_container_type::iterator find_key(const K& key,
+                                                     std::size_t hash) {
+    if (rehash_in_progress()) {
+      const bucket_entry* old_bucket = find_key_in_old_buckets(key, hash);
+      if (old_bucket != nullptr) {
+        migrate_old_bucket(std::size_t(old_bucket - m_old_buckets.data()));
+      }
+    }
+
+    auto it = static_cast<const ordered_hash*>(this)->find_key(key, hash);
+    return m_buckets.begin() + std::distance(m_buckets.cbegin(), it);
+  }
+
+  /**
+   * Return bucket which has the key 'key' or m_buckets.end() if none.
+   *
+   * From the bucket_for_hash, search for the value until we either find an
+   * empty bucket or a bucket which has a value with a distance from its ideal
+   * bucket longer than the probe length for the value we are looking for.
+   */
+  template <class K>
+  typename buckets_container_type::const_iterator find_key(
+      const K& key, std::size_t hash) const {
+    return find_key(key, hash, has_probe_metadata());
+  }
+
+  template <class K>
+  typename buckets_container_type::const_iterator find_key(
+      const K& key, std::size_t hash,
+      std::false_type /*probe_metadata*/) const {
+    return find_key_from(key, hash, bucket_for_hash(hash), 0);
+  }
+
+  /**
+   * Same as above but scan the probe metadata a probe_group at a time. Only
+   * the buckets with a matching fingerprint and placed before the end of the
+   * probe are checked. Fallback to find_key_from for small buckets arrays and
+   * for the (very rare) probes too long to be encoded in the metadata.
+   */
+  template <class K>
+  typename buckets_container_type::const_iterator find_key(
+      const K& key, std::size_t hash, std::true_type /*probe_metadata*/) const {
+    std::size_t ibucket = bucket_for_hash(hash);
+    std::size_t dist_from_ideal_bucket = 0;
+
+    if (bucket_count() >= probe_group::WIDTH) {
+      const truncated_hash_type truncated_hash =
+          bucket_entry::truncate_hash(hash);
+      const std::uint8_t fingerprint = probe_fingerprint(truncated_hash);
+      const std::uint8_t* distances = m_probe_metadata.data();
+      const std::uint8_t* fingerprints =
+          distances + bucket_count() + probe_group::MIRRORED_BYTES;
+
+      while (dist_from_ideal_bucket + probe_group::WIDTH <=
+             probe_group::MAX_DISTANCE) {
+        TSL_OH_INSTRUMENT(tsl::ordered_hash_event::probe_step,
+                          dist_from_ideal_bucket);
+
+        probe_group::mask_type stop;
+        probe_group::mask_type match;
+        probe_group::scan(distances + ibucket, fingerprints + ibucket,
+                          dist_from_ideal_bucket, fingerprint, stop, match);
+        if (stop != 0) {
+          // Only keep the matches before the first bucket ending the probe.
+          match &= (stop & (~stop + 1)) - 1;
+        }
+
+        while (match != 0) {
+          std::size_t imatch = ibucket + count_trailing_zeros(match);
+          if (imatch >= bucket_count()) {
+            imatch -= bucket_count();
+          }
+
+          if (m_buckets[imatch].truncated_hash() == truncated_hash &&
+              compare_keys(key, KeySelect()(m_values[value_index(
+                                    m_buckets[imatch])]))) {
+            return m_buckets.begin() + imatch;
+          }
+
+          match &= match - 1;
+        }
+
+        if (stop != 0) {
+          return m_buckets.end();
+        }
+
+        ibucket += probe_group::WIDTH;
+        if (ibucket >= bucket_count()) {
+          ibucket -= bucket_count();
+        }
+        dist_from_ideal_bucket += probe_group::WIDTH;
+      }
     }
 
-    return insert_or_assign(std::forward<K>(key), std::forward<M>(obj)).first;
+    return find_key_from(key, hash, ibucket, dist_from_ideal_bucket);
   }
 
-  template <class... Args>
-  std::pair<iterator, bool> emplace(Args&&... args) {
-    return insert(value_type(std::forward<Args>(args)...));
+  /**
+   * Return the bucket which has the key 'key', in m_buckets or in
+   * m_old_buckets, or nullptr if none.
+   */
+  template <class K>
+  const bucket_entry* find_bucket(const K& key, std::size_t hash) const {
+    auto it_bucket = find_key(key, hash);
+    if (it_bucket != m_buckets.cend()) {
+      return std::addressof(*it_bucket);
+    }
+
+    return rehash_in_progress() ? find_key_in_old_buckets(key, hash) : nullptr;
+  }
+
+  /**
+   * Call 'on_result' with find_bucket(key, hash_key(key)) for each of the
+   * 'count' keys starting at 'keys', in order. 'keys' must be a forward
+   * iterator.
+   *
+   * A lookup is a chain of dependent cache misses, the bucket and then the
+   * value. To overlap the misses of different keys, the keys are processed by
+   * groups of FIND_BATCH_SIZE: all the hashes of a group are computed and their
+   * ideal buckets prefetched, then the values referenced by these buckets are
+   * prefetched and only then the probes are resolved.
+   */
+  template <class KeyIt, class Function>
+  void find_keys_batch(KeyIt keys, size_type count, Function on_result) const {
+    std::size_t hashes[FIND_BATCH_SIZE];
+
+    while (count > 0) {
+      const size_type batch_size =
+          (count < FIND_BATCH_SIZE) ? count : FIND_BATCH_SIZE;
+      prefetch_keys_batch(keys, batch_size, hashes);
+
+      for (size_type i = 0; i < batch_size; i++, ++keys) {
+        on_result(find_bucket(*keys, hashes[i]));
+      }
+
+      count -= batch_size;
+    }
+  }
+
+  /**
+   * Same as find_keys_batch but insert the keys which are not in the set and
+   * call 'on_result' with the index in m_values of each key (see
+   * insert_value_impl). The prefetched buckets may be moved by a rehash
+   * triggered in the middle of a group, the insertions are still correct.
+   */
+  template <class KeyIt, class Function>
+  void insert_keys_batch(KeyIt keys, size_type count, Function on_result) {
+    std::size_t hashes[FIND_BATCH_SIZE];
+
+    while (count > 0) {
+      const size_type batch_size =
+          (count < FIND_BATCH_SIZE) ? count : FIND_BATCH_SIZE;
+      prefetch_keys_batch(keys, batch_size, hashes);
+
+      for (size_type i = 0; i < batch_size; i++, ++keys) {
+        on_result(insert_value_impl(*keys, hashes[i], *keys).first);
+      }
+
+      count -= batch_size;
+    }
+  }
+
+  /**
+   * Write the hashes of the 'batch_size' keys starting at 'keys' to 'hashes',
+   * prefetch their ideal buckets and then the values referenced by these
+   * buckets, see find_keys_batch.
+   */
+  template <class KeyIt>
+  void prefetch_keys_batch(KeyIt keys, size_type batch_size,
+                           std::size_t* hashes) const {
+    for (size_type i = 0; i < batch_size; i++, ++keys) {
+      hashes[i] = hash_key(*keys);
+
+      const std::size_t ibucket = bucket_for_hash(hashes[i]);
+      prefetch(m_buckets.data() + ibucket);
+      prefetch_probe_metadata(ibucket);
+    }
+
+    for (size_type i = 0; i < batch_size; i++) {
+      const bucket_entry& bucket = m_buckets[bucket_for_hash(hashes[i])];
+      if (!bucket.empty()) {
+        prefetch(std::addressof(m_values[value_index(bucket)]));
+      }
+    }
+  }
+
+  /**
+   * Continue the search of 'key' from the bucket 'ibucket' which is at
+   * 'dist_from_ideal_bucket' from the ideal bucket of 'hash'.
+   */
+  template <class K>
+  typename buckets_container_type::const_iterator find_key_from(
+      const K& key, std::size_t hash, std::size_t ibucket,
+      std::size_t dist_from_ideal_bucket) const {
+    for (;; ibucket = next_bucket(ibucket), dist_from_ideal_bucket++) {
+      TSL_OH_INSTRUMENT(tsl::ordered_hash_event::probe_step,
+                        dist_from_ideal_bucket);
+
+      if (m_buckets[ibucket].empty()) {
+        return m_buckets.end();
+      } else if (m_buckets[ibucket].truncated_hash() ==
+                     bucket_entry::truncate_hash(hash) &&
+                 compare_keys(key, KeySelect()(m_values[value_index(
+                                       m_buckets[ibucket])]))) {
+        return m_buckets.begin() + ibucket;
+      } else if (dist_from_ideal_bucket > distance_from_ideal_bucket(ibucket)) {
+        return m_buckets.end();
+      }
+    }
+  }
+
+  /**
+   * If 'incremental' is true, the current buckets are kept in m_old_buckets
+   * and migrated later by migrate_old_buckets, and the new buckets array is
+   * m_next_buckets if it has the new bucket count.
+   */
+  void rehash_impl(size_type bucket_count, bool incremental = false) {
+    tsl_oh_assert(bucket_count >=
+                  size_type(std::ceil(float(size()) / max_load_factor())));
+
+    complete_incremental_rehash();
+
+    if (bucket_count > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The map exceeds its maximum size.");
+    }
+
+    GrowthPolicy new_growth_policy(bucket_count);
+    if (bucket_count == this->bucket_count()) {
+      return;
+    }
+
+    TSL_OH_INSTRUMENT(tsl::ordered_hash_event::rehash_start, bucket_count);
+
+    buckets_container_type old_buckets(m_buckets.get_allocator());
+    if (incremental && m_next_buckets.size() == bucket_count) {
+      m_next_buckets.construct_buckets(m_nb_next_buckets, bucket_count);
+      old_buckets.swap(m_next_buckets);
+      m_nb_next_buckets = 0;
+    } else {
+      buckets_container_type(bucket_count, m_buckets.get_allocator())
+          .swap(old_buckets);
+    }
+    probe_metadata_container_type probe_metadata =
+        make_probe_metadata(bucket_count);
+
+    m_buckets.swap(old_buckets);
+    swap_probe_metadata(probe_metadata);
+    // Everything should be noexcept from here.
+
+    if (incremental) {
+      m_old_growth_policy = static_cast<const GrowthPolicy&>(*this);
+    }
+    GrowthPolicy::operator=(std::move(new_growth_policy));
+    this->max_load_factor(m_max_load_factor);
+    m_grow_on_next_insert = false;
+    m_nb_rehashes++;
+
+    if (incremental) {
+      m_old_buckets.swap(old_buckets);
+      m_old_ibucket = 0;
+      TSL_OH_INSTRUMENT(tsl::ordered_hash_event::rehash_end, bucket_count);
+      return;
+    }
+
+    for (const bucket_entry& old_bucket : old_buckets) {
+      if (!old_bucket.empty()) {
+        insert_rehashed_bucket(old_bucket);
+      }
+    }
+
+    TSL_OH_INSTRUMENT(tsl::ordered_hash_event::rehash_end, bucket_count);
+  }
+
+  /**
+   * Insert the bucket of a value which is not in m_buckets yet. Same as
+   * insert_index but without the check on the probe length.
+   */
+  void insert_rehashed_bucket(bucket_entry bucket) noexcept {
+    for (std::size_t ibucket = bucket_for_hash(ideal_hash(bucket)),
+                     dist_from_ideal_bucket = 0;
+         ; ibucket = next_bucket(ibucket), dist_from_ideal_bucket++) {
+      if (m_buckets[ibucket].empty()) {
+        bucket.set_distance(dist_from_ideal_bucket);
+        m_buckets[ibucket] = bucket;
+        set_probe_metadata(ibucket, dist_from_ideal_bucket,
+                           bucket.truncated_hash());
+        return;
+      }
+
+      const std::size_t distance = distance_from_ideal_bucket(ibucket);
+      if (dist_from_ideal_bucket > distance) {
+        bucket.set_distance(dist_from_ideal_bucket);
+        std::swap(bucket, m_buckets[ibucket]);
+        set_probe_metadata(ibucket, dist_from_ideal_bucket,
+                           m_buckets[ibucket].truncated_hash());
+        dist_from_ideal_bucket = distance;
+      }
+    }
+  }
+
+  /**
+   * Same as rehash_impl but the buckets are placed by up to 'nb_threads'
+   * threads. The new buckets array is split in a power of two number of ranges
+   * of the same size, the last one taking the remainder of the division if the
+   * bucket count isn't a power of two, and each thread fills one range, see
+   * place_buckets_in_range. The few insertions which would cross the end of a
+   * range are spilled and done at the end on the current thread.
+   *
+   * Fallback to rehash_impl if the map doesn't grow, if the ranges would be
+   * smaller than PARALLEL_REHASH__MIN_RANGE_SIZE or if a range spills more
+   * buckets than its share of the spill array.
+   */
+  void rehash_impl_parallel(size_type bucket_count, size_type nb_threads) {
+    tsl_oh_assert(bucket_count >=
+                  size_type(std::ceil(float(size()) / max_load_factor())));
+
+    complete_incremental_rehash();
+
+    if (bucket_count > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The map exceeds its maximum size.");
+    }
+
+    GrowthPolicy new_growth_policy(bucket_count);
+
+    size_type nb_ranges = 1;
+    while (nb_ranges * 2 <= nb_threads &&
+           bucket_count / (nb_ranges * 2) >= PARALLEL_REHASH__MIN_RANGE_SIZE) {
+      nb_ranges *= 2;
+    }
+
+    if (nb_ranges == 1 || empty() || bucket_count <= this->bucket_count()) {
+      rehash_impl(bucket_count);
+      return;
+    }
+
+    TSL_OH_INSTRUMENT(tsl::ordered_hash_event::rehash_start, bucket_count);
+
+    const size_type range_size = bucket_count / nb_ranges;
+    const size_type spill_capacity = std::max(
+        size_type(PARALLEL_REHASH__MIN_SPILL_CAPACITY), range_size / 16);
+
+    buckets_container_type buckets(bucket_count, m_buckets.get_allocator());
+    buckets_container_type spills(nb_ranges * spill_capacity,
+                                  m_buckets.get_allocator());
+    std::vector<size_type> nb_spills(nb_ranges);
+    probe_metadata_container_type probe_metadata =
+        make_probe_metadata(bucket_count);
+
+    parallel_for(nb_ranges, [&](std::size_t irange) {
+      const size_type ibucket_first = irange * range_size;
+      nb_spills[irange] = place_buckets_in_range(
+          buckets, new_growth_policy, ibucket_first,
+          (irange + 1 == nb_ranges) ? bucket_count - ibucket_first
+                                    : range_size,
+          spills.data() + irange * spill_capacity, spill_capacity);
+    });
+
+    for (size_type irange = 0; irange < nb_ranges; irange++) {
+      if (nb_spills[irange] > spill_capacity) {
+        TSL_OH_INSTRUMENT(tsl::ordered_hash_event::rehash_end, bucket_count);
+        rehash_impl(bucket_count);
+        return;
+      }
+    }
+
+    for (size_type irange = 0; irange < nb_ranges; irange++) {
+      for (size_type i = 0; i < nb_spills[irange]; i++) {
+        insert_bucket(buckets, new_growth_policy,
+                      spills[irange * spill_capacity + i]);
+      }
+    }
+
+    m_buckets.swap(buckets);
+    swap_probe_metadata(probe_metadata);
+    // Everything should be noexcept from here.
+
+    GrowthPolicy::operator=(std::move(new_growth_policy));
+    this->max_load_factor(m_max_load_factor);
+    m_grow_on_next_insert = false;
+    m_nb_rehashes++;
+
+    fill_probe_metadata();
+
+    TSL_OH_INSTRUMENT(tsl::ordered_hash_event::rehash_end, bucket_count);
+  }
+
+  /**
+   * Place the values of m_buckets whose ideal bucket in 'buckets', mapped
+   * by 'growth_policy', is in [ibucket_first, ibucket_first + range_size) with
+   * robin hood insertions which stay in this range: the bucket which would have
+   * to go past the end of the range is spilled to 'spills' instead. Return the
+   * number of spilled buckets, or spill_capacity + 1 if they didn't fit.
+   *
+   * With a power_of_two_growth_policy, as bucket_count() divides
+   * buckets.size(), the ideal bucket of a value in m_buckets is its ideal
+   * bucket in 'buckets' modulo bucket_count(). If range_size < bucket_count(),
+   * the values to place are thus the ones with an ideal bucket in the range of
+   * m_buckets starting at ibucket_first modulo bucket_count(). These
+   * values are stored from the beginning of this range, sorted by ideal bucket,
+   * possibly past its end due to the probing. The other policies scan the whole
+   * m_buckets.
+   */
+  std::size_t place_buckets_in_range(
+      buckets_container_type& buckets, const GrowthPolicy& growth_policy,
+      std::size_t ibucket_first, std::size_t range_size, bucket_entry* spills,
+      std::size_t spill_capacity) const noexcept {
+    std::size_t nb_spills = 0;
+
+    // Return false if the bucket had to be spilled but the spills are full.
+    auto place = [&](bucket_entry bucket) {
+      std::size_t ibucket = growth_policy.bucket_for_hash(ideal_hash(bucket));
+      if (ibucket < ibucket_first || ibucket - ibucket_first >= range_size) {
+        return true;
+      }
+
+      for (std::size_t dist_from_ideal_bucket = 0;;
+           ibucket++, dist_from_ideal_bucket++) {
+        if (ibucket == ibucket_first + range_size) {
+          if (nb_spills == spill_capacity) {
+            return false;
+          }
+
+          spills[nb_spills++] = bucket;
+          return true;
+        }
+
+        if (buckets[ibucket].empty()) {
+          bucket.set_distance(dist_from_ideal_bucket);
+          buckets[ibucket] = bucket;
+          return true;
+        }
+
+        const std::size_t distance =
+            bucket_distance(buckets, growth_policy, ibucket);
+        if (dist_from_ideal_bucket > distance) {
+          bucket.set_distance(dist_from_ideal_bucket);
+          std::swap(bucket, buckets[ibucket]);
+          dist_from_ideal_bucket = distance;
+        }
+      }
+    };
+
+    if (range_size >= bucket_count() ||
+        !std::is_same<GrowthPolicy,
+                      tsl::oh::power_of_two_growth_policy>::value) {
+      for (const bucket_entry& old_bucket : m_buckets) {
+        if (!old_bucket.empty() && !place(old_bucket)) {
+          return spill_capacity + 1;
+        }
+      }
+
+      return nb_spills;
+    }
+
+    const std::size_t hash_mask = bucket_count() - 1;
+    const std::size_t old_ibucket_first = ibucket_first & hash_mask;
+    for (std::size_t ibucket = old_ibucket_first, i = 0;;
+         ibucket = next_bucket(ibucket), i++) {
+      const bucket_entry& old_bucket = m_buckets[ibucket];
+      const bool in_range =
+          !old_bucket.empty() &&
+          ((ideal_hash(old_bucket) - old_ibucket_first) & hash_mask) <
+              range_size;
+
+      if (in_range) {
+        if (!place(old_bucket)) {
+          return spill_capacity + 1;
+        }
+      } else if (i >= range_size) {
+        // Past the range, the first bucket which is empty or has a value with
+        // an ideal bucket outside the range ends the values to place.
+        return nb_spills;
+      }
+    }
+  }
+
+  /**
+   * Robin hood insertion of 'bucket' in 'buckets', a buckets array other than
+   * m_buckets which doesn't contain it yet, mapped by 'growth_policy'.
+   * The probe metadata is left untouched.
+   */
+  void insert_bucket(buckets_container_type& buckets,
+                     const GrowthPolicy& growth_policy,
+                     bucket_entry bucket) const noexcept {
+    std::size_t ibucket = growth_policy.bucket_for_hash(ideal_hash(bucket));
+    std::size_t dist_from_ideal_bucket = 0;
+    for (; !buckets[ibucket].empty();
+         ibucket = (ibucket + 1 < buckets.size()) ? ibucket + 1 : 0,
+         dist_from_ideal_bucket++) {
+      const std::size_t distance =
+          bucket_distance(buckets, growth_policy, ibucket);
+      if (dist_from_ideal_bucket > distance) {
+        bucket.set_distance(dist_from_ideal_bucket);
+        std::swap(bucket, buckets[ibucket]);
+        dist_from_ideal_bucket = distance;
+      }
+    }
+
+    bucket.set_distance(dist_from_ideal_bucket);
+    buckets[ibucket] = bucket;
+  }
+
+  /**
+   * Threads are only used if the map is empty and the buckets array, reserved
+   * for all the elements, can be split in ranges of at least
+   * PARALLEL_REHASH__MIN_RANGE_SIZE buckets. Otherwise, or if a range spills
+   * too many buckets, fallback to insert(first, last).
+   */
+  template <class InputIt>
+  void build_parallel(InputIt first, InputIt last, size_type /*nb_threads*/,
+                      std::false_type /*parallel build*/) {
+    insert(first, last);
   }
 
-  template <class... Args>
-  iterator emplace_hint(const_iterator hint, Args&&... args) {
-    return insert_hint(hint, value_type(std::forward<Args>(args)...));
+  template <class RandomIt>
+  void build_parallel(RandomIt first, RandomIt last, size_type nb_threads,
+                      std::true_type /*parallel build*/) {
+    if (!empty() || first == last) {
+      insert(first, last);
+      return;
+    }
+
+    const size_type nb_elements = size_type(last - first);
+    if (nb_elements > max_size()) {
+      TSL_OH_THROW_OR_TERMINATE(std::length_error,
+                                "The map exceeds its maximum size.");
+    }
+
+    clear();
+    reserve(nb_elements);
+
+    size_type nb_ranges = 1;
+    while (nb_ranges * 2 <= nb_threads &&
+           bucket_count() / (nb_ranges * 2) >=
+               PARALLEL_REHASH__MIN_RANGE_SIZE) {
+      nb_ranges *= 2;
+    }
+
+    if (nb_ranges == 1) {
+      insert(first, last);
+      return;
+    }
+
+    if (!build_parallel_impl(first, nb_elements, nb_ranges)) {
+      clear();
+      insert(first, last);
+    }
+  }
+
+  /**
+   * Fill the empty m_buckets, sized for 'nb_elements' values, with the values
+   * of [first, first + nb_elements) in 'nb_ranges' threads. Each thread:
+   *
+   * - hashes a chunk of the input and counts its elements per range of
+   *   buckets (the ranges of rehash_impl_parallel). A counting sort then
+   *   groups the input indexes by range, in input order;
+   * - places the input indexes of a range in m_buckets with robin hood
+   *   insertions which stay in the range and skip the keys already placed, so
+   *   that the first occurrence of a key is kept. The insertions which would
+   *   cross the end of the range are spilled and done at the end on the
+   *   current thread, in the same order;
+   * - once the kept values are appended to m_values in input order on the
+   *   current thread, replaces the input indexes of a range of buckets by the
+   *   indexes of the values.
+   *
+   * Return false, with input indexes left in m_buckets, if a range spilled
+   * more buckets than its share of the spill array.
+   */
+  template <class RandomIt>
+  bool build_parallel_impl(RandomIt first, size_type nb_elements,
+                           size_type nb_ranges) {
+    const size_type range_size = bucket_count() / nb_ranges;
+    const size_type chunk_size = nb_elements / nb_ranges;
+    auto range_first = [&](size_type irange) {
+      return (irange == nb_ranges) ? bucket_count() : irange * range_size;
+    };
+    auto chunk_first = [&](size_type ichunk) {
+      return (ichunk == nb_ranges) ? nb_elements : ichunk * chunk_size;
+    };
+    auto range_of = [&](std::size_t hash) {
+      return std::min(bucket_for_hash(hash) / range_size, nb_ranges - 1);
+    };
+
+    // positions[ichunk * nb_ranges + irange] counts the elements of the chunk
+    // in the range, then is the position in 'order' of the next one.
+    std::vector<std::size_t> hashes(nb_elements);
+    std::vector<size_type> positions(nb_ranges * nb_ranges);
+    parallel_for(nb_ranges, [&](std::size_t ichunk) {
+      for (size_type i = chunk_first(ichunk); i < chunk_first(ichunk + 1);
+           i++) {
+        hashes[i] = hash_key(KeySelect()(first[i]));
+        positions[ichunk * nb_ranges + range_of(hashes[i])]++;
+      }
+    });
+
+    std::vector<size_type> range_positions(nb_ranges + 1);
+    size_type position = 0;
+    for (size_type irange = 0; irange < nb_ranges; irange++) {
+      range_positions[irange] = position;
+      for (size_type ichunk = 0; ichunk < nb_ranges; ichunk++) {
+        const size_type count = positions[ichunk * nb_ranges + irange];
+        positions[ichunk * nb_ranges + irange] = position;
+        position += count;
+      }
+    }
+    range_positions[nb_ranges] = position;
+
+    std::vector<size_type> order(nb_elements);
+    parallel_for(nb_ranges, [&](std::size_t ichunk) {
+      for (size_type i = chunk_first(ichunk); i < chunk_first(ichunk + 1);
+           i++) {
+        order[positions[ichunk * nb_ranges + range_of(hashes[i])]++] = i;
+      }
+    });
+
+    const size_type spill_capacity = std::max(
+        size_type(PARALLEL_REHASH__MIN_SPILL_CAPACITY), range_size / 16);
+    buckets_container_type spills(nb_ranges * spill_capacity,
+                                  m_buckets.get_allocator());
+    std::vector<size_type> nb_spills(nb_ranges);
+
+    parallel_for(nb_ranges, [&](std::size_t irange) {
+      bucket_entry* range_spills = spills.data() + irange * spill_capacity;
+      for (size_type i = range_positions[irange];
+           i < range_positions[irange + 1]; i++) {
+        const bucket_entry spill = build_insert_bucket(
+            first, hashes, order[i], range_first(irange + 1));
+        if (!spill.empty()) {
+          if (nb_spills[irange] == spill_capacity) {
+            nb_spills[irange] = spill_capacity + 1;
+            return;
+          }
+
+          range_spills[nb_spills[irange]++] = spill;
+        }
+      }
+    });
+
+    for (size_type irange = 0; irange < nb_ranges; irange++) {
+      if (nb_spills[irange] > spill_capacity) {
+        return false;
+      }
+    }
+
+    for (size_type irange = 0; irange < nb_ranges; irange++) {
+      for (size_type i = 0; i < nb_spills[irange]; i++) {
+        build_insert_bucket(first, hashes,
+                            spills[irange * spill_capacity + i].index(),
+                            std::numeric_limits<std::size_t>::max());
+      }
+    }
+
+    // 'order' now maps the input indexes to the indexes in m_values,
+    // nb_elements for the dropped duplicates.
+    parallel_for(nb_ranges, [&](std::size_t ichunk) {
+      std::fill(order.begin() + chunk_first(ichunk),
+                order.begin() + chunk_first(ichunk + 1), nb_elements);
+    });
+    parallel_for(nb_ranges, [&](std::size_t irange) {
+      for (size_type ibucket = range_first(irange);
+           ibucket < range_first(irange + 1); ibucket++) {
+        if (!m_buckets[ibucket].empty()) {
+          order[m_buckets[ibucket].index()] = 0;
+        }
+      }
+    });
+
+    // Leave the map empty if a value throws on copy.
+    struct clear_on_exception {
+      ~clear_on_exception() {
+        if (!done) {
+          map.clear();
+        }
+      }
+
+      ordered_hash& map;
+      bool done;
+    } guard{*this, false};
+
+    for (size_type i = 0; i < nb_elements; i++) {
+      if (order[i] != nb_elements) {
+        order[i] = values_raw_size();
+        m_values.emplace_back(first[i]);
+      }
+    }
+    guard.done = true;
+
+    parallel_for(nb_ranges, [&](std::size_t irange) {
+      for (size_type ibucket = range_first(irange);
+           ibucket < range_first(irange + 1); ibucket++) {
+        bucket_entry& bucket = m_buckets[ibucket];
+        if (!bucket.empty()) {
+          bucket.set_index(stored_index(order[bucket.index()]));
+        }
+      }
+    });
+
+    fill_probe_metadata();
+
+    return true;
+  }
+
+  /**
+   * Robin hood insertion in m_buckets of the bucket of the input element
+   * first[input_index], unless its key is already there, while m_buckets
+   * stores input indexes (see build_parallel_impl). Return the bucket which
+   * would have to go to 'ibucket_end' or past it, an empty bucket if none.
+   * The probing wraps around at the end of m_buckets if 'ibucket_end' is
+   * std::numeric_limits<std::size_t>::max().
+   */
+  template <class RandomIt>
+  bucket_entry build_insert_bucket(RandomIt first,
+                                   const std::vector<std::size_t>& hashes,
+                                   size_type input_index,
+                                   std::size_t ibucket_end) {
+    bucket_entry bucket;
+    bucket.set_index(index_type(input_index));
+    bucket.set_truncated_hash(bucket_entry::truncate_hash(hashes[input_index]));
+
+    // False once 'bucket' is a displaced bucket, whose key is already unique.
+    bool new_key = true;
+    for (std::size_t ibucket = bucket_for_hash(hashes[input_index]),
+                     dist_from_ideal_bucket = 0;
+         ; ibucket++, dist_from_ideal_bucket++) {
+      if (ibucket == ibucket_end) {
+        return bucket;
+      }
+      if (ibucket == bucket_count()) {
+        ibucket = 0;
+      }
+
+      if (m_buckets[ibucket].empty()) {
+        bucket.set_distance(dist_from_ideal_bucket);
+        m_buckets[ibucket] = bucket;
+        return bucket_entry();
+      }
+
+      if (new_key &&
+          m_buckets[ibucket].truncated_hash() == bucket.truncated_hash() &&
+          compare_keys(KeySelect()(first[input_index]),
+                       KeySelect()(first[m_buckets[ibucket].index()]))) {
+        return bucket_entry();
+      }
+
+      const std::size_t distance =
+          build_bucket_distance(hashes, ibucket, has_stored_distance());
+      if (dist_from_ideal_bucket > distance) {
+        bucket.set_distance(dist_from_ideal_bucket);
+        std::swap(bucket, m_buckets[ibucket]);
+        dist_from_ideal_bucket = distance;
+        new_key = false;
+      }
+    }
   }
 
-  template <class K, class... Args>
-  std::pair<iterator, bool> try_emplace(K&& key, Args&&... value_args) {
-    return insert_impl(
-        key, std::piecewise_construct,
-        std::forward_as_tuple(std::forward<K>(key)),
-        std::forward_as_tuple(std::forward<Args>(value_args)...));
+  /**
+   * distance_from_ideal_bucket(ibucket) while m_buckets stores input indexes,
+   * the hash of the key is then in 'hashes'.
+   */
+  std::size_t build_bucket_distance(const std::vector<std::size_t>& /*hashes*/,
+                                    std::size_t ibucket,
+                                    std::false_type /*stored distance*/) const
+      noexcept {
+    return distance_from_ideal_bucket(ibucket);
   }
 
-  template <class K, class... Args>
-  iterator try_emplace_hint(const_iterator hint, K&& key, Args&&... args) {
-    if (hint != cend() && compare_keys(KeySelect()(*hint), key)) {
-      return mutable_iterator(hint);
+  std::size_t build_bucket_distance(const std::vector<std::size_t>& hashes,
+                                    std::size_t ibucket,
+                                    std::true_type /*stored distance*/) const
+      noexcept {
+    const std::size_t distance = m_buckets[ibucket].distance();
+    if (distance < bucket_entry::DISTANCE_OVERFLOW) {
+      return distance;
     }
 
-    return try_emplace(std::forward<K>(key), std::forward<Args>(args)...).first;
+    const std::size_t ideal_bucket =
+        bucket_for_hash(hashes[m_buckets[ibucket].index()]);
+    return (ibucket >= ideal_bucket)
+               ? ibucket - ideal_bucket
+               : (bucket_count() + ibucket) - ideal_bucket;
   }
 
+  /*
+   * Incremental rehash, see incremental_rehash(size_type). All the buckets of
+   * m_old_buckets before m_old_ibucket are empty.
+   */
+  bool rehash_in_progress() const noexcept { return !m_old_buckets.empty(); }
+
   /**
-   * Here to avoid `template<class K> size_type erase(const K& key)` being used
-   * when we use an `iterator` instead of a `const_iterator`.
+   * Called on each insertion and non-const lookup. Migrate some buckets of
+   * m_old_buckets if a rehash is in progress, otherwise prepare the buckets
+   * array of the next growth.
    */
-  iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+  void incremental_rehash_step() {
+    if (rehash_in_progress()) {
+      migrate_old_buckets(m_incremental_rehash);
+    } else if (m_incremental_rehash > 0) {
+      prepare_next_buckets();
+    }
+  }
 
-  iterator erase(const_iterator pos) {
-    tsl_oh_assert(pos != cend());
+  /**
+   * Allocating a buckets array is cheap but initializing it touches all its
+   * memory, which would be the main cost left in the insertion triggering the
+   * growth. Reserve the next buckets array once the map is close enough to its
+   * load threshold and initialize m_incremental_rehash *
+   * INCREMENTAL_REHASH__NEXT_BUCKETS_RATIO of its buckets on each step.
+   */
+  void prepare_next_buckets() {
+    if (bucket_count() == 0 || bucket_count() > max_bucket_count() / 2) {
+      return;
+    }
 
-    const std::size_t index_erase = iterator_to_index(pos);
+    const size_type next_bucket_count = GrowthPolicy::next_bucket_count();
+    const size_type nb_buckets = std::max(
+        size_type(1), m_incremental_rehash *
+                          size_type(INCREMENTAL_REHASH__NEXT_BUCKETS_RATIO));
 
-    auto it_bucket = find_key(pos.key(), hash_key(pos.key()));
-    tsl_oh_assert(it_bucket != m_buckets_data.end());
+    if (m_next_buckets.size() != next_bucket_count) {
+      if (size() + next_bucket_count / nb_buckets < m_load_threshold) {
+        return;
+      }
 
-    erase_value_from_bucket(it_bucket);
+      buckets_container_type(next_bucket_count, m_next_buckets.get_allocator(),
+                             std::false_type())
+          .swap(m_next_buckets);
+      m_nb_next_buckets = 0;
+    }
 
-    /*
-     * One element was removed from m_values, due to the left shift the next
-     * element is now at the position of the previous element (or end if none).
-     */
-    return begin() + index_erase;
+    if (m_nb_next_buckets < next_bucket_count) {
+      const size_type nb_constructed =
+          std::min(next_bucket_count, m_nb_next_buckets + nb_buckets);
+      m_next_buckets.construct_buckets(m_nb_next_buckets, nb_constructed);
+      m_nb_next_buckets = nb_constructed;
+    }
   }
 
-  iterator erase(const_iterator first, const_iterator last) {
-    if (first == last) {
-      return mutable_iterator(first);
+  /**
+   * Migrate up to 'nb_buckets' buckets from m_old_buckets to m_buckets,
+   * an empty bucket counts as one. Free m_old_buckets once all the buckets have
+   * been migrated.
+   */
+  void migrate_old_buckets(size_type nb_buckets) {
+    if (!rehash_in_progress()) {
+      return;
     }
 
-    tsl_oh_assert(std::distance(first, last) > 0);
-    const std::size_t start_index = iterator_to_index(first);
-    const std::size_t nb_values = std::size_t(std::distance(first, last));
-    const std::size_t end_index = start_index + nb_values;
-
-    // Delete all values
-#ifdef TSL_OH_NO_CONTAINER_ERASE_CONST_ITERATOR
-    auto next_it = m_values.erase(mutable_iterator(first).m_iterator,
-                                  mutable_iterator(last).m_iterator);
-#else
-    auto next_it = m_values.erase(first.m_iterator, last.m_iterator);
-#endif
-
-    /*
-     * Mark the buckets corresponding to the values as empty and do a backward
-     * shift.
-     *
-     * Also, the erase operation on m_values has shifted all the values on the
-     * right of last.m_iterator. Adapt the indexes for these values.
-     */
-    std::size_t ibucket = 0;
-    while (ibucket < m_buckets_data.size()) {
-      if (m_buckets[ibucket].empty()) {
-        ibucket++;
-      } else if (m_buckets[ibucket].index() >= start_index &&
-                 m_buckets[ibucket].index() < end_index) {
-        m_buckets[ibucket].clear();
-        backward_shift(ibucket);
-        // Don't increment ibucket, backward_shift may have replaced current
-        // bucket.
-      } else if (m_buckets[ibucket].index() >= end_index) {
-        m_buckets[ibucket].set_index(
-            index_type(m_buckets[ibucket].index() - nb_values));
-        ibucket++;
+    for (; nb_buckets > 0 && m_old_ibucket < m_old_buckets.size();
+         nb_buckets--) {
+      if (m_old_buckets[m_old_ibucket].empty()) {
+        m_old_ibucket++;
       } else {
-        ibucket++;
+        // The backward shift may move another bucket to m_old_ibucket, don't
+        // increment it.
+        migrate_old_bucket(m_old_ibucket);
       }
     }
 
-    return iterator(next_it);
+    if (m_old_ibucket == m_old_buckets.size()) {
+      m_old_buckets.clear();
+      m_old_ibucket = 0;
+    }
   }
 
-  template <class K>
-  size_type erase(const K& key) {
-    return erase(key, hash_key(key));
+  void complete_incremental_rehash() {
+    migrate_old_buckets(std::numeric_limits<size_type>::max());
   }
 
-  template <class K>
-  size_type erase(const K& key, std::size_t hash) {
-    return erase_impl(key, hash);
+  void migrate_old_bucket(std::size_t ibucket) noexcept {
+    tsl_oh_assert(!m_old_buckets[ibucket].empty());
+    insert_rehashed_bucket(m_old_buckets[ibucket]);
+
+    // Same as clear_bucket and backward_shift but on m_old_buckets.
+    m_old_buckets[ibucket].clear();
+    for (std::size_t next_ibucket = next_old_bucket(ibucket);
+         !m_old_buckets[next_ibucket].empty();
+         ibucket = next_ibucket, next_ibucket = next_old_bucket(next_ibucket)) {
+      const std::size_t distance = old_distance_from_ideal_bucket(next_ibucket);
+      if (distance == 0) {
+        break;
+      }
+
+      std::swap(m_old_buckets[ibucket], m_old_buckets[next_ibucket]);
+      m_old_buckets[ibucket].set_distance(distance - 1);
+    }
   }
 
-  void swap(ordered_hash& other) {
-    using std::swap;
+  template <class K>
+  const bucket_entry* find_key_in_old_buckets(const K& key,
+                                              std::size_t hash) const {
+    tsl_oh_assert(rehash_in_progress());
 
-    swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
-    swap(static_cast<KeyEqual&>(*this), static_cast<KeyEqual&>(other));
-    swap(m_buckets_data, other.m_buckets_data);
-    swap(m_buckets, other.m_buckets);
-    swap(m_hash_mask, other.m_hash_mask);
-    swap(m_values, other.m_values);
-    swap(m_load_threshold, other.m_load_threshold);
-    swap(m_max_load_factor, other.m_max_load_factor);
-    swap(m_grow_on_next_insert, other.m_grow_on_next_insert);
+    for (std::size_t ibucket = m_old_growth_policy.bucket_for_hash(
+                         bucket_entry::ideal_hash(hash)),
+                     dist_from_ideal_bucket = 0;
+         ; ibucket = next_old_bucket(ibucket), dist_from_ideal_bucket++) {
+      const bucket_entry& bucket = m_old_buckets[ibucket];
+      if (bucket.empty() ||
+          dist_from_ideal_bucket > old_distance_from_ideal_bucket(ibucket)) {
+        return nullptr;
+      } else if (bucket.truncated_hash() == bucket_entry::truncate_hash(hash) &&
+                 compare_keys(key,
+                              KeySelect()(m_values[value_index(bucket)]))) {
+        return std::addressof(bucket);
+      }
+    }
   }
 
-  /*
-   * Lookup
-   */
-  template <class K, class U = ValueSelect,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  typename U::value_type& at(const K& key) {
-    return at(key, hash_key(key));
+  std::size_t old_distance_from_ideal_bucket(
+      std::size_t ibucket) const noexcept {
+    return bucket_distance(m_old_buckets, m_old_growth_policy, ibucket);
   }
 
-  template <class K, class U = ValueSelect,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  typename U::value_type& at(const K& key, std::size_t hash) {
-    return const_cast<typename U::value_type&>(
-        static_cast<const ordered_hash*>(this)->at(key, hash));
+  std::size_t next_old_bucket(std::size_t index) const noexcept {
+    index++;
+    return (index < m_old_buckets.size()) ? index : 0;
   }
 
-  template <class K, class U = ValueSelect,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  const typename U::value_type& at(const K& key) const {
-    return at(key, hash_key(key));
+  template <class T = values_container_type,
+            typename std::enable_if<is_vector<T>::value>::type* = nullptr>
+  void reserve_space_for_values(size_type count) {
+    m_values.reserve(count);
   }
 
-  template <class K, class U = ValueSelect,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  const typename U::value_type& at(const K& key, std::size_t hash) const {
-    auto it = find(key, hash);
-    if (it != end()) {
-      return it.value();
-    } else {
-      TSL_OH_THROW_OR_TERMINATE(std::out_of_range, "Couldn't find the key.");
-    }
-  }
+  template <class T = values_container_type,
+            typename std::enable_if<!is_vector<T>::value>::type* = nullptr>
+  void reserve_space_for_values(size_type /*count*/) {}
 
-  template <class K, class U = ValueSelect,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  typename U::value_type& operator[](K&& key) {
-    return try_emplace(std::forward<K>(key)).first.value();
-  }
+  /**
+   * Swap the empty bucket with the values on its right until we cross another
+   * empty bucket or if the other bucket has a distance_from_ideal_bucket == 0.
+   */
+  void backward_shift(std::size_t empty_ibucket) noexcept {
+    tsl_oh_assert(m_buckets[empty_ibucket].empty());
 
-  template <class K>
-  size_type count(const K& key) const {
-    return count(key, hash_key(key));
-  }
+    std::size_t previous_ibucket = empty_ibucket;
+    for (std::size_t current_ibucket = next_bucket(previous_ibucket);
+         !m_buckets[current_ibucket].empty();
+         previous_ibucket = current_ibucket,
+                     current_ibucket = next_bucket(current_ibucket)) {
+      const std::size_t distance = distance_from_ideal_bucket(current_ibucket);
+      if (distance == 0) {
+        break;
+      }
 
-  template <class K>
-  size_type count(const K& key, std::size_t hash) const {
-    if (find(key, hash) == cend()) {
-      return 0;
-    } else {
-      return 1;
+      std::swap(m_buckets[current_ibucket], m_buckets[previous_ibucket]);
+      m_buckets[previous_ibucket].set_distance(distance - 1);
+      set_probe_metadata(previous_ibucket, distance - 1,
+                         m_buckets[previous_ibucket].truncated_hash());
+      clear_probe_metadata(current_ibucket);
     }
   }
 
-  template <class K>
-  iterator find(const K& key) {
-    return find(key, hash_key(key));
-  }
+  void erase_value_from_bucket(
+      typename buckets_container_type::iterator it_bucket) {
+    tsl_oh_assert(it_bucket != m_buckets.end() && !it_bucket->empty());
 
-  template <class K>
-  iterator find(const K& key, std::size_t hash) {
-    auto it_bucket = find_key(key, hash);
-    return (it_bucket != m_buckets_data.end())
-               ? iterator(m_values.begin() + it_bucket->index())
-               : end();
-  }
+    erase_value_at(index_type(value_index(*it_bucket)), has_tombstone_values());
 
-  template <class K>
-  const_iterator find(const K& key) const {
-    return find(key, hash_key(key));
+    // Mark the bucket as empty and do a backward shift of the values on the
+    // right
+    const std::size_t ibucket =
+        std::size_t(std::distance(m_buckets.begin(), it_bucket));
+    clear_bucket(ibucket);
+    backward_shift(ibucket);
   }
 
-  template <class K>
-  const_iterator find(const K& key, std::size_t hash) const {
-    auto it_bucket = find_key(key, hash);
-    return (it_bucket != m_buckets_data.cend())
-               ? const_iterator(m_values.begin() + it_bucket->index())
-               : end();
-  }
+  void erase_value_at(index_type index, std::false_type /*tombstones*/) {
+    m_values.erase(m_values.begin() + index);
 
-  template <class K>
-  bool contains(const K& key) const {
-    return contains(key, hash_key(key));
+    /*
+     * m_values.erase shifted all the values on the right of the erased value,
+     * shift the indexes by -1 in the buckets array for these values. If the
+     * erased value was the first one, they were all shifted and incrementing
+     * m_index_offset is enough.
+     */
+    if (m_values.empty()) {
+      m_index_offset = 0;
+    } else if (index == 0) {
+      m_index_offset++;
+    } else if (index != m_values.size()) {
+      shift_indexes_in_buckets(index + 1, -1);
+    }
   }
 
-  template <class K>
-  bool contains(const K& key, std::size_t hash) const {
-    return find(key, hash) != cend();
+  /**
+   * The other values keep their index, the compaction is left to the caller
+   * (see compact_tombstones_if_needed) as it may need to remap an index.
+   */
+  void erase_value_at(index_type index, std::true_type /*tombstones*/) {
+    m_values.tombstone(index);
   }
 
-  template <class K>
-  std::pair<iterator, iterator> equal_range(const K& key) {
-    return equal_range(key, hash_key(key));
+  /**
+   * Compact m_values if the tombstones take too much space (or if the raw
+   * indexes reach max_size()) and return the new index of 'tracked_index',
+   * which must be the index of a value which is not a tombstone or the raw
+   * size of m_values. No-op without tombstones.
+   */
+  std::size_t compact_tombstones_if_needed(std::size_t tracked_index) {
+    return compact_tombstones_if_needed(tracked_index, has_tombstone_values());
   }
 
-  template <class K>
-  std::pair<iterator, iterator> equal_range(const K& key, std::size_t hash) {
-    iterator it = find(key, hash);
-    return std::make_pair(it, (it == end()) ? it : std::next(it));
+  std::size_t compact_tombstones_if_needed(
+      std::size_t tracked_index, std::false_type /*tombstones*/) noexcept {
+    return tracked_index;
   }
 
-  template <class K>
-  std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
-    return equal_range(key, hash_key(key));
-  }
+  std::size_t compact_tombstones_if_needed(std::size_t tracked_index,
+                                           std::true_type /*tombstones*/) {
+    if (float(m_values.nb_tombstones()) <
+            COMPACT_TOMBSTONES__RATIO *
+                float(m_values.raw_size() + bucket_count()) &&
+        m_values.raw_size() < max_size()) {
+      return tracked_index;
+    }
 
-  template <class K>
-  std::pair<const_iterator, const_iterator> equal_range(
-      const K& key, std::size_t hash) const {
-    const_iterator it = find(key, hash);
-    return std::make_pair(it, (it == cend()) ? it : std::next(it));
+    return compact_tombstones(tracked_index);
   }
 
-  /*
-   * Bucket interface
-   */
-  size_type bucket_count() const { return m_buckets_data.size(); }
-
-  size_type max_bucket_count() const { return m_buckets_data.max_size(); }
+  void compact_all_tombstones(std::false_type /*tombstones*/) noexcept {}
 
-  /*
-   *  Hash policy
-   */
-  float load_factor() const {
-    if (bucket_count() == 0) {
-      return 0;
+  void compact_all_tombstones(std::true_type /*tombstones*/) {
+    if (m_values.nb_tombstones() > 0) {
+      compact_tombstones(m_values.raw_size());
     }
-
-    return float(size()) / float(bucket_count());
   }
 
-  float max_load_factor() const { return m_max_load_factor; }
+  std::size_t compact_tombstones(std::size_t tracked_index) {
+    m_values.prepare_compaction();
+    for (buckets_container_type* buckets : {&m_buckets, &m_old_buckets}) {
+      for (bucket_entry& bucket : *buckets) {
+        if (!bucket.empty()) {
+          bucket.set_index(
+              index_type(m_values.compacted_index(value_index(bucket))));
+        }
+      }
+    }
+    m_index_offset = 0;
 
-  void max_load_factor(float ml) {
-    m_max_load_factor = clamp(ml, float(MAX_LOAD_FACTOR__MINIMUM),
-                              float(MAX_LOAD_FACTOR__MAXIMUM));
+    tracked_index = m_values.compacted_index(tracked_index);
+    m_values.compact();
 
-    m_max_load_factor = ml;
-    m_load_threshold = size_type(float(bucket_count()) * m_max_load_factor);
+    return tracked_index;
   }
 
-  void rehash(size_type count) {
-    count = std::max(count,
-                     size_type(std::ceil(float(size()) / max_load_factor())));
-    rehash_impl(count);
+  /*
+   * Access to m_values through the indexes stored in the buckets, raw indexes
+   * if m_values has tombstones.
+   */
+  typename values_container_type::iterator values_iterator_at(
+      std::size_t index) {
+    return values_iterator_at(index, has_tombstone_values());
   }
 
-  void reserve(size_type count) {
-    reserve_space_for_values(count);
+  typename values_container_type::iterator values_iterator_at(
+      std::size_t index, std::false_type /*tombstones*/) {
+    return m_values.begin() + index;
+  }
 
-    count = size_type(std::ceil(float(count) / max_load_factor()));
-    rehash(count);
+  typename values_container_type::iterator values_iterator_at(
+      std::size_t index, std::true_type /*tombstones*/) {
+    return m_values.iterator_at(index);
   }
 
-  /*
-   * Observers
-   */
-  hasher hash_function() const { return static_cast<const Hash&>(*this); }
+  typename values_container_type::const_iterator values_iterator_at(
+      std::size_t index) const {
+    return values_iterator_at(index, has_tombstone_values());
+  }
 
-  key_equal key_eq() const { return static_cast<const KeyEqual&>(*this); }
+  typename values_container_type::const_iterator values_iterator_at(
+      std::size_t index, std::false_type /*tombstones*/) const {
+    return m_values.cbegin() + index;
+  }
 
-  /*
-   * Other
-   */
-  iterator mutable_iterator(const_iterator pos) {
-    return iterator(m_values.begin() + iterator_to_index(pos));
+  typename values_container_type::const_iterator values_iterator_at(
+      std::size_t index, std::true_type /*tombstones*/) const {
+    return m_values.iterator_at(index);
   }
 
-  iterator nth(size_type index) {
-    tsl_oh_assert(index <= size());
-    return iterator(m_values.begin() + index);
+  std::size_t values_iterator_index(
+      typename values_container_type::const_iterator it) const noexcept {
+    return values_iterator_index(it, has_tombstone_values());
   }
 
-  const_iterator nth(size_type index) const {
-    tsl_oh_assert(index <= size());
-    return const_iterator(m_values.cbegin() + index);
+  std::size_t values_iterator_index(
+      typename values_container_type::const_iterator it,
+      std::false_type /*tombstones*/) const noexcept {
+    const auto dist = std::distance(m_values.cbegin(), it);
+    tsl_oh_assert(dist >= 0);
+
+    return std::size_t(dist);
   }
 
-  const_reference front() const {
-    tsl_oh_assert(!empty());
-    return m_values.front();
+  std::size_t values_iterator_index(
+      typename values_container_type::const_iterator it,
+      std::true_type /*tombstones*/) const noexcept {
+    return it.index();
   }
 
-  const_reference back() const {
-    tsl_oh_assert(!empty());
-    return m_values.back();
+  std::size_t values_raw_size() const noexcept {
+    return values_raw_size(has_tombstone_values());
   }
 
-  const values_container_type& values_container() const noexcept {
-    return m_values;
+  std::size_t values_raw_size(std::false_type /*tombstones*/) const noexcept {
+    return m_values.size();
   }
 
-  values_container_type release() {
-    values_container_type ret;
-    for (auto& bucket : m_buckets_data) {
-      bucket.clear();
-    }
-    m_grow_on_next_insert = false;
-    std::swap(ret, m_values);
-    return ret;
+  std::size_t values_raw_size(std::true_type /*tombstones*/) const noexcept {
+    return m_values.raw_size();
   }
 
-  template <class U = values_container_type,
-            typename std::enable_if<is_vector<U>::value>::type* = nullptr>
-  const typename values_container_type::value_type* data() const noexcept {
-    return m_values.data();
+  typename values_container_type::iterator values_nth(
+      size_type index, std::false_type /*tombstones*/) {
+    return m_values.begin() + index;
   }
 
-  template <class U = values_container_type,
-            typename std::enable_if<is_vector<U>::value>::type* = nullptr>
-  size_type capacity() const noexcept {
-    return m_values.capacity();
+  typename values_container_type::iterator values_nth(
+      size_type index, std::true_type /*tombstones*/) {
+    return m_values.nth(index);
   }
 
-  void shrink_to_fit() { m_values.shrink_to_fit(); }
+  typename values_container_type::const_iterator values_nth(
+      size_type index, std::false_type /*tombstones*/) const {
+    return m_values.cbegin() + index;
+  }
 
-  template <typename P>
-  std::pair<iterator, bool> insert_at_position(const_iterator pos, P&& value) {
-    return insert_at_position_impl(pos.m_iterator, KeySelect()(value),
-                                   std::forward<P>(value));
+  typename values_container_type::const_iterator values_nth(
+      size_type index, std::true_type /*tombstones*/) const {
+    return m_values.nth(index);
   }
 
-  template <class... Args>
-  std::pair<iterator, bool> emplace_at_position(const_iterator pos,
-                                                Args&&... args) {
-    return insert_at_position(pos, value_type(std::forward<Args>(args)...));
+  /**
+   * Index in m_values of the value of the non-empty 'bucket'.
+   */
+  std::size_t value_index(const bucket_entry& bucket) const noexcept {
+    return index_type(bucket.index() - m_index_offset);
   }
 
-  template <class K, class... Args>
-  std::pair<iterator, bool> try_emplace_at_position(const_iterator pos, K&& key,
-                                                    Args&&... value_args) {
-    return insert_at_position_impl(
-        pos.m_iterator, key, std::piecewise_construct,
-        std::forward_as_tuple(std::forward<K>(key)),
-        std::forward_as_tuple(std::forward<Args>(value_args)...));
+  /**
+   * Index to store in a bucket for the value at 'index' in m_values.
+   */
+  index_type stored_index(std::size_t index) const noexcept {
+    return index_type(index + m_index_offset);
   }
 
-  void pop_back() {
-    tsl_oh_assert(!empty());
-    erase(std::prev(end()));
+  /**
+   * Subtract m_index_offset from the indexes stored in the buckets if the
+   * index of a new value at the end of m_values would exceed
+   * bucket_entry::max_size() once offset. Amortized by the
+   * bucket_entry::max_size() - size() front erasures since the last reset.
+   */
+  void reset_index_offset_if_needed() noexcept {
+    if (m_index_offset <= bucket_entry::max_size() - values_raw_size()) {
+      return;
+    }
+
+    for (buckets_container_type* buckets : {&m_buckets, &m_old_buckets}) {
+      for (bucket_entry& bucket : *buckets) {
+        if (!bucket.empty()) {
+          bucket.set_index(index_type(value_index(bucket)));
+        }
+      }
+    }
+    m_index_offset = 0;
   }
 
   /**
-   * Here to avoid `template<class K> size_type unordered_erase(const K& key)`
-   * being used when we use a iterator instead of a const_iterator.
+   * Shift any index >= index_above_or_equal in m_buckets (and
+   * m_old_buckets) by delta.
+   *
+   * delta must be equal to 1 or -1.
    */
-  iterator unordered_erase(iterator pos) {
-    return unordered_erase(const_iterator(pos));
+  void shift_indexes_in_buckets(index_type index_above_or_equal,
+                                int delta) noexcept {
+    tsl_oh_assert(delta == 1 || delta == -1);
+    TSL_OH_INSTRUMENT(tsl::ordered_hash_event::shift_indexes_start,
+                      m_buckets.size() + m_old_buckets.size());
+
+    for (buckets_container_type* buckets : {&m_buckets, &m_old_buckets}) {
+      for (bucket_entry& bucket : *buckets) {
+        if (!bucket.empty() && value_index(bucket) >= index_above_or_equal) {
+          tsl_oh_assert(delta >= 0 ||
+                        bucket.index() >= static_cast<index_type>(-delta));
+          tsl_oh_assert(delta <= 0 ||
+                        (bucket_entry::max_size() - bucket.index()) >=
+                            static_cast<index_type>(delta));
+          bucket.set_index(static_cast<index_type>(bucket.index() + delta));
+        }
+      }
+    }
+
+    TSL_OH_INSTRUMENT(tsl::ordered_hash_event::shift_indexes_end,
+                      m_buckets.size() + m_old_buckets.size());
   }
 
-  iterator unordered_erase(const_iterator pos) {
+  iterator erase_at(const_iterator pos, std::false_type /*tombstones*/) {
     const std::size_t index_erase = iterator_to_index(pos);
-    unordered_erase(pos.key());
+
+    auto it_bucket = find_key(pos.key(), hash_key(pos.key()));
+    tsl_oh_assert(it_bucket != m_buckets.end());
+
+    erase_value_from_bucket(it_bucket);
 
     /*
-     * One element was deleted, index_erase now points to the next element as
-     * the elements after the deleted value were shifted to the left in m_values
-     * (will be end() if we deleted the last element).
+     * One element was removed from m_values, due to the left shift the next
+     * element is now at the position of the previous element (or end if none).
      */
     return begin() + index_erase;
   }
 
-  template <class K>
-  size_type unordered_erase(const K& key) {
-    return unordered_erase(key, hash_key(key));
-  }
+  iterator erase_at(const_iterator pos, std::true_type /*tombstones*/) {
+    std::size_t index_next = iterator_to_index(std::next(pos));
 
-  template <class K>
-  size_type unordered_erase(const K& key, std::size_t hash) {
-    auto it_bucket_key = find_key(key, hash);
-    if (it_bucket_key == m_buckets_data.end()) {
-      return 0;
-    }
+    auto it_bucket = find_key(pos.key(), hash_key(pos.key()));
+    tsl_oh_assert(it_bucket != m_buckets.end());
 
-    /**
-     * If we are not erasing the last element in m_values, we swap
-     * the element we are erasing with the last element. We then would
-     * just have to do a pop_back() in m_values.
+    erase_value_from_bucket(it_bucket);
+
+    /*
+     * The other values kept their raw index, unless the erased value was the
+     * last one and the trailing tombstones were removed, in which case
+     * index_next was end().
      */
-    if (!compare_keys(key, KeySelect()(back()))) {
-      auto it_bucket_last_elem =
-          find_key(KeySelect()(back()), hash_key(KeySelect()(back())));
-      tsl_oh_assert(it_bucket_last_elem != m_buckets_data.end());
-      tsl_oh_assert(it_bucket_last_elem->index() == m_values.size() - 1);
+    index_next = std::min(index_next, m_values.raw_size());
+    return iterator(
+        values_iterator_at(compact_tombstones_if_needed(index_next)));
+  }
 
-      using std::swap;
-      swap(m_values[it_bucket_key->index()],
-           m_values[it_bucket_last_elem->index()]);
-      swap(it_bucket_key->index_ref(), it_bucket_last_elem->index_ref());
-    }
+  iterator erase_range(const_iterator first, const_iterator last,
+                       std::false_type /*tombstones*/) {
+    tsl_oh_assert(std::distance(first, last) > 0);
+    const std::size_t start_index = iterator_to_index(first);
+    const std::size_t nb_values = std::size_t(std::distance(first, last));
+    const std::size_t end_index = start_index + nb_values;
 
-    erase_value_from_bucket(it_bucket_key);
+    if (start_index == 0 || end_index == m_values.size()) {
+      return erase_range_front_or_back(first, last);
+    }
 
-    return 1;
-  }
+    // The loop below is in O(bucket_count()) anyway.
+    complete_incremental_rehash();
 
-  /**
-   * Remove all entries for which the given predicate matches.
-   */
-  template <class Predicate>
-  size_type erase_if(Predicate& pred) {
-    // Get the bucket associated with the given element.
-    auto get_bucket = [this](typename values_container_type::iterator it) {
-      return find_key(KeySelect()(*it), hash_key(KeySelect()(*it)));
-    };
-    // Clear a bucket without touching the container holding the values.
-    auto clear_bucket = [this](typename buckets_container_type::iterator it) {
-      tsl_oh_assert(it != m_buckets_data.end());
-      it->clear();
-      backward_shift(std::size_t(std::distance(m_buckets_data.begin(), it)));
-    };
-    // Ensure that only const references are passed to the predicate.
-    auto cpred = [&pred](typename values_container_type::const_reference x) {
-      return pred(x);
-    };
+    // Delete all values
+#ifdef TSL_OH_NO_CONTAINER_ERASE_CONST_ITERATOR
+    auto next_it = m_values.erase(mutable_iterator(first).m_iterator,
+                                  mutable_iterator(last).m_iterator);
+#else
+    auto next_it = m_values.erase(first.m_iterator, last.m_iterator);
+#endif
 
-    // Find first element that matches the predicate.
-    const auto last = m_values.end();
-    auto first = std::find_if(m_values.begin(), last, cpred);
-    if (first == last) {
-      return 0;
-    }
-    // Remove all elements that match the predicate.
-    clear_bucket(get_bucket(first));
-    for (auto it = std::next(first); it != last; ++it) {
-      auto it_bucket = get_bucket(it);
-      if (cpred(*it)) {
-        clear_bucket(it_bucket);
+    /*
+     * Mark the buckets corresponding to the values as empty and do a backward
+     * shift.
+     *
+     * Also, the erase operation on m_values has shifted all the values on the
+     * right of last.m_iterator. Adapt the indexes for these values.
+     */
+    std::size_t ibucket = 0;
+    while (ibucket < m_buckets.size()) {
+      if (m_buckets[ibucket].empty()) {
+        ibucket++;
+      } else if (value_index(m_buckets[ibucket]) >= start_index &&
+                 value_index(m_buckets[ibucket]) < end_index) {
+        clear_bucket(ibucket);
+        backward_shift(ibucket);
+        // Don't increment ibucket, backward_shift may have replaced current
+        // bucket.
+      } else if (value_index(m_buckets[ibucket]) >= end_index) {
+        m_buckets[ibucket].set_index(
+            index_type(m_buckets[ibucket].index() - nb_values));
+        ibucket++;
       } else {
-        it_bucket->set_index(
-            static_cast<index_type>(std::distance(m_values.begin(), first)));
-        *first++ = std::move(*it);
+        ibucket++;
       }
     }
-    // Resize the vector and return the number of deleted elements.
-    auto deleted = static_cast<size_type>(std::distance(first, last));
-    m_values.erase(first, last);
-    return deleted;
-  }
 
-  template <class Serializer>
-  void serialize(Serializer& serializer) const {
-    serialize_impl(serializer);
+    return iterator(next_it);
   }
 
-  template <class Deserializer>
-  void deserialize(Deserializer& deserializer, bool hash_compatible) {
-    deserialize_impl(deserializer, hash_compatible);
-  }
+  /**
+   * Erase a range at the front or at the back of m_values in O(last - first)
+   * by looking up the bucket of each erased value. The indexes of the other
+   * values don't change (at the back) or are all shifted by the same amount
+   * (at the front), which is absorbed by m_index_offset.
+   */
+  iterator erase_range_front_or_back(const_iterator first,
+                                     const_iterator last) {
+    const std::size_t nb_values = std::size_t(std::distance(first, last));
+    const bool front = (first == cbegin());
 
-  friend bool operator==(const ordered_hash& lhs, const ordered_hash& rhs) {
-    return lhs.m_values == rhs.m_values;
-  }
+    for (auto it = first.m_iterator; it != last.m_iterator; ++it) {
+      auto it_bucket = find_key(KeySelect()(*it), hash_key(KeySelect()(*it)));
+      tsl_oh_assert(it_bucket != m_buckets.end());
 
-  friend bool operator!=(const ordered_hash& lhs, const ordered_hash& rhs) {
-    return lhs.m_values != rhs.m_values;
-  }
+      const std::size_t ibucket =
+          std::size_t(std::distance(m_buckets.begin(), it_bucket));
+      clear_bucket(ibucket);
+      backward_shift(ibucket);
+    }
 
-  friend bool operator<(const ordered_hash& lhs, const ordered_hash& rhs) {
-    return lhs.m_values < rhs.m_values;
-  }
+#ifdef TSL_OH_NO_CONTAINER_ERASE_CONST_ITERATOR
+    auto next_it = m_values.erase(mutable_iterator(first).m_iterator,
+                                  mutable_iterator(last).m_iterator);
+#else
+    auto next_it = m_values.erase(first.m_iterator, last.m_iterator);
+#endif
 
-  friend bool operator<=(const ordered_hash& lhs, const ordered_hash& rhs) {
-    return lhs.m_values <= rhs.m_values;
-  }
+    if (m_values.empty()) {
+      m_index_offset = 0;
+    } else if (front) {
+      m_index_offset = index_type(m_index_offset + nb_values);
+    }
 
-  friend bool operator>(const ordered_hash& lhs, const ordered_hash& rhs) {
-    return lhs.m_values > rhs.m_values;
+    return iterator(next_it);
   }
 
-  friend bool operator>=(const ordered_hash& lhs, const ordered_hash& rhs) {
-    return lhs.m_values >= rhs.m_values;
-  }
+  iterator erase_range(const_iterator first, const_iterator last,
+                       std::true_type /*tombstones*/) {
+    std::size_t end_index = iterator_to_index(last);
 
- private:
-  template <class K>
-  std::size_t hash_key(const K& key) const {
-    return Hash::operator()(key);
-  }
+    // The iterator to the next value is computed before the erasure of the
+    // current one, see erase_at.
+    auto it = first.m_iterator;
+    while (it != last.m_iterator) {
+      const value_type& value = *it++;
 
-  template <class K1, class K2>
-  bool compare_keys(const K1& key1, const K2& key2) const {
-    return KeyEqual::operator()(key1, key2);
+      auto it_bucket =
+          find_key(KeySelect()(value), hash_key(KeySelect()(value)));
+      tsl_oh_assert(it_bucket != m_buckets.end());
+      erase_value_from_bucket(it_bucket);
+    }
+
+    end_index = std::min(end_index, m_values.raw_size());
+    return iterator(
+        values_iterator_at(compact_tombstones_if_needed(end_index)));
   }
 
-  template <class K>
-  typename buckets_container_type::iterator find_key(const K& key,
-                                                     std::size_t hash) {
-    auto it = static_cast<const ordered_hash*>(this)->find_key(key, hash);
-    return m_buckets_data.begin() + std::distance(m_buckets_data.cbegin(), it);
+  iterator unordered_erase_at(const_iterator pos,
+                              std::false_type /*tombstones*/) {
+    const std::size_t index_erase = iterator_to_index(pos);
+    unordered_erase(pos.key());
+
+    /*
+     * One element was deleted, index_erase now points to the next element as
+     * the elements after the deleted value were shifted to the left in m_values
+     * (will be end() if we deleted the last element).
+     */
+    return begin() + index_erase;
   }
 
-  /**
-   * Return bucket which has the key 'key' or m_buckets_data.end() if none.
-   *
-   * From the bucket_for_hash, search for the value until we either find an
-   * empty bucket or a bucket which has a value with a distance from its ideal
-   * bucket longer than the probe length for the value we are looking for.
-   */
-  template <class K>
-  typename buckets_container_type::const_iterator find_key(
-      const K& key, std::size_t hash) const {
-    for (std::size_t ibucket = bucket_for_hash(hash),
-                     dist_from_ideal_bucket = 0;
-         ; ibucket = next_bucket(ibucket), dist_from_ideal_bucket++) {
-      if (m_buckets[ibucket].empty()) {
-        return m_buckets_data.end();
-      } else if (m_buckets[ibucket].truncated_hash() ==
-                     bucket_entry::truncate_hash(hash) &&
-                 compare_keys(
-                     key, KeySelect()(m_values[m_buckets[ibucket].index()]))) {
-        return m_buckets_data.begin() + ibucket;
-      } else if (dist_from_ideal_bucket > distance_from_ideal_bucket(ibucket)) {
-        return m_buckets_data.end();
-      }
-    }
+  /**
+   * The ordered erase is already in O(1) with tombstones, no need to swap the
+   * value with the last one.
+   */
+  iterator unordered_erase_at(const_iterator pos,
+                              std::true_type /*tombstones*/) {
+    return erase(pos);
   }
 
-  void rehash_impl(size_type bucket_count) {
-    tsl_oh_assert(bucket_count >=
-                  size_type(std::ceil(float(size()) / max_load_factor())));
+  template <class K>
+  size_type unordered_erase_impl(const K& key, std::size_t hash,
+                                 std::true_type /*tombstones*/) {
+    return erase_impl(key, hash);
+  }
 
-    if (bucket_count > max_bucket_count()) {
-      TSL_OH_THROW_OR_TERMINATE(std::length_error,
-                                "The map exceeds its maximum size.");
+  template <class K>
+  size_type unordered_erase_impl(const K& key, std::size_t hash,
+                                 std::false_type /*tombstones*/) {
+    if (rehash_in_progress() && !empty()) {
+      // Migrate the bucket of the last value before taking an iterator to the
+      // bucket of 'key', see find_key.
+      find_key(KeySelect()(back()), hash_key(KeySelect()(back())));
     }
 
-    if (bucket_count > 0) {
-      bucket_count = round_up_to_power_of_two(bucket_count);
+    auto it_bucket_key = find_key(key, hash);
+    if (it_bucket_key == m_buckets.end()) {
+      return 0;
     }
 
-    if (bucket_count == this->bucket_count()) {
-      return;
+    /**
+     * If we are not erasing the last element in m_values, we swap
+     * the element we are erasing with the last element. We then would
+     * just have to do a pop_back() in m_values.
+     */
+    if (!compare_keys(key, KeySelect()(back()))) {
+      auto it_bucket_last_elem =
+          find_key(KeySelect()(back()), hash_key(KeySelect()(back())));
+      tsl_oh_assert(it_bucket_last_elem != m_buckets.end());
+      tsl_oh_assert(value_index(*it_bucket_last_elem) == m_values.size() - 1);
+
+      using std::swap;
+      swap(m_values[value_index(*it_bucket_key)],
+           m_values[value_index(*it_bucket_last_elem)]);
+
+      const index_type index_key = it_bucket_key->index();
+      it_bucket_key->set_index(it_bucket_last_elem->index());
+      it_bucket_last_elem->set_index(index_key);
     }
 
-    buckets_container_type old_buckets(bucket_count);
-    m_buckets_data.swap(old_buckets);
-    m_buckets = m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                       : m_buckets_data.data();
-    // Everything should be noexcept from here.
+    erase_value_from_bucket(it_bucket_key);
 
-    m_hash_mask = (bucket_count > 0) ? (bucket_count - 1) : 0;
-    this->max_load_factor(m_max_load_factor);
-    m_grow_on_next_insert = false;
+    return 1;
+  }
 
-    for (const bucket_entry& old_bucket : old_buckets) {
-      if (old_bucket.empty()) {
-        continue;
-      }
+  template <class Predicate>
+  size_type erase_if_impl(Predicate& pred, std::false_type /*tombstones*/) {
+    // Get the bucket associated with the given element.
+    auto get_bucket = [this](typename values_container_type::iterator it) {
+      return find_key(KeySelect()(*it), hash_key(KeySelect()(*it)));
+    };
+    // Clear a bucket without touching the container holding the values.
+    auto clear_bucket = [this](typename buckets_container_type::iterator it) {
+      tsl_oh_assert(it != m_buckets.end());
+      const std::size_t ibucket =
+          std::size_t(std::distance(m_buckets.begin(), it));
+      this->clear_bucket(ibucket);
+      backward_shift(ibucket);
+    };
+    // Ensure that only const references are passed to the predicate.
+    auto cpred = [&pred](typename values_container_type::const_reference x) {
+      return pred(x);
+    };
 
-      truncated_hash_type insert_hash = old_bucket.truncated_hash();
-      index_type insert_index = old_bucket.index();
+    // Find first element that matches the predicate.
+    const auto last = m_values.end();
+    auto first = std::find_if(m_values.begin(), last, cpred);
+    if (first == last) {
+      return 0;
+    }
+    // Remove all elements that match the predicate.
+    clear_bucket(get_bucket(first));
+    for (auto it = std::next(first); it != last; ++it) {
+      auto it_bucket = get_bucket(it);
+      if (cpred(*it)) {
+        clear_bucket(it_bucket);
+      } else {
+        it_bucket->set_index(
+            stored_index(std::size_t(std::distance(m_values.begin(), first))));
+        *first++ = std::move(*it);
+      }
+    }
+    // Resize the vector and return the number of deleted elements.
+    auto deleted = static_cast<size_type>(std::distance(first, last));
+    m_values.erase(first, last);
+    return deleted;
+  }
 
-      for (std::size_t ibucket = bucket_for_hash(insert_hash),
-                       dist_from_ideal_bucket = 0;
-           ; ibucket = next_bucket(ibucket), dist_from_ideal_bucket++) {
-        if (m_buckets[ibucket].empty()) {
-          m_buckets[ibucket].set_index(insert_index);
-          m_buckets[ibucket].set_hash(insert_hash);
-          break;
-        }
+  template <class Predicate>
+  size_type erase_if_impl(Predicate& pred, std::true_type /*tombstones*/) {
+    size_type deleted = 0;
 
-        const std::size_t distance = distance_from_ideal_bucket(ibucket);
-        if (dist_from_ideal_bucket > distance) {
-          std::swap(insert_index, m_buckets[ibucket].index_ref());
-          std::swap(insert_hash, m_buckets[ibucket].truncated_hash_ref());
-          dist_from_ideal_bucket = distance;
-        }
+    // The iterator to the next value is computed before the erasure of the
+    // current one, see erase_at.
+    const auto last = m_values.end();
+    auto it = m_values.begin();
+    while (it != last) {
+      const value_type& value = *it++;
+      if (pred(value)) {
+        auto it_bucket =
+            find_key(KeySelect()(value), hash_key(KeySelect()(value)));
+        tsl_oh_assert(it_bucket != m_buckets.end());
+        erase_value_from_bucket(it_bucket);
+        deleted++;
       }
     }
+
+    compact_tombstones_if_needed(values_raw_size());
+    return deleted;
   }
 
-  template <class T = values_container_type,
-            typename std::enable_if<is_vector<T>::value>::type* = nullptr>
-  void reserve_space_for_values(size_type count) {
-    m_values.reserve(count);
+  template <class K>
+  size_type erase_impl(const K& key, std::size_t hash) {
+    auto it_bucket = find_key(key, hash);
+    if (it_bucket != m_buckets.end()) {
+      erase_value_from_bucket(it_bucket);
+      compact_tombstones_if_needed(values_raw_size());
+
+      return 1;
+    } else {
+      return 0;
+    }
   }
 
-  template <class T = values_container_type,
-            typename std::enable_if<!is_vector<T>::value>::type* = nullptr>
-  void reserve_space_for_values(size_type /*count*/) {}
+  /**
+   * Insert the element at the end, 'hash' is the hash of 'key'.
+   */
+  template <class K, class... Args>
+  std::pair<iterator, bool> insert_impl(const K& key, std::size_t hash,
+                                        Args&&... value_type_args) {
+    const auto inserted = insert_value_impl(
+        key, hash, std::forward<Args>(value_type_args)...);
+    if (inserted.second) {
+      return std::make_pair(std::prev(end()), true);
+    }
+
+    return std::make_pair(iterator(values_iterator_at(inserted.first)), false);
+  }
 
   /**
-   * Swap the empty bucket with the values on its right until we cross another
-   * empty bucket or if the other bucket has a distance_from_ideal_bucket == 0.
+   * Same as insert_impl but return the index in m_values of the inserted
+   * value, or of the value already having the key, without building an
+   * iterator.
    */
-  void backward_shift(std::size_t empty_ibucket) noexcept {
-    tsl_oh_assert(m_buckets[empty_ibucket].empty());
+  template <class K, class... Args>
+  std::pair<std::size_t, bool> insert_value_impl(const K& key,
+                                                 std::size_t hash,
+                                                 Args&&... value_type_args) {
+    incremental_rehash_step();
 
-    std::size_t previous_ibucket = empty_ibucket;
-    for (std::size_t current_ibucket = next_bucket(previous_ibucket);
-         !m_buckets[current_ibucket].empty() &&
-         distance_from_ideal_bucket(current_ibucket) > 0;
-         previous_ibucket = current_ibucket,
-                     current_ibucket = next_bucket(current_ibucket)) {
-      std::swap(m_buckets[current_ibucket], m_buckets[previous_ibucket]);
+    std::size_t ibucket = bucket_for_hash(hash);
+    std::size_t dist_from_ideal_bucket = 0;
+
+    while (!m_buckets[ibucket].empty() &&
+           dist_from_ideal_bucket <= distance_from_ideal_bucket(ibucket)) {
+      TSL_OH_INSTRUMENT(tsl::ordered_hash_event::probe_step,
+                        dist_from_ideal_bucket);
+
+      if (m_buckets[ibucket].truncated_hash() ==
+              bucket_entry::truncate_hash(hash) &&
+          compare_keys(key, KeySelect()(
+                                m_values[value_index(m_buckets[ibucket])]))) {
+        return std::make_pair(value_index(m_buckets[ibucket]), false);
+      }
+
+      ibucket = next_bucket(ibucket);
+      dist_from_ideal_bucket++;
     }
-  }
 
-  void erase_value_from_bucket(
-      typename buckets_container_type::iterator it_bucket) {
-    tsl_oh_assert(it_bucket != m_buckets_data.end() && !it_bucket->empty());
+    if (rehash_in_progress()) {
+      const bucket_entry* old_bucket = find_key_in_old_buckets(key, hash);
+      if (old_bucket != nullptr) {
+        return std::make_pair(value_index(*old_bucket), false);
+      }
+    }
 
-    m_values.erase(m_values.begin() + it_bucket->index());
+    if (size() >= max_size()) {
+      TSL_OH_THROW_OR_TERMINATE(
+          std::length_error, "We reached the maximum size for the hash table.");
+    }
 
-    /*
-     * m_values.erase shifted all the values on the right of the erased value,
-     * shift the indexes by -1 in the buckets array for these values.
-     */
-    if (it_bucket->index() != m_values.size()) {
-      shift_indexes_in_buckets(it_bucket->index() + 1, -1);
+    if (grow_on_high_load()) {
+      ibucket = bucket_for_hash(hash);
+      dist_from_ideal_bucket = 0;
     }
 
-    // Mark the bucket as empty and do a backward shift of the values on the
-    // right
-    it_bucket->clear();
-    backward_shift(
-        std::size_t(std::distance(m_buckets_data.begin(), it_bucket)));
+    compact_tombstones_if_needed(values_raw_size());
+    reset_index_offset_if_needed();
+
+    const std::size_t values_capacity_before =
+        contiguous_values_capacity(has_contiguous_values());
+    m_values.emplace_back(std::forward<Args>(value_type_args)...);
+    instrument_values_grow(values_capacity_before);
+
+    const std::size_t index_inserted = values_raw_size() - 1;
+    insert_index(ibucket, dist_from_ideal_bucket, stored_index(index_inserted),
+                 bucket_entry::truncate_hash(hash));
+
+    return std::make_pair(index_inserted, true);
   }
 
   /**
-   * Shift any index >= index_above_or_equal in m_buckets_data by delta.
-   *
-   * delta must be equal to 1 or -1.
+   * Insert the element at the end, the key must not be in the map. Same as
+   * insert_impl without the comparisons of the keys: the bucket is directly
+   * inserted by insert_index from the ideal bucket.
    */
-  void shift_indexes_in_buckets(index_type index_above_or_equal,
-                                int delta) noexcept {
-    tsl_oh_assert(delta == 1 || delta == -1);
+  template <class K, class... Args>
+  iterator insert_unique_unchecked_impl(const K& key,
+                                        Args&&... value_type_args) {
+    const std::size_t hash = hash_key(key);
+    tsl_oh_assert(!contains(key, hash));
+    incremental_rehash_step();
 
-    for (bucket_entry& bucket : m_buckets_data) {
-      if (!bucket.empty() && bucket.index() >= index_above_or_equal) {
-        tsl_oh_assert(delta >= 0 ||
-                      bucket.index() >= static_cast<index_type>(-delta));
-        tsl_oh_assert(delta <= 0 ||
-                      (bucket_entry::max_size() - bucket.index()) >=
-                          static_cast<index_type>(delta));
-        bucket.set_index(static_cast<index_type>(bucket.index() + delta));
-      }
+    if (size() >= max_size()) {
+      TSL_OH_THROW_OR_TERMINATE(
+          std::length_error, "We reached the maximum size for the hash table.");
     }
-  }
 
-  template <class K>
-  size_type erase_impl(const K& key, std::size_t hash) {
-    auto it_bucket = find_key(key, hash);
-    if (it_bucket != m_buckets_data.end()) {
-      erase_value_from_bucket(it_bucket);
+    grow_on_high_load();
 
-      return 1;
-    } else {
-      return 0;
-    }
+    compact_tombstones_if_needed(values_raw_size());
+    reset_index_offset_if_needed();
+
+    const std::size_t values_capacity_before =
+        contiguous_values_capacity(has_contiguous_values());
+    m_values.emplace_back(std::forward<Args>(value_type_args)...);
+    instrument_values_grow(values_capacity_before);
+    insert_index(bucket_for_hash(hash), 0, stored_index(values_raw_size() - 1),
+                 bucket_entry::truncate_hash(hash));
+
+    return std::prev(end());
   }
 
   /**
-   * Insert the element at the end.
+   * Insert the element before insert_position, 'hash' is the hash of 'key'.
    */
   template <class K, class... Args>
-  std::pair<iterator, bool> insert_impl(const K& key,
-                                        Args&&... value_type_args) {
-    const std::size_t hash = hash_key(key);
+  std::pair<iterator, bool> insert_at_position_impl(
+      typename values_container_type::const_iterator insert_position,
+      const K& key, std::size_t hash, Args&&... value_type_args) {
+    incremental_rehash_step();
 
     std::size_t ibucket = bucket_for_hash(hash);
     std::size_t dist_from_ideal_bucket = 0;
 
     while (!m_buckets[ibucket].empty() &&
            dist_from_ideal_bucket <= distance_from_ideal_bucket(ibucket)) {
+      TSL_OH_INSTRUMENT(tsl::ordered_hash_event::probe_step,
+                        dist_from_ideal_bucket);
+
       if (m_buckets[ibucket].truncated_hash() ==
               bucket_entry::truncate_hash(hash) &&
-          compare_keys(key,
-                       KeySelect()(m_values[m_buckets[ibucket].index()]))) {
-        return std::make_pair(begin() + m_buckets[ibucket].index(), false);
+          compare_keys(key, KeySelect()(
+                                m_values[value_index(m_buckets[ibucket])]))) {
+        return std::make_pair(
+            iterator(values_iterator_at(value_index(m_buckets[ibucket]))),
+            false);
       }
 
       ibucket = next_bucket(ibucket);
       dist_from_ideal_bucket++;
     }
 
+    if (rehash_in_progress()) {
+      const bucket_entry* old_bucket = find_key_in_old_buckets(key, hash);
+      if (old_bucket != nullptr) {
+        return std::make_pair(
+            iterator(values_iterator_at(value_index(*old_bucket))), false);
+      }
+    }
+
     if (size() >= max_size()) {
       TSL_OH_THROW_OR_TERMINATE(
           std::length_error, "We reached the maximum size for the hash table.");
@@ -1399,133 +3927,349 @@ class ordered_hash : private Hash, private KeyEqual {
       dist_from_ideal_bucket = 0;
     }
 
-    m_values.emplace_back(std::forward<Args>(value_type_args)...);
-    insert_index(ibucket, dist_from_ideal_bucket,
-                 index_type(m_values.size() - 1),
-                 bucket_entry::truncate_hash(hash));
+    const index_type index_insert_position = index_type(
+        compact_tombstones_if_needed(values_iterator_index(insert_position)));
+    reset_index_offset_if_needed();
+
+    const std::size_t values_capacity_before =
+        contiguous_values_capacity(has_contiguous_values());
+    auto it_inserted =
+        m_values.emplace(values_iterator_at(index_insert_position),
+                         std::forward<Args>(value_type_args)...);
+    instrument_values_grow(values_capacity_before);
+
+    /*
+     * The insertion didn't happend at the end of the m_values container,
+     * we need to shift the indexes in m_buckets. A container with stable
+     * indexes stores the new value in a new slot at the end instead.
+     */
+    const index_type index_inserted =
+        has_stable_index_values::value
+            ? index_type(values_iterator_index(it_inserted))
+            : index_insert_position;
+    if (!has_stable_index_values::value &&
+        index_insert_position != values_raw_size() - 1) {
+      shift_indexes_in_buckets(index_insert_position, 1);
+    }
+
+    insert_index(ibucket, dist_from_ideal_bucket, stored_index(index_inserted),
+                 bucket_entry::truncate_hash(hash));
+
+    return std::make_pair(iterator(it_inserted), true);
+  }
+
+  void insert_index(std::size_t ibucket, std::size_t dist_from_ideal_bucket,
+                    index_type index_insert,
+                    truncated_hash_type hash_insert) noexcept {
+    bucket_entry bucket_insert;
+    bucket_insert.set_index(index_insert);
+    bucket_insert.set_truncated_hash(hash_insert);
+
+    while (!m_buckets[ibucket].empty()) {
+      TSL_OH_INSTRUMENT(tsl::ordered_hash_event::probe_step,
+                        dist_from_ideal_bucket);
+
+      const std::size_t distance = distance_from_ideal_bucket(ibucket);
+      if (dist_from_ideal_bucket > distance) {
+        bucket_insert.set_distance(dist_from_ideal_bucket);
+        std::swap(bucket_insert, m_buckets[ibucket]);
+        set_probe_metadata(ibucket, dist_from_ideal_bucket,
+                           m_buckets[ibucket].truncated_hash());
+
+        dist_from_ideal_bucket = distance;
+      }
+
+      ibucket = next_bucket(ibucket);
+      dist_from_ideal_bucket++;
+
+      if (dist_from_ideal_bucket > REHASH_ON_HIGH_NB_PROBES__NPROBES &&
+          !m_grow_on_next_insert &&
+          load_factor() >= REHASH_ON_HIGH_NB_PROBES__MIN_LOAD_FACTOR) {
+        // We don't want to grow the map now as we need this method to be
+        // noexcept. Do it on next insert.
+        m_grow_on_next_insert = true;
+        m_nb_grows_on_high_nb_probes++;
+      }
+    }
+
+    bucket_insert.set_distance(dist_from_ideal_bucket);
+    m_buckets[ibucket] = bucket_insert;
+    set_probe_metadata(ibucket, dist_from_ideal_bucket,
+                       bucket_insert.truncated_hash());
+  }
+
+  /**
+   * Distance from its ideal bucket of the non-empty bucket ibucket of
+   * 'buckets', which doesn't need to be m_buckets, mapped by
+   * 'growth_policy'.
+   */
+  std::size_t bucket_distance(const buckets_container_type& buckets,
+                              const GrowthPolicy& growth_policy,
+                              std::size_t ibucket) const noexcept {
+    return bucket_distance(buckets, growth_policy, ibucket,
+                           has_stored_distance());
+  }
+
+  std::size_t bucket_distance(const buckets_container_type& buckets,
+                              const GrowthPolicy& growth_policy,
+                              std::size_t ibucket,
+                              std::false_type /*stored*/) const noexcept {
+    const std::size_t ideal_bucket =
+        growth_policy.bucket_for_hash(ideal_hash(buckets[ibucket]));
+
+    // If the bucket is smaller than the ideal bucket for the value, there was a
+    // wrapping at the end of the bucket array due to the modulo.
+    return (ibucket >= ideal_bucket)
+               ? ibucket - ideal_bucket
+               : (buckets.size() + ibucket) - ideal_bucket;
+  }
+
+  std::size_t bucket_distance(const buckets_container_type& buckets,
+                              const GrowthPolicy& growth_policy,
+                              std::size_t ibucket,
+                              std::true_type /*stored*/) const noexcept {
+    const std::size_t distance = buckets[ibucket].distance();
+    if (distance < bucket_entry::DISTANCE_OVERFLOW) {
+      return distance;
+    }
+
+    return bucket_distance(buckets, growth_policy, ibucket, std::false_type());
+  }
+
+  /**
+   * Hash from which the GrowthPolicy computes the ideal bucket of the
+   * non-empty 'bucket': its stored hash, or the hash of its key if the bucket
+   * only stores a part of the hash (see bucket_entry::ideal_hash).
+   */
+  std::size_t ideal_hash(const bucket_entry& bucket) const noexcept {
+    return ideal_hash(bucket, has_stored_distance());
+  }
+
+  std::size_t ideal_hash(const bucket_entry& bucket,
+                         std::false_type /*stored distance*/) const noexcept {
+    return bucket.truncated_hash();
+  }
+
+  std::size_t ideal_hash(const bucket_entry& bucket,
+                         std::true_type /*stored distance*/) const noexcept {
+    return hash_key(KeySelect()(m_values[value_index(bucket)]));
+  }
+
+  /**
+   * Number of value slots allocated in m_values. The block overhead of a
+   * deque-like container isn't known and not counted.
+   */
+  std::size_t values_capacity(std::true_type /*contiguous*/) const noexcept {
+    return m_values.capacity();
+  }
+
+  std::size_t values_capacity(std::false_type /*contiguous*/) const noexcept {
+    return values_raw_size();
+  }
+
+  /**
+   * Capacity of m_values if it reallocates its storage on growth, 0 otherwise.
+   */
+  std::size_t contiguous_values_capacity(
+      std::true_type /*contiguous*/) const noexcept {
+    return m_values.capacity();
+  }
+
+  std::size_t contiguous_values_capacity(
+      std::false_type /*contiguous*/) const noexcept {
+    return 0;
+  }
+
+  void instrument_values_grow(std::size_t values_capacity_before) noexcept {
+    const std::size_t capacity =
+        contiguous_values_capacity(has_contiguous_values());
+    if (capacity != values_capacity_before) {
+      TSL_OH_INSTRUMENT(tsl::ordered_hash_event::values_grow, capacity);
+    }
+  }
+
+  std::size_t distance_from_ideal_bucket(std::size_t ibucket) const noexcept {
+    return bucket_distance(m_buckets, *this, ibucket);
+  }
+
+  std::size_t next_bucket(std::size_t index) const noexcept {
+    tsl_oh_assert(index < m_buckets.size());
 
-    return std::make_pair(std::prev(end()), true);
+    index++;
+    return (index < m_buckets.size()) ? index : 0;
   }
 
   /**
-   * Insert the element before insert_position.
+   * Only the truncated hash is stored in the buckets, the policy maps it
+   * instead of 'hash' so that a rehash finds the same ideal bucket (see
+   * bucket_entry::ideal_hash).
    */
-  template <class K, class... Args>
-  std::pair<iterator, bool> insert_at_position_impl(
-      typename values_container_type::const_iterator insert_position,
-      const K& key, Args&&... value_type_args) {
-    const std::size_t hash = hash_key(key);
-
-    std::size_t ibucket = bucket_for_hash(hash);
-    std::size_t dist_from_ideal_bucket = 0;
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    return GrowthPolicy::bucket_for_hash(bucket_entry::ideal_hash(hash));
+  }
 
-    while (!m_buckets[ibucket].empty() &&
-           dist_from_ideal_bucket <= distance_from_ideal_bucket(ibucket)) {
-      if (m_buckets[ibucket].truncated_hash() ==
-              bucket_entry::truncate_hash(hash) &&
-          compare_keys(key,
-                       KeySelect()(m_values[m_buckets[ibucket].index()]))) {
-        return std::make_pair(begin() + m_buckets[ibucket].index(), false);
-      }
+  void clear_bucket(std::size_t ibucket) noexcept {
+    m_buckets[ibucket].clear();
+    clear_probe_metadata(ibucket);
+  }
 
-      ibucket = next_bucket(ibucket);
-      dist_from_ideal_bucket++;
-    }
+  /*
+   * Maintenance of the probe metadata, see probe_group. These methods do
+   * nothing if SimdProbing is false.
+   */
+  static std::uint8_t probe_fingerprint(truncated_hash_type hash) noexcept {
+    // Mix the high bits with the low bits so that hash functions with few
+    // significant bits (e.g. identity for small integers) still produce
+    // different fingerprints.
+    return static_cast<std::uint8_t>(
+        hash ^ (hash >> (sizeof(truncated_hash_type) * CHAR_BIT - 8)));
+  }
 
-    if (size() >= max_size()) {
-      TSL_OH_THROW_OR_TERMINATE(
-          std::length_error, "We reached the maximum size for the hash table.");
-    }
+  probe_metadata_container_type make_probe_metadata(size_type bucket_count) {
+    return make_probe_metadata(bucket_count, has_probe_metadata());
+  }
 
-    if (grow_on_high_load()) {
-      ibucket = bucket_for_hash(hash);
-      dist_from_ideal_bucket = 0;
-    }
+  probe_metadata_container_type make_probe_metadata(
+      size_type /*bucket_count*/, std::false_type /*probe_metadata*/) {
+    return probe_metadata_container_type();
+  }
 
-    const index_type index_insert_position =
-        index_type(std::distance(m_values.cbegin(), insert_position));
+  /**
+   * The distance bytes followed by the fingerprint bytes, both with
+   * probe_group::MIRRORED_BYTES extra bytes mirroring the first buckets.
+   */
+  probe_metadata_container_type make_probe_metadata(
+      size_type bucket_count, std::true_type /*probe_metadata*/) {
+    return probe_metadata_container_type(
+        (bucket_count == 0)
+            ? 0
+            : 2 * (bucket_count + probe_group::MIRRORED_BYTES),
+        std::uint8_t(0), m_probe_metadata.get_allocator());
+  }
 
-#ifdef TSL_OH_NO_CONTAINER_EMPLACE_CONST_ITERATOR
-    m_values.emplace(
-        m_values.begin() + std::distance(m_values.cbegin(), insert_position),
-        std::forward<Args>(value_type_args)...);
-#else
-    m_values.emplace(insert_position, std::forward<Args>(value_type_args)...);
-#endif
+  void prefetch_probe_metadata(std::size_t ibucket) const noexcept {
+    prefetch_probe_metadata(ibucket, has_probe_metadata());
+  }
 
-    /*
-     * The insertion didn't happend at the end of the m_values container,
-     * we need to shift the indexes in m_buckets_data.
-     */
-    if (index_insert_position != m_values.size() - 1) {
-      shift_indexes_in_buckets(index_insert_position, 1);
+  void prefetch_probe_metadata(
+      std::size_t /*ibucket*/,
+      std::false_type /*probe_metadata*/) const noexcept {}
+
+  void prefetch_probe_metadata(std::size_t ibucket,
+                               std::true_type /*probe_metadata*/) const
+      noexcept {
+    if (!m_probe_metadata.empty()) {
+      const std::uint8_t* distances = m_probe_metadata.data() + ibucket;
+      prefetch(distances);
+      prefetch(distances + bucket_count() + probe_group::MIRRORED_BYTES);
     }
+  }
 
-    insert_index(ibucket, dist_from_ideal_bucket, index_insert_position,
-                 bucket_entry::truncate_hash(hash));
+  void swap_probe_metadata(probe_metadata_container_type& other) noexcept {
+    using std::swap;
+    swap(m_probe_metadata, other);
+  }
 
-    return std::make_pair(iterator(m_values.begin() + index_insert_position),
-                          true);
+  void set_probe_metadata(std::size_t ibucket,
+                          std::size_t dist_from_ideal_bucket,
+                          truncated_hash_type hash) noexcept {
+    set_probe_metadata(ibucket, dist_from_ideal_bucket, hash,
+                       has_probe_metadata());
   }
 
-  void insert_index(std::size_t ibucket, std::size_t dist_from_ideal_bucket,
-                    index_type index_insert,
-                    truncated_hash_type hash_insert) noexcept {
-    while (!m_buckets[ibucket].empty()) {
-      const std::size_t distance = distance_from_ideal_bucket(ibucket);
-      if (dist_from_ideal_bucket > distance) {
-        std::swap(index_insert, m_buckets[ibucket].index_ref());
-        std::swap(hash_insert, m_buckets[ibucket].truncated_hash_ref());
+  void set_probe_metadata(std::size_t /*ibucket*/,
+                          std::size_t /*dist_from_ideal_bucket*/,
+                          truncated_hash_type /*hash*/,
+                          std::false_type /*probe_metadata*/) noexcept {}
+
+  void set_probe_metadata(std::size_t ibucket,
+                          std::size_t dist_from_ideal_bucket,
+                          truncated_hash_type hash,
+                          std::true_type /*probe_metadata*/) noexcept {
+    const std::uint8_t distance = static_cast<std::uint8_t>(
+        std::min(dist_from_ideal_bucket,
+                 std::size_t(probe_group::MAX_DISTANCE)) +
+        1);
+    write_probe_metadata(ibucket, distance, probe_fingerprint(hash));
+  }
 
-        dist_from_ideal_bucket = distance;
-      }
+  void clear_probe_metadata(std::size_t ibucket) noexcept {
+    clear_probe_metadata(ibucket, has_probe_metadata());
+  }
 
-      ibucket = next_bucket(ibucket);
-      dist_from_ideal_bucket++;
+  void clear_probe_metadata(std::size_t /*ibucket*/,
+                            std::false_type /*probe_metadata*/) noexcept {}
 
-      if (dist_from_ideal_bucket > REHASH_ON_HIGH_NB_PROBES__NPROBES &&
-          !m_grow_on_next_insert &&
-          load_factor() >= REHASH_ON_HIGH_NB_PROBES__MIN_LOAD_FACTOR) {
-        // We don't want to grow the map now as we need this method to be
-        // noexcept. Do it on next insert.
-        m_grow_on_next_insert = true;
-      }
+  void clear_probe_metadata(std::size_t ibucket,
+                            std::true_type /*probe_metadata*/) noexcept {
+    write_probe_metadata(ibucket, 0, 0);
+  }
+
+  void write_probe_metadata(std::size_t ibucket, std::uint8_t distance,
+                            std::uint8_t fingerprint) noexcept {
+    tsl_oh_assert(ibucket < bucket_count());
+    const std::size_t stride = bucket_count() + probe_group::MIRRORED_BYTES;
+
+    m_probe_metadata[ibucket] = distance;
+    m_probe_metadata[stride + ibucket] = fingerprint;
+    if (ibucket < probe_group::MIRRORED_BYTES) {
+      m_probe_metadata[bucket_count() + ibucket] = distance;
+      m_probe_metadata[stride + bucket_count() + ibucket] = fingerprint;
     }
+  }
 
-    m_buckets[ibucket].set_index(index_insert);
-    m_buckets[ibucket].set_hash(hash_insert);
+  /**
+   * Clear the probe metadata of all the buckets.
+   */
+  void clear_all_probe_metadata() noexcept {
+    clear_all_probe_metadata(has_probe_metadata());
   }
 
-  std::size_t distance_from_ideal_bucket(std::size_t ibucket) const noexcept {
-    const std::size_t ideal_bucket =
-        bucket_for_hash(m_buckets[ibucket].truncated_hash());
+  void clear_all_probe_metadata(std::false_type /*probe_metadata*/) noexcept {}
 
-    if (ibucket >= ideal_bucket) {
-      return ibucket - ideal_bucket;
-    }
-    // If the bucket is smaller than the ideal bucket for the value, there was a
-    // wrapping at the end of the bucket array due to the modulo.
-    else {
-      return (bucket_count() + ibucket) - ideal_bucket;
-    }
+  void clear_all_probe_metadata(std::true_type /*probe_metadata*/) noexcept {
+    std::fill(m_probe_metadata.begin(), m_probe_metadata.end(),
+              std::uint8_t(0));
   }
 
-  std::size_t next_bucket(std::size_t index) const noexcept {
-    tsl_oh_assert(index < m_buckets_data.size());
+  /**
+   * Recompute the probe metadata from the buckets array.
+   */
+  void rebuild_probe_metadata() {
+    rebuild_probe_metadata(has_probe_metadata());
+  }
 
-    index++;
-    return (index < m_buckets_data.size()) ? index : 0;
+  void rebuild_probe_metadata(std::false_type /*probe_metadata*/) {}
+
+  void rebuild_probe_metadata(std::true_type /*probe_metadata*/) {
+    m_probe_metadata = make_probe_metadata(bucket_count());
+    fill_probe_metadata(std::true_type());
   }
 
-  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
-    return hash & m_hash_mask;
+  /**
+   * Set the probe metadata of all the buckets, m_probe_metadata must already
+   * have the right size.
+   */
+  void fill_probe_metadata() noexcept {
+    fill_probe_metadata(has_probe_metadata());
   }
 
-  std::size_t iterator_to_index(const_iterator it) const noexcept {
-    const auto dist = std::distance(cbegin(), it);
-    tsl_oh_assert(dist >= 0);
+  void fill_probe_metadata(std::false_type /*probe_metadata*/) noexcept {}
 
-    return std::size_t(dist);
+  void fill_probe_metadata(std::true_type /*probe_metadata*/) noexcept {
+    for (std::size_t ibucket = 0; ibucket < bucket_count(); ibucket++) {
+      if (!m_buckets[ibucket].empty()) {
+        set_probe_metadata(ibucket, distance_from_ideal_bucket(ibucket),
+                           m_buckets[ibucket].truncated_hash());
+      }
+    }
+  }
+
+  /**
+   * Index of the value in m_values, raw index if m_values has tombstones.
+   */
+  std::size_t iterator_to_index(const_iterator it) const noexcept {
+    return values_iterator_index(it.m_iterator);
   }
 
   /**
@@ -1533,7 +4277,9 @@ class ordered_hash : private Hash, private KeyEqual {
    */
   bool grow_on_high_load() {
     if (m_grow_on_next_insert || size() >= m_load_threshold) {
-      rehash_impl(std::max(size_type(1), bucket_count() * 2));
+      rehash_impl((bucket_count() == 0) ? size_type(1)
+                                        : GrowthPolicy::next_bucket_count(),
+                  m_incremental_rehash > 0);
       m_grow_on_next_insert = false;
 
       return true;
@@ -1542,38 +4288,189 @@ class ordered_hash : private Hash, private KeyEqual {
     }
   }
 
+  /**
+   * With a Serializer supporting bulk writes and bulk serializable values, use
+   * the BULK_SERIALIZATION_PROTOCOL_VERSION protocol which writes the values
+   * and the buckets as two blocks of bytes, see serialize_block.
+   */
   template <class Serializer>
   void serialize_impl(Serializer& serializer) const {
-    const slz_size_type version = SERIALIZATION_PROTOCOL_VERSION;
+    using bulk = bulk_serialization<Serializer>;
+
+    const slz_size_type version = bulk::value
+                                      ? BULK_SERIALIZATION_PROTOCOL_VERSION
+                                      : SERIALIZATION_PROTOCOL_VERSION;
     serializer(version);
 
     const slz_size_type nb_elements = m_values.size();
     serializer(nb_elements);
 
-    const slz_size_type bucket_count = m_buckets_data.size();
+    const slz_size_type bucket_count = m_buckets.size();
     serializer(bucket_count);
 
     const float max_load_factor = m_max_load_factor;
     serializer(max_load_factor);
 
+    if (bulk::value) {
+      const slz_size_type value_size = sizeof(value_type);
+      serializer(value_size);
+
+      const slz_size_type bucket_size = sizeof(bucket_entry);
+      serializer(bucket_size);
+    }
+
+    serialize_values(serializer, bulk());
+
+    if (!rehash_in_progress()) {
+      serialize_buckets(serializer, m_buckets, has_tombstone_values());
+      return;
+    }
+
+    // Serialize the buckets as if the incremental rehash was completed.
+    buckets_container_type buckets(m_buckets);
+    for (const bucket_entry& old_bucket : m_old_buckets) {
+      if (!old_bucket.empty()) {
+        insert_bucket(buckets, *this, old_bucket);
+      }
+    }
+
+    serialize_buckets(serializer, buckets, has_tombstone_values());
+  }
+
+  template <class Serializer>
+  void serialize_values(Serializer& serializer,
+                        std::false_type /*bulk*/) const {
     for (const value_type& value : m_values) {
       serializer(value);
     }
+  }
+
+  template <class Serializer>
+  void serialize_values(Serializer& serializer,
+                        std::true_type /*bulk*/) const {
+    serialize_block(serializer, m_values, has_contiguous_values());
+  }
+
+  /**
+   * The serialized indexes are the indexes in m_values, without
+   * m_index_offset.
+   */
+  template <class Serializer>
+  void serialize_buckets(Serializer& serializer,
+                         const buckets_container_type& buckets,
+                         std::false_type /*tombstones*/) const {
+    if (m_index_offset == 0) {
+      serialize_buckets(serializer, buckets, bulk_serialization<Serializer>(),
+                        std::false_type());
+      return;
+    }
+
+    buckets_container_type offset_buckets(buckets);
+    for (bucket_entry& bucket : offset_buckets) {
+      if (!bucket.empty()) {
+        bucket.set_index(index_type(value_index(bucket)));
+      }
+    }
+
+    serialize_buckets(serializer, offset_buckets,
+                      bulk_serialization<Serializer>(), std::false_type());
+  }
 
-    for (const bucket_entry& bucket : m_buckets_data) {
+  template <class Serializer>
+  static void serialize_buckets(Serializer& serializer,
+                                const buckets_container_type& buckets,
+                                std::false_type /*bulk*/,
+                                std::false_type /*tombstones*/) {
+    for (const bucket_entry& bucket : buckets) {
       bucket.serialize(serializer);
     }
   }
 
+  template <class Serializer>
+  static void serialize_buckets(Serializer& serializer,
+                                const buckets_container_type& buckets,
+                                std::true_type /*bulk*/,
+                                std::false_type /*tombstones*/) {
+    serialize_block(serializer, buckets, std::true_type());
+  }
+
+  /**
+   * The serialized indexes are the positions of the values in the order of
+   * iteration, the deserialized m_values has no tombstones and its raw
+   * indexes are in order. The front of a tombstone_deque is erased with
+   * tombstones, m_index_offset is always 0.
+   */
+  template <class Serializer>
+  void serialize_buckets(Serializer& serializer,
+                         const buckets_container_type& buckets,
+                         std::true_type /*tombstones*/) const {
+    tsl_oh_assert(m_index_offset == 0);
+    if (m_values.nb_tombstones() == 0 && !has_stable_index_values::value) {
+      serialize_buckets(serializer, buckets, bulk_serialization<Serializer>(),
+                        std::false_type());
+      return;
+    }
+
+    std::vector<index_type> compacted_indexes(m_values.raw_size());
+    index_type nb_values = 0;
+    for (auto it = m_values.cbegin(); it != m_values.cend(); ++it) {
+      compacted_indexes[it.index()] = nb_values++;
+    }
+
+    buckets_container_type compacted_buckets(buckets);
+    for (bucket_entry& bucket : compacted_buckets) {
+      if (!bucket.empty()) {
+        bucket.set_index(compacted_indexes[value_index(bucket)]);
+      }
+    }
+
+    serialize_buckets(serializer, compacted_buckets,
+                      bulk_serialization<Serializer>(), std::false_type());
+  }
+
+  /**
+   * Write the elements of the container as raw bytes, in one call if the
+   * container is contiguous or else through a buffer of
+   * BULK_SERIALIZATION__BUFFER_SIZE elements.
+   */
+  template <class Serializer, class Container>
+  static void serialize_block(Serializer& serializer,
+                              const Container& container,
+                              std::true_type /*contiguous*/) {
+    serializer(reinterpret_cast<const char*>(container.data()),
+               container.size() * sizeof(typename Container::value_type));
+  }
+
+  template <class Serializer, class Container>
+  static void serialize_block(Serializer& serializer,
+                              const Container& container,
+                              std::false_type /*contiguous*/) {
+    std::vector<typename Container::value_type> buffer;
+    buffer.reserve(std::min(container.size(),
+                            size_type(BULK_SERIALIZATION__BUFFER_SIZE)));
+
+    for (const auto& element : container) {
+      buffer.push_back(element);
+      if (buffer.size() == BULK_SERIALIZATION__BUFFER_SIZE) {
+        serialize_block(serializer, buffer, std::true_type());
+        buffer.clear();
+      }
+    }
+
+    if (!buffer.empty()) {
+      serialize_block(serializer, buffer, std::true_type());
+    }
+  }
+
   template <class Deserializer>
   void deserialize_impl(Deserializer& deserializer, bool hash_compatible) {
-    tsl_oh_assert(m_buckets_data.empty());  // Current hash table must be empty
+    tsl_oh_assert(m_buckets.empty());  // Current hash table must be empty
 
     const slz_size_type version =
         deserialize_value<slz_size_type>(deserializer);
-    // For now we only have one version of the serialization protocol.
-    // If it doesn't match there is a problem with the file.
-    if (version != SERIALIZATION_PROTOCOL_VERSION) {
+    // If it doesn't match any version there is a problem with the file.
+    if (version != SERIALIZATION_PROTOCOL_VERSION &&
+        version != BULK_SERIALIZATION_PROTOCOL_VERSION) {
       TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
                                 "Can't deserialize the ordered_map/set. "
                                 "The protocol version header is invalid.");
@@ -1596,6 +4493,13 @@ class ordered_hash : private Hash, private KeyEqual {
 
     this->max_load_factor(max_load_factor);
 
+    if (version == BULK_SERIALIZATION_PROTOCOL_VERSION) {
+      deserialize_blocks(deserializer, nb_elements, bucket_count_ds,
+                         hash_compatible,
+                         bulk_deserialization<Deserializer>());
+      return;
+    }
+
     if (bucket_count_ds == 0) {
       tsl_oh_assert(nb_elements == 0);
       return;
@@ -1608,10 +4512,11 @@ class ordered_hash : private Hash, private KeyEqual {
         insert(deserialize_value<value_type>(deserializer));
       }
     } else {
-      m_buckets_data.reserve(numeric_cast<size_type>(
-          bucket_count_ds, "Deserialized bucket_count is too big."));
-      m_buckets = m_buckets_data.data(),
-      m_hash_mask = m_buckets_data.capacity() - 1;
+      const size_type bucket_count = numeric_cast<size_type>(
+          bucket_count_ds, "Deserialized bucket_count is too big.");
+      set_deserialized_growth_policy(bucket_count);
+
+      buckets_container_type buckets(bucket_count, m_buckets.get_allocator());
 
       reserve_space_for_values(numeric_cast<size_type>(
           nb_elements, "Deserialized nb_elements is too big."));
@@ -1619,31 +4524,160 @@ class ordered_hash : private Hash, private KeyEqual {
         m_values.push_back(deserialize_value<value_type>(deserializer));
       }
 
-      for (slz_size_type b = 0; b < bucket_count_ds; b++) {
-        m_buckets_data.push_back(bucket_entry::deserialize(deserializer));
+      for (size_type ibucket = 0; ibucket < bucket_count; ibucket++) {
+        buckets[ibucket] = bucket_entry::deserialize(deserializer);
       }
+      m_buckets.swap(buckets);
+
+      rebuild_probe_metadata();
     }
   }
 
-  static std::size_t round_up_to_power_of_two(std::size_t value) {
-    if (is_power_of_two(value)) {
-      return value;
+  template <class Deserializer>
+  void deserialize_blocks(Deserializer& /*deserializer*/,
+                          slz_size_type /*nb_elements*/,
+                          slz_size_type /*bucket_count_ds*/,
+                          bool /*hash_compatible*/, std::false_type /*bulk*/) {
+    TSL_OH_THROW_OR_TERMINATE(
+        std::runtime_error,
+        "Can't deserialize the ordered_map/set. The bulk protocol requires "
+        "trivially copyable values and a deserializer supporting bulk reads.");
+  }
+
+  /**
+   * Read the values and the buckets written by serialize_block. With
+   * hash_compatible, each block is read with one call if its container is
+   * contiguous.
+   */
+  template <class Deserializer>
+  void deserialize_blocks(Deserializer& deserializer, slz_size_type nb_elements,
+                          slz_size_type bucket_count_ds, bool hash_compatible,
+                          std::true_type /*bulk*/) {
+    const slz_size_type value_size =
+        deserialize_value<slz_size_type>(deserializer);
+    const slz_size_type bucket_size =
+        deserialize_value<slz_size_type>(deserializer);
+    if (value_size != sizeof(value_type) ||
+        bucket_size != sizeof(bucket_entry)) {
+      TSL_OH_THROW_OR_TERMINATE(
+          std::runtime_error,
+          "Can't deserialize the ordered_map/set. The size of the serialized "
+          "values or buckets doesn't match, check the types and IndexType.");
     }
 
-    if (value == 0) {
-      return 1;
+    if (bucket_count_ds == 0) {
+      tsl_oh_assert(nb_elements == 0);
+      return;
+    }
+
+    const size_type nb_values = numeric_cast<size_type>(
+        nb_elements, "Deserialized nb_elements is too big.");
+    const size_type bucket_count = numeric_cast<size_type>(
+        bucket_count_ds, "Deserialized bucket_count is too big.");
+    if (nb_values > bucket_count) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                "Can't deserialize the ordered_map/set. "
+                                "The deserialized bucket_count is invalid.");
+    }
+
+    if (!hash_compatible) {
+      reserve(nb_values);
+      for (size_type i = 0; i < nb_values; i++) {
+        value_type value;
+        deserializer(reinterpret_cast<char*>(&value), sizeof(value_type));
+        insert(value);
+      }
+
+      return;
+    }
+
+    set_deserialized_growth_policy(bucket_count);
+
+    reserve_space_for_values(nb_values);
+    deserialize_values_block(deserializer, nb_values, has_contiguous_values());
+
+    // The buckets are trivially copyable, no need to construct them before
+    // overwriting them.
+    buckets_container_type buckets(bucket_count, m_buckets.get_allocator(),
+                                   std::false_type());
+    deserializer(reinterpret_cast<char*>(buckets.data()),
+                 bucket_count * sizeof(bucket_entry));
+    m_buckets.swap(buckets);
+
+    rebuild_probe_metadata();
+  }
+
+  template <class Deserializer>
+  void deserialize_values_block(Deserializer& deserializer, size_type nb_values,
+                                std::true_type /*contiguous*/) {
+    m_values.resize(nb_values);
+    deserializer(reinterpret_cast<char*>(m_values.data()),
+                 nb_values * sizeof(value_type));
+  }
+
+  template <class Deserializer>
+  void deserialize_values_block(Deserializer& deserializer, size_type nb_values,
+                                std::false_type /*contiguous*/) {
+    std::vector<value_type> buffer(
+        std::min(nb_values, size_type(BULK_SERIALIZATION__BUFFER_SIZE)));
+
+    while (nb_values > 0) {
+      const size_type nb_read = std::min(nb_values, buffer.size());
+      deserializer(reinterpret_cast<char*>(buffer.data()),
+                   nb_read * sizeof(value_type));
+      for (size_type i = 0; i < nb_read; i++) {
+        m_values.push_back(buffer[i]);
+      }
+
+      nb_values -= nb_read;
+    }
+  }
+
+  /**
+   * The buckets of a hash compatible deserialization are used as-is, the
+   * bucket count must be one of the GrowthPolicy.
+   */
+  void set_deserialized_growth_policy(size_type bucket_count) {
+    size_type policy_bucket_count = bucket_count;
+    if (bucket_count > max_bucket_count()) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                "Can't deserialize the ordered_map/set. "
+                                "The deserialized bucket_count is invalid.");
     }
 
-    --value;
-    for (std::size_t i = 1; i < sizeof(std::size_t) * CHAR_BIT; i *= 2) {
-      value |= value >> i;
+    GrowthPolicy growth_policy(policy_bucket_count);
+    if (policy_bucket_count != bucket_count) {
+      TSL_OH_THROW_OR_TERMINATE(std::runtime_error,
+                                "Can't deserialize the ordered_map/set. "
+                                "The deserialized bucket_count is invalid.");
     }
 
-    return value + 1;
+    GrowthPolicy::operator=(std::move(growth_policy));
+  }
+
+  static GrowthPolicy empty_growth_policy() {
+    std::size_t bucket_count = 0;
+    return GrowthPolicy(bucket_count);
+  }
+
+  /**
+   * The BucketAllocator of the constructors without one: built from the values
+   * allocator if possible (e.g. std::allocator<ValueType> rebound to
+   * std::allocator<bucket_entry>), otherwise default constructed.
+   */
+  static BucketAllocator default_bucket_allocator(const Allocator& alloc) {
+    return default_bucket_allocator(
+        alloc, std::is_constructible<BucketAllocator, const Allocator&>());
+  }
+
+  static BucketAllocator default_bucket_allocator(const Allocator& alloc,
+                                                  std::true_type) {
+    return BucketAllocator(alloc);
   }
 
-  static constexpr bool is_power_of_two(std::size_t value) {
-    return value != 0 && (value & (value - 1)) == 0;
+  static BucketAllocator default_bucket_allocator(const Allocator& /*alloc*/,
+                                                  std::false_type) {
+    return BucketAllocator();
   }
 
  public:
@@ -1657,41 +4691,102 @@ class ordered_hash : private Hash, private KeyEqual {
   static const size_type REHASH_ON_HIGH_NB_PROBES__NPROBES = 128;
   static constexpr float REHASH_ON_HIGH_NB_PROBES__MIN_LOAD_FACTOR = 0.15f;
 
+  /**
+   * With tombstones, compact m_values once nb_tombstones >=
+   * COMPACT_TOMBSTONES__RATIO * (raw_size + bucket_count).
+   */
+  static constexpr float COMPACT_TOMBSTONES__RATIO = 0.25f;
+
+  /**
+   * See rehash_impl_parallel.
+   */
+  static const size_type PARALLEL_REHASH__MIN_RANGE_SIZE = 4096;
+  static const size_type PARALLEL_REHASH__MIN_SPILL_CAPACITY = 1024;
+
+  /**
+   * See prepare_next_buckets.
+   */
+  static const size_type INCREMENTAL_REHASH__NEXT_BUCKETS_RATIO = 16;
+
+  /**
+   * Number of keys whose lookups are interleaved by find_keys_batch.
+   */
+  static const size_type FIND_BATCH_SIZE = 16;
+
   /**
    * Protocol version currenlty used for serialization.
    */
   static const slz_size_type SERIALIZATION_PROTOCOL_VERSION = 1;
 
   /**
-   * Return an always valid pointer to an static empty bucket_entry with
-   * last_bucket() == true.
+   * Protocol version used for serialization when the Serializer supports bulk
+   * writes and the values are bulk serializable. The max load factor is
+   * followed by the sizes of value_type and bucket_entry, then the values and
+   * the buckets are written as raw bytes in their native layout.
    */
-  bucket_entry* static_empty_bucket_ptr() {
-    static bucket_entry empty_bucket;
-    return &empty_bucket;
-  }
-
- private:
-  buckets_container_type m_buckets_data;
+  static const slz_size_type BULK_SERIALIZATION_PROTOCOL_VERSION = 2;
 
   /**
-   * Points to m_buckets_data.data() if !m_buckets_data.empty() otherwise points
-   * to static_empty_bucket_ptr. This variable is useful to avoid the cost of
-   * checking if m_buckets_data is empty when trying to find an element.
-   *
-   * TODO Remove m_buckets_data and only use a pointer+size instead of a
-   * pointer+vector to save some space in the ordered_hash object.
+   * Number of values written or read at once by the bulk serialization of a
+   * non-contiguous ValueTypeContainer.
    */
-  bucket_entry* m_buckets;
+  static const size_type BULK_SERIALIZATION__BUFFER_SIZE = 1024;
 
-  size_type m_hash_mask;
+ private:
+  /**
+   * Only a pointer and a size, the pointer is always valid even if the map has
+   * no bucket (see bucket_array).
+   */
+  buckets_container_type m_buckets;
 
   values_container_type m_values;
 
+  /**
+   * The buckets store the index of their value in m_values plus
+   * m_index_offset, see value_index. Erasing the first values of m_values
+   * increments the offset instead of decrementing the index in all the
+   * buckets.
+   */
+  index_type m_index_offset;
+
   size_type m_load_threshold;
   float m_max_load_factor;
 
   bool m_grow_on_next_insert;
+
+  /**
+   * Distance and fingerprint bytes of each bucket if SimdProbing is true, an
+   * empty no_probe_metadata otherwise. See make_probe_metadata for the layout.
+   */
+  probe_metadata_container_type m_probe_metadata;
+
+  /**
+   * Buckets not yet migrated to m_buckets while an incremental rehash is
+   * in progress, empty otherwise.
+   */
+  buckets_container_type m_old_buckets;
+  GrowthPolicy m_old_growth_policy;
+  size_type m_old_ibucket;
+
+  /**
+   * Buckets array of the next growth when the incremental rehash is enabled,
+   * see prepare_next_buckets. Only its first m_nb_next_buckets buckets are
+   * constructed.
+   */
+  buckets_container_type m_next_buckets;
+  size_type m_nb_next_buckets;
+
+  /**
+   * Number of buckets migrated on each insertion or non-const lookup during an
+   * incremental rehash, 0 if the incremental rehash is disabled.
+   */
+  size_type m_incremental_rehash;
+
+  /**
+   * Counters reported by stats().
+   */
+  size_type m_nb_rehashes;
+  size_type m_nb_grows_on_high_nb_probes;
 };
 
 }  // end namespace detail_ordered_hash
@@ -0,0 +1,323 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_ORDERED_LRU_CACHE_H
+#define TSL_ORDERED_LRU_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "ordered_map.h"
+#include "tombstone_deque.h"
+
+namespace tsl {
+
+/**
+ * Default Weigher of tsl::ordered_lru_cache, each entry weighs the size in
+ * bytes of the std::pair<Key, T> stored in the cache. A custom weigher should
+ * be used to also count the memory owned by the keys or the values, e.g. the
+ * characters of a std::string.
+ */
+template <class Key, class T>
+struct lru_cache_sizeof_weigher {
+  std::size_t operator()(const Key& /*key*/,
+                         const T& /*value*/) const noexcept {
+    return sizeof(std::pair<Key, T>);
+  }
+};
+
+/**
+ * Least recently used cache on top of a tsl::ordered_map whose insertion order
+ * is the recency order: the least recently used entry is at the front, the
+ * most recently used one at the back.
+ *
+ * The map uses a tsl::tombstone_deque as ValueTypeContainer. An access moves
+ * the entry to the back with ordered_map::move_to_back, which only updates the
+ * index stored in its bucket, and an eviction is a pop_front. Both are in O(1)
+ * amortized and the entries are stored contiguously in the deque blocks, there
+ * is no linked list to follow.
+ *
+ * The cache is limited by a maximum number of entries and by a maximum total
+ * weight, where the weight of an entry is Weigher()(key, value) (e.g. a size in
+ * bytes, see lru_cache_sizeof_weigher). When an insertion exceeds one of the
+ * limits, the least recently used entries are evicted until both are
+ * respected. The entry which has just been inserted is never evicted, even if
+ * its weight alone exceeds max_weight().
+ *
+ * The pointers and references to the values are invalidated by any operation
+ * modifying the cache, including get(). The cache is not thread-safe.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<std::pair<Key, T>>,
+          class Weigher = lru_cache_sizeof_weigher<Key, T>,
+          class IndexType = std::uint_least32_t>
+class ordered_lru_cache {
+ public:
+  using map_type =
+      tsl::ordered_map<Key, T, Hash, KeyEqual, Allocator,
+                       tsl::tombstone_deque<std::pair<Key, T>, Allocator>,
+                       IndexType>;
+
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using weigher = Weigher;
+  using allocator_type = Allocator;
+  using const_iterator = typename map_type::const_iterator;
+
+  /**
+   * Cache of at most 'max_size' entries and 'max_weight' in total weight.
+   * 'max_size' must be greater than 0.
+   */
+  explicit ordered_lru_cache(
+      size_type max_size,
+      size_type max_weight = std::numeric_limits<size_type>::max(),
+      const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+      const Weigher& weigher = Weigher(), const Allocator& alloc = Allocator())
+      : m_map(0, hash, equal, alloc),
+        m_weigher(weigher),
+        m_max_size(max_size),
+        m_max_weight(max_weight),
+        m_weight(0) {
+    if (max_size == 0) {
+      TSL_OH_THROW_OR_TERMINATE(std::invalid_argument,
+                                "The maximum size must be greater than 0.");
+    }
+  }
+
+  /*
+   * Iterators, from the least recently used entry to the most recently used
+   * one.
+   */
+  const_iterator begin() const noexcept { return m_map.begin(); }
+
+  const_iterator end() const noexcept { return m_map.end(); }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_map.empty(); }
+
+  size_type size() const noexcept { return m_map.size(); }
+
+  size_type max_size() const noexcept { return m_max_size; }
+
+  /**
+   * Sum of the weights of the entries in the cache.
+   */
+  size_type weight() const noexcept { return m_weight; }
+
+  size_type max_weight() const noexcept { return m_max_weight; }
+
+  /**
+   * Change the maximum number of entries and evict the least recently used
+   * entries if needed. 'max_size' must be greater than 0.
+   */
+  void set_max_size(size_type max_size) {
+    if (max_size == 0) {
+      TSL_OH_THROW_OR_TERMINATE(std::invalid_argument,
+                                "The maximum size must be greater than 0.");
+    }
+
+    m_max_size = max_size;
+    evict_over_limits(0);
+  }
+
+  /**
+   * Change the maximum total weight and evict the least recently used entries
+   * if needed.
+   */
+  void set_max_weight(size_type max_weight) {
+    m_max_weight = max_weight;
+    evict_over_limits(0);
+  }
+
+  /*
+   * Lookup
+   */
+
+  /**
+   * Return a pointer to the value of 'key' and mark it as the most recently
+   * used entry, or nullptr if the key isn't in the cache.
+   */
+  T* get(const key_type& key) {
+    const std::size_t hash = m_map.hash_function()(key);
+    auto it = m_map.find(key, hash);
+    if (it == m_map.end()) {
+      return nullptr;
+    }
+
+    return std::addressof(m_map.move_to_back(it, hash).value());
+  }
+
+  /**
+   * Same as get(key) but without changing the recency of the entry.
+   */
+  const T* peek(const key_type& key) const {
+    auto it = m_map.find(key);
+    return (it != m_map.end()) ? std::addressof(it->second) : nullptr;
+  }
+
+  bool contains(const key_type& key) const { return m_map.contains(key); }
+
+  size_type count(const key_type& key) const { return m_map.count(key); }
+
+  /**
+   * Mark 'key' as the most recently used entry. Return false if the key isn't
+   * in the cache.
+   */
+  bool touch(const key_type& key) { return get(key) != nullptr; }
+
+  /**
+   * Least recently used entry, the next one to be evicted. The cache must not
+   * be empty.
+   */
+  const value_type& front() const { return m_map.front(); }
+
+  /**
+   * Most recently used entry. The cache must not be empty.
+   */
+  const value_type& back() const { return m_map.back(); }
+
+  /*
+   * Modifiers
+   */
+
+  /**
+   * Insert the key with the value 'obj', or assign 'obj' to the value of the
+   * key if it's already in the cache, and mark it as the most recently used
+   * entry. Evict the least recently used entries if a limit is exceeded and
+   * return a reference to the value.
+   */
+  template <class M>
+  T& insert_or_assign(const key_type& k, M&& obj) {
+    return insert_or_assign_impl(k, std::forward<M>(obj));
+  }
+
+  template <class M>
+  T& insert_or_assign(key_type&& k, M&& obj) {
+    return insert_or_assign_impl(std::move(k), std::forward<M>(obj));
+  }
+
+  /**
+   * Erase 'key' from the cache. Return the number of erased entries (0 or 1).
+   */
+  size_type erase(const key_type& key) {
+    auto it = m_map.find(key);
+    if (it == m_map.end()) {
+      return 0;
+    }
+
+    m_weight -= m_weigher(it->first, it->second);
+    m_map.erase(it);
+
+    return 1;
+  }
+
+  /**
+   * Evict the least recently used entry. The cache must not be empty.
+   */
+  void pop_front() {
+    const value_type& lru = m_map.front();
+    m_weight -= m_weigher(lru.first, lru.second);
+    m_map.pop_front();
+  }
+
+  void clear() noexcept {
+    m_map.clear();
+    m_weight = 0;
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return m_map.hash_function(); }
+
+  key_equal key_eq() const { return m_map.key_eq(); }
+
+  weigher weight_function() const { return m_weigher; }
+
+  /**
+   * The underlying map, ordered from the least recently used entry to the most
+   * recently used one.
+   */
+  const map_type& map() const noexcept { return m_map; }
+
+ private:
+  template <class K, class M>
+  T& insert_or_assign_impl(K&& key, M&& obj) {
+    const std::size_t hash = m_map.hash_function()(key);
+
+    // try_emplace doesn't move from 'obj' if the key is already present.
+    auto it = m_map.try_emplace(tsl::precalculated_hash_t(hash),
+                                std::forward<K>(key), std::forward<M>(obj));
+    if (it.second) {
+      m_weight += m_weigher(it.first->first, it.first->second);
+    } else {
+      // Update the weight only once the assignment succeeded.
+      const size_type old_weight = m_weigher(it.first->first, it.first->second);
+      it.first.value() = std::forward<M>(obj);
+      m_weight = m_weight - old_weight +
+                 m_weigher(it.first->first, it.first->second);
+      m_map.move_to_back(it.first, hash);
+    }
+
+    evict_over_limits(1);
+
+    // The eviction may have compacted the tombstones and moved the values.
+    return std::prev(m_map.end()).value();
+  }
+
+  /**
+   * Evict the least recently used entries until the limits are respected,
+   * keeping at least the 'nb_kept' most recently used entries.
+   */
+  void evict_over_limits(size_type nb_kept) {
+    while (m_map.size() > nb_kept &&
+           (m_map.size() > m_max_size || m_weight > m_max_weight)) {
+      pop_front();
+    }
+  }
+
+ private:
+  map_type m_map;
+  Weigher m_weigher;
+
+  size_type m_max_size;
+  size_type m_max_weight;
+  size_type m_weight;
+};
+
+}  // end namespace tsl
+
+#endif
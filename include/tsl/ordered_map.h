@@ -62,6 +62,62 @@ namespace tsl {
  * 16 bytes instead of 8 bytes in addition to the space needed to store the
  * values.
  *
+ * A tsl::oh::packed_index<IndexBits> IndexType, with IndexBits in [24, 48],
+ * keeps 8 bytes buckets for up to 2^IndexBits - 2 values (e.g. 2^40 - 2 with
+ * tsl::oh::packed_index<40>). Each bucket packs the index, its distance from
+ * its ideal bucket and the upper 56 - IndexBits bits of the hash. The hash of
+ * the keys is computed again on rehash and the bucket count isn't limited by
+ * the stored hash. StoreFullHash must be false.
+ *
+ * With an IndexType of 32 bits or less, the buckets only keep the lower 32
+ * bits of the hash, the map is thus limited to 2^32 buckets and keys whose
+ * hashes only differ in their upper bits are compared on lookups. If
+ * StoreFullHash is true, the whole std::size_t hash is kept whatever IndexType
+ * (a 16 bytes bucket instead of 8 with the default IndexType), which lifts the
+ * limit on the bucket count and spares the key comparisons with expensive to
+ * compare keys (e.g. long strings with a common prefix).
+ *
+ * GrowthPolicy maps the hash of a key to its ideal bucket and chooses the
+ * bucket counts (see ordered_growth_policy.h). The default
+ * tsl::oh::power_of_two_growth_policy keeps the lower bits of the hash, which
+ * clusters integer keys with a power of two stride if the hash is the identity
+ * (std::hash of libstdc++). tsl::oh::fibonacci_growth_policy mixes the hash
+ * with a multiplication first. tsl::oh::fastrange_growth_policy also mixes it
+ * and supports any bucket count: the map grows by 1.5 instead of 2 and reserve
+ * gives the exact number of buckets needed instead of the next power of two.
+ *
+ * The buckets array is allocated with BucketAllocator, rebound to the bucket
+ * type, and the values with Allocator. By default BucketAllocator is Allocator
+ * but it may be any allocator, e.g. one allocating the buckets, which are
+ * randomly accessed on each lookup, in huge pages or in a NUMA local arena
+ * while the values stay in the default heap. If BucketAllocator can't be
+ * constructed from Allocator, the constructors without a BucketAllocator
+ * parameter default construct it. The map object itself only holds a pointer
+ * and a size for its buckets array.
+ *
+ * If SimdProbing is true, the map keeps two extra bytes per bucket (distance
+ * from the ideal bucket and a fingerprint of the hash) in a separate array.
+ * Lookups scan this array 16 or 32 buckets at a time with SSE2 or AVX2 (8 at
+ * a time with a scalar fallback if none is available) and only compare the
+ * keys of the buckets with a matching fingerprint. It mainly speeds-up
+ * unsuccessful lookups and lookups at high load factors. On tables bigger than
+ * the CPU caches, successful lookups may be slower as the metadata is an
+ * additional memory access. Insertions and erasures are slightly slower.
+ *
+ * A tsl::tombstone_deque (see tombstone_deque.h) may also be used as
+ * ValueTypeContainer. Erasing a value then only marks it as a tombstone which
+ * the iterators skip, giving an ordered erase in O(1) amortized instead of
+ * O(bucket_count()). The tombstones are compacted once they reach a quarter of
+ * the number of slots plus the number of buckets. The iterators are only
+ * bidirectional and nth() is in O(n / 64) if there are tombstones.
+ *
+ * A tsl::ranked_deque (see ranked_deque.h) works the same way for the erase and
+ * also keeps the indexes stable on insert_at_position, which becomes
+ * O(log n) amortized (plus a shift of up to 128 indexes) instead of
+ * O(bucket_count()). nth() and the arithmetic of its random access iterators
+ * are in O(log n). The values are stored in creation order, they are only back
+ * in iteration order in values_container() after a compaction.
+ *
  * Iterators invalidation:
  *  - clear, operator=, reserve, rehash: always invalidate the iterators (also
  * invalidate end()).
@@ -70,14 +126,19 @@ namespace tsl {
  * iterators are invalidated if an insert occurs.
  *  - erase, unordered_erase: when a std::vector is used as ValueTypeContainer
  * invalidate the iterator of the erased element and all the ones after the
- * erased element (including end()). Otherwise all the iterators are invalidated
- * if an erase occurs.
+ * erased element (including end()). When a tsl::tombstone_deque is used,
+ * only invalidate the iterator of the erased element (and end() if it was the
+ * last element) unless a compaction occurs. Otherwise all the iterators are
+ * invalidated if an erase occurs.
  */
 template <class Key, class T, class Hash = std::hash<Key>,
           class KeyEqual = std::equal_to<Key>,
           class Allocator = std::allocator<std::pair<Key, T>>,
           class ValueTypeContainer = std::deque<std::pair<Key, T>, Allocator>,
-          class IndexType = std::uint_least32_t>
+          class IndexType = std::uint_least32_t, bool SimdProbing = false,
+          bool StoreFullHash = false,
+          class GrowthPolicy = tsl::oh::power_of_two_growth_policy,
+          class BucketAllocator = Allocator>
 class ordered_map {
  private:
   template <typename U>
@@ -114,7 +175,9 @@ class ordered_map {
   using ht =
       detail_ordered_hash::ordered_hash<std::pair<Key, T>, KeySelect,
                                         ValueSelect, Hash, KeyEqual, Allocator,
-                                        ValueTypeContainer, IndexType>;
+                                        ValueTypeContainer, IndexType,
+                                        SimdProbing, StoreFullHash,
+                                        GrowthPolicy, BucketAllocator>;
 
  public:
   using key_type = typename ht::key_type;
@@ -146,6 +209,11 @@ class ordered_map {
                        const Allocator& alloc = Allocator())
       : m_ht(bucket_count, hash, equal, alloc, ht::DEFAULT_MAX_LOAD_FACTOR) {}
 
+  ordered_map(size_type bucket_count, const Hash& hash, const KeyEqual& equal,
+              const Allocator& alloc, const BucketAllocator& bucket_alloc)
+      : m_ht(bucket_count, hash, equal, alloc, bucket_alloc,
+             ht::DEFAULT_MAX_LOAD_FACTOR) {}
+
   ordered_map(size_type bucket_count, const Allocator& alloc)
       : ordered_map(bucket_count, Hash(), KeyEqual(), alloc) {}
 
@@ -202,6 +270,10 @@ class ordered_map {
 
   allocator_type get_allocator() const { return m_ht.get_allocator(); }
 
+  BucketAllocator get_bucket_allocator() const {
+    return m_ht.get_bucket_allocator();
+  }
+
   /*
    * Iterators
    */
@@ -247,6 +319,33 @@ class ordered_map {
     return m_ht.insert(std::move(value));
   }
 
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the insertion if you already have the hash, e.g. after a failed find.
+   */
+  std::pair<iterator, bool> insert(const value_type& value,
+                                   std::size_t precalculated_hash) {
+    return m_ht.insert_with_hash(precalculated_hash, value);
+  }
+
+  /**
+   * @copydoc insert(const value_type& value, std::size_t precalculated_hash)
+   */
+  template <class P, typename std::enable_if<std::is_constructible<
+                         value_type, P&&>::value>::type* = nullptr>
+  std::pair<iterator, bool> insert(P&& value, std::size_t precalculated_hash) {
+    return m_ht.emplace_with_hash(precalculated_hash, std::forward<P>(value));
+  }
+
+  /**
+   * @copydoc insert(const value_type& value, std::size_t precalculated_hash)
+   */
+  std::pair<iterator, bool> insert(value_type&& value,
+                                   std::size_t precalculated_hash) {
+    return m_ht.insert_with_hash(precalculated_hash, std::move(value));
+  }
+
   iterator insert(const_iterator hint, const value_type& value) {
     return m_ht.insert_hint(hint, value);
   }
@@ -269,6 +368,45 @@ class ordered_map {
     m_ht.insert(ilist.begin(), ilist.end());
   }
 
+  /**
+   * Same as insert(first, last) but, if the map is empty and InputIt is a
+   * random access iterator on value_type, the hashes are computed and the
+   * buckets filled by up to nb_threads threads (std::thread, see
+   * rehash(count, nb_threads)). As with insert, the first occurrence of a key
+   * is kept and the values are in the order of the range.
+   *
+   * The buckets array, reserved for all the elements, is split in ranges as
+   * in rehash(count, nb_threads); if the ranges would be smaller than 4096
+   * buckets, it's the same as insert(first, last). Hash and KeyEqual are
+   * called concurrently. If the copy of a value throws, the map is left empty.
+   */
+  template <class InputIt>
+  void build_parallel(InputIt first, InputIt last, size_type nb_threads) {
+    m_ht.build_parallel(first, last, nb_threads);
+  }
+
+  /**
+   * Insert the values of the range at the end of the map without checking if
+   * their keys are already in the map: the keys of the range must be unique
+   * and not already in the map, otherwise the behaviour is undefined. It
+   * skips the comparisons of the keys done by insert(first, last) and, as it,
+   * reserves the buckets once for a forward iterator.
+   */
+  template <class InputIt>
+  void insert_unique_unchecked(InputIt first, InputIt last) {
+    m_ht.insert_unique_unchecked(first, last);
+  }
+
+  /**
+   * Same as emplace(std::forward<Args>(args)...) but the key of the value must
+   * not already be in the map, see insert_unique_unchecked(first, last).
+   * Return an iterator to the inserted value, at the end of the map.
+   */
+  template <class... Args>
+  iterator emplace_back_unchecked(Args&&... args) {
+    return m_ht.emplace_back_unchecked(std::forward<Args>(args)...);
+  }
+
   template <class M>
   std::pair<iterator, bool> insert_or_assign(const key_type& k, M&& obj) {
     return m_ht.insert_or_assign(k, std::forward<M>(obj));
@@ -289,6 +427,26 @@ class ordered_map {
     return m_ht.insert_or_assign(hint, std::move(k), std::forward<M>(obj));
   }
 
+  /**
+   * @copydoc insert(const value_type& value, std::size_t precalculated_hash)
+   */
+  template <class M>
+  std::pair<iterator, bool> insert_or_assign(const key_type& k, M&& obj,
+                                             std::size_t precalculated_hash) {
+    return m_ht.insert_or_assign_with_hash(precalculated_hash, k,
+                                           std::forward<M>(obj));
+  }
+
+  /**
+   * @copydoc insert(const value_type& value, std::size_t precalculated_hash)
+   */
+  template <class M>
+  std::pair<iterator, bool> insert_or_assign(key_type&& k, M&& obj,
+                                             std::size_t precalculated_hash) {
+    return m_ht.insert_or_assign_with_hash(precalculated_hash, std::move(k),
+                                           std::forward<M>(obj));
+  }
+
   /**
    * Due to the way elements are stored, emplace will need to move or copy the
    * key-value once. The method is equivalent to
@@ -301,6 +459,18 @@ class ordered_map {
     return m_ht.emplace(std::forward<Args>(args)...);
   }
 
+  /**
+   * Same as emplace(std::forward<Args>(args)...) but use the hash value
+   * 'precalculated_hash.hash' instead of hashing the key, see
+   * tsl::precalculated_hash_t.
+   */
+  template <class... Args>
+  std::pair<iterator, bool> emplace(precalculated_hash_t precalculated_hash,
+                                    Args&&... args) {
+    return m_ht.emplace_with_hash(precalculated_hash.hash,
+                                  std::forward<Args>(args)...);
+  }
+
   /**
    * Due to the way elements are stored, emplace_hint will need to move or copy
    * the key-value once. The method is equivalent to insert(hint,
@@ -323,6 +493,75 @@ class ordered_map {
     return m_ht.try_emplace(std::move(k), std::forward<Args>(args)...);
   }
 
+  /**
+   * Same as try_emplace(k, std::forward<Args>(args)...) but use the hash value
+   * 'precalculated_hash.hash' instead of hashing the key, see
+   * tsl::precalculated_hash_t. The equivalent of operator[] with a
+   * precalculated hash is `try_emplace(precalculated_hash, k).first.value()`.
+   */
+  template <class... Args>
+  std::pair<iterator, bool> try_emplace(precalculated_hash_t precalculated_hash,
+                                        const key_type& k, Args&&... args) {
+    return m_ht.try_emplace_with_hash(precalculated_hash.hash, k,
+                                      std::forward<Args>(args)...);
+  }
+
+  /**
+   * @copydoc try_emplace(precalculated_hash_t precalculated_hash, const
+   * key_type& k, Args&&... args)
+   */
+  template <class... Args>
+  std::pair<iterator, bool> try_emplace(precalculated_hash_t precalculated_hash,
+                                        key_type&& k, Args&&... args) {
+    return m_ht.try_emplace_with_hash(precalculated_hash.hash, std::move(k),
+                                      std::forward<Args>(args)...);
+  }
+
+  /**
+   * Same as try_emplace(k, std::forward<Args>(args)...) but return the index
+   * of the value in values_container() instead of an iterator, see index_of.
+   * Useful when the index is used as a code, e.g. to intern strings, as it
+   * avoids building an iterator and converting it back to an index.
+   */
+  template <class... Args>
+  std::pair<size_type, bool> try_emplace_index(const key_type& k,
+                                               Args&&... args) {
+    return m_ht.try_emplace_index(k, std::forward<Args>(args)...);
+  }
+
+  /**
+   * @copydoc try_emplace_index(const key_type& k, Args&&... args)
+   */
+  template <class... Args>
+  std::pair<size_type, bool> try_emplace_index(key_type&& k, Args&&... args) {
+    return m_ht.try_emplace_index(std::move(k), std::forward<Args>(args)...);
+  }
+
+  /**
+   * @copydoc try_emplace_index(const key_type& k, Args&&... args)
+   *
+   * Use the hash value 'precalculated_hash.hash' instead of hashing the key,
+   * see tsl::precalculated_hash_t.
+   */
+  template <class... Args>
+  std::pair<size_type, bool> try_emplace_index(
+      precalculated_hash_t precalculated_hash, const key_type& k,
+      Args&&... args) {
+    return m_ht.try_emplace_index_with_hash(precalculated_hash.hash, k,
+                                            std::forward<Args>(args)...);
+  }
+
+  /**
+   * @copydoc try_emplace_index(precalculated_hash_t precalculated_hash, const
+   * key_type& k, Args&&... args)
+   */
+  template <class... Args>
+  std::pair<size_type, bool> try_emplace_index(
+      precalculated_hash_t precalculated_hash, key_type&& k, Args&&... args) {
+    return m_ht.try_emplace_index_with_hash(
+        precalculated_hash.hash, std::move(k), std::forward<Args>(args)...);
+  }
+
   template <class... Args>
   iterator try_emplace(const_iterator hint, const key_type& k, Args&&... args) {
     return m_ht.try_emplace_hint(hint, k, std::forward<Args>(args)...);
@@ -340,6 +579,12 @@ class ordered_map {
    *
    * The method is in O(bucket_count()), if the order is not important
    * 'unordered_erase(...)' method is faster with an O(1) average complexity.
+   * With a tsl::tombstone_deque as ValueTypeContainer, the method is in O(1)
+   * amortized.
+   *
+   * Erasing the first or the last elements (e.g. `erase(begin(), begin() + k)`)
+   * doesn't update the indexes of the other values in the buckets and is in
+   * O(k) average with a std::deque ValueTypeContainer.
    */
   iterator erase(iterator pos) { return m_ht.erase(pos); }
 
@@ -705,6 +950,40 @@ class ordered_map {
     return m_ht.equal_range(key, precalculated_hash);
   }
 
+  /**
+   * Search the 'count' keys starting at 'keys' (a forward iterator over Key,
+   * or over any type K usable with find(const K&) if KeyEqual::is_transparent
+   * exists) and write for each of them an iterator to the element, or end()
+   * if not found, to 'out'. Return 'out' past the last written iterator.
+   *
+   * Same result as calling find() on each key but the lookups of a small
+   * group of keys are interleaved: all the keys are hashed first and their
+   * buckets and values are prefetched before resolving the probes, so that the
+   * cache misses of the different lookups overlap. Useful to probe a large
+   * map with many keys at once.
+   */
+  template <class KeyIt, class OutputIt>
+  OutputIt find_batch(KeyIt keys, size_type count, OutputIt out) {
+    return m_ht.find_batch(keys, count, out);
+  }
+
+  /**
+   * @copydoc find_batch(KeyIt keys, size_type count, OutputIt out)
+   */
+  template <class KeyIt, class OutputIt>
+  OutputIt find_batch(KeyIt keys, size_type count, OutputIt out) const {
+    return m_ht.find_batch(keys, count, out);
+  }
+
+  /**
+   * Same as find_batch but write a bool to 'out' for each key, true if the
+   * key is in the map.
+   */
+  template <class KeyIt, class OutputIt>
+  OutputIt contains_batch(KeyIt keys, size_type count, OutputIt out) const {
+    return m_ht.contains_batch(keys, count, out);
+  }
+
   /*
    * Bucket interface
    */
@@ -718,9 +997,55 @@ class ordered_map {
   float max_load_factor() const { return m_ht.max_load_factor(); }
   void max_load_factor(float ml) { m_ht.max_load_factor(ml); }
 
+  /**
+   * Number of buckets migrated on each insertion or non-const find during an
+   * incremental rehash, 0 (the default) if the incremental rehash is disabled.
+   */
+  size_type incremental_rehash() const noexcept {
+    return m_ht.incremental_rehash();
+  }
+
+  /**
+   * If nb_buckets_per_op > 0, growing the map allocates the new buckets array
+   * but keeps the old one alive instead of reinserting all the elements at
+   * once. Each following insertion or non-const find then migrates up to
+   * nb_buckets_per_op buckets, which bounds the latency of an insertion
+   * triggering a growth. Until the migration is done, the lookups which miss
+   * in the new buckets array also search the old one, and both arrays are
+   * kept in memory.
+   *
+   * If the migration isn't finished when the map needs to grow again, or on
+   * a rehash/reserve, the rest of it is done at once. With the default
+   * max_load_factor, a nb_buckets_per_op of 4 or more is enough to always
+   * finish the migration with the insertions alone.
+   *
+   * Setting it to 0 completes the migration in progress, if any.
+   */
+  void incremental_rehash(size_type nb_buckets_per_op) {
+    m_ht.incremental_rehash(nb_buckets_per_op);
+  }
+
   void rehash(size_type count) { m_ht.rehash(count); }
   void reserve(size_type count) { m_ht.reserve(count); }
 
+  /**
+   * Same as rehash(count) and reserve(count) but the elements are placed in the
+   * new buckets array by up to nb_threads threads (std::thread, link with the
+   * threads library of your platform if needed). The new buckets array is
+   * split in ranges, each thread placing the elements whose ideal bucket falls
+   * in its range.
+   *
+   * The threads are only used if the map grows and if each thread gets a range
+   * big enough (at least 4096 buckets), otherwise it's the same as
+   * rehash(count).
+   */
+  void rehash(size_type count, size_type nb_threads) {
+    m_ht.rehash(count, nb_threads);
+  }
+  void reserve(size_type count, size_type nb_threads) {
+    m_ht.reserve(count, nb_threads);
+  }
+
   /*
    * Observers
    */
@@ -738,6 +1063,14 @@ class ordered_map {
     return m_ht.mutable_iterator(pos);
   }
 
+  /**
+   * Statistics on the probe lengths, the rehashes and the memory of the map,
+   * see tsl::ordered_hash_stats. Useful to check the quality of the hash
+   * function and to tune max_load_factor. Walks all the buckets, in
+   * O(bucket_count()).
+   */
+  tsl::ordered_hash_stats stats() const { return m_ht.stats(); }
+
   /**
    * Requires index <= size().
    *
@@ -751,6 +1084,39 @@ class ordered_map {
    */
   const_iterator nth(size_type index) const { return m_ht.nth(index); }
 
+  /**
+   * Return the index in values_container() of the value with the key 'key',
+   * the index stored in its bucket, without building an iterator. Return
+   * std::numeric_limits<size_type>::max() if the key is not in the map.
+   *
+   * With the default containers the index is the position of the value in
+   * the insertion order (same as `find(key) - begin()`). With a
+   * tsl::tombstone_deque or a tsl::ranked_deque, it's the slot of the value,
+   * which also counts the tombstones. The index stays valid until the next
+   * erase, insert_at_position or shrink_to_fit (with tombstones, until the
+   * next insertion after an erase, which may compact them).
+   */
+  size_type index_of(const key_type& key) const { return m_ht.index_of(key); }
+
+  /**
+   * @copydoc index_of(const key_type& key) const
+   *
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key).
+   */
+  size_type index_of(const key_type& key,
+                     std::size_t precalculated_hash) const {
+    return m_ht.index_of(key, precalculated_hash);
+  }
+
+  /**
+   * Return the value at 'index' in values_container(), a valid index returned
+   * by index_of or try_emplace_index. In O(1), without building an iterator.
+   */
+  const_reference value_at(size_type index) const {
+    return m_ht.value_at(index);
+  }
+
   /**
    * Return const_reference to the first element. Requires the container to not
    * be empty.
@@ -777,7 +1143,9 @@ class ordered_map {
   /**
    * Return the container in which the values are stored. The values are in the
    * same order as the insertion order and are contiguous in the structure, no
-   * holes (size() == values_container().size()).
+   * holes (size() == values_container().size()), unless ValueTypeContainer is
+   * a tsl::tombstone_deque or a tsl::ranked_deque in which case its iterators
+   * skip the holes.
    */
   const values_container_type& values_container() const noexcept {
     return m_ht.values_container();
@@ -803,7 +1171,8 @@ class ordered_map {
    * Insert the value before pos shifting all the elements on the right of pos
    * (including pos) one position to the right.
    *
-   * O(bucket_count()) runtime complexity.
+   * O(bucket_count()) runtime complexity, O(log n) amortized with a
+   * tsl::ranked_deque as ValueTypeContainer.
    */
   std::pair<iterator, bool> insert_at_position(const_iterator pos,
                                                const value_type& value) {
@@ -851,8 +1220,96 @@ class ordered_map {
                                         std::forward<Args>(args)...);
   }
 
+  /**
+   * @copydoc insert_at_position(const_iterator pos, const value_type& value)
+   *
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key).
+   */
+  std::pair<iterator, bool> insert_at_position(const_iterator pos,
+                                               const value_type& value,
+                                               std::size_t precalculated_hash) {
+    return m_ht.insert_at_position_with_hash(pos, precalculated_hash, value);
+  }
+
+  /**
+   * @copydoc insert_at_position(const_iterator pos, const value_type& value,
+   * std::size_t precalculated_hash)
+   */
+  std::pair<iterator, bool> insert_at_position(const_iterator pos,
+                                               value_type&& value,
+                                               std::size_t precalculated_hash) {
+    return m_ht.insert_at_position_with_hash(pos, precalculated_hash,
+                                             std::move(value));
+  }
+
+  /**
+   * Same as emplace_at_position(pos, std::forward<Args>(args)...) but use the
+   * hash value 'precalculated_hash.hash' instead of hashing the key, see
+   * tsl::precalculated_hash_t.
+   */
+  template <class... Args>
+  std::pair<iterator, bool> emplace_at_position(
+      const_iterator pos, precalculated_hash_t precalculated_hash,
+      Args&&... args) {
+    return m_ht.emplace_at_position_with_hash(pos, precalculated_hash.hash,
+                                              std::forward<Args>(args)...);
+  }
+
+  /**
+   * Same as try_emplace_at_position(pos, k, std::forward<Args>(args)...) but
+   * use the hash value 'precalculated_hash.hash' instead of hashing the key,
+   * see tsl::precalculated_hash_t.
+   */
+  template <class... Args>
+  std::pair<iterator, bool> try_emplace_at_position(
+      const_iterator pos, precalculated_hash_t precalculated_hash,
+      const key_type& k, Args&&... args) {
+    return m_ht.try_emplace_at_position_with_hash(
+        pos, precalculated_hash.hash, k, std::forward<Args>(args)...);
+  }
+
+  /**
+   * @copydoc try_emplace_at_position(const_iterator pos, precalculated_hash_t
+   * precalculated_hash, const key_type& k, Args&&... args)
+   */
+  template <class... Args>
+  std::pair<iterator, bool> try_emplace_at_position(
+      const_iterator pos, precalculated_hash_t precalculated_hash,
+      key_type&& k, Args&&... args) {
+    return m_ht.try_emplace_at_position_with_hash(
+        pos, precalculated_hash.hash, std::move(k),
+        std::forward<Args>(args)...);
+  }
+
   void pop_back() { m_ht.pop_back(); }
 
+  /**
+   * Erase the first element, in O(1) average with the default std::deque
+   * ValueTypeContainer. Useful to use the map as a FIFO window, see erase.
+   */
+  void pop_front() { m_ht.pop_front(); }
+
+  /**
+   * Move the element at 'pos' to the back of the insertion order, keeping its
+   * bucket, and return an iterator to its new position. The iterators are
+   * invalidated as with an erase of 'pos' followed by an insertion. The key is
+   * hashed to find its bucket, see the overload taking a precalculated hash.
+   *
+   * In O(1) amortized with a tsl::tombstone_deque as ValueTypeContainer (see
+   * tsl::ordered_lru_cache), otherwise same complexity as erase(pos).
+   */
+  iterator move_to_back(const_iterator pos) { return m_ht.move_to_back(pos); }
+
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key at
+   * 'pos'. The hash value should be the same as hash_function()(pos->first).
+   * Useful to avoid a second hash after a find with a precalculated hash.
+   */
+  iterator move_to_back(const_iterator pos, std::size_t precalculated_hash) {
+    return m_ht.move_to_back(pos, precalculated_hash);
+  }
+
   /**
    * Faster erase operation with an O(1) average complexity but it doesn't
    * preserve the insertion order.
@@ -924,6 +1381,13 @@ class ordered_map {
    *  - `template<typename U> void operator()(const U& value);` where the types
    * `std::uint64_t`, `float` and `std::pair<Key, T>` must be supported for U.
    *
+   * If the `Serializer` also supports `void operator()(const char* data,
+   * std::size_t size);` and `Key` and `T` are trivially copyable, the values
+   * and the buckets are written in two blocks of raw bytes through this call
+   * instead. The buckets are written in their native width and the
+   * deserialization must then be done with a `Deserializer` supporting bulk
+   * reads on a platform with the same binary representation.
+   *
    * The implementation leaves binary compatibility (endianness, IEEE 754 for
    * floats, ...) of the types it serializes in the hands of the `Serializer`
    * function object if compatibility is required.
@@ -953,6 +1417,11 @@ class ordered_map {
    * The behaviour is undefined if the type `Key` and `T` of the `ordered_map`
    * are not the same as the types used during serialization.
    *
+   * A map serialized with bulk writes requires a `Deserializer` which also
+   * supports `void operator()(char* data, std::size_t size);` to read a block
+   * of bytes. With `hash_compatible` set to true, the values and the buckets
+   * are then read in a few calls instead of one call per value and per bucket.
+   *
    * The implementation leaves binary compatibility (endianness, IEEE 754 for
    * floats, size of int, ...) of the types it deserializes in the hands of the
    * `Deserializer` function object if compatibility is required.
@@ -0,0 +1,988 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_RANKED_DEQUE_H
+#define TSL_RANKED_DEQUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ordered_hash.h"
+
+namespace tsl {
+
+/**
+ * Container which can be used as ValueTypeContainer of tsl::ordered_map and
+ * tsl::ordered_set to get a sub-linear insert_at_position, erase in the middle
+ * and nth, e.g.
+ *
+ * tsl::ordered_map<Key, T, std::hash<Key>, std::equal_to<Key>,
+ *                  std::allocator<std::pair<Key, T>>,
+ *                  tsl::ranked_deque<std::pair<Key, T>>>
+ *
+ * The values are stored in a std::deque<T, Allocator> in the order of their
+ * creation: a new value always gets a new slot at the end of the deque, even
+ * when it is inserted in the middle of the sequence, and its raw index (the
+ * index stored by the ordered_hash) never changes until the next compaction.
+ * The ordered_hash thus doesn't have to shift the indexes stored in its
+ * buckets on insert_at_position.
+ *
+ * The order of the sequence is kept apart, as a list of chunks of up to
+ * CHUNK_SIZE raw indexes. Each slot knows its location (chunk and offset in the
+ * chunk) and a Fenwick tree over the sizes of the chunks, in sequence order,
+ * gives the rank of a chunk. The complexities are:
+ * - iterator increment and decrement: O(1);
+ * - nth(n), distance between two iterators and iterator arithmetic:
+ *   O(log(size() / CHUNK_SIZE));
+ * - emplace(pos, ...), emplace_back(...) and tombstone(...): O(CHUNK_SIZE +
+ *   log(size() / CHUNK_SIZE)), plus the rebuild of the chunk list in
+ *   O(size() / CHUNK_SIZE) when a chunk is split or emptied, at most once
+ *   every CHUNK_SIZE / 2 insertions in the same chunk.
+ *
+ * As with tsl::tombstone_deque, an erased value only becomes a tombstone and
+ * the ordered_hash remaps its indexes with 'prepare_compaction()' and
+ * 'compacted_index(...)' before removing the tombstones with 'compact()'. The
+ * compaction also stores the values in sequence order again.
+ *
+ * The iterators point to a raw index, they stay valid when other values are
+ * inserted or erased. They are random access but the arithmetic is in
+ * O(log(size() / CHUNK_SIZE)), not O(1).
+ *
+ * Besides the values, each slot costs one size_type for its location and each
+ * value about 1.5 size_type in the chunks.
+ */
+template <class T, class Allocator = std::allocator<T>>
+class ranked_deque {
+ private:
+  using values_container_type = std::deque<T, Allocator>;
+
+  using indexes_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<std::size_t>;
+  using indexes_container_type = std::vector<std::size_t, indexes_allocator>;
+
+  static const std::size_t CHUNK_SIZE = 128;
+
+  /**
+   * Location of a tombstone and end of the list of free chunks.
+   */
+  static const std::size_t NO_LOCATION =
+      std::numeric_limits<std::size_t>::max();
+
+ public:
+  template <bool IsConst>
+  class ranked_iterator;
+
+  /**
+   * Tells ordered_hash that erased values only become tombstones.
+   */
+  using tombstone_tag = void;
+
+  /**
+   * Tells ordered_hash that emplace(...) doesn't change the raw index of the
+   * other values.
+   */
+  using stable_index_tag = void;
+
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+  using iterator = ranked_iterator<false>;
+  using const_iterator = ranked_iterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  template <bool IsConst>
+  class ranked_iterator {
+    friend class ranked_deque;
+
+    template <bool>
+    friend class ranked_iterator;
+
+   private:
+    using container_pointer =
+        typename std::conditional<IsConst, const ranked_deque*,
+                                  ranked_deque*>::type;
+
+    ranked_iterator(container_pointer container, size_type index) noexcept
+        : m_container(container), m_index(index) {}
+
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename ranked_deque::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename std::conditional<IsConst, const value_type&,
+                                                value_type&>::type;
+    using pointer = typename std::conditional<IsConst, const value_type*,
+                                              value_type*>::type;
+
+    ranked_iterator() noexcept : m_container(nullptr), m_index(0) {}
+
+    // Copy constructor from iterator to const_iterator.
+    template <bool TIsConst = IsConst,
+              typename std::enable_if<TIsConst>::type* = nullptr>
+    ranked_iterator(const ranked_iterator<!TIsConst>& other) noexcept
+        : m_container(other.m_container), m_index(other.m_index) {}
+
+    ranked_iterator(const ranked_iterator& other) = default;
+    ranked_iterator(ranked_iterator&& other) = default;
+    ranked_iterator& operator=(const ranked_iterator& other) = default;
+    ranked_iterator& operator=(ranked_iterator&& other) = default;
+
+    /**
+     * Raw index of the slot pointed by the iterator (raw_size() for end()).
+     */
+    size_type index() const noexcept { return m_index; }
+
+    reference operator*() const { return m_container->m_values[m_index]; }
+    pointer operator->() const { return std::addressof(**this); }
+
+    ranked_iterator& operator++() {
+      m_index = m_container->next_index(m_index);
+      return *this;
+    }
+    ranked_iterator& operator--() {
+      m_index = m_container->previous_index(m_index);
+      return *this;
+    }
+
+    ranked_iterator operator++(int) {
+      ranked_iterator tmp(*this);
+      ++(*this);
+      return tmp;
+    }
+    ranked_iterator operator--(int) {
+      ranked_iterator tmp(*this);
+      --(*this);
+      return tmp;
+    }
+
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    ranked_iterator& operator+=(difference_type n) {
+      const difference_type rank =
+          difference_type(m_container->rank(m_index)) + n;
+      tsl_oh_assert(rank >= 0);
+
+      m_index = m_container->nth_index(size_type(rank));
+      return *this;
+    }
+    ranked_iterator& operator-=(difference_type n) { return *this += -n; }
+
+    friend ranked_iterator operator+(ranked_iterator it, difference_type n) {
+      return it += n;
+    }
+
+    friend ranked_iterator operator+(difference_type n, ranked_iterator it) {
+      return it += n;
+    }
+
+    friend ranked_iterator operator-(ranked_iterator it, difference_type n) {
+      return it -= n;
+    }
+
+    friend difference_type operator-(const ranked_iterator& lhs,
+                                     const ranked_iterator& rhs) {
+      return difference_type(lhs.rank()) - difference_type(rhs.rank());
+    }
+
+    friend bool operator==(const ranked_iterator& lhs,
+                           const ranked_iterator& rhs) {
+      return lhs.m_index == rhs.m_index;
+    }
+
+    friend bool operator!=(const ranked_iterator& lhs,
+                           const ranked_iterator& rhs) {
+      return lhs.m_index != rhs.m_index;
+    }
+
+    friend bool operator<(const ranked_iterator& lhs,
+                          const ranked_iterator& rhs) {
+      return lhs.rank() < rhs.rank();
+    }
+
+    friend bool operator>(const ranked_iterator& lhs,
+                          const ranked_iterator& rhs) {
+      return rhs < lhs;
+    }
+
+    friend bool operator<=(const ranked_iterator& lhs,
+                           const ranked_iterator& rhs) {
+      return !(rhs < lhs);
+    }
+
+    friend bool operator>=(const ranked_iterator& lhs,
+                           const ranked_iterator& rhs) {
+      return !(lhs < rhs);
+    }
+
+   private:
+    size_type rank() const noexcept { return m_container->rank(m_index); }
+
+   private:
+    container_pointer m_container;
+    size_type m_index;
+  };
+
+ public:
+  ranked_deque() : ranked_deque(Allocator()) {}
+
+  explicit ranked_deque(const Allocator& alloc)
+      : m_values(alloc),
+        m_slot_locations(indexes_allocator(alloc)),
+        m_chunk_slots(indexes_allocator(alloc)),
+        m_chunk_sizes(indexes_allocator(alloc)),
+        m_chunk_positions(indexes_allocator(alloc)),
+        m_chunk_order(indexes_allocator(alloc)),
+        m_chunk_ranks(indexes_allocator(alloc)),
+        m_free_chunk(NO_LOCATION),
+        m_nb_tombstones(0) {}
+
+  ranked_deque(const ranked_deque& other) = default;
+
+  ranked_deque(ranked_deque&& other) noexcept(
+      std::is_nothrow_move_constructible<values_container_type>::value)
+      : m_values(std::move(other.m_values)),
+        m_slot_locations(std::move(other.m_slot_locations)),
+        m_chunk_slots(std::move(other.m_chunk_slots)),
+        m_chunk_sizes(std::move(other.m_chunk_sizes)),
+        m_chunk_positions(std::move(other.m_chunk_positions)),
+        m_chunk_order(std::move(other.m_chunk_order)),
+        m_chunk_ranks(std::move(other.m_chunk_ranks)),
+        m_free_chunk(other.m_free_chunk),
+        m_nb_tombstones(other.m_nb_tombstones) {
+    other.clear();
+  }
+
+  ranked_deque& operator=(const ranked_deque& other) = default;
+
+  ranked_deque& operator=(ranked_deque&& other) {
+    other.swap(*this);
+    other.clear();
+
+    return *this;
+  }
+
+  allocator_type get_allocator() const { return m_values.get_allocator(); }
+
+  /*
+   * Iterators
+   */
+  iterator begin() noexcept { return iterator(this, front_index()); }
+
+  const_iterator begin() const noexcept { return cbegin(); }
+
+  const_iterator cbegin() const noexcept {
+    return const_iterator(this, front_index());
+  }
+
+  iterator end() noexcept { return iterator(this, m_values.size()); }
+
+  const_iterator end() const noexcept { return cend(); }
+
+  const_iterator cend() const noexcept {
+    return const_iterator(this, m_values.size());
+  }
+
+  reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+
+  const_reverse_iterator rbegin() const noexcept { return crbegin(); }
+
+  const_reverse_iterator crbegin() const noexcept {
+    return const_reverse_iterator(cend());
+  }
+
+  reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+
+  const_reverse_iterator rend() const noexcept { return crend(); }
+
+  const_reverse_iterator crend() const noexcept {
+    return const_reverse_iterator(cbegin());
+  }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return size() == 0; }
+
+  /**
+   * Number of values, tombstones excluded.
+   */
+  size_type size() const noexcept { return m_values.size() - m_nb_tombstones; }
+
+  size_type max_size() const noexcept { return m_values.max_size(); }
+
+  /**
+   * Number of slots, tombstones included.
+   */
+  size_type raw_size() const noexcept { return m_values.size(); }
+
+  size_type nb_tombstones() const noexcept { return m_nb_tombstones; }
+
+  void shrink_to_fit() {
+    // The chunks in use are never empty, the free chunks at the end can go.
+    size_type nb_chunks = m_chunk_sizes.size();
+    while (nb_chunks > 0 && m_chunk_sizes[nb_chunks - 1] == 0) {
+      nb_chunks--;
+    }
+
+    m_chunk_slots.resize(nb_chunks * CHUNK_SIZE);
+    m_chunk_sizes.resize(nb_chunks);
+    m_chunk_positions.resize(nb_chunks);
+    m_free_chunk = NO_LOCATION;
+    for (size_type chunk = 0; chunk < nb_chunks; chunk++) {
+      if (m_chunk_sizes[chunk] == 0) {
+        push_free_chunk(chunk);
+      }
+    }
+
+    m_values.shrink_to_fit();
+    m_slot_locations.shrink_to_fit();
+    m_chunk_slots.shrink_to_fit();
+    m_chunk_sizes.shrink_to_fit();
+    m_chunk_positions.shrink_to_fit();
+  }
+
+  /*
+   * Element access
+   */
+
+  /**
+   * Access the slot at 'raw_index', which may be a tombstone. Use nth(...) to
+   * access the n-th value.
+   */
+  reference operator[](size_type raw_index) {
+    tsl_oh_assert(raw_index < m_values.size());
+    return m_values[raw_index];
+  }
+
+  const_reference operator[](size_type raw_index) const {
+    tsl_oh_assert(raw_index < m_values.size());
+    return m_values[raw_index];
+  }
+
+  bool is_tombstone(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index < m_values.size());
+    return m_slot_locations[raw_index] == NO_LOCATION;
+  }
+
+  reference front() {
+    tsl_oh_assert(!empty());
+    return m_values[front_index()];
+  }
+
+  const_reference front() const {
+    tsl_oh_assert(!empty());
+    return m_values[front_index()];
+  }
+
+  reference back() {
+    tsl_oh_assert(!empty());
+    return m_values[back_index()];
+  }
+
+  const_reference back() const {
+    tsl_oh_assert(!empty());
+    return m_values[back_index()];
+  }
+
+  /**
+   * Requires raw_index == raw_size() or a raw index which is not a tombstone.
+   */
+  iterator iterator_at(size_type raw_index) noexcept {
+    tsl_oh_assert(raw_index == m_values.size() || !is_tombstone(raw_index));
+    return iterator(this, raw_index);
+  }
+
+  /**
+   * @copydoc iterator_at(size_type raw_index)
+   */
+  const_iterator iterator_at(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index == m_values.size() || !is_tombstone(raw_index));
+    return const_iterator(this, raw_index);
+  }
+
+  /**
+   * Requires n <= size().
+   *
+   * Return an iterator to the n-th value, end() if n == size().
+   */
+  iterator nth(size_type n) noexcept { return iterator(this, nth_index(n)); }
+
+  /**
+   * @copydoc nth(size_type n)
+   */
+  const_iterator nth(size_type n) const noexcept {
+    return const_iterator(this, nth_index(n));
+  }
+
+  /*
+   * Modifiers
+   */
+  void clear() noexcept {
+    m_values.clear();
+    m_slot_locations.clear();
+    m_chunk_slots.clear();
+    m_chunk_sizes.clear();
+    m_chunk_positions.clear();
+    m_chunk_order.clear();
+    m_chunk_ranks.clear();
+    m_free_chunk = NO_LOCATION;
+    m_nb_tombstones = 0;
+  }
+
+  template <class... Args>
+  void emplace_back(Args&&... args) {
+    reserve_slot();
+    m_values.emplace_back(std::forward<Args>(args)...);
+    m_slot_locations.push_back(size_type(NO_LOCATION));
+
+    link_back(m_values.size() - 1);
+  }
+
+  void push_back(const value_type& value) { emplace_back(value); }
+
+  void push_back(value_type&& value) { emplace_back(std::move(value)); }
+
+  /**
+   * Insert a value before pos. The value gets a new slot at the end of the
+   * underlying deque, the raw indexes of the other values don't change.
+   */
+  template <class... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    const size_type next_index = pos.index();
+    tsl_oh_assert(next_index == m_values.size() || !is_tombstone(next_index));
+
+    reserve_slot();
+    m_values.emplace_back(std::forward<Args>(args)...);
+    m_slot_locations.push_back(size_type(NO_LOCATION));
+
+    const size_type raw_index = m_values.size() - 1;
+    if (next_index == raw_index) {
+      link_back(raw_index);
+    } else {
+      link_before(next_index, raw_index);
+    }
+
+    return iterator(this, raw_index);
+  }
+
+  /**
+   * Mark the value at 'raw_index' as erased. The other values keep their raw
+   * index, unless the erased value is the last value of the sequence and of
+   * the deque in which case the slot and the tombstones preceding it are
+   * removed.
+   */
+  void tombstone(size_type raw_index) noexcept {
+    tsl_oh_assert(raw_index < m_values.size() && !is_tombstone(raw_index));
+
+    const bool last_slot =
+        raw_index + 1 == m_values.size() && raw_index == back_index();
+    unlink(raw_index);
+
+    if (last_slot) {
+      m_values.pop_back();
+      m_slot_locations.pop_back();
+      while (!m_values.empty() && is_tombstone(m_values.size() - 1)) {
+        m_values.pop_back();
+        m_slot_locations.pop_back();
+        m_nb_tombstones--;
+      }
+    } else {
+      m_slot_locations[raw_index] = NO_LOCATION;
+      m_nb_tombstones++;
+    }
+  }
+
+  /**
+   * Must be called before using compacted_index(...). The ranks are always up
+   * to date, there is nothing to prepare.
+   */
+  void prepare_compaction() noexcept {}
+
+  /**
+   * Return the raw index that the value at 'raw_index' (or end() if 'raw_index'
+   * == raw_size()) will have after compact(), its rank in the sequence.
+   */
+  size_type compacted_index(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index == m_values.size() || !is_tombstone(raw_index));
+    return rank(raw_index);
+  }
+
+  /**
+   * Remove all the tombstones and store the values in sequence order, the raw
+   * index of a value becomes its rank.
+   */
+  void compact() {
+    // Each swap puts a value in its final slot.
+    for (size_type raw_index = 0; raw_index < m_values.size(); raw_index++) {
+      while (!is_tombstone(raw_index) && rank(raw_index) != raw_index) {
+        swap_slots(raw_index, rank(raw_index));
+      }
+    }
+
+    const size_type nb_values = size();
+    m_values.erase(m_values.begin() + difference_type(nb_values),
+                   m_values.end());
+    m_slot_locations.resize(nb_values);
+    m_nb_tombstones = 0;
+
+    // Fill the chunks in order, there are never more chunks needed than the
+    // number of chunks in use before the compaction.
+    const size_type nb_chunks = (nb_values + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    tsl_oh_assert(nb_chunks <= m_chunk_order.size());
+
+    m_chunk_order.resize(nb_chunks);
+    m_free_chunk = NO_LOCATION;
+    for (size_type chunk = m_chunk_sizes.size(); chunk > 0; chunk--) {
+      if (chunk - 1 >= nb_chunks) {
+        m_chunk_sizes[chunk - 1] = 0;
+        push_free_chunk(chunk - 1);
+      } else {
+        m_chunk_sizes[chunk - 1] =
+            std::min(size_type(CHUNK_SIZE),
+                     nb_values - (chunk - 1) * CHUNK_SIZE);
+        m_chunk_order[chunk - 1] = chunk - 1;
+      }
+    }
+
+    for (size_type raw_index = 0; raw_index < nb_values; raw_index++) {
+      m_slot_locations[raw_index] = raw_index;
+      m_chunk_slots[raw_index] = raw_index;
+    }
+
+    rebuild_chunk_ranks(0);
+  }
+
+  void swap(ranked_deque& other) {
+    using std::swap;
+
+    swap(m_values, other.m_values);
+    swap(m_slot_locations, other.m_slot_locations);
+    swap(m_chunk_slots, other.m_chunk_slots);
+    swap(m_chunk_sizes, other.m_chunk_sizes);
+    swap(m_chunk_positions, other.m_chunk_positions);
+    swap(m_chunk_order, other.m_chunk_order);
+    swap(m_chunk_ranks, other.m_chunk_ranks);
+    swap(m_free_chunk, other.m_free_chunk);
+    swap(m_nb_tombstones, other.m_nb_tombstones);
+  }
+
+  friend void swap(ranked_deque& lhs, ranked_deque& rhs) { lhs.swap(rhs); }
+
+  friend bool operator==(const ranked_deque& lhs, const ranked_deque& rhs) {
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin());
+  }
+
+  friend bool operator!=(const ranked_deque& lhs, const ranked_deque& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(const ranked_deque& lhs, const ranked_deque& rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(),
+                                        rhs.end());
+  }
+
+  friend bool operator<=(const ranked_deque& lhs, const ranked_deque& rhs) {
+    return !(rhs < lhs);
+  }
+
+  friend bool operator>(const ranked_deque& lhs, const ranked_deque& rhs) {
+    return rhs < lhs;
+  }
+
+  friend bool operator>=(const ranked_deque& lhs, const ranked_deque& rhs) {
+    return !(lhs < rhs);
+  }
+
+ private:
+  /**
+   * Grow the containers so that the insertion of one value, which may take a
+   * new chunk, doesn't allocate after the value has been constructed.
+   */
+  void reserve_slot() {
+    if (m_free_chunk == NO_LOCATION) {
+      const size_type chunk = m_chunk_sizes.size();
+      m_chunk_slots.resize((chunk + 1) * CHUNK_SIZE);
+      m_chunk_positions.resize(chunk + 1);
+      m_chunk_sizes.push_back(0);
+      push_free_chunk(chunk);
+    }
+
+    reserve_one_more(m_chunk_order);
+    reserve_one_more(m_chunk_ranks);
+    reserve_one_more(m_slot_locations);
+  }
+
+  static void reserve_one_more(indexes_container_type& container) {
+    if (container.size() == container.capacity()) {
+      container.reserve(std::max(size_type(8), 2 * container.size()));
+    }
+  }
+
+  /**
+   * The free chunks form a stack linked through m_chunk_positions.
+   */
+  void push_free_chunk(size_type chunk) noexcept {
+    m_chunk_positions[chunk] = m_free_chunk;
+    m_free_chunk = chunk;
+  }
+
+  size_type pop_free_chunk() noexcept {
+    tsl_oh_assert(m_free_chunk != NO_LOCATION);
+    const size_type chunk = m_free_chunk;
+    m_free_chunk = m_chunk_positions[chunk];
+
+    return chunk;
+  }
+
+  size_type front_index() const noexcept {
+    if (m_chunk_order.empty()) {
+      return m_values.size();
+    }
+
+    return m_chunk_slots[m_chunk_order.front() * CHUNK_SIZE];
+  }
+
+  size_type back_index() const noexcept {
+    tsl_oh_assert(!m_chunk_order.empty());
+    const size_type chunk = m_chunk_order.back();
+
+    return m_chunk_slots[chunk * CHUNK_SIZE + m_chunk_sizes[chunk] - 1];
+  }
+
+  /**
+   * Return the raw index of the value following the value at 'raw_index' in
+   * the sequence, raw_size() if none.
+   */
+  size_type next_index(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index < m_values.size() && !is_tombstone(raw_index));
+    const size_type location = m_slot_locations[raw_index];
+    const size_type chunk = location / CHUNK_SIZE;
+
+    if (location % CHUNK_SIZE + 1 < m_chunk_sizes[chunk]) {
+      return m_chunk_slots[location + 1];
+    }
+
+    const size_type position = m_chunk_positions[chunk] + 1;
+    if (position == m_chunk_order.size()) {
+      return m_values.size();
+    }
+
+    return m_chunk_slots[m_chunk_order[position] * CHUNK_SIZE];
+  }
+
+  /**
+   * Return the raw index of the value preceding the value at 'raw_index' (or
+   * end() if 'raw_index' == raw_size()) in the sequence. There must be one.
+   */
+  size_type previous_index(size_type raw_index) const noexcept {
+    if (raw_index == m_values.size()) {
+      return back_index();
+    }
+
+    tsl_oh_assert(!is_tombstone(raw_index));
+    const size_type location = m_slot_locations[raw_index];
+    if (location % CHUNK_SIZE > 0) {
+      return m_chunk_slots[location - 1];
+    }
+
+    const size_type position = m_chunk_positions[location / CHUNK_SIZE];
+    tsl_oh_assert(position > 0);
+    const size_type chunk = m_chunk_order[position - 1];
+
+    return m_chunk_slots[chunk * CHUNK_SIZE + m_chunk_sizes[chunk] - 1];
+  }
+
+  /**
+   * Return the position in the sequence of the value at 'raw_index', size() if
+   * 'raw_index' == raw_size().
+   */
+  size_type rank(size_type raw_index) const noexcept {
+    if (raw_index == m_values.size()) {
+      return size();
+    }
+
+    tsl_oh_assert(!is_tombstone(raw_index));
+    const size_type location = m_slot_locations[raw_index];
+
+    return chunk_rank(m_chunk_positions[location / CHUNK_SIZE]) +
+           location % CHUNK_SIZE;
+  }
+
+  size_type nth_index(size_type n) const noexcept {
+    tsl_oh_assert(n <= size());
+    if (n == size()) {
+      return m_values.size();
+    }
+
+    // Descend the Fenwick tree to the last position whose rank is <= n.
+    size_type step = 1;
+    while (2 * step <= m_chunk_ranks.size()) {
+      step *= 2;
+    }
+
+    size_type position = 0;
+    for (; step > 0; step /= 2) {
+      if (position + step <= m_chunk_ranks.size() &&
+          m_chunk_ranks[position + step - 1] <= n) {
+        position += step;
+        n -= m_chunk_ranks[position - 1];
+      }
+    }
+
+    return m_chunk_slots[m_chunk_order[position] * CHUNK_SIZE + n];
+  }
+
+  /**
+   * Number of values in the chunks before 'position' in the sequence.
+   */
+  size_type chunk_rank(size_type position) const noexcept {
+    size_type rank = 0;
+    for (; position > 0; position &= position - 1) {
+      rank += m_chunk_ranks[position - 1];
+    }
+
+    return rank;
+  }
+
+  void update_chunk_rank(size_type position, bool increment) noexcept {
+    for (position++; position <= m_chunk_ranks.size();
+         position += position & (~position + 1)) {
+      if (increment) {
+        m_chunk_ranks[position - 1]++;
+      } else {
+        m_chunk_ranks[position - 1]--;
+      }
+    }
+  }
+
+  /**
+   * Update m_chunk_positions from 'first_position' and rebuild the Fenwick
+   * tree after a change in m_chunk_order, in O(m_chunk_order.size()).
+   */
+  void rebuild_chunk_ranks(size_type first_position) noexcept {
+    for (size_type position = first_position; position < m_chunk_order.size();
+         position++) {
+      m_chunk_positions[m_chunk_order[position]] = position;
+    }
+
+    m_chunk_ranks.resize(m_chunk_order.size());
+    for (size_type position = 0; position < m_chunk_order.size(); position++) {
+      m_chunk_ranks[position] = m_chunk_sizes[m_chunk_order[position]];
+    }
+    for (size_type position = 1; position <= m_chunk_ranks.size();
+         position++) {
+      const size_type parent = position + (position & (~position + 1));
+      if (parent <= m_chunk_ranks.size()) {
+        m_chunk_ranks[parent - 1] += m_chunk_ranks[position - 1];
+      }
+    }
+  }
+
+  /**
+   * Add the empty 'chunk' at the end of the sequence in
+   * O(log(m_chunk_order.size())).
+   */
+  void push_back_chunk(size_type chunk) noexcept {
+    tsl_oh_assert(m_chunk_sizes[chunk] == 0);
+    m_chunk_order.push_back(chunk);
+    m_chunk_positions[chunk] = m_chunk_order.size() - 1;
+
+    const size_type position = m_chunk_order.size();
+    m_chunk_ranks.push_back(chunk_rank(position - 1) -
+                            chunk_rank(position & (position - 1)));
+  }
+
+  void insert_in_chunk(size_type position, size_type offset,
+                       size_type raw_index) noexcept {
+    const size_type chunk = m_chunk_order[position];
+    const size_type first = chunk * CHUNK_SIZE;
+    tsl_oh_assert(offset <= m_chunk_sizes[chunk] &&
+                  m_chunk_sizes[chunk] < CHUNK_SIZE);
+
+    for (size_type i = first + m_chunk_sizes[chunk]; i > first + offset; i--) {
+      m_chunk_slots[i] = m_chunk_slots[i - 1];
+      m_slot_locations[m_chunk_slots[i]] = i;
+    }
+
+    m_chunk_slots[first + offset] = raw_index;
+    m_slot_locations[raw_index] = first + offset;
+    m_chunk_sizes[chunk]++;
+    update_chunk_rank(position, true);
+  }
+
+  void link_back(size_type raw_index) noexcept {
+    if (m_chunk_order.empty() ||
+        m_chunk_sizes[m_chunk_order.back()] == CHUNK_SIZE) {
+      push_back_chunk(pop_free_chunk());
+    }
+
+    insert_in_chunk(m_chunk_order.size() - 1,
+                    m_chunk_sizes[m_chunk_order.back()], raw_index);
+  }
+
+  /**
+   * Link 'raw_index' before the value at 'next_index' in the sequence.
+   */
+  void link_before(size_type next_index, size_type raw_index) noexcept {
+    size_type location = m_slot_locations[next_index];
+    if (m_chunk_sizes[location / CHUNK_SIZE] == CHUNK_SIZE) {
+      split_chunk(m_chunk_positions[location / CHUNK_SIZE]);
+      location = m_slot_locations[next_index];
+    }
+
+    insert_in_chunk(m_chunk_positions[location / CHUNK_SIZE],
+                    location % CHUNK_SIZE, raw_index);
+  }
+
+  /**
+   * Move the second half of the full chunk at 'position' to a new chunk
+   * following it in the sequence.
+   */
+  void split_chunk(size_type position) noexcept {
+    const size_type chunk = m_chunk_order[position];
+    const size_type new_chunk = pop_free_chunk();
+    tsl_oh_assert(m_chunk_sizes[chunk] == CHUNK_SIZE);
+
+    for (size_type offset = CHUNK_SIZE / 2; offset < CHUNK_SIZE; offset++) {
+      const size_type location = new_chunk * CHUNK_SIZE + offset -
+                                 CHUNK_SIZE / 2;
+      m_chunk_slots[location] = m_chunk_slots[chunk * CHUNK_SIZE + offset];
+      m_slot_locations[m_chunk_slots[location]] = location;
+    }
+    m_chunk_sizes[chunk] = CHUNK_SIZE / 2;
+    m_chunk_sizes[new_chunk] = CHUNK_SIZE - CHUNK_SIZE / 2;
+
+    m_chunk_order.insert(m_chunk_order.begin() + difference_type(position + 1),
+                         new_chunk);
+    rebuild_chunk_ranks(position + 1);
+  }
+
+  /**
+   * Remove the value at 'raw_index' from its chunk, and the chunk from the
+   * sequence if it becomes empty. The location of the slot is left as is.
+   */
+  void unlink(size_type raw_index) noexcept {
+    const size_type location = m_slot_locations[raw_index];
+    const size_type chunk = location / CHUNK_SIZE;
+    const size_type last = chunk * CHUNK_SIZE + m_chunk_sizes[chunk] - 1;
+    const size_type position = m_chunk_positions[chunk];
+
+    for (size_type i = location; i < last; i++) {
+      m_chunk_slots[i] = m_chunk_slots[i + 1];
+      m_slot_locations[m_chunk_slots[i]] = i;
+    }
+    m_chunk_sizes[chunk]--;
+    update_chunk_rank(position, false);
+
+    if (m_chunk_sizes[chunk] == 0) {
+      if (position + 1 == m_chunk_order.size()) {
+        m_chunk_order.pop_back();
+        m_chunk_ranks.pop_back();
+      } else {
+        m_chunk_order.erase(m_chunk_order.begin() + difference_type(position));
+        rebuild_chunk_ranks(position);
+      }
+
+      push_free_chunk(chunk);
+    }
+  }
+
+  /**
+   * Swap the slots 'raw_index' and 'other_raw_index', the first one must not
+   * be a tombstone. The values keep their place in the sequence.
+   */
+  void swap_slots(size_type raw_index, size_type other_raw_index) {
+    using std::swap;
+    swap(m_values[raw_index], m_values[other_raw_index]);
+
+    const size_type location = m_slot_locations[raw_index];
+    const size_type other_location = m_slot_locations[other_raw_index];
+    m_chunk_slots[location] = other_raw_index;
+    if (other_location != NO_LOCATION) {
+      m_chunk_slots[other_location] = raw_index;
+    }
+
+    m_slot_locations[raw_index] = other_location;
+    m_slot_locations[other_raw_index] = location;
+  }
+
+ private:
+  values_container_type m_values;
+
+  /**
+   * Location of each slot in m_chunk_slots, NO_LOCATION for a tombstone.
+   */
+  indexes_container_type m_slot_locations;
+
+  /**
+   * CHUNK_SIZE raw indexes per chunk, the first m_chunk_sizes[chunk] ones are
+   * the raw indexes of the values of the chunk in sequence order.
+   */
+  indexes_container_type m_chunk_slots;
+
+  /**
+   * Number of values in each chunk, only the free chunks are empty.
+   */
+  indexes_container_type m_chunk_sizes;
+
+  /**
+   * Position of each chunk in m_chunk_order, or the next free chunk for a free
+   * chunk.
+   */
+  indexes_container_type m_chunk_positions;
+
+  /**
+   * The chunks in use, in sequence order.
+   */
+  indexes_container_type m_chunk_order;
+
+  /**
+   * Fenwick tree over the sizes of the chunks of m_chunk_order.
+   */
+  indexes_container_type m_chunk_ranks;
+
+  /**
+   * Top of the stack of free chunks, NO_LOCATION if none.
+   */
+  size_type m_free_chunk;
+
+  size_type m_nb_tombstones;
+};
+
+}  // end namespace tsl
+
+#endif
@@ -0,0 +1,308 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_SNAPSHOT_ORDERED_MAP_H
+#define TSL_SNAPSHOT_ORDERED_MAP_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "ordered_map.h"
+
+namespace tsl {
+
+namespace detail_snapshot_ordered_map {
+
+/**
+ * Number of readers currently in an epoch, spread over cache line sized slots
+ * to keep the readers of different threads from contending on one counter.
+ */
+class read_indicator {
+ public:
+  read_indicator() noexcept {
+    for (slot& s : m_slots) {
+      s.nb_readers.store(0);
+    }
+  }
+
+  read_indicator(const read_indicator& other) = delete;
+  read_indicator& operator=(const read_indicator& other) = delete;
+
+  void arrive(std::size_t islot) noexcept {
+    m_slots[islot].nb_readers.fetch_add(1);
+  }
+
+  void depart(std::size_t islot) noexcept {
+    m_slots[islot].nb_readers.fetch_sub(1);
+  }
+
+  bool empty() const noexcept {
+    for (const slot& s : m_slots) {
+      if (s.nb_readers.load() != 0) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * Slot of the calling thread.
+   */
+  static std::size_t thread_slot() {
+    static thread_local const std::size_t islot =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % NB_SLOTS;
+    return islot;
+  }
+
+ private:
+  static const std::size_t NB_SLOTS = 32;
+
+  struct slot {
+    std::atomic<std::int64_t> nb_readers;
+    char padding[64 - sizeof(std::atomic<std::int64_t>)];
+  };
+
+  slot m_slots[NB_SLOTS];
+};
+
+}  // end namespace detail_snapshot_ordered_map
+
+/**
+ * tsl::ordered_map for read-mostly workloads where the readers never lock nor
+ * wait on the writers.
+ *
+ * The map keeps two instances of the same tsl::ordered_map and uses the
+ * left-right technique. The readers always read the instance published by the
+ * writer. The writer modifies the other instance, publishes it, waits for the
+ * readers which may still be in the previous instance to leave it, then
+ * applies the same modification to it. Each reader announces the epoch in
+ * which it reads, only the readers of the previous epoch are waited for. A
+ * bucket array or a value freed by a rehash or an erase is thus never
+ * reclaimed while a reader may still access it.
+ *
+ * The readers are wait-free, a lookup costs two atomic increments on a
+ * counter of the thread in addition to the lookup itself. The writes are
+ * applied twice and wait for the ongoing reads to finish, they are serialized
+ * through a mutex and should be rare compared to the reads. The memory used is
+ * twice the memory of an ordered_map.
+ *
+ * Inside read() the whole map can be accessed through a const reference, the
+ * iterators and references must not escape the function object.
+ *
+ * The functions passed to write() are called twice, once on each instance, and
+ * must do the same modification each time. If a modification throws on the
+ * second instance, after succeeding on the first, the two instances diverge
+ * and the behaviour is undefined until the map is cleared.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<std::pair<Key, T>>,
+          class ValueTypeContainer = std::deque<std::pair<Key, T>, Allocator>,
+          class IndexType = std::uint_least32_t>
+class snapshot_ordered_map {
+ public:
+  using map_type = tsl::ordered_map<Key, T, Hash, KeyEqual, Allocator,
+                                    ValueTypeContainer, IndexType>;
+
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+
+  explicit snapshot_ordered_map(size_type bucket_count = 0,
+                                const Hash& hash = Hash(),
+                                const KeyEqual& equal = KeyEqual(),
+                                const Allocator& alloc = Allocator())
+      : m_maps{{map_type(bucket_count, hash, equal, alloc),
+                map_type(bucket_count, hash, equal, alloc)}},
+        m_read_map(0),
+        m_version(0) {}
+
+  snapshot_ordered_map(const snapshot_ordered_map& other) = delete;
+  snapshot_ordered_map& operator=(const snapshot_ordered_map& other) = delete;
+
+  /*
+   * Readers, can be called concurrently with each other and with the writers.
+   */
+
+  /**
+   * Call f(const map_type&) and return its result. The map given to f doesn't
+   * change during the call.
+   */
+  template <class F>
+  auto read(F&& f) const -> decltype(f(std::declval<const map_type&>())) {
+    const read_guard guard(*this);
+    return f(m_maps[m_read_map.load()]);
+  }
+
+  /**
+   * If the key is present, copy its value in 'value' and return true.
+   */
+  bool find(const key_type& key, mapped_type& value) const {
+    return read([&](const map_type& map) {
+      auto it = map.find(key);
+      if (it == map.end()) {
+        return false;
+      }
+
+      value = it->second;
+      return true;
+    });
+  }
+
+  bool contains(const key_type& key) const {
+    return read([&](const map_type& map) { return map.contains(key); });
+  }
+
+  size_type count(const key_type& key) const { return contains(key) ? 1 : 0; }
+
+  size_type size() const {
+    return read([](const map_type& map) { return map.size(); });
+  }
+
+  bool empty() const { return size() == 0; }
+
+  /*
+   * Writers, serialized with each other.
+   */
+
+  /**
+   * Call f(map_type&) on each instance of the map, see the class description.
+   */
+  template <class F>
+  void write(F&& f) {
+    const std::lock_guard<std::mutex> lock(m_writer_mutex);
+
+    const std::size_t read_map = m_read_map.load();
+    f(m_maps[1 - read_map]);
+    m_read_map.store(1 - read_map);
+
+    wait_for_readers();
+    f(m_maps[read_map]);
+  }
+
+  /**
+   * Return true if the value was inserted, false if the key was already
+   * present.
+   */
+  bool insert(const value_type& value) {
+    bool inserted = false;
+    write([&](map_type& map) { inserted = map.insert(value).second; });
+
+    return inserted;
+  }
+
+  /**
+   * Return true if the value was inserted, false if it was assigned to an
+   * existing key.
+   */
+  bool insert_or_assign(const key_type& key, const mapped_type& obj) {
+    bool inserted = false;
+    write([&](map_type& map) {
+      inserted = map.insert_or_assign(key, obj).second;
+    });
+
+    return inserted;
+  }
+
+  size_type erase(const key_type& key) {
+    size_type nb_erased = 0;
+    write([&](map_type& map) { nb_erased = map.erase(key); });
+
+    return nb_erased;
+  }
+
+  void clear() {
+    write([](map_type& map) { map.clear(); });
+  }
+
+  void reserve(size_type count) {
+    write([&](map_type& map) { map.reserve(count); });
+  }
+
+ private:
+  class read_guard {
+   public:
+    explicit read_guard(const snapshot_ordered_map& map)
+        : m_map(map),
+          m_slot(detail_snapshot_ordered_map::read_indicator::thread_slot()),
+          m_version(map.m_version.load()) {
+      m_map.m_read_indicators[m_version].arrive(m_slot);
+    }
+
+    read_guard(const read_guard& other) = delete;
+    read_guard& operator=(const read_guard& other) = delete;
+
+    ~read_guard() { m_map.m_read_indicators[m_version].depart(m_slot); }
+
+   private:
+    const snapshot_ordered_map& m_map;
+    std::size_t m_slot;
+    std::size_t m_version;
+  };
+
+  /**
+   * Once this returns, no reader is still reading the instance unpublished
+   * before the call. New readers arrive in the indicator of the other version
+   * first so that waiting for the current one terminates.
+   */
+  void wait_for_readers() {
+    const std::size_t previous_version = m_version.load();
+    const std::size_t next_version = 1 - previous_version;
+
+    while (!m_read_indicators[next_version].empty()) {
+      std::this_thread::yield();
+    }
+
+    m_version.store(next_version);
+
+    while (!m_read_indicators[previous_version].empty()) {
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  std::array<map_type, 2> m_maps;
+  std::atomic<std::size_t> m_read_map;
+
+  mutable detail_snapshot_ordered_map::read_indicator m_read_indicators[2];
+  std::atomic<std::size_t> m_version;
+
+  std::mutex m_writer_mutex;
+};
+
+}  // end namespace tsl
+
+#endif
@@ -0,0 +1,706 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_TOMBSTONE_DEQUE_H
+#define TSL_TOMBSTONE_DEQUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ordered_hash.h"
+
+namespace tsl {
+
+namespace detail_tombstone_deque {
+
+inline std::size_t popcount(std::uint64_t word) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return std::size_t(__builtin_popcountll(word));
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ull);
+  word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+  word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+  return std::size_t((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/**
+ * Return the index of the lowest set bit of a non-zero word.
+ */
+inline std::size_t lowest_bit(std::uint64_t word) noexcept {
+  tsl_oh_assert(word != 0);
+#if defined(__GNUC__) || defined(__clang__)
+  return std::size_t(__builtin_ctzll(word));
+#else
+  return popcount((word & (~word + 1)) - 1);
+#endif
+}
+
+/**
+ * Return the index of the highest set bit of a non-zero word.
+ */
+inline std::size_t highest_bit(std::uint64_t word) noexcept {
+  tsl_oh_assert(word != 0);
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - std::size_t(__builtin_clzll(word));
+#else
+  std::size_t index = 0;
+  while ((word >>= 1) != 0) {
+    index++;
+  }
+  return index;
+#endif
+}
+
+}  // end namespace detail_tombstone_deque
+
+/**
+ * Container which can be used as ValueTypeContainer of tsl::ordered_map and
+ * tsl::ordered_set to get an O(1) amortized erase which preserves the
+ * insertion order, e.g.
+ *
+ * tsl::ordered_map<Key, T, std::hash<Key>, std::equal_to<Key>,
+ *                  std::allocator<std::pair<Key, T>>,
+ *                  tsl::tombstone_deque<std::pair<Key, T>>>
+ *
+ * The values are stored in a std::deque<T, Allocator>. Erasing a value with
+ * 'tombstone(raw_index)' doesn't shift the values on its right, it only marks
+ * its slot as a tombstone in a bitmap and the iterators skip the tombstones.
+ * The ordered_hash thus doesn't have to update the indexes stored in its
+ * buckets on erase. When the tombstones take too much space, the ordered_hash
+ * remaps its indexes with 'prepare_compaction()' and 'compacted_index(...)' and
+ * removes the tombstones with 'compact()'.
+ *
+ * Each slot has a raw index, its position in the underlying std::deque
+ * tombstones included, which is the index stored by the ordered_hash. The
+ * tombstones at the end of the container are removed directly, back() and
+ * end() are thus always O(1). The raw index of the first live value is cached
+ * to keep begin() in O(1).
+ *
+ * The value of a tombstone is only destroyed on compaction, clear or when it
+ * reaches the end of the container.
+ *
+ * The iterators are bidirectional, nth(n) is in O(raw_size() / 64) if there
+ * are tombstones, O(1) otherwise.
+ */
+template <class T, class Allocator = std::allocator<T>>
+class tombstone_deque {
+ private:
+  using values_container_type = std::deque<T, Allocator>;
+
+  using word_type = std::uint64_t;
+  using words_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<word_type>;
+  using ranks_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<std::size_t>;
+
+  static const std::size_t WORD_BITS = 64;
+
+ public:
+  template <bool IsConst>
+  class tombstone_iterator;
+
+  /**
+   * Tells ordered_hash that erased values only become tombstones.
+   */
+  using tombstone_tag = void;
+
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+  using iterator = tombstone_iterator<false>;
+  using const_iterator = tombstone_iterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  template <bool IsConst>
+  class tombstone_iterator {
+    friend class tombstone_deque;
+
+    template <bool>
+    friend class tombstone_iterator;
+
+   private:
+    using container_pointer =
+        typename std::conditional<IsConst, const tombstone_deque*,
+                                  tombstone_deque*>::type;
+
+    tombstone_iterator(container_pointer container, size_type index) noexcept
+        : m_container(container), m_index(index) {}
+
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename tombstone_deque::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename std::conditional<IsConst, const value_type&,
+                                                value_type&>::type;
+    using pointer = typename std::conditional<IsConst, const value_type*,
+                                              value_type*>::type;
+
+    tombstone_iterator() noexcept : m_container(nullptr), m_index(0) {}
+
+    // Copy constructor from iterator to const_iterator.
+    template <bool TIsConst = IsConst,
+              typename std::enable_if<TIsConst>::type* = nullptr>
+    tombstone_iterator(const tombstone_iterator<!TIsConst>& other) noexcept
+        : m_container(other.m_container), m_index(other.m_index) {}
+
+    tombstone_iterator(const tombstone_iterator& other) = default;
+    tombstone_iterator(tombstone_iterator&& other) = default;
+    tombstone_iterator& operator=(const tombstone_iterator& other) = default;
+    tombstone_iterator& operator=(tombstone_iterator&& other) = default;
+
+    /**
+     * Raw index of the slot pointed by the iterator (raw_size() for end()).
+     */
+    size_type index() const noexcept { return m_index; }
+
+    reference operator*() const { return m_container->m_values[m_index]; }
+    pointer operator->() const { return std::addressof(**this); }
+
+    tombstone_iterator& operator++() {
+      m_index = m_container->next_live_index(m_index + 1);
+      return *this;
+    }
+    tombstone_iterator& operator--() {
+      tsl_oh_assert(m_index > 0);
+      m_index = m_container->previous_live_index(m_index - 1);
+      return *this;
+    }
+
+    tombstone_iterator operator++(int) {
+      tombstone_iterator tmp(*this);
+      ++(*this);
+      return tmp;
+    }
+    tombstone_iterator operator--(int) {
+      tombstone_iterator tmp(*this);
+      --(*this);
+      return tmp;
+    }
+
+    friend bool operator==(const tombstone_iterator& lhs,
+                           const tombstone_iterator& rhs) {
+      return lhs.m_index == rhs.m_index;
+    }
+
+    friend bool operator!=(const tombstone_iterator& lhs,
+                           const tombstone_iterator& rhs) {
+      return lhs.m_index != rhs.m_index;
+    }
+
+   private:
+    container_pointer m_container;
+    size_type m_index;
+  };
+
+ public:
+  tombstone_deque() : tombstone_deque(Allocator()) {}
+
+  explicit tombstone_deque(const Allocator& alloc)
+      : m_values(alloc),
+        m_dead_words(words_allocator(alloc)),
+        m_dead_ranks(ranks_allocator(alloc)),
+        m_nb_tombstones(0),
+        m_first_index(0) {}
+
+  tombstone_deque(const tombstone_deque& other) = default;
+
+  tombstone_deque(tombstone_deque&& other) noexcept(
+      std::is_nothrow_move_constructible<values_container_type>::value)
+      : m_values(std::move(other.m_values)),
+        m_dead_words(std::move(other.m_dead_words)),
+        m_dead_ranks(std::move(other.m_dead_ranks)),
+        m_nb_tombstones(other.m_nb_tombstones),
+        m_first_index(other.m_first_index) {
+    other.clear();
+  }
+
+  tombstone_deque& operator=(const tombstone_deque& other) = default;
+
+  tombstone_deque& operator=(tombstone_deque&& other) {
+    other.swap(*this);
+    other.clear();
+
+    return *this;
+  }
+
+  allocator_type get_allocator() const { return m_values.get_allocator(); }
+
+  /*
+   * Iterators
+   */
+  iterator begin() noexcept { return iterator(this, m_first_index); }
+
+  const_iterator begin() const noexcept { return cbegin(); }
+
+  const_iterator cbegin() const noexcept {
+    return const_iterator(this, m_first_index);
+  }
+
+  iterator end() noexcept { return iterator(this, m_values.size()); }
+
+  const_iterator end() const noexcept { return cend(); }
+
+  const_iterator cend() const noexcept {
+    return const_iterator(this, m_values.size());
+  }
+
+  reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+
+  const_reverse_iterator rbegin() const noexcept { return crbegin(); }
+
+  const_reverse_iterator crbegin() const noexcept {
+    return const_reverse_iterator(cend());
+  }
+
+  reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+
+  const_reverse_iterator rend() const noexcept { return crend(); }
+
+  const_reverse_iterator crend() const noexcept {
+    return const_reverse_iterator(cbegin());
+  }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return size() == 0; }
+
+  /**
+   * Number of values, tombstones excluded.
+   */
+  size_type size() const noexcept { return m_values.size() - m_nb_tombstones; }
+
+  size_type max_size() const noexcept { return m_values.max_size(); }
+
+  /**
+   * Number of slots, tombstones included.
+   */
+  size_type raw_size() const noexcept { return m_values.size(); }
+
+  size_type nb_tombstones() const noexcept { return m_nb_tombstones; }
+
+  void shrink_to_fit() {
+    m_values.shrink_to_fit();
+
+    m_dead_words.resize(nb_words(m_values.size()));
+    m_dead_words.shrink_to_fit();
+    m_dead_ranks.resize(nb_words(m_values.size()));
+    m_dead_ranks.shrink_to_fit();
+  }
+
+  /*
+   * Element access
+   */
+
+  /**
+   * Access the slot at 'raw_index', which may be a tombstone. Use nth(...) to
+   * access the n-th value.
+   */
+  reference operator[](size_type raw_index) {
+    tsl_oh_assert(raw_index < m_values.size());
+    return m_values[raw_index];
+  }
+
+  const_reference operator[](size_type raw_index) const {
+    tsl_oh_assert(raw_index < m_values.size());
+    return m_values[raw_index];
+  }
+
+  bool is_tombstone(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index < m_values.size());
+    return (m_dead_words[raw_index / WORD_BITS] >>
+            (raw_index % WORD_BITS)) &
+           1;
+  }
+
+  reference front() {
+    tsl_oh_assert(!empty());
+    return m_values[m_first_index];
+  }
+
+  const_reference front() const {
+    tsl_oh_assert(!empty());
+    return m_values[m_first_index];
+  }
+
+  reference back() {
+    tsl_oh_assert(!empty());
+    return m_values.back();
+  }
+
+  const_reference back() const {
+    tsl_oh_assert(!empty());
+    return m_values.back();
+  }
+
+  /**
+   * Requires raw_index == raw_size() or a raw index which is not a tombstone.
+   */
+  iterator iterator_at(size_type raw_index) noexcept {
+    tsl_oh_assert(raw_index == m_values.size() || !is_tombstone(raw_index));
+    return iterator(this, raw_index);
+  }
+
+  /**
+   * @copydoc iterator_at(size_type raw_index)
+   */
+  const_iterator iterator_at(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index == m_values.size() || !is_tombstone(raw_index));
+    return const_iterator(this, raw_index);
+  }
+
+  /**
+   * Requires n <= size().
+   *
+   * Return an iterator to the n-th value, end() if n == size().
+   */
+  iterator nth(size_type n) noexcept { return iterator(this, nth_index(n)); }
+
+  /**
+   * @copydoc nth(size_type n)
+   */
+  const_iterator nth(size_type n) const noexcept {
+    return const_iterator(this, nth_index(n));
+  }
+
+  /*
+   * Modifiers
+   */
+  void clear() noexcept {
+    m_values.clear();
+    m_dead_words.clear();
+    m_dead_ranks.clear();
+    m_nb_tombstones = 0;
+    m_first_index = 0;
+  }
+
+  template <class... Args>
+  void emplace_back(Args&&... args) {
+    reserve_dead_words(m_values.size() + 1);
+    m_values.emplace_back(std::forward<Args>(args)...);
+  }
+
+  void push_back(const value_type& value) { emplace_back(value); }
+
+  void push_back(value_type&& value) { emplace_back(std::move(value)); }
+
+  /**
+   * Insert a value before pos, the raw indexes of the slots on the right of
+   * pos (tombstones included) are shifted by one.
+   */
+  template <class... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    const size_type raw_index = pos.index();
+    tsl_oh_assert(raw_index <= m_values.size());
+
+    reserve_dead_words(m_values.size() + 1);
+    m_values.emplace(m_values.begin() + difference_type(raw_index),
+                     std::forward<Args>(args)...);
+    insert_live_bit(raw_index);
+
+    m_first_index = std::min(m_first_index, raw_index);
+
+    return iterator(this, raw_index);
+  }
+
+  /**
+   * Mark the value at 'raw_index' as erased. The other values keep their raw
+   * index, unless the erased value is the last value of the container in which
+   * case the slot and the tombstones preceding it are removed.
+   */
+  void tombstone(size_type raw_index) noexcept {
+    tsl_oh_assert(raw_index < m_values.size() && !is_tombstone(raw_index));
+
+    if (raw_index + 1 == m_values.size()) {
+      m_values.pop_back();
+      while (!m_values.empty() && is_tombstone(m_values.size() - 1)) {
+        set_dead_bit(m_values.size() - 1, false);
+        m_values.pop_back();
+        m_nb_tombstones--;
+      }
+
+      m_first_index = std::min(m_first_index, m_values.size());
+    } else {
+      set_dead_bit(raw_index, true);
+      m_nb_tombstones++;
+
+      if (raw_index == m_first_index) {
+        m_first_index = next_live_index(raw_index + 1);
+      }
+    }
+  }
+
+  /**
+   * Must be called before using compacted_index(...). Any modification of the
+   * container invalidates the preparation.
+   */
+  void prepare_compaction() noexcept {
+    size_type nb_tombstones = 0;
+    for (size_type iword = 0; iword < nb_words(m_values.size()); iword++) {
+      m_dead_ranks[iword] = nb_tombstones;
+      nb_tombstones += detail_tombstone_deque::popcount(m_dead_words[iword]);
+    }
+
+    tsl_oh_assert(nb_tombstones == m_nb_tombstones);
+  }
+
+  /**
+   * Return the raw index that the value at 'raw_index' (or end() if 'raw_index'
+   * == raw_size()) will have after compact().
+   */
+  size_type compacted_index(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index <= m_values.size());
+    if (raw_index == m_values.size()) {
+      return size();
+    }
+
+    const size_type iword = raw_index / WORD_BITS;
+    const word_type dead_before =
+        m_dead_words[iword] &
+        ((word_type(1) << (raw_index % WORD_BITS)) - 1);
+
+    return raw_index - m_dead_ranks[iword] -
+           detail_tombstone_deque::popcount(dead_before);
+  }
+
+  /**
+   * Remove all the tombstones, the values keep their order.
+   */
+  void compact() {
+    size_type compacted_size = 0;
+    for (size_type raw_index = m_first_index; raw_index < m_values.size();
+         raw_index = next_live_index(raw_index + 1)) {
+      if (raw_index != compacted_size) {
+        m_values[compacted_size] = std::move(m_values[raw_index]);
+      }
+      compacted_size++;
+    }
+    tsl_oh_assert(compacted_size == size());
+
+    m_values.erase(m_values.begin() + difference_type(compacted_size),
+                   m_values.end());
+    std::fill(m_dead_words.begin(), m_dead_words.end(), word_type(0));
+    m_nb_tombstones = 0;
+    m_first_index = 0;
+  }
+
+  void swap(tombstone_deque& other) {
+    using std::swap;
+
+    swap(m_values, other.m_values);
+    swap(m_dead_words, other.m_dead_words);
+    swap(m_dead_ranks, other.m_dead_ranks);
+    swap(m_nb_tombstones, other.m_nb_tombstones);
+    swap(m_first_index, other.m_first_index);
+  }
+
+  friend void swap(tombstone_deque& lhs, tombstone_deque& rhs) {
+    lhs.swap(rhs);
+  }
+
+  friend bool operator==(const tombstone_deque& lhs,
+                         const tombstone_deque& rhs) {
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin());
+  }
+
+  friend bool operator!=(const tombstone_deque& lhs,
+                         const tombstone_deque& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(const tombstone_deque& lhs,
+                        const tombstone_deque& rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(),
+                                        rhs.end());
+  }
+
+  friend bool operator<=(const tombstone_deque& lhs,
+                         const tombstone_deque& rhs) {
+    return !(rhs < lhs);
+  }
+
+  friend bool operator>(const tombstone_deque& lhs,
+                        const tombstone_deque& rhs) {
+    return rhs < lhs;
+  }
+
+  friend bool operator>=(const tombstone_deque& lhs,
+                         const tombstone_deque& rhs) {
+    return !(lhs < rhs);
+  }
+
+ private:
+  static size_type nb_words(size_type nb_slots) noexcept {
+    return (nb_slots + WORD_BITS - 1) / WORD_BITS;
+  }
+
+  /**
+   * Grow the bitmap (and the ranks) so that it can hold 'nb_slots' slots. The
+   * words past raw_size() are always zero.
+   */
+  void reserve_dead_words(size_type nb_slots) {
+    const size_type nb_words_needed = nb_words(nb_slots);
+    if (m_dead_words.size() < nb_words_needed) {
+      m_dead_words.resize(nb_words_needed, word_type(0));
+    }
+    if (m_dead_ranks.size() < nb_words_needed) {
+      m_dead_ranks.resize(nb_words_needed, 0);
+    }
+  }
+
+  void set_dead_bit(size_type raw_index, bool dead) noexcept {
+    const word_type bit = word_type(1) << (raw_index % WORD_BITS);
+    if (dead) {
+      m_dead_words[raw_index / WORD_BITS] |= bit;
+    } else {
+      m_dead_words[raw_index / WORD_BITS] &= ~bit;
+    }
+  }
+
+  /**
+   * Shift the bits at 'raw_index' and after by one to the left and insert a
+   * live bit at 'raw_index'. Called after the insertion of the new slot.
+   */
+  void insert_live_bit(size_type raw_index) noexcept {
+    const size_type first_word = raw_index / WORD_BITS;
+    const word_type low_mask =
+        (word_type(1) << (raw_index % WORD_BITS)) - 1;
+
+    word_type carry = 0;
+    for (size_type iword = first_word; iword < nb_words(m_values.size());
+         iword++) {
+      const word_type word = m_dead_words[iword];
+      if (iword == first_word) {
+        m_dead_words[iword] = (word & low_mask) | ((word & ~low_mask) << 1);
+      } else {
+        m_dead_words[iword] = (word << 1) | carry;
+      }
+      carry = word >> (WORD_BITS - 1);
+    }
+  }
+
+  /**
+   * Return the raw index of the first value which is not a tombstone at or
+   * after 'raw_index', raw_size() if none.
+   */
+  size_type next_live_index(size_type raw_index) const noexcept {
+    if (raw_index >= m_values.size()) {
+      return m_values.size();
+    }
+
+    // The last slot is never a tombstone, the loop always ends before it.
+    size_type iword = raw_index / WORD_BITS;
+    word_type live = ~m_dead_words[iword] &
+                     (~word_type(0) << (raw_index % WORD_BITS));
+    while (live == 0) {
+      iword++;
+      live = ~m_dead_words[iword];
+    }
+
+    return iword * WORD_BITS + detail_tombstone_deque::lowest_bit(live);
+  }
+
+  /**
+   * Return the raw index of the last value which is not a tombstone at or
+   * before 'raw_index'. There must be one.
+   */
+  size_type previous_live_index(size_type raw_index) const noexcept {
+    tsl_oh_assert(raw_index >= m_first_index);
+
+    size_type iword = raw_index / WORD_BITS;
+    word_type live = ~m_dead_words[iword] &
+                     (~word_type(0) >> (WORD_BITS - 1 - raw_index % WORD_BITS));
+    while (live == 0) {
+      iword--;
+      live = ~m_dead_words[iword];
+    }
+
+    return iword * WORD_BITS + detail_tombstone_deque::highest_bit(live);
+  }
+
+  size_type nth_index(size_type n) const noexcept {
+    tsl_oh_assert(n <= size());
+    if (n == size()) {
+      return m_values.size();
+    }
+    if (m_nb_tombstones == 0) {
+      return n;
+    }
+
+    for (size_type iword = 0;; iword++) {
+      word_type live = ~m_dead_words[iword];
+      const size_type nb_live = detail_tombstone_deque::popcount(live);
+      if (n < nb_live) {
+        for (; n > 0; n--) {
+          live &= live - 1;
+        }
+
+        return iword * WORD_BITS + detail_tombstone_deque::lowest_bit(live);
+      }
+
+      n -= nb_live;
+    }
+  }
+
+ private:
+  values_container_type m_values;
+
+  /**
+   * Bitmap with a bit set for each tombstone in m_values.
+   */
+  std::vector<word_type, words_allocator> m_dead_words;
+
+  /**
+   * Filled by prepare_compaction() with the number of tombstones before each
+   * word of m_dead_words. Kept the same size as m_dead_words so that the
+   * compaction never allocates.
+   */
+  std::vector<size_type, ranks_allocator> m_dead_ranks;
+
+  size_type m_nb_tombstones;
+
+  /**
+   * Raw index of the first value which is not a tombstone, raw_size() if the
+   * container is empty.
+   */
+  size_type m_first_index;
+};
+
+}  // end namespace tsl
+
+#endif
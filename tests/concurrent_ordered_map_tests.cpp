@@ -0,0 +1,246 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tsl/concurrent_ordered_map.h"
+#include "tsl/ordered_map.h"
+#include "utils.h"
+
+BOOST_AUTO_TEST_SUITE(test_concurrent_ordered_map)
+
+namespace {
+
+template <class CMap>
+std::vector<std::pair<typename CMap::key_type, typename CMap::mapped_type>>
+values_in_order(const CMap& map) {
+  std::vector<std::pair<typename CMap::key_type, typename CMap::mapped_type>>
+      values;
+  map.for_each_in_order(
+      [&](const typename CMap::key_type& key,
+          const typename CMap::mapped_type& value) {
+        values.emplace_back(key, value);
+      });
+
+  return values;
+}
+
+/**
+ * Mutex recording the address of each instance locked exclusively, to know
+ * which shards of a map were modified.
+ */
+class recording_shared_mutex {
+ public:
+  void lock() {
+    m_mutex.lock();
+    locked_mutexes().insert(this);
+  }
+  void unlock() { m_mutex.unlock(); }
+
+  void lock_shared() { m_mutex.lock(); }
+  void unlock_shared() { m_mutex.unlock(); }
+
+  static std::set<const recording_shared_mutex*>& locked_mutexes() {
+    static std::set<const recording_shared_mutex*> mutexes;
+    return mutexes;
+  }
+
+ private:
+  std::mutex m_mutex;
+};
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_random_operations_single_thread) {
+  // Do the same random operations on a tsl::ordered_map and check that
+  // for_each_in_order gives the same values in the same order.
+  tsl::concurrent_ordered_map<std::int64_t, std::int64_t> map(16);
+  tsl::ordered_map<std::int64_t, std::int64_t> ref_map;
+  BOOST_CHECK_EQUAL(map.nb_shards(), 16);
+
+  std::mt19937_64 generator(1);
+  std::uniform_int_distribution<std::int64_t> rand_key(0, 2000);
+  for (std::int64_t i = 0; i < 20000; i++) {
+    const std::int64_t key = rand_key(generator);
+    switch (i % 4) {
+      case 0:
+      case 1:
+        BOOST_CHECK_EQUAL(map.insert({key, i}),
+                          ref_map.insert({key, i}).second);
+        break;
+      case 2:
+        BOOST_CHECK_EQUAL(map.insert_or_assign(key, i),
+                          ref_map.insert_or_assign(key, i).second);
+        break;
+      case 3:
+        BOOST_CHECK_EQUAL(map.erase(key), ref_map.erase(key));
+        break;
+    }
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), ref_map.size());
+  const auto values = values_in_order(map);
+  BOOST_REQUIRE_EQUAL(values.size(), ref_map.size());
+  BOOST_CHECK(std::equal(values.begin(), values.end(), ref_map.begin()));
+
+  for (std::int64_t key = 0; key <= 2000; key++) {
+    std::int64_t value = -1;
+    const bool found = map.find(key, value);
+    BOOST_CHECK_EQUAL(found, ref_map.contains(key));
+    BOOST_CHECK_EQUAL(map.count(key), ref_map.count(key));
+    if (found) {
+      BOOST_CHECK_EQUAL(value, ref_map.at(key));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_sequential_keys_span_shards) {
+  // std::hash is the identity for the integers in libstdc++, the sequential
+  // keys must still be spread over the shards.
+  using cmap_t = tsl::concurrent_ordered_map<
+      std::uint64_t, std::uint64_t, std::hash<std::uint64_t>,
+      std::equal_to<std::uint64_t>,
+      std::allocator<std::pair<std::uint64_t, std::uint64_t>>,
+      std::uint_least32_t, recording_shared_mutex>;
+
+  recording_shared_mutex::locked_mutexes().clear();
+  cmap_t map(64);
+  for (std::uint64_t i = 0; i < 10000; i++) {
+    map.insert({i, i});
+  }
+  BOOST_CHECK_EQUAL(recording_shared_mutex::locked_mutexes().size(),
+                    map.nb_shards());
+
+  recording_shared_mutex::locked_mutexes().clear();
+  for (std::uint64_t i = 0; i < 64; i++) {
+    map.erase(i);
+  }
+  BOOST_CHECK_GT(recording_shared_mutex::locked_mutexes().size(), 1);
+  recording_shared_mutex::locked_mutexes().clear();
+}
+
+BOOST_AUTO_TEST_CASE(test_sequential_keys_order) {
+  // Insert sequential keys, erase some of them and insert a part of them
+  // again. The values of the different shards must be merged back into the
+  // insertion order.
+  tsl::concurrent_ordered_map<std::uint64_t, std::uint64_t> map;
+  tsl::ordered_map<std::uint64_t, std::uint64_t> ref_map;
+
+  for (std::uint64_t i = 0; i < 10000; i++) {
+    BOOST_CHECK(map.insert({i, i}));
+    ref_map.insert({i, i});
+  }
+  for (std::uint64_t i = 0; i < 10000; i += 3) {
+    BOOST_CHECK_EQUAL(map.erase(i), 1);
+    ref_map.erase(i);
+  }
+  for (std::uint64_t i = 0; i < 10000; i += 7) {
+    BOOST_CHECK_EQUAL(map.insert_or_assign(i, i + 1),
+                      ref_map.insert_or_assign(i, i + 1).second);
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), ref_map.size());
+  const auto values = values_in_order(map);
+  BOOST_REQUIRE_EQUAL(values.size(), ref_map.size());
+  BOOST_CHECK(std::equal(values.begin(), values.end(), ref_map.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(test_visit_update) {
+  tsl::concurrent_ordered_map<std::string, std::string> map;
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK(map.try_emplace("a", 3, 'x'));
+  BOOST_CHECK(!map.try_emplace("a", "other"));
+
+  BOOST_CHECK(map.update("a", [](std::string& value) { value += "y"; }));
+  BOOST_CHECK(!map.update("b", [](std::string& value) { value += "y"; }));
+
+  std::string visited;
+  BOOST_CHECK(
+      map.visit("a", [&](const std::string& value) { visited = value; }));
+  BOOST_CHECK_EQUAL(visited, "xxxy");
+  BOOST_CHECK(!map.contains("b"));
+
+  map.clear();
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK(!map.contains("a"));
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_insert_erase) {
+  // Each thread inserts its own keys, erases a part of them and inserts them
+  // again while other threads read. Check the content and that the values of
+  // each thread come in the order they were inserted.
+  const std::int64_t nb_threads = 4;
+  const std::int64_t nb_values_per_thread = 5000;
+
+  tsl::concurrent_ordered_map<std::int64_t, std::int64_t> map(8);
+  map.reserve(std::size_t(nb_threads * nb_values_per_thread));
+
+  std::vector<std::thread> threads;
+  for (std::int64_t t = 0; t < nb_threads; t++) {
+    threads.emplace_back([&map, t, nb_threads, nb_values_per_thread]() {
+      for (std::int64_t i = 0; i < nb_values_per_thread; i++) {
+        const std::int64_t key = i * nb_threads + t;
+        map.insert({key, t});
+        map.contains(key - nb_threads);
+        if (i % 10 == 0) {
+          map.erase(key);
+          map.insert({key, t});
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), std::size_t(nb_threads * nb_values_per_thread));
+
+  std::vector<std::int64_t> last_key(nb_threads, -1);
+  std::size_t nb_values = 0;
+  map.for_each_in_order([&](std::int64_t key, std::int64_t t) {
+    BOOST_REQUIRE_EQUAL(key % nb_threads, t);
+    const std::int64_t i = key / nb_threads;
+    if (i % 10 != 0) {
+      BOOST_CHECK_LT(last_key[std::size_t(t)], key);
+      last_key[std::size_t(t)] = key;
+    }
+    nb_values++;
+  });
+  BOOST_CHECK_EQUAL(nb_values, map.size());
+
+  std::size_t nb_values_unordered = 0;
+  map.for_each([&](std::int64_t, std::int64_t) { nb_values_unordered++; });
+  BOOST_CHECK_EQUAL(nb_values_unordered, map.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,12 +21,16 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
+#include <tsl/huge_page_allocator.h>
 #include <tsl/ordered_map.h>
 
 #include <boost/test/unit_test.hpp>
 #include <cstdint>
 #include <cstdlib>
+#include <deque>
+#include <functional>
 #include <limits>
+#include <new>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
@@ -104,6 +108,52 @@ bool operator!=(const custom_allocator<T>&, const custom_allocator<U>&) {
   return false;
 }
 
+/**
+ * Allocator for the buckets only, it keeps track of the bytes currently
+ * allocated. It can't be constructed from custom_allocator, the maps default
+ * construct it unless one is passed to the constructor.
+ */
+static std::size_t nb_bucket_bytes = 0;
+
+template <typename T>
+class bucket_allocator {
+ public:
+  using value_type = T;
+
+  bucket_allocator() : m_id(0) {}
+  explicit bucket_allocator(int id) : m_id(id) {}
+
+  template <typename U>
+  bucket_allocator(const bucket_allocator<U>& other) : m_id(other.id()) {}
+
+  T* allocate(std::size_t n) {
+    nb_bucket_bytes += n * sizeof(T);
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) {
+    nb_bucket_bytes -= n * sizeof(T);
+    ::operator delete(p);
+  }
+
+  int id() const { return m_id; }
+
+ private:
+  int m_id;
+};
+
+template <class T, class U>
+bool operator==(const bucket_allocator<T>& lhs,
+                const bucket_allocator<U>& rhs) {
+  return lhs.id() == rhs.id();
+}
+
+template <class T, class U>
+bool operator!=(const bucket_allocator<T>& lhs,
+                const bucket_allocator<U>& rhs) {
+  return !(lhs == rhs);
+}
+
 // TODO Avoid overloading new to check number of global new.
 // How can we check we only go through the allocator for allocation?
 
@@ -136,4 +186,107 @@ BOOST_AUTO_TEST_CASE(test_custom_allocator_1) {
   //    BOOST_CHECK_EQUAL(nb_global_new, 0);
 }
 
+/**
+ * The buckets only come from the BucketAllocator, the values from Allocator.
+ */
+BOOST_AUTO_TEST_CASE(test_custom_bucket_allocator) {
+  using map_type =
+      tsl::ordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                       custom_allocator<std::pair<int, int>>,
+                       std::deque<std::pair<int, int>,
+                                  custom_allocator<std::pair<int, int>>>,
+                       std::uint_least32_t, false, false,
+                       tsl::oh::power_of_two_growth_policy,
+                       bucket_allocator<std::pair<int, int>>>;
+
+  nb_custom_allocs = 0;
+  nb_bucket_bytes = 0;
+  {
+    map_type map(0, std::hash<int>(), std::equal_to<int>(),
+                 custom_allocator<std::pair<int, int>>(),
+                 bucket_allocator<std::pair<int, int>>(7));
+    BOOST_CHECK_EQUAL(map.get_bucket_allocator().id(), 7);
+    BOOST_CHECK_EQUAL(nb_bucket_bytes, 0u);
+
+    map.incremental_rehash(4);
+    const int nb_elements = 1000;
+    for (int i = 0; i < nb_elements; i++) {
+      map.insert({i, i * 2});
+      BOOST_REQUIRE_EQUAL(nb_bucket_bytes, map.stats().buckets_bytes);
+    }
+
+    BOOST_CHECK_NE(nb_custom_allocs, 0u);
+    BOOST_CHECK_NE(nb_bucket_bytes, 0u);
+    for (int i = 0; i < nb_elements; i++) {
+      BOOST_CHECK_EQUAL(map.at(i), i * 2);
+    }
+
+    const map_type map_copy = map;
+    BOOST_CHECK_EQUAL(map_copy.get_bucket_allocator().id(), 7);
+    BOOST_CHECK(map_copy == map);
+
+    map_type map_default;
+    BOOST_CHECK_EQUAL(map_default.get_bucket_allocator().id(), 0);
+    map_default.insert({1, 2});
+    map_default.clear();
+    map_default.rehash(0);
+  }
+  BOOST_CHECK_EQUAL(nb_bucket_bytes, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_huge_page_allocator) {
+  using allocator_type = tsl::oh::huge_page_allocator<std::uint64_t>;
+
+  allocator_type alloc(0);
+  BOOST_CHECK_EQUAL(alloc.numa_node(), 0);
+  BOOST_CHECK_EQUAL(allocator_type().numa_node(), allocator_type::NO_NUMA_NODE);
+
+  // Big enough to be mapped in huge pages on Linux.
+  const std::size_t nb_elements = 3 * 1024 * 1024 / sizeof(std::uint64_t) + 5;
+  for (const std::size_t size : {std::size_t(10), nb_elements}) {
+    std::uint64_t* ptr = alloc.allocate(size);
+    if (allocator_type::use_huge_pages(size * sizeof(std::uint64_t))) {
+      BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(ptr) %
+                            (std::uintptr_t(2) * 1024 * 1024),
+                        0u);
+    }
+
+    for (std::size_t i = 0; i < size; i++) {
+      ptr[i] = i;
+    }
+    for (std::size_t i = 0; i < size; i++) {
+      BOOST_REQUIRE_EQUAL(ptr[i], i);
+    }
+
+    alloc.deallocate(ptr, size);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_huge_page_ordered_map) {
+  tsl::huge_page_ordered_map<std::int64_t, std::int64_t> map(
+      0, std::hash<std::int64_t>(), std::equal_to<std::int64_t>(),
+      std::allocator<std::pair<std::int64_t, std::int64_t>>(),
+      tsl::oh::huge_page_allocator<std::pair<std::int64_t, std::int64_t>>(0));
+  BOOST_CHECK_EQUAL(map.get_bucket_allocator().numa_node(), 0);
+
+  // Enough elements for a buckets array of more than 2 MiB.
+  const std::int64_t nb_elements = 300000;
+  for (std::int64_t i = 0; i < nb_elements; i++) {
+    map.insert({i, i * 2});
+  }
+  BOOST_CHECK_GE(map.bucket_count() * 8, std::size_t(2) * 1024 * 1024);
+
+  for (std::int64_t i = 0; i < nb_elements; i++) {
+    BOOST_REQUIRE_EQUAL(map.at(i), i * 2);
+  }
+  BOOST_CHECK(map.find(nb_elements) == map.end());
+
+  tsl::huge_page_ordered_map<std::int64_t, std::int64_t> map_copy = map;
+  BOOST_CHECK(map_copy == map);
+
+  map.clear();
+  map.rehash(0);
+  BOOST_CHECK_EQUAL(map.bucket_count(), 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,126 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tsl/dictionary_encoder.h"
+#include "utils.h"
+
+BOOST_AUTO_TEST_SUITE(test_dictionary_encoder)
+
+BOOST_AUTO_TEST_CASE(test_encode_decode) {
+  tsl::dictionary_encoder<std::string> encoder;
+  BOOST_CHECK(encoder.empty());
+
+  BOOST_CHECK_EQUAL(encoder.encode("b"), 0u);
+  BOOST_CHECK_EQUAL(encoder.encode("a"), 1u);
+  BOOST_CHECK_EQUAL(encoder.encode("b"), 0u);
+  BOOST_CHECK_EQUAL(encoder.encode(std::string("c")), 2u);
+  BOOST_CHECK_EQUAL(encoder.size(), 3u);
+
+  BOOST_CHECK_EQUAL(encoder.decode(0), "b");
+  BOOST_CHECK_EQUAL(encoder.decode(1), "a");
+  BOOST_CHECK_EQUAL(encoder.decode(2), "c");
+
+  std::uint_least32_t code = 0;
+  BOOST_CHECK(encoder.find_code("c", code));
+  BOOST_CHECK_EQUAL(code, 2u);
+  BOOST_CHECK(!encoder.find_code("d", code));
+  BOOST_CHECK(!encoder.contains("d"));
+  BOOST_CHECK_EQUAL(encoder.size(), 3u);
+
+  encoder.clear();
+  BOOST_CHECK(encoder.empty());
+  BOOST_CHECK_EQUAL(encoder.encode("c"), 0u);
+}
+
+/**
+ * The batch encode must give the same codes as a row by row encode, across
+ * several blocks and with a lot of collisions.
+ */
+BOOST_AUTO_TEST_CASE(test_encode_batch) {
+  const std::size_t nb_rows = 5000;
+  const std::size_t nb_distinct_keys = 700;
+
+  std::vector<std::int64_t> column;
+  for (std::size_t i = 0; i < nb_rows; i++) {
+    column.push_back(utils::get_key<std::int64_t>((i * 7919) %
+                                                  nb_distinct_keys));
+  }
+
+  tsl::dictionary_encoder<std::int64_t, mod_hash<9>> row_encoder;
+  std::vector<std::uint_least32_t> expected_codes;
+  for (const std::int64_t key : column) {
+    expected_codes.push_back(row_encoder.encode(key));
+  }
+
+  tsl::dictionary_encoder<std::int64_t, mod_hash<9>> batch_encoder;
+  batch_encoder.reserve(nb_distinct_keys);
+  std::vector<std::uint_least32_t> codes(nb_rows);
+  auto codes_end = batch_encoder.encode(column.begin(), column.size(),
+                                        codes.begin());
+  BOOST_CHECK(codes_end == codes.end());
+  BOOST_CHECK(codes == expected_codes);
+  BOOST_CHECK_EQUAL(batch_encoder.size(), nb_distinct_keys);
+
+  std::vector<std::int64_t> decoded(nb_rows);
+  auto decoded_end =
+      batch_encoder.decode(codes.begin(), codes.size(), decoded.begin());
+  BOOST_CHECK(decoded_end == decoded.end());
+  BOOST_CHECK(decoded == column);
+
+  // the dictionary is in code order
+  for (std::size_t i = 0; i < batch_encoder.size(); i++) {
+    BOOST_CHECK_EQUAL(batch_encoder.dictionary().values_container()[i],
+                      batch_encoder.decode(std::uint_least32_t(i)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_encode_batch_forward_iterator) {
+  std::list<std::string> column = {"x", "y", "x", "z", "y", "x"};
+
+  tsl::dictionary_encoder<std::string, std::hash<std::string>,
+                          std::equal_to<std::string>,
+                          std::allocator<std::string>, std::uint16_t>
+      encoder;
+  BOOST_CHECK_EQUAL(encoder.encode("z"), 0u);
+
+  std::vector<std::uint16_t> codes;
+  encoder.encode(column.begin(), column.size(), std::back_inserter(codes));
+  BOOST_CHECK(codes == (std::vector<std::uint16_t>{1, 2, 1, 0, 2, 1}));
+
+  std::vector<std::string> decoded;
+  encoder.decode(codes.begin(), codes.size(), std::back_inserter(decoded));
+  BOOST_CHECK(decoded == std::vector<std::string>(column.begin(),
+                                                  column.end()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
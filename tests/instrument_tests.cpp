@@ -0,0 +1,129 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <array>
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace instrument_test {
+template <class Event>
+void record(Event event, std::size_t value);
+}
+
+#define TSL_OH_INSTRUMENT(event, value) instrument_test::record(event, value)
+#include <tsl/ordered_map.h>
+
+namespace instrument_test {
+/**
+ * Number of events and sum of their values, by tsl::ordered_hash_event.
+ */
+std::array<std::size_t, 6> nb_events;
+std::array<std::size_t, 6> events_values;
+
+template <class Event>
+void record(Event event, std::size_t value) {
+  nb_events[static_cast<std::size_t>(event)]++;
+  events_values[static_cast<std::size_t>(event)] += value;
+}
+
+std::size_t nb(tsl::ordered_hash_event event) {
+  return nb_events[static_cast<std::size_t>(event)];
+}
+
+void reset() {
+  nb_events.fill(0);
+  events_values.fill(0);
+}
+
+/**
+ * The ordered_map instantiations of this translation unit must not be shared
+ * with the other ones which don't define TSL_OH_INSTRUMENT, use a hash only
+ * used here.
+ */
+struct instrumented_hash {
+  std::size_t operator()(std::int64_t value) const noexcept {
+    return std::hash<std::int64_t>()(value);
+  }
+};
+
+using instrumented_map =
+    tsl::ordered_map<std::int64_t, std::int64_t, instrumented_hash,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::vector<std::pair<std::int64_t, std::int64_t>>>;
+}  // namespace instrument_test
+
+using namespace instrument_test;
+
+BOOST_AUTO_TEST_SUITE(test_instrument)
+
+BOOST_AUTO_TEST_CASE(test_instrument_insert_find) {
+  reset();
+
+  instrumented_map map;
+  for (std::int64_t i = 0; i < 1000; i++) {
+    map.insert({i, i});
+  }
+
+  BOOST_CHECK(nb(tsl::ordered_hash_event::rehash_start) > 0);
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::rehash_start),
+                    nb(tsl::ordered_hash_event::rehash_end));
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::rehash_start),
+                    map.stats().nb_rehashes);
+  BOOST_CHECK(nb(tsl::ordered_hash_event::values_grow) > 0);
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::shift_indexes_start), 0);
+
+  const std::size_t nb_probe_steps = nb(tsl::ordered_hash_event::probe_step);
+  BOOST_CHECK(map.find(1) != map.end());
+  BOOST_CHECK(nb(tsl::ordered_hash_event::probe_step) > nb_probe_steps);
+}
+
+BOOST_AUTO_TEST_CASE(test_instrument_shift_indexes) {
+  instrumented_map map;
+  for (std::int64_t i = 0; i < 100; i++) {
+    map.insert({i, i});
+  }
+
+  reset();
+
+  map.erase(50);
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::shift_indexes_start), 1);
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::shift_indexes_end), 1);
+  BOOST_CHECK_EQUAL(events_values[static_cast<std::size_t>(
+                        tsl::ordered_hash_event::shift_indexes_start)],
+                    map.bucket_count());
+
+  map.insert_at_position(map.begin(), {-1, -1});
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::shift_indexes_start), 2);
+
+  // No index shift when erasing at the end.
+  map.erase(99);
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::shift_indexes_start), 2);
+  BOOST_CHECK_EQUAL(nb(tsl::ordered_hash_event::rehash_start), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,250 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "tsl/mapped_ordered_map.h"
+#include "tsl/ordered_map.h"
+#include "tsl/tombstone_deque.h"
+
+BOOST_AUTO_TEST_SUITE(test_mapped_ordered_map)
+
+namespace {
+
+/**
+ * Remove the file on destruction.
+ */
+class temporary_file {
+ public:
+  explicit temporary_file(std::string path) : m_path(std::move(path)) {}
+  ~temporary_file() { std::remove(m_path.c_str()); }
+
+  const std::string& path() const { return m_path; }
+
+ private:
+  std::string m_path;
+};
+
+template <class Map, class MappedMap>
+void check_same_content(const Map& map, const MappedMap& mapped_map) {
+  BOOST_REQUIRE_EQUAL(mapped_map.size(), map.size());
+  BOOST_CHECK_EQUAL(mapped_map.bucket_count(), map.bucket_count());
+
+  auto it_mapped = mapped_map.begin();
+  std::ptrdiff_t index = 0;
+  for (const auto& value : map) {
+    BOOST_CHECK_EQUAL(it_mapped->first, value.first);
+    BOOST_CHECK_EQUAL(it_mapped->second, value.second);
+    ++it_mapped;
+
+    auto it_find = mapped_map.find(value.first);
+    BOOST_REQUIRE(it_find != mapped_map.end());
+    BOOST_CHECK_EQUAL(it_find->second, value.second);
+    BOOST_CHECK_EQUAL(it_find - mapped_map.begin(), index);
+    index++;
+  }
+  BOOST_CHECK(it_mapped == mapped_map.end());
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_write_and_map) {
+  // insert x values; erase some; write the map; map the file; check same
+  // values in same order and same lookups.
+  const temporary_file file("test_write_and_map.tslomap");
+
+  tsl::ordered_map<std::int64_t, double> map;
+  for (std::int64_t i = 0; i < 5000; i++) {
+    map.insert({i * 7, double(i) / 2});
+  }
+  for (std::int64_t i = 0; i < 5000; i += 3) {
+    map.erase(i * 7);
+  }
+
+  tsl::mapped_ordered_map<std::int64_t, double>::write(map, file.path());
+  const tsl::mapped_ordered_map<std::int64_t, double> mapped_map(file.path());
+
+  check_same_content(map, mapped_map);
+
+  BOOST_CHECK(mapped_map.find(3) == mapped_map.end());
+  BOOST_CHECK(mapped_map.find(0) == mapped_map.end());
+  BOOST_CHECK(!mapped_map.contains(5000 * 7));
+  BOOST_CHECK_EQUAL(mapped_map.count(7), 1);
+  BOOST_CHECK_EQUAL(mapped_map.at(7), 0.5);
+  BOOST_CHECK_EQUAL(mapped_map.at(14, std::hash<std::int64_t>()(14)), 1.0);
+  BOOST_CHECK_THROW(mapped_map.at(0), std::out_of_range);
+
+  BOOST_CHECK_EQUAL(mapped_map.front().first, 7);
+  BOOST_CHECK_EQUAL(mapped_map.back().first, 4999 * 7);
+  BOOST_CHECK_EQUAL(mapped_map.nth(1)->first, 14);
+  BOOST_CHECK(mapped_map.nth(mapped_map.size()) == mapped_map.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_write_and_map_tombstones_incremental_rehash) {
+  // Write a map with tombstones while an incremental rehash is in progress.
+  // The mapped map must only see the live values, in order.
+  const temporary_file file("test_write_and_map_tombstones.tslomap");
+
+  using map_t = tsl::ordered_map<
+      std::int32_t, std::int32_t, std::hash<std::int32_t>,
+      std::equal_to<std::int32_t>,
+      std::allocator<std::pair<std::int32_t, std::int32_t>>,
+      tsl::tombstone_deque<std::pair<std::int32_t, std::int32_t>>>;
+
+  map_t map;
+  map.incremental_rehash(4);
+  for (std::int32_t i = 0; i < 3000; i++) {
+    map.insert({i, -i});
+    if (i % 5 == 0) {
+      map.erase(i / 2);
+    }
+  }
+
+  tsl::mapped_ordered_map<std::int32_t, std::int32_t>::write(map,
+                                                             file.path());
+  const tsl::mapped_ordered_map<std::int32_t, std::int32_t> mapped_map(
+      file.path());
+
+  check_same_content(map, mapped_map);
+  BOOST_CHECK(!mapped_map.contains(0));
+  BOOST_CHECK(!mapped_map.contains(3000));
+}
+
+BOOST_AUTO_TEST_CASE(test_write_and_map_growth_policy) {
+  // Write a map with a bucket count which isn't a power of two, the mapped map
+  // needs the same GrowthPolicy.
+  const temporary_file file("test_write_and_map_growth_policy.tslomap");
+
+  using policy_t = tsl::oh::fastrange_growth_policy<>;
+  using map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, std::hash<std::int64_t>,
+      std::equal_to<std::int64_t>,
+      std::allocator<std::pair<std::int64_t, std::int64_t>>,
+      std::deque<std::pair<std::int64_t, std::int64_t>>, std::uint_least32_t,
+      false, false, policy_t>;
+  using mapped_map_t =
+      tsl::mapped_ordered_map<std::int64_t, std::int64_t,
+                              std::hash<std::int64_t>,
+                              std::equal_to<std::int64_t>,
+                              std::uint_least32_t, policy_t>;
+
+  map_t map(1000);
+  for (std::int64_t i = 0; i < 700; i++) {
+    map.insert({i * 1024, i});
+  }
+  BOOST_CHECK_EQUAL(map.bucket_count(), 1000u);
+
+  mapped_map_t::write(map, file.path());
+  const mapped_map_t mapped_map(file.path());
+
+  check_same_content(map, mapped_map);
+  BOOST_CHECK(!mapped_map.contains(1));
+
+  BOOST_CHECK_THROW(
+      (tsl::mapped_ordered_map<std::int64_t, std::int64_t>{file.path()}),
+      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_and_map_store_full_hash) {
+  // With StoreFullHash and a fibonacci_growth_policy, the ideal bucket comes
+  // from the full hash. The mapped map must probe from the full hash too.
+  const temporary_file file("test_write_and_map_store_full_hash.tslomap");
+
+  using policy_t = tsl::oh::fibonacci_growth_policy;
+  using map_t = tsl::ordered_map<
+      std::uint64_t, std::uint64_t, std::hash<std::uint64_t>,
+      std::equal_to<std::uint64_t>,
+      std::allocator<std::pair<std::uint64_t, std::uint64_t>>,
+      std::deque<std::pair<std::uint64_t, std::uint64_t>>,
+      std::uint_least32_t, false, true, policy_t>;
+  using mapped_map_t =
+      tsl::mapped_ordered_map<std::uint64_t, std::uint64_t,
+                              std::hash<std::uint64_t>,
+                              std::equal_to<std::uint64_t>,
+                              std::uint_least32_t, policy_t, true>;
+
+  map_t map;
+  for (std::uint64_t i = 0; i < 1000; i++) {
+    map.insert({i * 0x9E3779B97F4A7C15ull, i});
+  }
+
+  mapped_map_t::write(map, file.path());
+  const mapped_map_t mapped_map(file.path());
+
+  check_same_content(map, mapped_map);
+  BOOST_CHECK(!mapped_map.contains(1));
+
+  BOOST_CHECK_THROW(
+      (tsl::mapped_ordered_map<std::uint64_t, std::uint64_t,
+                               std::hash<std::uint64_t>,
+                               std::equal_to<std::uint64_t>,
+                               std::uint_least32_t, policy_t>{file.path()}),
+      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_and_map_empty) {
+  const temporary_file file("test_write_and_map_empty.tslomap");
+
+  tsl::ordered_map<std::int64_t, std::int64_t> map(0);
+  tsl::mapped_ordered_map<std::int64_t, std::int64_t>::write(map, file.path());
+
+  tsl::mapped_ordered_map<std::int64_t, std::int64_t> mapped_map(file.path());
+  BOOST_CHECK(mapped_map.empty());
+  BOOST_CHECK(mapped_map.begin() == mapped_map.end());
+  BOOST_CHECK(mapped_map.find(1) == mapped_map.end());
+
+  const tsl::mapped_ordered_map<std::int64_t, std::int64_t> mapped_map_moved(
+      std::move(mapped_map));
+  BOOST_CHECK(mapped_map_moved.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_map_invalid_file) {
+  // missing file, file which isn't a map and file written with other types
+  const temporary_file file("test_map_invalid_file.tslomap");
+  using mapped_map_t = tsl::mapped_ordered_map<std::int64_t, std::int64_t>;
+
+  BOOST_CHECK_THROW(mapped_map_t("test_map_missing_file.tslomap"),
+                    std::runtime_error);
+
+  {
+    std::ofstream ofile(file.path(), std::ios::binary);
+    ofile << "not a mapped ordered map, not a mapped ordered map";
+  }
+  BOOST_CHECK_THROW(mapped_map_t{file.path()}, std::runtime_error);
+
+  tsl::ordered_map<std::int32_t, std::int32_t> map = {{1, 2}, {3, 4}};
+  tsl::mapped_ordered_map<std::int32_t, std::int32_t>::write(map, file.path());
+  BOOST_CHECK_THROW(mapped_map_t{file.path()}, std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
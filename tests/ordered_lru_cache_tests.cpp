@@ -0,0 +1,289 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tsl/ordered_lru_cache.h"
+#include "utils.h"
+
+namespace {
+struct string_size_weigher {
+  std::size_t operator()(const std::string& key,
+                         const std::string& value) const noexcept {
+    return key.size() + value.size();
+  }
+};
+
+/**
+ * Hash counting its calls, to check that an access hashes the key only once.
+ */
+struct counting_hash {
+  std::size_t operator()(std::int64_t key) const {
+    nb_calls++;
+    return std::hash<std::int64_t>()(key);
+  }
+
+  static std::size_t nb_calls;
+};
+
+std::size_t counting_hash::nb_calls = 0;
+
+/**
+ * Value whose assignment throws if the assigned value is negative, weighing
+ * its value.
+ */
+struct throwing_value {
+  explicit throwing_value(std::int64_t v) : value(v) {}
+  throwing_value(const throwing_value& other) = default;
+
+  throwing_value& operator=(const throwing_value& other) {
+    if (other.value < 0) {
+      throw std::runtime_error("Negative value.");
+    }
+
+    value = other.value;
+    return *this;
+  }
+
+  std::int64_t value;
+};
+
+struct throwing_value_weigher {
+  std::size_t operator()(std::int64_t /*key*/,
+                         const throwing_value& value) const noexcept {
+    return std::size_t(value.value < 0 ? -value.value : value.value);
+  }
+};
+
+template <class Cache>
+std::vector<typename Cache::key_type> cache_keys(const Cache& cache) {
+  std::vector<typename Cache::key_type> keys;
+  for (const auto& key_value : cache) {
+    keys.push_back(key_value.first);
+  }
+
+  return keys;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(test_ordered_lru_cache)
+
+BOOST_AUTO_TEST_CASE(test_eviction_order) {
+  tsl::ordered_lru_cache<std::int64_t, std::int64_t> cache(3);
+
+  cache.insert_or_assign(1, 10);
+  cache.insert_or_assign(2, 20);
+  cache.insert_or_assign(3, 30);
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::int64_t>{1, 2, 3}));
+
+  // 1 becomes the most recently used entry, 2 is evicted
+  BOOST_REQUIRE(cache.get(1) != nullptr);
+  BOOST_CHECK_EQUAL(*cache.get(1), 10);
+  cache.insert_or_assign(4, 40);
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::int64_t>{3, 1, 4}));
+  BOOST_CHECK(cache.get(2) == nullptr);
+
+  // peek doesn't change the recency, 3 is evicted
+  BOOST_REQUIRE(cache.peek(3) != nullptr);
+  BOOST_CHECK_EQUAL(*cache.peek(3), 30);
+  cache.insert_or_assign(5, 50);
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::int64_t>{1, 4, 5}));
+
+  // assign an existing key
+  BOOST_CHECK_EQUAL(cache.insert_or_assign(1, 100), 100);
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::int64_t>{4, 5, 1}));
+  BOOST_CHECK_EQUAL(cache.size(), 3u);
+
+  BOOST_CHECK(cache.touch(4));
+  BOOST_CHECK(!cache.touch(2));
+  BOOST_CHECK_EQUAL(cache.front().first, 5);
+  BOOST_CHECK_EQUAL(cache.back().first, 4);
+
+  BOOST_CHECK_EQUAL(cache.erase(1), 1u);
+  BOOST_CHECK_EQUAL(cache.erase(1), 0u);
+  cache.pop_front();
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::int64_t>{4}));
+
+  cache.clear();
+  BOOST_CHECK(cache.empty());
+  BOOST_CHECK_EQUAL(cache.weight(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_weight_limit) {
+  tsl::ordered_lru_cache<std::string, std::string, std::hash<std::string>,
+                         std::equal_to<std::string>,
+                         std::allocator<std::pair<std::string, std::string>>,
+                         string_size_weigher>
+      cache(100, 10);
+
+  cache.insert_or_assign("a", "1234");
+  cache.insert_or_assign("b", "1234");
+  BOOST_CHECK_EQUAL(cache.weight(), 10u);
+  BOOST_CHECK_EQUAL(cache.size(), 2u);
+
+  cache.insert_or_assign("c", "1");
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::string>{"b", "c"}));
+  BOOST_CHECK_EQUAL(cache.weight(), 7u);
+
+  // Growing the value of an existing entry also evicts
+  cache.insert_or_assign("c", "1234567");
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::string>{"c"}));
+  BOOST_CHECK_EQUAL(cache.weight(), 8u);
+
+  // An entry heavier than max_weight is kept alone
+  cache.insert_or_assign("d", "12345678901234567890");
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::string>{"d"}));
+  BOOST_CHECK_EQUAL(cache.weight(), 21u);
+
+  cache.set_max_weight(30);
+  cache.insert_or_assign("e", "1");
+  BOOST_CHECK_EQUAL(cache.size(), 2u);
+
+  cache.set_max_size(1);
+  BOOST_CHECK(cache_keys(cache) == (std::vector<std::string>{"e"}));
+  BOOST_CHECK_EQUAL(cache.weight(), 2u);
+
+  cache.set_max_weight(0);
+  BOOST_CHECK(cache.empty());
+  BOOST_CHECK_EQUAL(cache.weight(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_access_hashes_once) {
+  tsl::ordered_lru_cache<std::int64_t, std::int64_t, counting_hash> cache(100);
+  for (std::int64_t i = 0; i < 10; i++) {
+    cache.insert_or_assign(i, i);
+  }
+
+  counting_hash::nb_calls = 0;
+  BOOST_CHECK_EQUAL(*cache.get(3), 3);
+  BOOST_CHECK_EQUAL(counting_hash::nb_calls, 1u);
+
+  counting_hash::nb_calls = 0;
+  BOOST_CHECK(cache.touch(5));
+  BOOST_CHECK_EQUAL(counting_hash::nb_calls, 1u);
+
+  counting_hash::nb_calls = 0;
+  cache.insert_or_assign(7, 70);
+  BOOST_CHECK_EQUAL(counting_hash::nb_calls, 1u);
+
+  BOOST_CHECK(cache_keys(cache) ==
+              (std::vector<std::int64_t>{0, 1, 2, 4, 6, 8, 9, 3, 5, 7}));
+  BOOST_CHECK_EQUAL(*cache.peek(7), 70);
+}
+
+BOOST_AUTO_TEST_CASE(test_assign_throws) {
+  // The weight must stay the same if the assignment of the value throws.
+  tsl::ordered_lru_cache<std::int64_t, throwing_value, std::hash<std::int64_t>,
+                         std::equal_to<std::int64_t>,
+                         std::allocator<std::pair<std::int64_t, throwing_value>>,
+                         throwing_value_weigher>
+      cache(100, 1000);
+  cache.insert_or_assign(1, throwing_value(10));
+  cache.insert_or_assign(2, throwing_value(20));
+  BOOST_CHECK_EQUAL(cache.weight(), 30u);
+
+  BOOST_CHECK_THROW(cache.insert_or_assign(1, throwing_value(-5)),
+                    std::runtime_error);
+  BOOST_CHECK_EQUAL(cache.weight(), 30u);
+  BOOST_CHECK_EQUAL(cache.peek(1)->value, 10);
+
+  cache.insert_or_assign(1, throwing_value(15));
+  BOOST_CHECK_EQUAL(cache.weight(), 35u);
+}
+
+BOOST_AUTO_TEST_CASE(test_random_operations) {
+  // Compare the cache with a std::list + std::unordered_map LRU on random
+  // operations
+  const std::size_t max_size = 100;
+  tsl::ordered_lru_cache<std::int64_t, std::int64_t> cache(max_size);
+
+  std::list<std::pair<std::int64_t, std::int64_t>> lru_list;
+  std::unordered_map<std::int64_t, decltype(lru_list)::iterator> lru_map;
+
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<std::int64_t> key_distribution(0, 300);
+  for (std::int64_t i = 0; i < 50000; i++) {
+    const std::int64_t key = key_distribution(rng);
+    auto it = lru_map.find(key);
+
+    if (rng() % 2 == 0) {
+      std::int64_t* value = cache.get(key);
+      BOOST_REQUIRE_EQUAL(value != nullptr, it != lru_map.end());
+      if (it != lru_map.end()) {
+        BOOST_REQUIRE_EQUAL(*value, it->second->second);
+        lru_list.splice(lru_list.end(), lru_list, it->second);
+      }
+    } else {
+      BOOST_REQUIRE_EQUAL(cache.insert_or_assign(key, i), i);
+      if (it != lru_map.end()) {
+        it->second->second = i;
+        lru_list.splice(lru_list.end(), lru_list, it->second);
+      } else {
+        lru_map[key] = lru_list.insert(lru_list.end(), {key, i});
+        if (lru_list.size() > max_size) {
+          lru_map.erase(lru_list.front().first);
+          lru_list.pop_front();
+        }
+      }
+    }
+
+    BOOST_REQUIRE_EQUAL(cache.size(), lru_list.size());
+  }
+
+  BOOST_CHECK(std::equal(cache.begin(), cache.end(), lru_list.begin()));
+  const std::size_t entry_size = sizeof(std::pair<std::int64_t, std::int64_t>);
+  BOOST_CHECK_EQUAL(cache.weight(), cache.size() * entry_size);
+}
+
+BOOST_AUTO_TEST_CASE(test_move_only) {
+  tsl::ordered_lru_cache<move_only_test, move_only_test, mod_hash<9>> cache(2);
+
+  cache.insert_or_assign(move_only_test(1), move_only_test(10));
+  cache.insert_or_assign(move_only_test(2), move_only_test(20));
+  BOOST_REQUIRE(cache.get(move_only_test(1)) != nullptr);
+  cache.insert_or_assign(move_only_test(3), move_only_test(30));
+
+  BOOST_CHECK(!cache.contains(move_only_test(2)));
+  BOOST_CHECK_EQUAL(cache.front().first, move_only_test(1));
+  BOOST_CHECK_EQUAL(cache.back().second, move_only_test(30));
+}
+
+BOOST_AUTO_TEST_CASE(test_zero_max_size) {
+  using cache_type = tsl::ordered_lru_cache<std::int64_t, std::int64_t>;
+
+  TSL_OH_CHECK_THROW(cache_type(0), std::invalid_argument);
+
+  cache_type cache(1);
+  TSL_OH_CHECK_THROW(cache.set_max_size(0), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
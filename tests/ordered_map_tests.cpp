@@ -22,13 +22,18 @@
  * SOFTWARE.
  */
 #include <boost/mpl/list.hpp>
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <iterator>
+#include <limits>
+#include <list>
 #include <memory>
+#include <random>
 #include <stdexcept>
 #include <string>
 #include <tuple>
@@ -37,6 +42,8 @@
 #include <vector>
 
 #include "tsl/ordered_map.h"
+#include "tsl/ranked_deque.h"
+#include "tsl/tombstone_deque.h"
 #include "utils.h"
 
 BOOST_AUTO_TEST_SUITE(test_ordered_map)
@@ -49,7 +56,68 @@ using test_types = boost::mpl::list<
                      std::vector<std::pair<std::int64_t, std::int64_t>>>,
     tsl::ordered_map<std::string, std::string>,
     tsl::ordered_map<std::string, std::string, mod_hash<9>>,
-    tsl::ordered_map<move_only_test, move_only_test, mod_hash<9>>>;
+    tsl::ordered_map<move_only_test, move_only_test, mod_hash<9>>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::deque<std::pair<std::int64_t, std::int64_t>>,
+                     std::uint_least32_t, true>,
+    tsl::ordered_map<std::string, std::string, mod_hash<9>,
+                     std::equal_to<std::string>,
+                     std::allocator<std::pair<std::string, std::string>>,
+                     std::deque<std::pair<std::string, std::string>>,
+                     std::uint_least32_t, true>,
+    tsl::ordered_map<
+        std::string, std::string, mod_hash<9>, std::equal_to<std::string>,
+        std::allocator<std::pair<std::string, std::string>>,
+        tsl::tombstone_deque<std::pair<std::string, std::string>>>,
+    tsl::ordered_map<
+        move_only_test, move_only_test, mod_hash<9>,
+        std::equal_to<move_only_test>,
+        std::allocator<std::pair<move_only_test, move_only_test>>,
+        tsl::tombstone_deque<std::pair<move_only_test, move_only_test>>>,
+    tsl::ordered_map<
+        std::string, std::string, mod_hash<9>, std::equal_to<std::string>,
+        std::allocator<std::pair<std::string, std::string>>,
+        tsl::ranked_deque<std::pair<std::string, std::string>>>,
+    tsl::ordered_map<
+        move_only_test, move_only_test, mod_hash<9>,
+        std::equal_to<move_only_test>,
+        std::allocator<std::pair<move_only_test, move_only_test>>,
+        tsl::ranked_deque<std::pair<move_only_test, move_only_test>>>,
+    tsl::ordered_map<std::string, std::string, std::hash<std::string>,
+                     std::equal_to<std::string>,
+                     std::allocator<std::pair<std::string, std::string>>,
+                     std::deque<std::pair<std::string, std::string>>,
+                     std::uint_least32_t, false, true>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::deque<std::pair<std::int64_t, std::int64_t>>,
+                     std::uint_least32_t, false, false,
+                     tsl::oh::fibonacci_growth_policy>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::vector<std::pair<std::int64_t, std::int64_t>>,
+                     std::uint_least32_t, false, false,
+                     tsl::oh::fastrange_growth_policy<>>,
+    tsl::ordered_map<std::string, std::string, mod_hash<9>,
+                     std::equal_to<std::string>,
+                     std::allocator<std::pair<std::string, std::string>>,
+                     std::deque<std::pair<std::string, std::string>>,
+                     std::uint_least32_t, true, false,
+                     tsl::oh::fastrange_growth_policy<>>,
+    tsl::ordered_map<
+        std::string, std::string, mod_hash<9>, std::equal_to<std::string>,
+        std::allocator<std::pair<std::string, std::string>>,
+        tsl::tombstone_deque<std::pair<std::string, std::string>>,
+        tsl::oh::packed_index<40>>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::vector<std::pair<std::int64_t, std::int64_t>>,
+                     tsl::oh::packed_index<48>, true>>;
 
 /**
  * insert
@@ -712,6 +780,188 @@ BOOST_AUTO_TEST_CASE(test_range_erase_same_iterators) {
   BOOST_CHECK_EQUAL(it_const.value(), -100);
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_pop_front_fifo_window, HMap, test_types) {
+  // insert x values, keep only the last window_size ones with pop_front and
+  // check the values and their order while the window slides
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  const std::size_t window_size = 100;
+
+  HMap map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert({utils::get_key<key_tt>(i), utils::get_value<value_tt>(i)});
+    if (map.size() > window_size) {
+      map.pop_front();
+      BOOST_CHECK_EQUAL(map.count(utils::get_key<key_tt>(i - window_size)), 0u);
+    }
+  }
+  BOOST_REQUIRE_EQUAL(map.size(), window_size);
+
+  // Erase in the middle and at a position with an offset index
+  BOOST_CHECK_EQUAL(map.erase(utils::get_key<key_tt>(nb_values - 50)), 1u);
+  map.insert_at_position(
+      std::next(map.begin(), 10),
+      {utils::get_key<key_tt>(nb_values), utils::get_value<value_tt>(0)});
+  BOOST_CHECK_EQUAL(map.size(), window_size);
+
+  std::size_t i = nb_values - window_size;
+  for (const auto& key_value : map) {
+    if (i == nb_values - window_size + 10) {
+      BOOST_CHECK_EQUAL(key_value.first, utils::get_key<key_tt>(nb_values));
+      i++;
+      continue;
+    }
+
+    const std::size_t expected = (i > nb_values - window_size + 10) ? i - 1 : i;
+    const std::size_t expected_key =
+        (expected >= nb_values - 50) ? expected + 1 : expected;
+    BOOST_CHECK_EQUAL(key_value.first, utils::get_key<key_tt>(expected_key));
+    BOOST_CHECK_EQUAL(key_value.second,
+                      utils::get_value<value_tt>(expected_key));
+    BOOST_CHECK(map.find(key_value.first) ==
+                std::next(map.begin(), i - (nb_values - window_size)));
+    i++;
+  }
+
+  BOOST_CHECK_EQUAL(map.unordered_erase(utils::get_key<key_tt>(nb_values - 1)),
+                    1u);
+  for (std::size_t j = 0; j < window_size - 1; j++) {
+    map.pop_front();
+  }
+  BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_range_erase_front_back, HMap, test_types) {
+  // insert x values, erase the 100 first and the 100 last values with a range
+  // erase, check the remaining values
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  HMap map = utils::get_filled_hash_map<HMap>(nb_values);
+
+  auto it = map.erase(map.begin(), std::next(map.begin(), 100));
+  BOOST_CHECK(it == map.begin());
+  it = map.erase(std::prev(map.end(), 100), map.end());
+  BOOST_CHECK(it == map.end());
+  BOOST_REQUIRE_EQUAL(map.size(), nb_values - 200);
+
+  std::size_t i = 100;
+  for (const auto& key_value : map) {
+    BOOST_CHECK_EQUAL(key_value.first, utils::get_key<key_tt>(i));
+    BOOST_CHECK_EQUAL(key_value.second, utils::get_value<value_tt>(i));
+    BOOST_CHECK(map.find(utils::get_key<key_tt>(i)) ==
+                std::next(map.begin(), i - 100));
+    i++;
+  }
+
+  for (std::size_t j = 0; j < nb_values; j++) {
+    BOOST_CHECK_EQUAL(map.count(utils::get_key<key_tt>(j)),
+                      (j >= 100 && j < nb_values - 100) ? 1u : 0u);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_pop_front_index_offset_reset) {
+  // With a small IndexType, the offset of the indexes must be reset after
+  // less than 255 pop_front
+  using HMap =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>,
+                       std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                       std::deque<std::pair<std::int64_t, std::int64_t>>,
+                       std::uint8_t>;
+
+  HMap map;
+  for (std::int64_t i = 0; i < 10000; i++) {
+    map.insert({i, i});
+    if (map.size() > 50) {
+      map.pop_front();
+    }
+
+    BOOST_REQUIRE(map.find(i) == std::prev(map.end()));
+  }
+
+  std::int64_t i = 10000 - 50;
+  for (const auto& key_value : map) {
+    BOOST_CHECK_EQUAL(key_value.first, i);
+    BOOST_CHECK(map.find(i) == map.begin() + (i - (10000 - 50)));
+    i++;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_after_pop_front) {
+  // The serialized indexes must not depend on the pop_front done before
+  tsl::ordered_map<std::int64_t, std::int64_t> map;
+  for (std::int64_t i = 0; i < 1000; i++) {
+    map.insert({i, i + 1});
+  }
+  for (std::int64_t i = 0; i < 300; i++) {
+    map.pop_front();
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  auto map_deserialized = decltype(map)::deserialize(dserial, true);
+  BOOST_CHECK(map == map_deserialized);
+  for (std::int64_t i = 300; i < 1000; i++) {
+    BOOST_CHECK(map_deserialized.find(i) ==
+                map_deserialized.begin() + (i - 300));
+  }
+
+  bulk_serializer bulk_serial;
+  map.serialize(bulk_serial);
+
+  bulk_deserializer bulk_dserial(bulk_serial.str());
+  map_deserialized = decltype(map)::deserialize(bulk_dserial, true);
+  BOOST_CHECK(map == map_deserialized);
+  for (std::int64_t i = 300; i < 1000; i++) {
+    BOOST_CHECK(map_deserialized.find(i) ==
+                map_deserialized.begin() + (i - 300));
+  }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_move_to_back, HMap, test_types) {
+  // insert x values, move each value at an even position to the back, check
+  // the order and the lookups
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  HMap map = utils::get_filled_hash_map<HMap>(nb_values);
+
+  auto it = map.begin();
+  for (std::size_t i = 0; i < nb_values / 2; i++) {
+    if (i % 2 == 0) {
+      it = map.move_to_back(it);
+    } else {
+      it = map.move_to_back(it, map.hash_function()(it->first));
+    }
+    BOOST_CHECK_EQUAL(it->first, utils::get_key<key_tt>(i * 2));
+    BOOST_CHECK(std::next(it) == map.end());
+
+    it = std::next(map.begin(), i + 1);
+  }
+  BOOST_REQUIRE_EQUAL(map.size(), nb_values);
+
+  // The last value is already at the back
+  it = map.move_to_back(std::prev(map.end()));
+  BOOST_CHECK(std::next(it) == map.end());
+
+  std::size_t i = 0;
+  for (const auto& key_value : map) {
+    const std::size_t expected =
+        (i < nb_values / 2) ? i * 2 + 1 : (i - nb_values / 2) * 2;
+    BOOST_CHECK_EQUAL(key_value.first, utils::get_key<key_tt>(expected));
+    BOOST_CHECK_EQUAL(key_value.second, utils::get_value<value_tt>(expected));
+    BOOST_CHECK(map.find(key_value.first) == std::next(map.begin(), i));
+    i++;
+  }
+}
+
 /**
  * erase_if
  */
@@ -1433,6 +1683,207 @@ BOOST_AUTO_TEST_CASE(test_serialize_deserialize_with_different_hash) {
   }
 }
 
+using bulk_test_types = boost::mpl::list<
+    tsl::ordered_map<std::int64_t, std::int64_t>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::vector<std::pair<std::int64_t, std::int64_t>>,
+                     std::uint64_t, true>,
+    tsl::ordered_map<
+        std::int64_t, std::int64_t, std::hash<std::int64_t>,
+        std::equal_to<std::int64_t>,
+        std::allocator<std::pair<std::int64_t, std::int64_t>>,
+        tsl::tombstone_deque<std::pair<std::int64_t, std::int64_t>>>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::vector<std::pair<std::int64_t, std::int64_t>>,
+                     std::uint_least32_t, false, false,
+                     tsl::oh::fastrange_growth_policy<>>,
+    tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>,
+                     std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                     std::vector<std::pair<std::int64_t, std::int64_t>>,
+                     tsl::oh::packed_index<40>>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_serialize_deserialize_bulk, HMap,
+                              bulk_test_types) {
+  // insert x values; erase some values; serialize with a bulk serializer;
+  // deserialize with a bulk deserializer with and without hash compatibility;
+  // check equal.
+  HMap map;
+  map.incremental_rehash(4);
+  for (std::int64_t i = 0; i < 3000; i++) {
+    map.insert({i, i * 2});
+    if (i % 7 == 0) {
+      map.erase(i / 2);
+    }
+  }
+
+  bulk_serializer serial;
+  map.serialize(serial);
+  BOOST_CHECK_GE(serial.nb_bulk_writes, 2);
+
+  bulk_deserializer dserial(serial.str());
+  auto map_deserialized = HMap::deserialize(dserial, true);
+  BOOST_CHECK(map_deserialized == map);
+  BOOST_CHECK_EQUAL(map_deserialized.bucket_count(), map.bucket_count());
+  BOOST_CHECK_GE(dserial.nb_bulk_reads, 2);
+
+  bulk_deserializer dserial2(serial.str());
+  map_deserialized = HMap::deserialize(dserial2, false);
+  BOOST_CHECK(map_deserialized == map);
+
+  for (std::int64_t i = 3000; i < 4000; i++) {
+    map_deserialized.insert({i, i * 2});
+  }
+  BOOST_CHECK_EQUAL(map_deserialized.size(), map.size() + 1000);
+  BOOST_CHECK_EQUAL(map_deserialized.at(3500), 7000);
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_bulk_size) {
+  // The bulk protocol writes the buckets in their native width.
+  tsl::ordered_map<std::int64_t, std::int64_t> map;
+  for (std::int64_t i = 0; i < 1000; i++) {
+    map.insert({i, i});
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  bulk_serializer bserial;
+  map.serialize(bserial);
+
+  BOOST_CHECK_EQUAL(serial.str().size() - bserial.str().size(),
+                    map.bucket_count() * 8 - 2 * sizeof(std::uint64_t));
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_bulk_fallback) {
+  // A bulk serializer uses the element-wise protocol for values which aren't
+  // trivially copyable.
+  tsl::ordered_map<std::string, std::int64_t> map;
+  for (std::size_t i = 0; i < 100; i++) {
+    map.insert({utils::get_key<std::string>(i), std::int64_t(i)});
+  }
+
+  bulk_serializer serial;
+  map.serialize(serial);
+  BOOST_CHECK_EQUAL(serial.nb_bulk_writes, 0);
+
+  deserializer dserial(serial.str());
+  BOOST_CHECK(decltype(map)::deserialize(dserial, true) == map);
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_bulk_invalid) {
+  // A bulk serialized map can't be deserialized without bulk reads or with
+  // different types.
+  tsl::ordered_map<std::int32_t, std::int32_t> map = {{1, 2}, {3, 4}};
+
+  bulk_serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  BOOST_CHECK_THROW(decltype(map)::deserialize(dserial, true),
+                    std::runtime_error);
+
+  bulk_deserializer dserial2(serial.str());
+  BOOST_CHECK_THROW(
+      (tsl::ordered_map<std::int64_t, std::int64_t>::deserialize(dserial2,
+                                                                 true)),
+      std::runtime_error);
+}
+
+/**
+ * stats()
+ */
+BOOST_AUTO_TEST_CASE(test_stats) {
+  struct identity_hash {
+    std::size_t operator()(std::int64_t value) const {
+      return std::size_t(value);
+    }
+  };
+
+  tsl::ordered_map<std::int64_t, std::int64_t, identity_hash> map;
+  tsl::ordered_hash_stats stats = map.stats();
+  BOOST_CHECK_EQUAL(stats.size, 0);
+  BOOST_CHECK(stats.distance_histogram.empty());
+  BOOST_CHECK_EQUAL(stats.max_probe_length_miss, 0);
+
+  // With an identity hash, the sequential keys are all in their ideal bucket.
+  for (std::int64_t i = 0; i < 1000; i++) {
+    map.insert({i, i});
+  }
+
+  stats = map.stats();
+  BOOST_CHECK_EQUAL(stats.size, 1000);
+  BOOST_CHECK_EQUAL(stats.bucket_count, map.bucket_count());
+  BOOST_CHECK_EQUAL(stats.load_factor, map.load_factor());
+  BOOST_REQUIRE_EQUAL(stats.distance_histogram.size(), 1);
+  BOOST_CHECK_EQUAL(stats.distance_histogram[0], 1000);
+  BOOST_CHECK_EQUAL(stats.average_probe_length_hit, 1.0);
+  BOOST_CHECK_EQUAL(stats.max_probe_length_hit, 1);
+  // A miss stops at the next bucket whose value is closer to its ideal bucket.
+  BOOST_CHECK_EQUAL(stats.max_probe_length_miss, 2);
+  BOOST_CHECK_GT(stats.average_probe_length_miss, 1.0);
+  BOOST_CHECK_LT(stats.average_probe_length_miss, 2.0);
+  BOOST_CHECK_GT(stats.nb_rehashes, 0);
+  BOOST_CHECK_EQUAL(stats.nb_grows_on_high_nb_probes, 0);
+  BOOST_CHECK_GE(stats.buckets_bytes, map.bucket_count() * 8);
+  BOOST_CHECK_GE(stats.values_bytes,
+                 1000 * sizeof(std::pair<std::int64_t, std::int64_t>));
+
+  const std::size_t nb_rehashes = stats.nb_rehashes;
+  map.rehash(map.bucket_count() * 2);
+  BOOST_CHECK_EQUAL(map.stats().nb_rehashes, nb_rehashes + 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_stats_collisions) {
+  // All the keys have the same hash, the distances go from 0 to size() - 1 and
+  // the long probes grow the map.
+  tsl::ordered_map<std::int64_t, std::int64_t, mod_hash<1>> map;
+  for (std::int64_t i = 0; i < 200; i++) {
+    map.insert({i, i});
+  }
+
+  const tsl::ordered_hash_stats stats = map.stats();
+  BOOST_REQUIRE_EQUAL(stats.distance_histogram.size(), 200);
+  for (std::size_t count : stats.distance_histogram) {
+    BOOST_CHECK_EQUAL(count, 1);
+  }
+  BOOST_CHECK_EQUAL(stats.average_probe_length_hit, 100.5);
+  BOOST_CHECK_EQUAL(stats.max_probe_length_hit, 200);
+  BOOST_CHECK_EQUAL(stats.max_probe_length_miss, 201);
+  BOOST_CHECK_GT(stats.nb_grows_on_high_nb_probes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_stats_incremental_rehash_tombstones) {
+  // The values not migrated yet by an incremental rehash are counted.
+  using map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, std::hash<std::int64_t>,
+      std::equal_to<std::int64_t>,
+      std::allocator<std::pair<std::int64_t, std::int64_t>>,
+      tsl::tombstone_deque<std::pair<std::int64_t, std::int64_t>>>;
+
+  map_t map;
+  map.incremental_rehash(1);
+  for (std::int64_t i = 0; i < 5000; i++) {
+    map.insert({i, i});
+    if (i % 3 == 0) {
+      map.erase(i / 3);
+    }
+
+    if (i % 500 == 0) {
+      const tsl::ordered_hash_stats stats = map.stats();
+      std::size_t nb_values = 0;
+      for (std::size_t count : stats.distance_histogram) {
+        nb_values += count;
+      }
+      BOOST_CHECK_EQUAL(nb_values, map.size());
+    }
+  }
+}
+
 /**
  * front(), back()
  */
@@ -1632,6 +2083,230 @@ BOOST_AUTO_TEST_CASE(test_empty_map) {
   BOOST_CHECK_EQUAL(map["new value"], int{});
 }
 
+/**
+ * StoreFullHash
+ */
+BOOST_AUTO_TEST_CASE(test_store_full_hash) {
+  // The hashes of the keys only differ in their upper bits, a truncated hash
+  // needs a key comparison for each probed bucket, a full one doesn't.
+  struct upper_bits_hash {
+    std::size_t operator()(std::int64_t key) const {
+      return std::size_t(key)
+             << (std::numeric_limits<std::size_t>::digits - 8);
+    }
+  };
+
+  struct counting_equal {
+    bool operator()(std::int64_t lhs, std::int64_t rhs) const {
+      (*nb_compares)++;
+      return lhs == rhs;
+    }
+
+    std::size_t* nb_compares;
+  };
+
+  using truncated_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, upper_bits_hash,
+                       counting_equal>;
+  using full_map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, upper_bits_hash, counting_equal,
+      std::allocator<std::pair<std::int64_t, std::int64_t>>,
+      std::deque<std::pair<std::int64_t, std::int64_t>>, std::uint_least32_t,
+      false, true>;
+
+  const std::int64_t nb_values = 100;
+  std::size_t nb_truncated_compares = 0;
+  std::size_t nb_full_compares = 0;
+  truncated_map_t truncated_map(0, upper_bits_hash(),
+                                counting_equal{&nb_truncated_compares});
+  full_map_t full_map(0, upper_bits_hash(), counting_equal{&nb_full_compares});
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    truncated_map.insert({i, i});
+    full_map.insert({i, i});
+  }
+
+  nb_truncated_compares = 0;
+  nb_full_compares = 0;
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(truncated_map.at(i), i);
+    BOOST_CHECK_EQUAL(full_map.at(i), i);
+  }
+  BOOST_CHECK_EQUAL(nb_full_compares, std::size_t(nb_values));
+  if (std::numeric_limits<std::size_t>::digits > 32) {
+    BOOST_CHECK(nb_truncated_compares > 10 * std::size_t(nb_values));
+    BOOST_CHECK(truncated_map.max_bucket_count() <=
+                std::size_t(std::numeric_limits<std::uint32_t>::max()) + 1);
+    BOOST_CHECK(full_map.max_bucket_count() > truncated_map.max_bucket_count());
+  }
+}
+
+/**
+ * GrowthPolicy
+ */
+BOOST_AUTO_TEST_CASE(test_growth_policy_bucket_count) {
+  // The power of two policies round the bucket count up, fastrange keeps it
+  // and grows by 1.5.
+  using int_pair = std::pair<std::int64_t, std::int64_t>;
+  using fibonacci_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>, std::allocator<int_pair>,
+                       std::deque<int_pair>, std::uint_least32_t, false,
+                       false, tsl::oh::fibonacci_growth_policy>;
+  using fastrange_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>, std::allocator<int_pair>,
+                       std::deque<int_pair>, std::uint_least32_t, false,
+                       false, tsl::oh::fastrange_growth_policy<>>;
+
+  tsl::ordered_map<std::int64_t, std::int64_t> map(1000);
+  fibonacci_map_t fibonacci_map(1000);
+  fastrange_map_t fastrange_map(1000);
+  BOOST_CHECK_EQUAL(map.bucket_count(), 1024u);
+  BOOST_CHECK_EQUAL(fibonacci_map.bucket_count(), 1024u);
+  BOOST_CHECK_EQUAL(fastrange_map.bucket_count(), 1000u);
+
+  for (std::int64_t i = 0; i < 751; i++) {
+    fastrange_map.insert({i, i});
+  }
+  BOOST_CHECK_EQUAL(fastrange_map.bucket_count(), 1500u);
+
+  fastrange_map.rehash(0);
+  BOOST_CHECK_EQUAL(fastrange_map.bucket_count(),
+                    std::size_t(std::ceil(751 / 0.75f)));
+  for (std::int64_t i = 0; i < 751; i++) {
+    BOOST_CHECK_EQUAL(fastrange_map.at(i), i);
+  }
+
+  fastrange_map_t small_map;
+  for (std::int64_t i = 0; i < 100; i++) {
+    small_map.insert({i, i});
+    BOOST_CHECK_EQUAL(small_map.at(i), i);
+  }
+  BOOST_CHECK(small_map.load_factor() <= small_map.max_load_factor());
+
+  BOOST_CHECK_THROW(fastrange_map.rehash(fastrange_map.max_bucket_count() + 1),
+                    std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_packed_index) {
+  // All the keys have the same hash, the distances from the ideal bucket go
+  // past what a packed bucket can store.
+  struct constant_hash {
+    std::size_t operator()(std::int64_t /*key*/) const { return 42; }
+  };
+
+  using int_pair = std::pair<std::int64_t, std::int64_t>;
+  using packed_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, constant_hash,
+                       std::equal_to<std::int64_t>, std::allocator<int_pair>,
+                       std::deque<int_pair>, tsl::oh::packed_index<40>>;
+
+  packed_map_t map;
+  map.max_load_factor(0.95f);
+  const std::int64_t nb_values = 600;
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    map.insert({i, i * 2});
+  }
+  BOOST_CHECK_EQUAL(map.stats().max_probe_length_hit, std::size_t(nb_values));
+  BOOST_CHECK_EQUAL(map.stats().buckets_bytes, map.bucket_count() * 8);
+
+  for (std::int64_t i = 0; i < nb_values; i += 2) {
+    BOOST_CHECK_EQUAL(map.erase(i), 1u);
+  }
+  map.rehash(map.bucket_count() * 2);
+
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    if (i % 2 == 0) {
+      BOOST_CHECK(map.find(i) == map.end());
+    } else {
+      BOOST_CHECK_EQUAL(map.at(i), i * 2);
+    }
+  }
+
+  using small_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>, std::allocator<int_pair>,
+                       std::deque<int_pair>, tsl::oh::packed_index<24>>;
+  BOOST_CHECK_EQUAL(small_map_t().max_size(), (std::size_t(1) << 24) - 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_growth_policy_strided_keys) {
+  // With an identity hash, keys with a stride of 1024 all have the same lower
+  // bits. The mixing policies still spread them over the buckets.
+  using int_pair = std::pair<std::int64_t, std::int64_t>;
+  using fibonacci_map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, identity_hash<std::int64_t>,
+      std::equal_to<std::int64_t>, std::allocator<int_pair>,
+      std::deque<int_pair>, std::uint_least32_t, false, false,
+      tsl::oh::fibonacci_growth_policy>;
+  using fastrange_map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, identity_hash<std::int64_t>,
+      std::equal_to<std::int64_t>, std::allocator<int_pair>,
+      std::deque<int_pair>, std::uint_least32_t, true, false,
+      tsl::oh::fastrange_growth_policy<>>;
+
+  const std::int64_t nb_values = 5000;
+  tsl::ordered_map<std::int64_t, std::int64_t, identity_hash<std::int64_t>>
+      map;
+  fibonacci_map_t fibonacci_map;
+  fastrange_map_t fastrange_map;
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    map.insert({i * 1024, i});
+    fibonacci_map.insert({i * 1024, i});
+    fastrange_map.insert({i * 1024, i});
+  }
+
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(map.at(i * 1024), i);
+    BOOST_CHECK_EQUAL(fibonacci_map.at(i * 1024), i);
+    BOOST_CHECK_EQUAL(fastrange_map.at(i * 1024), i);
+    BOOST_CHECK(fastrange_map.find(i * 1024 + 1) == fastrange_map.end());
+  }
+
+  BOOST_CHECK(map.stats().average_probe_length_hit > 100.0);
+  BOOST_CHECK(fibonacci_map.stats().average_probe_length_hit < 3.0);
+  BOOST_CHECK(fastrange_map.stats().average_probe_length_hit < 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_growth_policy_serialize_deserialize) {
+  // A hash compatible deserialization needs a bucket count of the policy.
+  using int_pair = std::pair<std::int64_t, std::int64_t>;
+  using fastrange_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>, std::allocator<int_pair>,
+                       std::deque<int_pair>, std::uint_least32_t, false,
+                       false, tsl::oh::fastrange_growth_policy<>>;
+
+  fastrange_map_t map(1000);
+  map.incremental_rehash(8);
+  for (std::int64_t i = 0; i < 2000; i++) {
+    map.insert({i, i});
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  auto map_deserialized = fastrange_map_t::deserialize(dserial, true);
+  BOOST_CHECK_EQUAL(map_deserialized.bucket_count(), map.bucket_count());
+  BOOST_CHECK(utils::test_is_equal(map, map_deserialized));
+
+  deserializer dserial2(serial.str());
+  BOOST_CHECK_THROW(
+      (tsl::ordered_map<std::int64_t, std::int64_t>::deserialize(dserial2,
+                                                                 true)),
+      std::runtime_error);
+
+  deserializer dserial3(serial.str());
+  auto map_rehashed =
+      tsl::ordered_map<std::int64_t, std::int64_t>::deserialize(dserial3,
+                                                                false);
+  BOOST_CHECK_EQUAL(map_rehashed.size(), map.size());
+  for (std::int64_t i = 0; i < 2000; i++) {
+    BOOST_CHECK_EQUAL(map_rehashed.at(i), i);
+  }
+}
+
 /**
  * Test precalculated hash
  */
@@ -1706,4 +2381,963 @@ BOOST_AUTO_TEST_CASE(test_precalculated_hash) {
   BOOST_CHECK_EQUAL(map.erase(4, map.hash_function()(2)), 0u);
 }
 
+BOOST_AUTO_TEST_CASE(test_precalculated_hash_insert) {
+  // Insert each key with the hash of the key + 1000 so that the insertions
+  // which use the precalculated hash can only be found with it.
+  using map_t = tsl::ordered_map<int, int, identity_hash<int>>;
+  map_t map;
+  auto hash = [&](int key) { return map.hash_function()(key + 1000); };
+
+  /**
+   * insert, emplace, try_emplace, insert_or_assign
+   */
+  BOOST_CHECK(map.insert({1, -1}, hash(1)).second);
+  const map_t::value_type value2(2, -2);
+  BOOST_CHECK(map.insert(value2, hash(2)).second);
+  BOOST_CHECK(map.insert(std::make_pair(3, -3), hash(3)).second);
+  BOOST_CHECK(map.emplace(tsl::precalculated_hash_t(hash(4)), 4, -4).second);
+  BOOST_CHECK(
+      map.try_emplace(tsl::precalculated_hash_t(hash(5)), 5, -5).second);
+  BOOST_CHECK(map.insert_or_assign(6, -6, hash(6)).second);
+
+  BOOST_CHECK(!map.insert({1, 1}, hash(1)).second);
+  BOOST_CHECK(!map.emplace(tsl::precalculated_hash_t(hash(4)), 4, 4).second);
+  BOOST_CHECK(!map.try_emplace(tsl::precalculated_hash_t(hash(5)), 5).second);
+  BOOST_CHECK(!map.insert_or_assign(6, 6, hash(6)).second);
+
+  // operator[]
+  map.try_emplace(tsl::precalculated_hash_t(hash(7)), 7).first.value() = -7;
+
+  /**
+   * insert_at_position, emplace_at_position, try_emplace_at_position
+   */
+  BOOST_CHECK(map.insert_at_position(map.begin(), {0, 0}, hash(0)).second);
+  BOOST_CHECK(map.emplace_at_position(map.begin(),
+                                      tsl::precalculated_hash_t(hash(-1)), -1,
+                                      1)
+                  .second);
+  BOOST_CHECK(map.try_emplace_at_position(map.begin(),
+                                          tsl::precalculated_hash_t(hash(-2)),
+                                          -2, 2)
+                  .second);
+  BOOST_CHECK(
+      !map.insert_at_position(map.begin() + 1, {-1, 0}, hash(-1)).second);
+
+  BOOST_CHECK(map == (map_t{{-2, 2},
+                            {-1, 1},
+                            {0, 0},
+                            {1, -1},
+                            {2, -2},
+                            {3, -3},
+                            {4, -4},
+                            {5, -5},
+                            {6, 6},
+                            {7, -7}}));
+  for (int key = -2; key <= 7; key++) {
+    BOOST_CHECK(map.find(key, hash(key)) != map.end());
+    BOOST_CHECK(map.find(key) == map.end());
+  }
+}
+
+/**
+ * find_batch
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_find_batch, HMap, test_types) {
+  // insert x values, search x*2 keys (half of them missing) with find_batch and
+  // contains_batch, check that the results are the same as with find
+  using key_tt = typename HMap::key_type;
+
+  const std::size_t nb_values = 1000;
+  HMap map = utils::get_filled_hash_map<HMap>(nb_values);
+  const HMap& map_const = map;
+
+  std::vector<key_tt> keys;
+  for (std::size_t i = 0; i < 2 * nb_values - 3; i++) {
+    keys.push_back(utils::get_key<key_tt>((i * 7) % (2 * nb_values)));
+  }
+
+  std::vector<typename HMap::iterator> its;
+  map.find_batch(keys.begin(), keys.size(), std::back_inserter(its));
+  std::vector<typename HMap::const_iterator> its_const(keys.size());
+  BOOST_CHECK(map_const.find_batch(keys.begin(), keys.size(),
+                                   its_const.begin()) == its_const.end());
+  std::vector<char> contains(keys.size());
+  map_const.contains_batch(keys.begin(), keys.size(), contains.begin());
+
+  BOOST_REQUIRE_EQUAL(its.size(), keys.size());
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    BOOST_CHECK(its[i] == map.find(keys[i]));
+    BOOST_CHECK(its_const[i] == map_const.find(keys[i]));
+    BOOST_CHECK_EQUAL(contains[i] != 0, map.contains(keys[i]));
+  }
+
+  // Nothing is written if there are no keys
+  BOOST_CHECK(map.find_batch(keys.begin(), 0, its.begin()) == its.begin());
+
+  HMap empty_map;
+  empty_map.find_batch(keys.begin(), keys.size(), its.begin());
+  BOOST_CHECK(std::all_of(its.begin(), its.end(),
+                          [&](const typename HMap::iterator& it) {
+                            return it == empty_map.end();
+                          }));
+}
+
+/**
+ * incremental_rehash
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_incremental_rehash, HMap, test_types) {
+  // insert x values while migrating one bucket per operation so that most
+  // operations run with an incremental rehash in progress, check the values
+  // through find and the order, erase half of the values and insert them again
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  HMap map;
+  map.incremental_rehash(1);
+  BOOST_CHECK_EQUAL(map.incremental_rehash(), 1u);
+  const HMap& map_const = map;
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.insert({utils::get_key<key_tt>(i),
+                            utils::get_value<value_tt>(i)})
+                    .second);
+    BOOST_CHECK(!map.insert({utils::get_key<key_tt>(i / 2),
+                             utils::get_value<value_tt>(i + 1)})
+                     .second);
+
+    auto it = map_const.find(utils::get_key<key_tt>(i / 3));
+    BOOST_REQUIRE(it != map_const.end());
+    BOOST_CHECK_EQUAL(it->second, utils::get_value<value_tt>(i / 3));
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  BOOST_CHECK(map.load_factor() <= map.max_load_factor());
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map_const.contains(utils::get_key<key_tt>(i)));
+    BOOST_CHECK(!map_const.contains(utils::get_key<key_tt>(nb_values + i)));
+  }
+
+  std::size_t i = 0;
+  for (const auto& key_value : map) {
+    BOOST_CHECK_EQUAL(key_value.first, utils::get_key<key_tt>(i));
+    BOOST_CHECK_EQUAL(key_value.second, utils::get_value<value_tt>(i));
+    i++;
+  }
+
+  for (i = 0; i < nb_values; i += 2) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<key_tt>(i)), 1u);
+  }
+  for (i = 1; i < nb_values; i += 4) {
+    BOOST_CHECK_EQUAL(map.unordered_erase(utils::get_key<key_tt>(i)), 1u);
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values / 4);
+
+  for (i = 0; i < nb_values; i++) {
+    map.insert({utils::get_key<key_tt>(i), utils::get_value<value_tt>(i)});
+
+    auto it = map.find(utils::get_key<key_tt>(i));
+    BOOST_REQUIRE(it != map.end());
+    BOOST_CHECK_EQUAL(it->second, utils::get_value<value_tt>(i));
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+
+  map.incremental_rehash(0);
+  for (i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map_const.contains(utils::get_key<key_tt>(i)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_incremental_rehash_in_progress) {
+  // Check the operations working on all the buckets (copy, serialization,
+  // range erase, insert at position, ...) while a rehash is in progress.
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t>;
+
+  map_t map;
+  map.incremental_rehash(4);
+  map.reserve(100);
+
+  const std::size_t bucket_count = map.bucket_count();
+  std::int64_t nb_values = 0;
+  while (map.bucket_count() == bucket_count) {
+    map.insert({nb_values, nb_values});
+    nb_values++;
+  }
+
+  const map_t map_copy = map;
+  BOOST_CHECK(map_copy == map);
+
+  serializer serial;
+  map.serialize(serial);
+  deserializer dserial(serial.str());
+  const map_t map_deserialized = map_t::deserialize(dserial, true);
+  BOOST_CHECK(map_deserialized == map);
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(map_copy.at(i), i);
+    BOOST_CHECK_EQUAL(map_deserialized.at(i), i);
+  }
+
+  map.insert_at_position(map.begin(), {-1, -1});
+  BOOST_CHECK_EQUAL(map.front().first, -1);
+  BOOST_CHECK_EQUAL(map.nth(1)->first, 0);
+
+  // Erase the multiples of 5 in [0, nb_values)
+  BOOST_CHECK_EQUAL(
+      erase_if(map,
+               [](const std::pair<std::int64_t, std::int64_t>& v) {
+                 return v.first % 5 == 0;
+               }),
+      std::size_t((nb_values + 4) / 5));
+
+  map.erase(map.begin(), map.begin() + 10);
+  map.insert({nb_values, nb_values});
+  BOOST_CHECK_EQUAL(map.back().first, nb_values);
+
+  std::int64_t previous = 0;
+  for (const auto& key_value : map) {
+    BOOST_CHECK_EQUAL(key_value.first, key_value.second);
+    BOOST_CHECK(key_value.first > previous);
+    BOOST_CHECK(map.find(key_value.first) != map.end());
+    previous = key_value.first;
+  }
+  BOOST_CHECK(map.find(-1) == map.end());
+  BOOST_CHECK(map.find(5) == map.end());
+
+  map.rehash(0);
+  BOOST_CHECK(map.find(nb_values) != map.end());
+}
+
+/**
+ * rehash/reserve with threads
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_parallel_rehash, HMap, test_types) {
+  // insert x values, rehash with 8 threads in a buckets array much bigger than
+  // the current one, check the values and insert some more
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  HMap map = utils::get_filled_hash_map<HMap>(nb_values);
+
+  map.rehash(1u << 16, 8);
+  BOOST_CHECK_EQUAL(map.bucket_count(), 1u << 16);
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+
+  for (std::size_t i = 0; i < 2 * nb_values; i++) {
+    map.insert({utils::get_key<key_tt>(i), utils::get_value<value_tt>(i)});
+  }
+  BOOST_CHECK_EQUAL(map.size(), 2 * nb_values);
+
+  std::size_t i = 0;
+  for (const auto& key_value : map) {
+    BOOST_CHECK_EQUAL(key_value.first, utils::get_key<key_tt>(i));
+    BOOST_CHECK_EQUAL(key_value.second, utils::get_value<value_tt>(i));
+    BOOST_CHECK(map.find(key_value.first) != map.end());
+    i++;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_rehash_big_map) {
+  // The old buckets array is bigger than the range of each thread.
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t>;
+  using simd_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>,
+                       std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                       std::deque<std::pair<std::int64_t, std::int64_t>>,
+                       std::uint_least32_t, true>;
+
+  const std::int64_t nb_values = 50000;
+  map_t map;
+  simd_map_t simd_map;
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    map.insert({i, i});
+    simd_map.insert({i, i});
+  }
+
+  map.reserve(std::size_t(nb_values) * 4, 8);
+  simd_map.reserve(std::size_t(nb_values) * 4, 3);
+  BOOST_CHECK(map.bucket_count() >= std::size_t(nb_values) * 4);
+  BOOST_CHECK(simd_map.bucket_count() >= std::size_t(nb_values) * 4);
+
+  for (std::int64_t i = 0; i < 2 * nb_values; i++) {
+    BOOST_CHECK_EQUAL(map.count(i), (i < nb_values) ? 1u : 0u);
+    BOOST_CHECK_EQUAL(simd_map.count(i), (i < nb_values) ? 1u : 0u);
+  }
+  BOOST_CHECK(map.nth(std::size_t(nb_values) - 1)->first == nb_values - 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_rehash_range_boundaries) {
+  // With 16 threads and 2^17 buckets, each thread fills 8192 buckets. Put all
+  // the values just before the end of the ranges so that most insertions
+  // cross into the next range, first with few values per range (spilled and
+  // placed after the threads are done) then with many (fallback on a rehash
+  // without threads).
+  struct boundary_hash {
+    std::size_t operator()(std::int64_t key) const {
+      return std::size_t((key % 8 + 1) * 8192 - 1 - (key / 8) % 4);
+    }
+  };
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t, boundary_hash>;
+
+  for (const std::int64_t nb_values : {400, 9000}) {
+    map_t map;
+    for (std::int64_t i = 0; i < nb_values; i++) {
+      map.insert({i, i});
+    }
+
+    map.rehash(1u << 17, 16);
+    BOOST_CHECK_EQUAL(map.bucket_count(), 1u << 17);
+
+    for (std::int64_t i = 0; i < nb_values; i++) {
+      BOOST_REQUIRE(map.find(i) != map.end());
+      BOOST_CHECK_EQUAL(map.find(i)->second, i);
+    }
+    BOOST_CHECK(map.find(nb_values) == map.end());
+
+    map.erase(map.begin(), map.begin() + nb_values / 2);
+    BOOST_CHECK_EQUAL(map.size(), std::size_t(nb_values / 2));
+    BOOST_CHECK(map.find(nb_values / 2) != map.end());
+  }
+}
+
+/**
+ * build_parallel
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_build_parallel, HMap, test_types) {
+  // Build with 8 threads from 2 * nb_keys values where each key appears twice,
+  // shuffled, and compare with the serial insertion of the same values. Then
+  // check that the map stays usable.
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_keys = 2000;
+  std::vector<std::size_t> ikeys(2 * nb_keys);
+  for (std::size_t i = 0; i < ikeys.size(); i++) {
+    ikeys[i] = i % nb_keys;
+  }
+  std::shuffle(ikeys.begin(), ikeys.end(), std::mt19937_64(0));
+
+  auto get_values = [&]() {
+    std::vector<typename HMap::value_type> values;
+    for (std::size_t i = 0; i < ikeys.size(); i++) {
+      values.emplace_back(utils::get_key<key_tt>(ikeys[i]),
+                          utils::get_value<value_tt>(i));
+    }
+
+    return values;
+  };
+
+  auto values = get_values();
+  HMap map;
+  map.build_parallel(std::make_move_iterator(values.begin()),
+                     std::make_move_iterator(values.end()), 8);
+
+  values = get_values();
+  HMap serial_map;
+  serial_map.insert(std::make_move_iterator(values.begin()),
+                    std::make_move_iterator(values.end()));
+
+  BOOST_CHECK_EQUAL(map.size(), nb_keys);
+  BOOST_CHECK(map == serial_map);
+  for (const auto& key_value : serial_map) {
+    BOOST_REQUIRE(map.find(key_value.first) != map.end());
+    BOOST_CHECK_EQUAL(map.at(key_value.first), key_value.second);
+  }
+
+  for (std::size_t i = nb_keys; i < 2 * nb_keys; i++) {
+    BOOST_CHECK(
+        map.insert({utils::get_key<key_tt>(i), utils::get_value<value_tt>(i)})
+            .second);
+  }
+  map.erase(map.begin(), std::next(map.begin(), nb_keys / 2));
+  BOOST_CHECK_EQUAL(map.size(), nb_keys + nb_keys / 2);
+  BOOST_CHECK(map.find(utils::get_key<key_tt>(ikeys.front())) == map.end());
+
+  // Not empty or not random access, same as insert.
+  values = get_values();
+  map.build_parallel(std::make_move_iterator(values.begin()),
+                     std::make_move_iterator(values.end()), 8);
+  BOOST_CHECK_EQUAL(map.size(), 2 * nb_keys);
+
+  values = get_values();
+  std::list<typename HMap::value_type> values_list;
+  for (auto& value : values) {
+    values_list.push_back(std::move(value));
+  }
+  HMap list_map;
+  list_map.build_parallel(std::make_move_iterator(values_list.begin()),
+                          std::make_move_iterator(values_list.end()), 8);
+  BOOST_CHECK(list_map == serial_map);
+}
+
+BOOST_AUTO_TEST_CASE(test_build_parallel_range_boundaries) {
+  // 90000 values reserve 2^17 buckets, with 16 threads each thread fills 8192
+  // buckets. As in test_parallel_rehash_range_boundaries, put the negative
+  // keys just before the end of the ranges. Every 'stride' value has such a
+  // key, with duplicates: first few (spilled and placed after the threads are
+  // done) then many (fallback on insert).
+  struct boundary_hash {
+    std::size_t operator()(std::int64_t key) const {
+      if (key >= 0) {
+        return std::size_t(key);
+      }
+
+      key = -key - 1;
+      return std::size_t((key % 8 + 1) * 8192 - 1 - (key / 8) % 4);
+    }
+  };
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t, boundary_hash>;
+
+  for (const std::int64_t stride : {100, 5}) {
+    const std::int64_t nb_boundary_keys = (stride == 100) ? 400 : 9000;
+
+    std::vector<std::pair<std::int64_t, std::int64_t>> values;
+    for (std::int64_t i = 0; i < 90000; i++) {
+      const std::int64_t key =
+          (i % stride == 0) ? -((i / stride) % nb_boundary_keys) - 1 : i;
+      values.emplace_back(key, i);
+    }
+
+    map_t map;
+    map.build_parallel(values.begin(), values.end(), 16);
+    BOOST_CHECK(map.bucket_count() >= 1u << 17);
+
+    const map_t serial_map(values.begin(), values.end());
+    BOOST_CHECK_EQUAL(map.size(), serial_map.size());
+    BOOST_CHECK(map == serial_map);
+    for (const auto& key_value : serial_map) {
+      BOOST_REQUIRE(map.find(key_value.first) != map.end());
+      BOOST_CHECK_EQUAL(map.find(key_value.first)->second, key_value.second);
+    }
+    BOOST_CHECK(map.find(-nb_boundary_keys - 1) == map.end());
+  }
+}
+
+/**
+ * insert_unique_unchecked/emplace_back_unchecked
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert_unique_unchecked, HMap, test_types) {
+  // Insert nb_values unique keys with insert_unique_unchecked and as many with
+  // emplace_back_unchecked, and compare with the same insertions done with
+  // insert. Then erase some values and insert them back unchecked.
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  auto get_values = [&]() {
+    std::vector<typename HMap::value_type> values;
+    for (std::size_t i = 0; i < nb_values; i++) {
+      values.emplace_back(utils::get_key<key_tt>(i),
+                          utils::get_value<value_tt>(i));
+    }
+
+    return values;
+  };
+
+  auto values = get_values();
+  HMap map;
+  map.insert_unique_unchecked(std::make_move_iterator(values.begin()),
+                              std::make_move_iterator(values.end()));
+  for (std::size_t i = nb_values; i < 2 * nb_values; i++) {
+    auto it = map.emplace_back_unchecked(utils::get_key<key_tt>(i),
+                                         utils::get_value<value_tt>(i));
+    BOOST_CHECK(it == std::prev(map.end()));
+    BOOST_CHECK(it->first == utils::get_key<key_tt>(i));
+  }
+
+  values = get_values();
+  HMap checked_map;
+  checked_map.insert(std::make_move_iterator(values.begin()),
+                     std::make_move_iterator(values.end()));
+  for (std::size_t i = nb_values; i < 2 * nb_values; i++) {
+    checked_map.emplace(utils::get_key<key_tt>(i),
+                        utils::get_value<value_tt>(i));
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), 2 * nb_values);
+  BOOST_CHECK(map == checked_map);
+  for (std::size_t i = 0; i < 2 * nb_values; i++) {
+    BOOST_CHECK_EQUAL(map.count(utils::get_key<key_tt>(i)), 1u);
+  }
+
+  for (std::size_t i = 0; i < 2 * nb_values; i += 3) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<key_tt>(i)), 1u);
+    checked_map.erase(utils::get_key<key_tt>(i));
+  }
+  for (std::size_t i = 0; i < 2 * nb_values; i += 3) {
+    map.emplace_back_unchecked(utils::get_key<key_tt>(i),
+                               utils::get_value<value_tt>(i));
+    checked_map.emplace(utils::get_key<key_tt>(i),
+                        utils::get_value<value_tt>(i));
+  }
+  BOOST_CHECK(map == checked_map);
+  BOOST_CHECK(map.find(utils::get_key<key_tt>(2 * nb_values)) == map.end());
+}
+
+/**
+ * index_of/try_emplace_index/value_at
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_index_of, HMap, test_types) {
+  // Insert nb_values keys with try_emplace_index, twice, and check that the
+  // indexes are the ones of the iterators and that value_at gives the values.
+  using key_tt = typename HMap::key_type;
+  using value_tt = typename HMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  HMap map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    auto inserted = map.try_emplace_index(utils::get_key<key_tt>(i),
+                                          utils::get_value<value_tt>(i));
+    BOOST_CHECK(inserted.second);
+    BOOST_CHECK_EQUAL(inserted.first, i);
+  }
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const key_tt key = utils::get_key<key_tt>(i);
+    auto inserted = map.try_emplace_index(utils::get_key<key_tt>(i),
+                                          utils::get_value<value_tt>(i + 1));
+    BOOST_CHECK(!inserted.second);
+    BOOST_CHECK_EQUAL(inserted.first, i);
+
+    BOOST_CHECK_EQUAL(map.index_of(key), i);
+    BOOST_CHECK_EQUAL(map.index_of(key, map.hash_function()(key)), i);
+    BOOST_CHECK(map.value_at(i).first == key);
+    BOOST_CHECK(map.value_at(i).second == utils::get_value<value_tt>(i));
+  }
+
+  BOOST_CHECK_EQUAL(map.index_of(utils::get_key<key_tt>(nb_values)),
+                    std::numeric_limits<typename HMap::size_type>::max());
+
+  // After an erase, the indexes are still the ones of the values container.
+  map.erase(utils::get_key<key_tt>(0));
+  map.pop_front();
+  for (std::size_t i = 2; i < nb_values; i++) {
+    const std::size_t index = map.index_of(utils::get_key<key_tt>(i));
+    BOOST_CHECK(map.value_at(index).first == utils::get_key<key_tt>(i));
+  }
+
+  const key_tt key = utils::get_key<key_tt>(nb_values);
+  const std::size_t hash = map.hash_function()(key);
+  auto inserted = map.try_emplace_index(tsl::precalculated_hash_t(hash),
+                                        utils::get_key<key_tt>(nb_values),
+                                        utils::get_value<value_tt>(nb_values));
+  BOOST_CHECK(inserted.second);
+  BOOST_CHECK_EQUAL(map.index_of(key, hash), inserted.first);
+  BOOST_CHECK(map.value_at(inserted.first).first == key);
+  BOOST_CHECK(std::prev(map.end())->first == key);
+}
+
+/**
+ * SimdProbing
+ */
+BOOST_AUTO_TEST_CASE(test_simd_probing) {
+  // Do the same random operations on a map with and without SimdProbing and
+  // check that lookups give the same results, also at high load factors.
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t>;
+  using simd_map_t =
+      tsl::ordered_map<std::int64_t, std::int64_t, std::hash<std::int64_t>,
+                       std::equal_to<std::int64_t>,
+                       std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                       std::deque<std::pair<std::int64_t, std::int64_t>>,
+                       std::uint_least32_t, true>;
+
+  const std::int64_t nb_values = 5000;
+  std::mt19937_64 generator(0);
+  std::uniform_int_distribution<std::int64_t> rand_key(0, 2 * nb_values);
+
+  map_t map;
+  simd_map_t simd_map;
+  map.max_load_factor(0.95f);
+  simd_map.max_load_factor(0.95f);
+
+  for (std::int64_t i = 0; i < 4 * nb_values; i++) {
+    const std::int64_t key = rand_key(generator);
+    switch (i % 5) {
+      case 0:
+      case 1:
+        BOOST_CHECK_EQUAL(map.insert({key, i}).second,
+                          simd_map.insert({key, i}).second);
+        break;
+      case 2:
+        BOOST_CHECK_EQUAL(map.erase(key), simd_map.erase(key));
+        break;
+      case 3:
+        BOOST_CHECK_EQUAL(map.unordered_erase(key),
+                          simd_map.unordered_erase(key));
+        break;
+      default:
+        BOOST_CHECK_EQUAL(map.count(key), simd_map.count(key));
+        break;
+    }
+  }
+
+  BOOST_REQUIRE_EQUAL(map.size(), simd_map.size());
+  BOOST_CHECK(std::equal(map.begin(), map.end(), simd_map.begin()));
+  for (std::int64_t key = 0; key <= 2 * nb_values; key++) {
+    auto it = simd_map.find(key);
+    BOOST_REQUIRE_EQUAL(map.contains(key), it != simd_map.end());
+    if (it != simd_map.end()) {
+      BOOST_CHECK_EQUAL(it->second, map.at(key));
+    }
+  }
+
+  erase_if(simd_map, [](const std::pair<std::int64_t, std::int64_t>& v) {
+    return v.first % 3 == 0;
+  });
+  simd_map.erase(simd_map.begin() + 10, simd_map.begin() + 100);
+  simd_map.rehash(0);
+
+  serializer serial;
+  simd_map.serialize(serial);
+  deserializer dserial(serial.str());
+  const auto simd_map_deserialized = simd_map_t::deserialize(dserial, true);
+
+  for (std::int64_t key = 0; key <= 2 * nb_values; key++) {
+    const auto it = simd_map.find(key);
+    const auto it_deserialized = simd_map_deserialized.find(key);
+    BOOST_REQUIRE_EQUAL(it != simd_map.end(),
+                        it_deserialized != simd_map_deserialized.end());
+    if (it != simd_map.end()) {
+      BOOST_CHECK_EQUAL(it->second, it_deserialized->second);
+      BOOST_CHECK_EQUAL(it - simd_map.begin(),
+                        it_deserialized - simd_map_deserialized.begin());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_simd_probing_long_probes) {
+  // Only 3 different hashes, the probes are longer than what the metadata can
+  // encode and the scalar fallback is used.
+  tsl::ordered_map<std::int64_t, std::int64_t, mod_hash<3>,
+                   std::equal_to<std::int64_t>,
+                   std::allocator<std::pair<std::int64_t, std::int64_t>>,
+                   std::deque<std::pair<std::int64_t, std::int64_t>>,
+                   std::uint_least32_t, true>
+      map;
+
+  const std::int64_t nb_values = 1000;
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.insert({i, i * 2}).second);
+  }
+
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_REQUIRE(map.find(i) != map.end());
+    BOOST_CHECK_EQUAL(map.find(i)->second, i * 2);
+  }
+  BOOST_CHECK(map.find(nb_values) == map.end());
+
+  for (std::int64_t i = 0; i < nb_values; i += 2) {
+    BOOST_CHECK_EQUAL(map.erase(i), 1u);
+  }
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(map.count(i), std::size_t(i % 2));
+  }
+}
+
+/**
+ * tombstone_deque
+ */
+BOOST_AUTO_TEST_CASE(test_tombstone_erase) {
+  // Do the same random operations on a map with and without tombstones and
+  // check that both have the same values in the same order.
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t>;
+  using tombstone_map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, std::hash<std::int64_t>,
+      std::equal_to<std::int64_t>,
+      std::allocator<std::pair<std::int64_t, std::int64_t>>,
+      tsl::tombstone_deque<std::pair<std::int64_t, std::int64_t>>>;
+
+  const std::int64_t nb_values = 2000;
+  std::mt19937_64 generator(1);
+  std::uniform_int_distribution<std::int64_t> rand_key(0, nb_values);
+
+  map_t map;
+  tombstone_map_t tombstone_map;
+  for (std::int64_t i = 0; i < 10 * nb_values; i++) {
+    const std::int64_t key = rand_key(generator);
+    switch (i % 8) {
+      case 0:
+      case 1:
+      case 2:
+        BOOST_CHECK_EQUAL(map.insert({key, i}).second,
+                          tombstone_map.insert({key, i}).second);
+        break;
+      case 3:
+        BOOST_CHECK_EQUAL(map.erase(key), tombstone_map.erase(key));
+        break;
+      case 4:
+        if (!map.empty()) {
+          const std::size_t n = std::size_t(key) % map.size();
+          auto it = map.erase(map.nth(n));
+          auto it_tombstone = tombstone_map.erase(tombstone_map.nth(n));
+          BOOST_REQUIRE_EQUAL(it == map.end(),
+                              it_tombstone == tombstone_map.end());
+          if (it != map.end()) {
+            BOOST_CHECK_EQUAL(it->first, it_tombstone->first);
+          }
+        }
+        break;
+      case 5:
+        if (!map.empty()) {
+          BOOST_CHECK_EQUAL(map.front().first, tombstone_map.front().first);
+          BOOST_CHECK_EQUAL(map.back().first, tombstone_map.back().first);
+          map.erase(map.begin());
+          tombstone_map.erase(tombstone_map.begin());
+        }
+        break;
+      case 6:
+        if (!map.empty()) {
+          const std::size_t n = std::size_t(key) % map.size();
+          BOOST_CHECK_EQUAL(
+              map.insert_at_position(map.nth(n), {key, i}).second,
+              tombstone_map.insert_at_position(tombstone_map.nth(n), {key, i})
+                  .second);
+        }
+        break;
+      default:
+        if (!map.empty()) {
+          map.pop_back();
+          tombstone_map.pop_back();
+        }
+        break;
+    }
+
+    BOOST_REQUIRE_EQUAL(map.size(), tombstone_map.size());
+  }
+
+  BOOST_CHECK(std::equal(map.begin(), map.end(), tombstone_map.begin()));
+  BOOST_CHECK(std::equal(map.rbegin(), map.rend(), tombstone_map.rbegin()));
+  for (std::int64_t key = 0; key <= nb_values; key++) {
+    auto it = tombstone_map.find(key);
+    BOOST_REQUIRE_EQUAL(map.contains(key), it != tombstone_map.end());
+    if (it != tombstone_map.end()) {
+      BOOST_CHECK_EQUAL(it->second, map.at(key));
+    }
+  }
+
+  // The compaction keeps the tombstones bounded.
+  const auto& values = tombstone_map.values_container();
+  BOOST_CHECK(float(values.nb_tombstones()) <
+              0.25f * float(values.raw_size() + tombstone_map.bucket_count()));
+
+  // Range erase in the middle and unordered_erase keep the order.
+  auto it_range = map.erase(map.nth(10), map.nth(50));
+  auto it_range_tombstone =
+      tombstone_map.erase(tombstone_map.nth(10), tombstone_map.nth(50));
+  BOOST_CHECK_EQUAL(it_range->first, it_range_tombstone->first);
+  BOOST_CHECK_EQUAL(tombstone_map.unordered_erase(map.nth(20)->first), 1u);
+  map.erase(map.nth(20));
+  BOOST_CHECK(map == map_t(tombstone_map.begin(), tombstone_map.end()));
+
+  tombstone_map.shrink_to_fit();
+  BOOST_CHECK_EQUAL(tombstone_map.values_container().nb_tombstones(), 0u);
+  BOOST_CHECK(std::equal(map.begin(), map.end(), tombstone_map.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(test_tombstone_erase_if_and_serialize) {
+  using tombstone_map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, std::hash<std::int64_t>,
+      std::equal_to<std::int64_t>,
+      std::allocator<std::pair<std::int64_t, std::int64_t>>,
+      tsl::tombstone_deque<std::pair<std::int64_t, std::int64_t>>>;
+
+  tombstone_map_t map;
+  for (std::int64_t i = 0; i < 1000; i++) {
+    map.insert({i, i * 2});
+  }
+
+  BOOST_CHECK_EQUAL(
+      erase_if(map,
+               [](const std::pair<std::int64_t, std::int64_t>& v) {
+                 return v.first % 3 != 0 && v.first < 900;
+               }),
+      600u);
+  BOOST_CHECK_EQUAL(map.size(), 400u);
+  BOOST_CHECK_EQUAL(map.front().first, 0);
+  BOOST_CHECK_EQUAL(map.nth(1)->first, 3);
+  BOOST_CHECK_EQUAL(map.nth(299)->first, 897);
+  BOOST_CHECK_EQUAL(map.nth(300)->first, 900);
+  BOOST_CHECK(map.nth(400) == map.end());
+
+  // Leave some tombstones before serializing.
+  map.erase(0);
+  map.erase(450);
+  BOOST_CHECK(map.values_container().nb_tombstones() > 0);
+
+  serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  const auto map_deserialized = tombstone_map_t::deserialize(dserial, true);
+  BOOST_CHECK(map == map_deserialized);
+  for (const auto& key_value : map) {
+    BOOST_REQUIRE(map_deserialized.find(key_value.first) !=
+                  map_deserialized.end());
+    BOOST_CHECK_EQUAL(map_deserialized.find(key_value.first)->second,
+                      key_value.second);
+  }
+
+  deserializer dserial2(serial.str());
+  BOOST_CHECK(map == tombstone_map_t::deserialize(dserial2, false));
+
+  const auto values = map.release();
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK_EQUAL(values.size(), 398u);
+  BOOST_CHECK_EQUAL(values.front().first, 3);
+}
+
+/**
+ * ranked_deque
+ */
+BOOST_AUTO_TEST_CASE(test_ranked_deque_positional_operations) {
+  // Do the same random positional operations on a map over a std::deque and
+  // a map over a ranked_deque and check that both have the same values in the
+  // same order.
+  using map_t = tsl::ordered_map<std::int64_t, std::int64_t>;
+  using ranked_map_t = tsl::ordered_map<
+      std::int64_t, std::int64_t, std::hash<std::int64_t>,
+      std::equal_to<std::int64_t>,
+      std::allocator<std::pair<std::int64_t, std::int64_t>>,
+      tsl::ranked_deque<std::pair<std::int64_t, std::int64_t>>>;
+
+  const std::int64_t nb_values = 5000;
+  std::mt19937_64 generator(2);
+  std::uniform_int_distribution<std::int64_t> rand_key(0, nb_values);
+
+  map_t map;
+  ranked_map_t ranked_map;
+  for (std::int64_t i = 0; i < 10 * nb_values; i++) {
+    const std::int64_t key = rand_key(generator);
+    const std::size_t n = map.empty() ? 0 : std::size_t(key) % map.size();
+    switch (i % 10) {
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+        BOOST_CHECK_EQUAL(
+            map.insert_at_position(map.nth(n), {key, i}).second,
+            ranked_map.insert_at_position(ranked_map.nth(n), {key, i}).second);
+        break;
+      case 4:
+        BOOST_CHECK_EQUAL(map.insert({key, i}).second,
+                          ranked_map.insert({key, i}).second);
+        break;
+      case 5:
+        BOOST_CHECK_EQUAL(map.erase(key), ranked_map.erase(key));
+        break;
+      case 6:
+        if (!map.empty()) {
+          auto it = map.erase(map.nth(n));
+          auto it_ranked = ranked_map.erase(ranked_map.nth(n));
+          BOOST_REQUIRE_EQUAL(it == map.end(), it_ranked == ranked_map.end());
+          if (it != map.end()) {
+            BOOST_CHECK_EQUAL(it->first, it_ranked->first);
+          }
+        }
+        break;
+      case 7:
+        if (!map.empty()) {
+          BOOST_CHECK_EQUAL(map.nth(n)->first, ranked_map.nth(n)->first);
+          BOOST_CHECK_EQUAL(ranked_map.nth(n) - ranked_map.begin(),
+                            std::ptrdiff_t(n));
+          BOOST_CHECK_EQUAL(map.front().first, ranked_map.front().first);
+          BOOST_CHECK_EQUAL(map.back().first, ranked_map.back().first);
+        }
+        break;
+      case 8:
+        if (!map.empty()) {
+          map.move_to_back(map.nth(n));
+          ranked_map.move_to_back(ranked_map.nth(n));
+        }
+        break;
+      default:
+        if (!map.empty()) {
+          map.pop_back();
+          ranked_map.pop_back();
+        }
+        break;
+    }
+
+    BOOST_REQUIRE_EQUAL(map.size(), ranked_map.size());
+  }
+
+  BOOST_CHECK(std::equal(map.begin(), map.end(), ranked_map.begin()));
+  BOOST_CHECK(std::equal(map.rbegin(), map.rend(), ranked_map.rbegin()));
+  for (std::int64_t key = 0; key <= nb_values; key++) {
+    auto it = ranked_map.find(key);
+    BOOST_REQUIRE_EQUAL(map.contains(key), it != ranked_map.end());
+    if (it != ranked_map.end()) {
+      BOOST_CHECK_EQUAL(it->second, map.at(key));
+    }
+  }
+
+  // Range erase in the middle and at the front.
+  auto it_range = map.erase(map.nth(10), map.nth(500));
+  auto it_range_ranked =
+      ranked_map.erase(ranked_map.nth(10), ranked_map.nth(500));
+  BOOST_CHECK_EQUAL(it_range->first, it_range_ranked->first);
+  map.erase(map.begin(), map.nth(20));
+  ranked_map.erase(ranked_map.begin(), ranked_map.nth(20));
+  BOOST_CHECK(map == map_t(ranked_map.begin(), ranked_map.end()));
+
+  // After the compaction, the raw indexes are in order.
+  ranked_map.shrink_to_fit();
+  const auto& values = ranked_map.values_container();
+  BOOST_CHECK_EQUAL(values.nb_tombstones(), 0u);
+  for (std::size_t i = 0; i < values.raw_size(); i++) {
+    BOOST_REQUIRE_EQUAL(values[i].first, map.nth(i)->first);
+  }
+  BOOST_CHECK(std::equal(map.begin(), map.end(), ranked_map.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(test_ranked_deque_iterators) {
+  // Insert at the front to split the chunks and check the iterator
+  // arithmetic.
+  tsl::ranked_deque<std::int64_t> values;
+  const std::int64_t nb_values = 2000;
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    values.emplace(values.begin(), nb_values - 1 - i);
+  }
+  BOOST_REQUIRE_EQUAL(values.size(), std::size_t(nb_values));
+  BOOST_CHECK_EQUAL(values.front(), 0);
+  BOOST_CHECK_EQUAL(values.back(), nb_values - 1);
+
+  auto it = values.begin();
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    BOOST_REQUIRE_EQUAL(*it, i);
+    BOOST_CHECK_EQUAL(*values.nth(std::size_t(i)), i);
+    BOOST_CHECK_EQUAL(values.begin()[i], i);
+    BOOST_CHECK(values.begin() + i == it);
+    BOOST_CHECK_EQUAL(it - values.begin(), i);
+    BOOST_CHECK(it < values.end());
+    ++it;
+  }
+  BOOST_CHECK(it == values.end());
+  BOOST_CHECK(values.end() - 1 == values.nth(std::size_t(nb_values - 1)));
+
+  // The raw index of a value doesn't change on insertion.
+  const std::size_t raw_index = values.nth(1000).index();
+  values.emplace(values.nth(500), -1);
+  BOOST_CHECK_EQUAL(values[raw_index], 1000);
+  BOOST_CHECK_EQUAL(*values.iterator_at(raw_index), 1000);
+  BOOST_CHECK_EQUAL(values.iterator_at(raw_index) - values.begin(), 1001);
+
+  // Empty a whole chunk from the middle.
+  for (std::size_t i = 0; i < 600; i++) {
+    values.tombstone(values.nth(300).index());
+  }
+  BOOST_CHECK_EQUAL(values.size(), std::size_t(nb_values) + 1 - 600);
+  BOOST_CHECK_EQUAL(*values.nth(299), 299);
+  BOOST_CHECK_EQUAL(*values.nth(300), 899);
+  BOOST_CHECK_EQUAL(*std::prev(values.nth(300)), 299);
+
+  values.prepare_compaction();
+  BOOST_CHECK_EQUAL(values.compacted_index(raw_index), 1001u - 600u);
+  values.compact();
+  BOOST_CHECK_EQUAL(values.raw_size(), values.size());
+  BOOST_CHECK_EQUAL(values[1001 - 600], 1000);
+  BOOST_CHECK(std::is_sorted(values.begin() + 300, values.end()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,8 @@
 #include <cstdint>
 #include <deque>
 #include <functional>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -33,6 +35,8 @@
 #include <vector>
 
 #include "tsl/ordered_set.h"
+#include "tsl/ranked_deque.h"
+#include "tsl/tombstone_deque.h"
 #include "utils.h"
 
 BOOST_AUTO_TEST_SUITE(test_ordered_set)
@@ -44,7 +48,20 @@ using test_types = boost::mpl::list<
                      std::vector<std::int64_t>>,
     tsl::ordered_set<std::int64_t, mod_hash<9>>, tsl::ordered_set<std::string>,
     tsl::ordered_set<std::string, mod_hash<9>>,
-    tsl::ordered_set<move_only_test, mod_hash<9>>>;
+    tsl::ordered_set<move_only_test, mod_hash<9>>,
+    tsl::ordered_set<std::string, std::hash<std::string>,
+                     std::equal_to<std::string>, std::allocator<std::string>,
+                     std::deque<std::string>, std::uint_least32_t, true>,
+    tsl::ordered_set<std::string, mod_hash<9>, std::equal_to<std::string>,
+                     std::allocator<std::string>,
+                     tsl::tombstone_deque<std::string>>,
+    tsl::ordered_set<std::string, mod_hash<9>, std::equal_to<std::string>,
+                     std::allocator<std::string>,
+                     tsl::ranked_deque<std::string>>,
+    tsl::ordered_set<std::int64_t, std::hash<std::int64_t>,
+                     std::equal_to<std::int64_t>, std::allocator<std::int64_t>,
+                     tsl::tombstone_deque<std::int64_t>, std::uint_least32_t,
+                     false, false, tsl::oh::fastrange_growth_policy<>>>;
 
 /**
  * insert
@@ -133,6 +150,61 @@ BOOST_AUTO_TEST_CASE(test_erase_if) {
   BOOST_CHECK_EQUAL(set.back(), 5);
 }
 
+BOOST_AUTO_TEST_CASE(test_contains_batch) {
+  const tsl::ordered_set<std::string> set = {"a", "b", "c", "d"};
+  const std::vector<std::string> keys = {"a", "z", "d", "", "b", "c", "e"};
+
+  std::vector<bool> contains;
+  set.contains_batch(keys.begin(), keys.size(), std::back_inserter(contains));
+  BOOST_CHECK((contains ==
+               std::vector<bool>{true, false, true, false, true, true, false}));
+
+  std::vector<tsl::ordered_set<std::string>::const_iterator> its(keys.size());
+  set.find_batch(keys.begin(), keys.size(), its.begin());
+  BOOST_CHECK(its[0] == set.begin());
+  BOOST_CHECK(its[1] == set.end());
+  BOOST_CHECK(its[2] == set.nth(3));
+}
+
+BOOST_AUTO_TEST_CASE(test_precalculated_hash_insert) {
+  // Insert each key with the hash of the key + 1000 so that the insertions
+  // which use the precalculated hash can only be found with it.
+  using set_t = tsl::ordered_set<int, identity_hash<int>>;
+  set_t set;
+  auto hash = [&](int key) { return set.hash_function()(key + 1000); };
+
+  BOOST_CHECK(set.insert(1, hash(1)).second);
+  BOOST_CHECK(set.emplace(tsl::precalculated_hash_t(hash(2)), 2).second);
+  BOOST_CHECK(set.insert_at_position(set.begin(), 0, hash(0)).second);
+  BOOST_CHECK(set.emplace_at_position(set.begin(),
+                                      tsl::precalculated_hash_t(hash(-1)), -1)
+                  .second);
+  BOOST_CHECK(!set.insert(2, hash(2)).second);
+
+  BOOST_CHECK(set == (set_t{-1, 0, 1, 2}));
+  for (int key = -1; key <= 2; key++) {
+    BOOST_CHECK(set.contains(key, hash(key)));
+    BOOST_CHECK(!set.contains(key));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_index_of) {
+  tsl::ordered_set<std::string> set;
+  BOOST_CHECK(set.emplace_index("a") == std::make_pair(std::size_t(0), true));
+  BOOST_CHECK(set.emplace_index("b") == std::make_pair(std::size_t(1), true));
+  BOOST_CHECK(set.emplace_index("a") == std::make_pair(std::size_t(0), false));
+  BOOST_CHECK(set.emplace_index(tsl::precalculated_hash_t(
+                                    set.hash_function()("c")),
+                                "c") == std::make_pair(std::size_t(2), true));
+
+  BOOST_CHECK_EQUAL(set.index_of("b"), 1u);
+  BOOST_CHECK_EQUAL(set.index_of("c", set.hash_function()("c")), 2u);
+  BOOST_CHECK_EQUAL(set.index_of("d"),
+                    std::numeric_limits<std::size_t>::max());
+  BOOST_CHECK_EQUAL(set.value_at(0), "a");
+  BOOST_CHECK_EQUAL(set.value_at(2), "c");
+}
+
 /**
  * serialize and deserialize
  */
@@ -164,4 +236,28 @@ BOOST_AUTO_TEST_CASE(test_serialize_deserialize) {
   BOOST_CHECK(set_deserialized == set);
 }
 
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_bulk) {
+  // Same with a bulk serializer and deserializer on trivially copyable keys.
+  tsl::ordered_set<std::int64_t> set;
+  for (std::int64_t i = 0; i < 1040; i++) {
+    set.insert(i);
+  }
+
+  for (std::int64_t i = 1000; i < 1040; i++) {
+    set.erase(i);
+  }
+
+  bulk_serializer serial;
+  set.serialize(serial);
+  BOOST_CHECK_GE(serial.nb_bulk_writes, 2);
+
+  bulk_deserializer dserial(serial.str());
+  auto set_deserialized = decltype(set)::deserialize(dserial, true);
+  BOOST_CHECK(set == set_deserialized);
+
+  bulk_deserializer dserial2(serial.str());
+  set_deserialized = decltype(set)::deserialize(dserial2, false);
+  BOOST_CHECK(set_deserialized == set);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tsl/ordered_map.h"
+#include "tsl/snapshot_ordered_map.h"
+#include "utils.h"
+
+BOOST_AUTO_TEST_SUITE(test_snapshot_ordered_map)
+
+BOOST_AUTO_TEST_CASE(test_random_operations_single_thread) {
+  // Do the same random operations on a tsl::ordered_map and check that both
+  // have the same values in the same order.
+  tsl::snapshot_ordered_map<std::int64_t, std::string> map;
+  tsl::ordered_map<std::int64_t, std::string> ref_map;
+
+  std::mt19937_64 generator(1);
+  std::uniform_int_distribution<std::int64_t> rand_key(0, 500);
+  for (std::int64_t i = 0; i < 5000; i++) {
+    const std::int64_t key = rand_key(generator);
+    const std::string value = utils::get_value<std::string>(std::size_t(i));
+    switch (i % 3) {
+      case 0:
+        BOOST_CHECK_EQUAL(map.insert({key, value}),
+                          ref_map.insert({key, value}).second);
+        break;
+      case 1:
+        BOOST_CHECK_EQUAL(map.insert_or_assign(key, value),
+                          ref_map.insert_or_assign(key, value).second);
+        break;
+      case 2:
+        BOOST_CHECK_EQUAL(map.erase(key), ref_map.erase(key));
+        break;
+    }
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), ref_map.size());
+  BOOST_CHECK(map.read([&](const decltype(map)::map_type& m) {
+    return m == ref_map;
+  }));
+
+  std::string value;
+  const auto& first = ref_map.front();
+  BOOST_CHECK(map.find(first.first, value));
+  BOOST_CHECK_EQUAL(value, first.second);
+  BOOST_CHECK(!map.find(501, value));
+  BOOST_CHECK_EQUAL(map.count(first.first), 1);
+
+  map.write([](decltype(map)::map_type& m) { m.erase(m.begin()); });
+  BOOST_CHECK(!map.contains(first.first));
+
+  map.clear();
+  BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_readers) {
+  // One writer inserts the keys 0 to n - 1 in order, through many rehashes,
+  // and then erases the first ones in order. The readers check that each map
+  // they see is a consistent state: a contiguous range of keys in order.
+  const std::int64_t nb_values = 5000;
+  const std::int64_t nb_erased = 500;
+  const std::size_t nb_readers = 3;
+
+  tsl::snapshot_ordered_map<std::int64_t, std::int64_t> map;
+  std::atomic<bool> done(false);
+  std::atomic<std::size_t> nb_errors(0);
+  std::atomic<std::size_t> nb_reads(0);
+
+  std::vector<std::thread> readers;
+  for (std::size_t r = 0; r < nb_readers; r++) {
+    readers.emplace_back([&map, &done, &nb_errors, &nb_reads]() {
+      do {
+        const bool consistent =
+            map.read([](const tsl::ordered_map<std::int64_t, std::int64_t>& m) {
+              if (m.empty()) {
+                return true;
+              }
+
+              const std::int64_t first = m.front().first;
+              const std::int64_t last = m.back().first;
+              const std::int64_t middle = first + std::int64_t(m.size() / 2);
+
+              return last - first + 1 == std::int64_t(m.size()) &&
+                     m.nth(m.size() / 2)->first == middle &&
+                     m.at(middle) == middle * 2 && m.contains(last) &&
+                     !m.contains(last + 1);
+            });
+
+        if (!consistent) {
+          nb_errors++;
+        }
+        nb_reads++;
+        std::this_thread::yield();
+      } while (!done.load());
+    });
+  }
+
+  for (std::int64_t i = 0; i < nb_values; i++) {
+    map.insert({i, i * 2});
+  }
+  for (std::int64_t i = 0; i < nb_erased; i++) {
+    map.erase(i);
+  }
+
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  BOOST_CHECK_EQUAL(nb_errors.load(), 0);
+  BOOST_CHECK_GE(nb_reads.load(), nb_readers);
+  BOOST_CHECK_EQUAL(map.size(), std::size_t(nb_values - nb_erased));
+  std::int64_t value = 0;
+  BOOST_CHECK(map.find(nb_values - 1, value));
+  BOOST_CHECK_EQUAL(value, (nb_values - 1) * 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -295,10 +295,26 @@ class serializer {
     m_ostream.write(reinterpret_cast<const char*>(&val), sizeof(val));
   }
 
- private:
+ protected:
   std::stringstream m_ostream;
 };
 
+/**
+ * serializer which also supports bulk writes, the ordered_map/set use the bulk
+ * serialization protocol with it if the values are trivially copyable.
+ */
+class bulk_serializer : public serializer {
+ public:
+  using serializer::operator();
+
+  void operator()(const char* data, std::size_t size) {
+    m_ostream.write(data, size);
+    nb_bulk_writes++;
+  }
+
+  std::size_t nb_bulk_writes = 0;
+};
+
 class deserializer {
  public:
   explicit deserializer(const std::string& init_str = "")
@@ -351,8 +367,21 @@ class deserializer {
     return val;
   }
 
- private:
+ protected:
   std::stringstream m_istream;
 };
 
+class bulk_deserializer : public deserializer {
+ public:
+  using deserializer::deserializer;
+  using deserializer::operator();
+
+  void operator()(char* data, std::size_t size) {
+    m_istream.read(data, size);
+    nb_bulk_reads++;
+  }
+
+  std::size_t nb_bulk_reads = 0;
+};
+
 #endif